@@ -39,1030 +39,2566 @@ int blbn_init () {
 }
 
 /**
- * Initializes meta-data used for "book-keeping" in budgeted learning algorithms.
+ * Returns the bucket of the specified node name in the node name map (FNV-1a
+ * hash of the name).
  */
-blbn_state_t* blbn_init_state (char *experiment_name, char *data_filepath, char *test_data_filepath, char *model_filepath, char *target_node_name, unsigned int budget, char *output_folder, int k, int f) {
+static unsigned int blbn_hash_node_name (blbn_state_t *state, const char *node_name) {
+	unsigned int hash = 2166136261u;
+	const char *c;
+	for (c = node_name; *c != '\0'; ++c) {
+		hash = (hash ^ (unsigned char) *c) * 16777619u;
+	}
+	return hash % state->node_name_bucket_count;
+}
 
-	net_bn *orig_net = NULL;
-	net_bn *net = NULL;
-	const nodelist_bn* orig_nodes;
-	nodelist_bn* copied_nodes = NULL;
-	int node_count = 0;
-	blbn_state_t *state = NULL;
-	const nodelist_bn *nodes = NULL;
-	node_bn *node = NULL;
-	char *node_name = NULL;
-	int node_name_length = 0;
-	caseposn_bn case_posn;
-	int i, j;
-	char graph_filename[128];
-	char log_filename[128];
-	stream_ns *data_stream = NULL;
-	stream_ns *validation_stream = NULL;
+/**
+ * Builds the hashed map from node names to indices in the static ordering.
+ */
+static void blbn_init_node_names (blbn_state_t *state) {
+	int i;
+	unsigned int bucket;
 
-	// Initialize random seed
-	srand (time (NULL));
+	state->node_name_bucket_count = 2 * state->node_count + 1;
+	state->node_name_buckets = (int *) malloc (state->node_name_bucket_count * sizeof (int));
+	state->node_name_next = (int *) malloc ((state->node_count > 0 ? state->node_count : 1) * sizeof (int));
+	for (i = 0; i < state->node_name_bucket_count; ++i) {
+		state->node_name_buckets[i] = -1;
+	}
 
-	// Create Netica network
-	orig_net = ReadNet_bn (NewFileStream_ns (model_filepath, env, NULL), NO_VISUAL_INFO);
-	orig_nodes = GetNetNodes_bn (orig_net);
-	SetNetAutoUpdate_bn (orig_net, 0);
-	//CHKERR
-	if (GetError_ns (env, ERROR_ERR, NULL)) {
-		//goto error;
+	// Insert in reverse, so the first node with a name is found first
+	for (i = state->node_count - 1; i >= 0; --i) {
+		bucket = blbn_hash_node_name (state, state->nodes[i]);
+		state->node_name_next[i] = state->node_name_buckets[bucket];
+		state->node_name_buckets[bucket] = i;
 	}
+}
 
-	net = NewNet_bn (GetNetName_bn (orig_net), env); // TODO: Update this!
-	copied_nodes = CopyNodes_bn (orig_nodes, net, NULL);
-	node_count = LengthNodeList_bn (copied_nodes);
+/**
+ * Stores the parents and children of every node as indices into the static
+ * node ordering, so structural queries (e.g., d-separation) do not have to
+ * go through Netica node lists and name lookups.
+ */
+void blbn_init_graph (blbn_state_t *state, const nodelist_bn *nodes) {
 
-//	// Remove CPTs of nodes in learned_net, so new ones can be learned.
-//	for (i = 0;  i < node_count;  ++i) {
-//		DeleteNodeTables_bn (NthNode_bn (copied_nodes, i));
-//	}
+	int i, p;
+	const nodelist_bn *relatives = NULL;
 
-	// Open training and testing data sets
-	// TODO: Make sure these exist and if not, return NULL
-	data_stream       = NewFileStream_ns (data_filepath, env, NULL);
-	validation_stream = NewFileStream_ns (test_data_filepath, env, NULL);
+	state->state_count  = (int *) malloc (state->node_count * sizeof (int));
+	state->parent_count = (int *) malloc (state->node_count * sizeof (int));
+	state->parents      = (int **) malloc (state->node_count * sizeof (int *));
+	state->child_count  = (int *) malloc (state->node_count * sizeof (int));
+	state->children     = (int **) malloc (state->node_count * sizeof (int *));
 
-	// Make sure that the output directory exists (it must already exist)
-	if (!file_exists (output_folder)) {
-		printf ("Error: Output directory does not exist. Exiting.\n");
-		exit (1);
+	for (i = 0; i < state->node_count; ++i) {
+		state->state_count[i] = GetNodeNumberStates_bn (NthNode_bn (nodes, i));
+
+		relatives = GetNodeParents_bn (NthNode_bn (nodes, i));
+		state->parent_count[i] = LengthNodeList_bn (relatives);
+		state->parents[i] = (int *) malloc ((state->parent_count[i] + 1) * sizeof (int));
+		for (p = 0; p < state->parent_count[i]; ++p) {
+			state->parents[i][p] = IndexOfNodeInList_bn (NthNode_bn (relatives, p), nodes, 0);
+		}
+
+		relatives = GetNodeChildren_bn (NthNode_bn (nodes, i));
+		state->child_count[i] = LengthNodeList_bn (relatives);
+		state->children[i] = (int *) malloc ((state->child_count[i] + 1) * sizeof (int));
+		for (p = 0; p < state->child_count[i]; ++p) {
+			state->children[i][p] = IndexOfNodeInList_bn (NthNode_bn (relatives, p), nodes, 0);
+		}
 	}
 
-	// Create log files
-	sprintf (graph_filename, "%s/graph.csv.%d", output_folder, f);
-	graph_fp = fopen (graph_filename, "w");
+	// Initialize d-separation cache
+	state->dsep_cache = (blbn_dsep_cache_entry_t **) calloc (BLBN_DSEP_CACHE_SIZE, sizeof (blbn_dsep_cache_entry_t *));
+	state->dsep_cache_hits = 0;
+	state->dsep_cache_misses = 0;
+	state->prune_d_separated = 0;
+}
 
-	sprintf (log_filename,   "%s/log.txt.%d", output_folder, f);
-	log_fp   = fopen (log_filename,   "w");
+void blbn_free_graph (blbn_state_t *state) {
 
-	if (net != NULL) {
-		// Allocate space for meta-data structure
-		state = (blbn_state_t *) malloc  (sizeof (blbn_state_t));
+	int i;
+	blbn_dsep_cache_entry_t *entry = NULL;
+	blbn_dsep_cache_entry_t *next = NULL;
 
-		if (state != NULL) {
+	for (i = 0; i < state->node_count; ++i) {
+		free (state->parents[i]);
+		free (state->children[i]);
+	}
+	free (state->parents);
+	free (state->parent_count);
+	free (state->state_count);
+	free (state->children);
+	free (state->child_count);
+
+	for (i = 0; i < BLBN_DSEP_CACHE_SIZE; ++i) {
+		entry = state->dsep_cache[i];
+		while (entry != NULL) {
+			next = entry->next;
+			free (entry->evidence);
+			free (entry->separated);
+			free (entry);
+			entry = next;
+		}
+	}
+	free (state->dsep_cache);
+}
 
-			// Copy original network (used as the "base" net from which to learn and revert to during unlearning)
-			state->orig_net = net;
+/**
+ * Builds the native copy of the working network used by the native
+ * inference methods (unless it has already been built): the structure is
+ * copied into a native model, and CPTs are copied from the working network
+ * whenever they change, so learning is unaffected.
+ */
+void blbn_init_model (blbn_state_t *state) {
 
-			// Set Netica network data structures
-			state->prior_net = CopyNet_bn (state->orig_net, GetNetName_bn (net), env, "no_visual");
+	int i, k;
+	int *state_count = NULL;
 
-			// Set Netica network data structures
-			state->work_net = CopyNet_bn (state->orig_net, GetNetName_bn (net), env, "no_visual");
+	if (state->model != NULL) {
+		return;
+	}
 
-			// Get statically-ordered list (keep it around for reference throughout execution of program)
-			nodes = GetNetNodes_bn (net);
-			state->nodelist = DupNodeList_bn (nodes); // Statically-ordered list used for node index queries
+	state_count = (int *) malloc (state->node_count * sizeof (int));
+	for (i = 0; i < state->node_count; ++i) {
+		state_count[i] = GetNodeNumberStates_bn (blbn_get_work_node (state, i));
+	}
 
-			// Get number of nodes
-			state->node_count = LengthNodeList_bn (nodes);
-			printf ("Node count: %d\n", state->node_count);
+	state->model = blbn_model_new (state->node_count, state_count, state->parent_count, state->parents);
+	blbn_mark_cpts_changed (state, -1);
 
-			// Create validation case set
-			state->validation_caseset  = NewCaseset_cs ("TestCases", env);
-			AddFileToCaseset_cs (state->validation_caseset, validation_stream, 1.0, NULL);
+	state->model_lambda = (double **) malloc (state->node_count * sizeof (double *));
+	for (i = 0; i < state->node_count; ++i) {
+		state->model_lambda[i] = (double *) malloc (state_count[i] * sizeof (double));
+		for (k = 0; k < state_count[i]; ++k) {
+			state->model_lambda[i][k] = 1.0;
+		}
+	}
 
-			// Get node names
-			if (state->node_count > 0) {
-				state->nodes = (char **) malloc (state->node_count * sizeof (char *));
+	free (state_count);
+}
 
-				for (i = 0;  i < state->node_count;  ++i) {
-					node = NthNode_bn (nodes, i);
-					node_name = GetNodeName_bn (node);
-					node_name_length = strlen (node_name) + 1;
+/**
+ * Frees the native model and every native inference engine, and reverts to
+ * inference with Netica.
+ */
+void blbn_free_model (blbn_state_t *state) {
 
-					// Copy name into new array (including null-terminated character)
-					state->nodes[i] = (char *) malloc (node_name_length * sizeof (char));
-					strncpy (state->nodes[i], node_name, node_name_length);
+	int i;
+	blbn_slice_cache_entry_t *entry = NULL;
+	blbn_slice_cache_entry_t *next = NULL;
 
-					//printf ("Adding node to meta-model: %s\n", state->nodes[i]);
-				}
+	if (state->model_lambda != NULL) {
+		for (i = 0; i < state->node_count; ++i) {
+			free (state->model_lambda[i]);
+		}
+		free (state->model_lambda);
+	}
+	blbn_lw_free (state->lw);
+	blbn_bp_free (state->bp);
+	if (state->slice_cache != NULL) {
+		for (i = 0; i < BLBN_SLICE_CACHE_SIZE; ++i) {
+			for (entry = state->slice_cache[i]; entry != NULL; entry = next) {
+				next = entry->next;
+				free (entry->evidence);
+				blbn_ve_plan_free (entry->plan);
+				free (entry);
 			}
+		}
+		free (state->slice_cache);
+	}
+	free (state->validation_plans); // plans are owned by the slice cache
+	blbn_codegen_free (state->generated);
+	blbn_ve_plan_free (state->model_plan);
+	blbn_model_free (state->model);
+
+	state->model = NULL;
+	state->model_plan = NULL;
+	state->generated = NULL;
+	state->lw = NULL;
+	state->bp = NULL;
+	state->slice_cache = NULL;
+	state->validation_plans = NULL;
+	state->model_lambda = NULL;
+	state->inference = BLBN_INFERENCE_NETICA;
+}
 
-			// Find target node index
-			for (i = 0; i <= state->node_count; ++i) {
-				if (i == state->node_count) {
-					// Target node not found
-					// TODO: Free memory (call blbln_free_metadata ())
-					return NULL;
-				} else {
-					if (strcasecmp (state->nodes[i], target_node_name) == 0) {
-						state->target = i;
-						printf ("Target set to index: %d\n", state->target);
-						printf ("Target set to node: %s\n", blbn_get_node_name (state, state->target));
-						break;
-					}
-				}
-			}
+/**
+ * Enables generated inference for target posterior queries and evaluation.
+ * An elimination plan for the target is built for the native model, and the
+ * straight-line C code generated for the plan is compiled (or found in
+ * cache_dir) and loaded.
+ *
+ * Returns zero on success.  On failure, queries keep using Netica.
+ */
+int blbn_enable_generated_inference (blbn_state_t *state, const char *cache_dir) {
 
-			// Count number of cases
-			state->case_count = 0;
-			case_posn = FIRST_CASE;
-			while (1) {
-				RetractNetFindings_bn (net); // Retracts all findings from net
-				ReadNetFindings_bn (&case_posn, data_stream, nodes, NULL, NULL); // Set findings
-				if (case_posn == NO_MORE_CASES)
-					break;
-				++state->case_count;
-				case_posn = NEXT_CASE;
+	blbn_init_model (state);
 
-				// TODO: CHKERR
-			}
-			printf ("Case count: %d\n", state->case_count);
+	state->model_plan = blbn_ve_plan_new (state->model, state->target);
+	state->generated = blbn_codegen_load (state->model, state->model_plan, cache_dir);
 
-			// Allocate space for state meta-data
-			state->state = (int **) malloc (state->node_count * sizeof (int *)); // n states (columns)
-			for (i = 0; i < state->node_count; i++) {
-				state->state[i] = (int *) malloc (state->case_count * sizeof (int)); // m cases (rows)
-			}
+	if (state->generated == NULL) {
+		fprintf (log_fp, "Generated inference: unavailable, using Netica\n");
+		blbn_free_model (state);
+		return -1;
+	}
 
-			// Allocate space for property flag meta-data
-			state->flags = (unsigned int **) malloc (state->node_count * sizeof (unsigned int *)); // n states (columns)
-			for (i = 0; i < state->node_count; i++) {
-				state->flags[i] = (unsigned int *) malloc (state->case_count * sizeof (unsigned int)); // m cases (rows)
-			}
+	state->inference = BLBN_INFERENCE_GENERATED;
 
-			// Initialize working copy of data set and book-keeping meta-data
-			case_posn = FIRST_CASE;
-			j = 0; // used to count number of cases
-			while (1) {
-				RetractNetFindings_bn (net); // Retracts all findings from net
-				ReadNetFindings_bn (&case_posn, data_stream, nodes, NULL, NULL); // Set findings
-				if (case_posn == NO_MORE_CASES)
-					break;
+	fprintf (log_fp, "Generated inference: %s %s (%d elimination steps, largest factor %d entries)\n", (state->generated->compiled ? "compiled" : "loaded cached"), state->generated->path, state->model_plan->step_count, state->model_plan->max_size);
+	fflush (log_fp);
 
-				// Gets the current state of nodes
-				for (i = 0; i < state->node_count; i++) {
-					state->state[i][j] = GetNodeFinding_bn (NthNode_bn (nodes, i)); // Initialize state from Netica stream_ns
+	return 0;
+}
 
-					// Initialize flags for target and non-target node findings in cases
-					if (i == state->target) {
-						state->flags[i][j] = 0x00000000 | BLBN_METADATA_FLAG_TARGET; // Initialize flags to zeros (i.e., not purchased, not target)
-					} else {
-						state->flags[i][j] = 0x00000000; // Initialize flags to zeros (i.e., not purchased, not target)
-					}
+/**
+ * Enables approximate inference by likelihood weighting for target
+ * posterior queries, joint (node, target) queries and evaluation.  Intended
+ * for networks too large to compile.  Returns zero on success.
+ */
+int blbn_enable_likelihood_weighting (blbn_state_t *state, const blbn_lw_options_t *options) {
 
-					// Prints states and flags
-					//printf ("%d/%d  ", state->state[i][j], state->flags[i][j]);
-					//printf ("%d/%d/%d  ", blbn_is_purchased_finding(state,i,j), blbn_is_learned_finding(state,i,j), blbn_is_target_finding(state,i,j));
-				}
-				//printf ("\n");
+	blbn_init_model (state);
 
-				++j;
+	state->lw = blbn_lw_new (state->model, options);
+	state->inference = BLBN_INFERENCE_LW;
 
-				case_posn = NEXT_CASE;
+	fprintf (log_fp, "Likelihood weighting: up to %ld samples per query, standard error threshold %f, %d threads\n", state->lw->options.sample_count, state->lw->options.max_std_error, state->lw->options.thread_count);
+	fflush (log_fp);
 
-				// TODO: CHKERR
-			}
+	return 0;
+}
 
-			// Allocate space for cost meta-data
-			state->cost = (unsigned int **) malloc (state->node_count * sizeof (unsigned int *)); // n states (columns)
-			for (i = 0; i < state->node_count; i++) {
-				state->cost[i] = (unsigned int *) malloc (state->case_count * sizeof (unsigned int)); // m cases (rows)
-			}
+/**
+ * Enables exact inference by variable elimination over CPTs sliced by the
+ * findings of each query, for target posterior queries and evaluation.  When
+ * most nodes are observed (e.g., validation cases, or training cases late in
+ * a run), inference runs on small factors over the few unobserved nodes.
+ * Elimination plans are cached per evidence pattern, so queries with a
+ * pattern seen before only gather their slices.  Returns zero on success.
+ */
+int blbn_enable_sliced_inference (blbn_state_t *state) {
 
-			// Initialize cost meta-data
-			for (i = 0; i < state->node_count; i++) {
-				for (j = 0; j < state->case_count; j++) {
-					state->cost[i][j] = 1;
-				}
-			}
+	blbn_init_model (state);
 
-			// Initialize budget
-			state->budget = budget;
+	state->slice_cache = (blbn_slice_cache_entry_t **) calloc (BLBN_SLICE_CACHE_SIZE, sizeof (blbn_slice_cache_entry_t *));
+	state->slice_cache_hits = 0;
+	state->slice_cache_misses = 0;
+	state->inference = BLBN_INFERENCE_SLICED;
 
-			// Initialize select action sequence
-			state->sel_action_seq = NULL;
-		}
-	}
+	fprintf (log_fp, "Sliced variable elimination: enabled\n");
+	fflush (log_fp);
 
-	DeleteStream_ns (data_stream); // added this... I think I should b/c of what I read in documentation
+	return 0;
+}
 
-	return state;
+/**
+ * Enables approximate inference by loopy belief propagation for target
+ * posterior queries, joint (node, target) queries and evaluation.  Messages
+ * are cached per case and evidence pattern, so repeated what-if queries on a
+ * case start close to their fixed point.  Returns zero on success.
+ */
+int blbn_enable_loopy_belief_propagation (blbn_state_t *state, const blbn_bp_options_t *options) {
+
+	blbn_init_model (state);
+
+	state->bp = blbn_bp_new (state->model, options);
+	state->inference = BLBN_INFERENCE_BP;
+
+	fprintf (log_fp, "Loopy belief propagation: up to %d sweeps per query, damping %f, tolerance %g, %d cached message sets\n", state->bp->options.max_iterations, state->bp->options.damping, state->bp->options.tolerance, state->bp->options.cache_size);
+	fflush (log_fp);
+
+	return 0;
 }
 
-void blbn_free_state (blbn_state_t *state) {
+/**
+ * Copies the CPTs of the working network that changed since the last copy
+ * into the native model.  Only the families marked by
+ * blbn_mark_cpts_changed () are copied.
+ */
+void blbn_sync_model (blbn_state_t *state) {
 
-	int i;
-	blbn_select_action_t *action = NULL;
+	int i, k;
+	const nodelist_bn *nodes = NULL;
+	const prob_bn *probs = NULL;
 
-	if (state != NULL) {
-		// Free node names
-		for (i = 0; i < state->node_count; i++) {
-			free (state->nodes [i]);
-		}
-		free (state->nodes);
+	if (state->model == NULL) {
+		return;
+	}
 
-		// Free space occupied by state meta-data
-		for (i = 0; i < state->node_count; i++) {
-			free (state->state[i]); // m cases (rows)
+	nodes = GetNetNodes_bn (state->work_net);
+	for (i = 0; i < state->node_count; ++i) {
+		if (!BLBN_BITSET_TEST (state->model_dirty, i)) {
+			continue;
 		}
-		free (state->state); // n states (columns)
 
-		// Free space occupied by flag meta-data
-		for (i = 0; i < state->node_count; i++) {
-			free (state->flags[i]); // m cases (rows)
+		probs = GetNodeProbs_bn (NthNode_bn (nodes, i), NULL);
+		for (k = 0; k < state->model->cpt_size[i]; ++k) {
+			state->model->cpt[i][k] = (probs != NULL ? probs[k] : 1.0 / state->model->state_count[i]);
 		}
-		free (state->flags); // n states (columns)
+		BLBN_BITSET_CLEAR (state->model_dirty, i);
+	}
+}
 
-		// Free space occupied by cost meta-data
-		for (i = 0; i < state->node_count; i++) {
-			free (state->cost[i]); // m cases (rows)
+/**
+ * Marks the CPT of the specified node in the working network as changed, or
+ * the CPTs of every node if node_index is -1.  Changed CPTs are copied into
+ * the native model on the next query that uses it, and cached target
+ * posteriors that depend on them become stale.
+ */
+void blbn_mark_cpts_changed (blbn_state_t *state, int node_index) {
+
+	int i;
+
+	++state->cpt_clock;
+	if (node_index < 0) {
+		memset (state->model_dirty, 0xFF, BLBN_BITSET_WORDS (state->node_count) * sizeof (unsigned int));
+		for (i = 0; i < state->node_count; ++i) {
+			state->cpt_version[i] = state->cpt_clock;
 		}
-		free (state->cost); // n states (columns)
+	} else {
+		BLBN_BITSET_SET (state->model_dirty, node_index);
+		state->cpt_version[node_index] = state->cpt_clock;
+	}
+}
 
-		// Free space occupied by Netica structures
-		action = state->sel_action_seq;
-		i = 0;
-		while (action != NULL) {
-			if (action->next != NULL) { // this is not the tail, b/c has next action
-				//printf ("deleting action %d\n", i);
-				action = action->next;
-				free (action->prev);
-				action->prev = NULL;
-			} else { // this is the tail action, so just delete the action
-				//printf ("deleting action %d\n", i);
-				free (action);
-				action = NULL;
+/**
+ * Marks the CPTs revised by ReviseCPTsByFindings_bn with the findings
+ * currently entered in the working network: those of nodes that have a
+ * finding and whose parents all have findings.
+ */
+void blbn_mark_cpts_changed_by_findings (blbn_state_t *state) {
+
+	int i, p;
+	const nodelist_bn *nodes = GetNetNodes_bn (state->work_net);
+
+	for (i = 0; i < state->node_count; ++i) {
+		if (GetNodeFinding_bn (NthNode_bn (nodes, i)) < 0) {
+			continue;
+		}
+		for (p = 0; p < state->parent_count[i]; ++p) {
+			if (GetNodeFinding_bn (NthNode_bn (nodes, state->parents[i][p])) < 0) {
+				break;
 			}
-			i++;
 		}
-
-		// Finally, free the structure
-		free (state);
-		state = NULL;
+		if (p == state->parent_count[i]) {
+			blbn_mark_cpts_changed (state, i);
+		}
 	}
-
-	// Close files pointers
-	fclose (graph_fp);
-	fclose (log_fp);
 }
 
 /**
- * Learns all using basic Netica-supplied template function.
+ * Compiles the specified network unless it has been compiled since it was
+ * created (i.e., read or copied).  The structure of a network never changes
+ * after initialization, and Netica keeps the junction tree of a compiled
+ * network when its CPTs are revised or learned, re-initializing the clique
+ * potentials on the next belief update.  Compiling again would rebuild the
+ * junction tree for nothing.
+ *
+ * A compiled network is marked in its blbn data (see blbn_get_net_data), which
+ * a copy of the network does not share.  Compiles are counted in the
+ * specified counters (the state's, or those of a scoring worker).
  */
-void blbn_learn_all_v0 (stream_ns *casefile, net_bn *net, nodelist_bn *nodes, caseposn_bn *case_posn) {
+static void blbn_compile_net_counted (blbn_state_t *state, net_bn *net, unsigned int *compile_count, unsigned int *compile_avoided_count) {
 
-	// Set initial case position
-	if (case_posn == NULL) {
-		*case_posn = FIRST_CASE;
+	blbn_net_data_t *data = blbn_get_net_data (state, net);
+
+	if (data->compiled) {
+		++*compile_avoided_count;
+		return;
 	}
 
-	// Iterates through cases, sets findings in each case, and updates
-	// CPTS to reflect the findings for each case.
-	if (case_posn != NULL) { // Makes sure case_posn isn't NULL
-		*case_posn = FIRST_CASE;
-		while (1) {
-			RetractNetFindings_bn (net); // Retracts all findings from net
-			ReadNetFindings_bn (case_posn, casefile, nodes, NULL, NULL);
+	CompileNet_bn (net);
+	data->compiled = 1;
+	++*compile_count;
+}
 
-			if (*case_posn == NO_MORE_CASES)
-				break;
+void blbn_compile_net (blbn_state_t *state, net_bn *net) {
+	blbn_compile_net_counted (state, net, &state->compile_count, &state->compile_avoided_count);
+}
 
-			// NOTE: This is the network parameterization before updating
+/**
+ * Sets the likelihood vector of each node to the indicator of its finding in
+ * findings[node][case_index] (if the node is not except_node, the finding is
+ * known, and, if flags is not NULL, the finding is learned), or to all ones.
+ */
+static void blbn_set_model_findings_from (blbn_state_t *state, int **findings, unsigned int **flags, int case_index, int except_node) {
 
-			ReviseCPTsByFindings_bn (nodes, 0, 1.0); // Learn (not unlearn) --- Update CPTs of network based on findings on the network
+	int i, k;
+	int finding;
 
-			// NOTE: This is the network parameterization after updating
+	state->model_evidence_key = (findings == state->validation_state ? -1 - (long) case_index : (long) case_index);
 
-			*case_posn = NEXT_CASE;
-			//CHKERR // TODO: Update this error-handlinge code
-			if (GetError_ns (env, ERROR_ERR, NULL)) {
-				//goto error;
-			}
+	for (i = 0; i < state->node_count; ++i) {
+		finding = findings[i][case_index];
+		if (i == except_node || (flags != NULL && !(flags[i][case_index] & BLBN_METADATA_FLAG_LEARNED))) {
+			finding = -1;
+		}
+		for (k = 0; k < state->model->state_count[i]; ++k) {
+			state->model_lambda[i][k] = (finding < 0 || k == finding ? 1.0 : 0.0);
 		}
 	}
 }
 
 /**
- * blbn_set_uniform_prior ()
- *
- * This function sets a uniform prior and sets all experience values to the
- * specified experience value.  Experience values are set (to the specified
- * value) for all states of all nodes under all parent state combinations.
- *
- * Notes:
- * - If node experience values are specified explicitly, the nodes CPTs must
- *   also be specified.  This is a Netica requirement (Netica C API Manual,
- *   p. 49).
+ * Sets the evidence of the native model to the learned findings in the
+ * specified case (like blbn_set_net_findings_learned () for the working
+ * network).
  */
-void blbn_set_uniform_prior (blbn_state_t *state, double experience) {
-
-	int i,j,k,p,parent_index,parent_state_combo_index,parent_state_index;
-	nodelist_bn* nodes = NULL;
-	node_bn* node = NULL;
-	nodelist_bn* parents = NULL;
-	node_bn* parent = NULL;
-	int parent_state_combo_count = 0;
-	int **parent_state_combos = NULL;
-	int node_count = 0;
-	int node_state_index, node_state_count;
-	int pn, parent_count;
-	prob_bn* uniform;
-	state_bn* parent_states;
-	int periodicity;
+void blbn_set_model_findings_learned (blbn_state_t *state, int case_index) {
+	blbn_set_model_findings_from (state, state->state, state->flags, case_index, -1);
+}
 
-	int *parent_state_count = NULL;
+void blbn_set_model_findings_learned_except_target (blbn_state_t *state, int case_index) {
+	blbn_set_model_findings_from (state, state->state, state->flags, case_index, state->target);
+}
 
-	nodes = DupNodeList_bn (GetNetNodes_bn (state->prior_net));
-	node_count = LengthNodeList_bn (nodes);
+/**
+ * Sets the evidence of the native model to the findings of every non-target
+ * node in the specified validation case.
+ */
+void blbn_set_model_findings_validation (blbn_state_t *state, int validation_case_index) {
+	blbn_set_model_findings_from (state, state->validation_state, NULL, validation_case_index, state->target);
+}
 
-	// Set conditional probability tables (CPTs) for each node
-	for (i = 0; i < node_count; i++) {
-		node = NthNode_bn (nodes, i);
-		node_state_count = GetNodeNumberStates_bn (node);
-		parent_count = LengthNodeList_bn (GetNodeParents_bn (node));
-		uniform = malloc (node_state_count * sizeof (prob_bn));
-		parent_states = malloc (parent_count * sizeof (state_bn));
-		for (node_state_index = 0; node_state_index < node_state_count; ++node_state_index)
-			uniform[node_state_index] = 1.0 / node_state_count;
-		for (parent_index = 0; parent_index < parent_count; ++parent_index)
-			parent_states[parent_index] = EVERY_STATE;
-		SetNodeProbs_bn (node, parent_states, uniform);
-		SetNodeExperience_bn (node, parent_states, experience); // Set experience for node
-		free (uniform);
-		free (parent_states);
+/**
+ * Adds the statistics of a likelihood weighting query to the totals written
+ * to the log file.
+ */
+static void blbn_add_lw_stats (blbn_state_t *state, const blbn_lw_stats_t *stats) {
+	++state->lw_query_count;
+	state->lw_stats.sample_count += stats->sample_count;
+	state->lw_stats.seconds += stats->seconds;
+	if (stats->std_error > state->lw_stats.std_error) {
+		state->lw_stats.std_error = stats->std_error;
 	}
+}
 
-	/*
-	// Set equivalent sample size of CPTs for each node and parent combination
-	for (i = 0; i < node_count; i++) {
-		node = NthNode_bn (nodes, i);
-		node_state_count = GetNodeNumberStates_bn (node);
-		parents = GetNodeParents_bn (node);
-		parent_count = LengthNodeList_bn (parents);
-
-		// Check if node has no parents
-		if (parent_count == 0) {
-			// Pass null for second argument (the parent states) since there are no parents
-			SetNodeExperience_bn (node, NULL, experience);
-			printf ("node %s has zero parents\n", GetNodeName_bn (node));
-		}
-
-		// Check if node has parents (at least one)
-		else if (parent_count > 0) {
-
-			printf ("node %s has %d parents\n", GetNodeName_bn (node), parent_count);
+/**
+ * Returns the elimination plan over the CPTs sliced by the hard findings set
+ * in the native model (the target's finding is never sliced), building and
+ * caching it if the evidence pattern has not been seen before.
+ */
+static const blbn_ve_plan_t* blbn_get_sliced_plan (blbn_state_t *state) {
 
-			// Store the number of states for each of current nodes' parents
-			parent_state_count = (int *) malloc (parent_count * sizeof (int));
-			for (j = 0; j < parent_count; j++) {
-				parent = NthNode_bn (parents, j);
+	int words = BLBN_BITSET_WORDS (state->node_count);
+	unsigned int *evidence = NULL;
+	unsigned int hash = 2166136261u;
+	blbn_slice_cache_entry_t *entry = NULL;
+	char *observed = NULL;
+	int i;
 
-				// TODO: Return failure if allocation fails to make code more robust (maybe assert with error message)
-				parent_state_count[j] = GetNodeNumberStates_bn (parent) + 1; // TODO: Add one to this to account for NO_FINDING state?
+	// Get the evidence pattern
+	evidence = (unsigned int *) calloc (words, sizeof (unsigned int));
+	for (i = 0; i < state->node_count; ++i) {
+		if (i != state->target && blbn_model_hard_finding (state->model, (const double * const *) state->model_lambda, i) >= 0) {
+			BLBN_BITSET_SET (evidence, i);
+		}
+	}
 
-				// Calculate running total number of parent state combinations
-				if (j == 0) {
-					parent_state_combo_count = parent_state_count[j];
-				} else {
-					parent_state_combo_count *= parent_state_count[j];
-				}
-			}
+	// Look up the evidence pattern in the cache
+	for (i = 0; i < words; ++i) {
+		hash = (hash ^ evidence[i]) * 16777619u;
+	}
+	hash %= BLBN_SLICE_CACHE_SIZE;
 
-			// TODO: Allocate parent_state_combos array (parent combinations count * parent count)
-			parent_state_combos = (int **) malloc (parent_state_combo_count * sizeof (int *));
-			for (j = 0; j < parent_state_combo_count; j++) {
-				parent_state_combos[j] = (int *) malloc (parent_count * sizeof (int));
-			}
+	for (entry = state->slice_cache[hash]; entry != NULL; entry = entry->next) {
+		if (memcmp (entry->evidence, evidence, words * sizeof (unsigned int)) == 0) {
+			state->slice_cache_hits++;
+			free (evidence);
+			return entry->plan;
+		}
+	}
 
-			// Iteratively compute all parent state combinations
-			periodicity = 1;
-			for (parent_index = 0; parent_index < parent_count; parent_index++) {
-				//printf ("periodicity = %d\n", periodicity);
-				for (parent_state_combo_index = 0; parent_state_combo_index < parent_state_combo_count; ) {
-					for (parent_state_index = 0; parent_state_index < parent_state_count[parent_index]; parent_state_index++) {
-						for (p = 0; p < periodicity; p++) {
-							if (parent_state_index < (parent_state_count[parent_index] - 1)) {
-								parent_state_combos[parent_state_combo_index][parent_index] = parent_state_index;
-							} else {
-								parent_state_combos[parent_state_combo_index][parent_index] = NO_FINDING;
-							}
-							parent_state_combo_index++;
-						}
-					}
-				}
+	// Build and cache the plan for the evidence pattern
+	state->slice_cache_misses++;
+	observed = (char *) malloc (state->node_count * sizeof (char));
+	for (i = 0; i < state->node_count; ++i) {
+		observed[i] = BLBN_BITSET_TEST (evidence, i);
+	}
+	entry = (blbn_slice_cache_entry_t *) malloc (sizeof (blbn_slice_cache_entry_t));
+	entry->evidence = evidence;
+	entry->plan = blbn_ve_plan_new_sliced (state->model, state->target, observed);
+	entry->next = state->slice_cache[hash];
+	state->slice_cache[hash] = entry;
+	free (observed);
 
-				if (parent_index < parent_count - 1) {
-					periodicity = periodicity * parent_state_count[parent_index];
-				}
-			}
+	return entry->plan;
+}
 
-			// Set prior equivalent sample size (i.e., experience)
-			for (parent_state_combo_index = 0; parent_state_combo_index < parent_state_combo_count; parent_state_combo_index++) {
-				for (parent_index = 0; parent_index < parent_count; parent_index++) {
-					printf ("%d ", parent_state_combos[parent_state_combo_index][parent_index]);
-				}
-				printf ("\n");
+/**
+ * Runs loopy belief propagation with the evidence set in the native model
+ * (keyed by its case for warm starts) and adds the query's statistics to the
+ * totals written to the log file.
+ */
+static void blbn_run_bp (blbn_state_t *state, const double * const *cpt) {
 
-				// for ( each state of the node with the parents )
-				for (k = 0; k < node_state_count; k++) {
-					SetNodeExperience_bn (node, parent_state_combos[parent_state_combo_index], experience);
-				}
-			}
+	blbn_bp_stats_t stats;
 
+	blbn_bp_query (state->bp, cpt, (const double * const *) state->model_lambda, state->model_evidence_key, &stats);
 
-//			// Try this on for size! (Netica's way)
-//			parent_states = (int *) malloc (parent_count * sizeof (int));
-//			for (j = 0; j < parent_count; j++) {
-//				parent = NthNode_bn (parents, j);
-//				parent_states[j] = EVERY_STATE;
-//			}
-//			SetNodeExperience_bn (node, parent_states, experience);
+	++state->bp_query_count;
+	state->bp_iteration_count += stats.iterations;
+	if (stats.iterations > state->bp_max_iterations) {
+		state->bp_max_iterations = stats.iterations;
+	}
+	if (stats.warm_start != BLBN_BP_COLD_START) {
+		++state->bp_warm_count;
+	}
+	if (!stats.converged) {
+		++state->bp_unconverged_count;
+	}
+}
 
+/**
+ * Computes the posterior distribution of the target node given the evidence
+ * set in the native model, with the native inference method and the
+ * specified CPTs (in the layout of blbn_model_t; pass the model's own CPTs
+ * for the working network).  Writes the posterior to posterior (one entry
+ * per target state) and returns the probability of the evidence (0 for loopy
+ * belief propagation, which does not estimate it).
+ */
+double blbn_get_model_target_posterior (blbn_state_t *state, const double * const *cpt, double *posterior) {
 
-			free (parent_state_count);
+	blbn_lw_stats_t stats;
+	double evidence_probability;
 
-			for (k = 0; k < parent_count; k++) {
-				free (parent_state_combos[k]);
-			}
-			free (parent_state_combos);
-		}
+	if (state->inference == BLBN_INFERENCE_LW) {
+		evidence_probability = blbn_lw_query (state->lw, cpt, (const double * const *) state->model_lambda, state->target, posterior, NULL, &stats);
+		blbn_add_lw_stats (state, &stats);
+		return evidence_probability;
 	}
-	*/
 
-	/*
-	// Perform initial revision, just to initialize all tables
-	RetractNetFindings_bn (state->prior_net);
-	ReviseCPTsByFindings_bn (nodes, 0, 1.0);
-	*/
+	if (state->inference == BLBN_INFERENCE_SLICED) {
+		return blbn_model_sliced_target_posterior (state->model, blbn_get_sliced_plan (state), cpt, (const double * const *) state->model_lambda, posterior);
+	}
 
-	// Replace working network with the prior network
-	DeleteNet_bn (state->work_net);
-	state->work_net = CopyNet_bn (state->prior_net, GetNetName_bn (state->prior_net), env, "no_visual");
+	if (state->inference == BLBN_INFERENCE_BP) {
+		blbn_run_bp (state, cpt);
+		memcpy (posterior, state->bp->beliefs[state->target], state->model->state_count[state->target] * sizeof (double));
+		return 0.0;
+	}
 
-	DeleteNodeList_bn (nodes);
+	return state->generated->posterior (cpt, (const double * const *) state->model_lambda, posterior);
 }
 
 /**
- * Sets distribution for target node using the target values
- * for each combination of attributes.  The equivalent sample size of each of
- * these observations is set the the specified ESS value.
+ * Returns the number of entries of the CPT of the specified node.
  */
-void blbn_learn_targets (blbn_state_t *state, double ess) {
+static int blbn_get_cpt_size (blbn_state_t *state, int node_index) {
 
-	// TODO: Implement this algorithm.
-
-}
+	int size = state->state_count[node_index];
+	int p;
 
-char blbn_is_valid_node (blbn_state_t *state, unsigned int node_index) {
-	if (node_index < state->node_count) {
-		return 0x01;
+	for (p = 0; p < state->parent_count[node_index]; ++p) {
+		size *= state->state_count[state->parents[node_index][p]];
 	}
-	return 0x00;
-}
 
-char blbn_is_valid_case (blbn_state_t *state, unsigned int case_index) {
-	if (case_index < state->case_count) {
-		return 0x01;
-	}
-	return 0x00;
+	return size;
 }
 
-char blbn_is_valid_finding (blbn_state_t *state, unsigned int node_index, unsigned int case_index) {
-	if (node_index < state->node_count && case_index < state->case_count) {
-		return 0x01;
+/**
+ * Copies the CPTs of the specified network (which must have the structure
+ * of the working network, e.g., a lookahead copy) into newly allocated
+ * arrays in the layout of blbn_model_t.
+ */
+static double** blbn_get_net_cpts (blbn_state_t *state, net_bn *net) {
+
+	double **cpt = NULL;
+	const nodelist_bn *nodes = GetNetNodes_bn (net);
+	const prob_bn *probs = NULL;
+	int i, k, size;
+
+	cpt = (double **) malloc (state->node_count * sizeof (double *));
+	for (i = 0; i < state->node_count; ++i) {
+		size = blbn_get_cpt_size (state, i);
+		cpt[i] = (double *) malloc (size * sizeof (double));
+		probs = GetNodeProbs_bn (NthNode_bn (nodes, i), NULL);
+		for (k = 0; k < size; ++k) {
+			cpt[i][k] = (probs != NULL ? probs[k] : 1.0 / state->state_count[i]);
+		}
 	}
-	return 0x00;
+
+	return cpt;
 }
 
-char blbn_is_target_finding (blbn_state_t *state, unsigned int node_index, unsigned int case_index) {
-	if (blbn_is_valid_finding (state, node_index, case_index)) {
-		return ((state->flags[node_index][case_index] & BLBN_METADATA_FLAG_TARGET) == BLBN_METADATA_FLAG_TARGET ? 0x01 : 0x00);
+static void blbn_free_net_cpts (blbn_state_t *state, double **cpt) {
+	int i;
+	for (i = 0; i < state->node_count; ++i) {
+		free (cpt[i]);
 	}
-	return 0x00;
+	free (cpt);
 }
 
 /**
- * Determines whether or not the node with the specified index node_index is a
- * target node.
+ * Restores the CPT versions and model dirty bits (saved before a relearning
+ * of the working network, which marks every CPT as changed) of the families
+ * whose CPTs did not move by more than BLBN_CPT_CHANGE_TOLERANCE in any
+ * entry, so that cached target posteriors that only depend on them stay
+ * valid.  CPTs are compared against the reference taken when the version of
+ * their family was last set here, so small changes do not accumulate
+ * unnoticed; a family stamped elsewhere since then keeps its new version.
  */
-int blbn_is_target_node (blbn_state_t *state, unsigned int node_index) {
-	if (state != NULL) {
-		if (node_index == state->target) {
-			return 1;
+static void blbn_unmark_unchanged_cpts (blbn_state_t *state, const unsigned long *version, const unsigned int *dirty) {
+
+	double **cpt = NULL;
+	int i, k, size;
+	char unchanged;
+
+	cpt = blbn_get_net_cpts (state, state->work_net);
+	for (i = 0; i < state->node_count; ++i) {
+		unchanged = (state->cpt_reference[i] != NULL && state->cpt_reference_version[i] == version[i]);
+		size = blbn_get_cpt_size (state, i);
+		for (k = 0; k < size && unchanged; ++k) {
+			unchanged = (fabs (cpt[i][k] - state->cpt_reference[i][k]) <= BLBN_CPT_CHANGE_TOLERANCE);
+		}
+
+		if (unchanged) {
+			state->cpt_version[i] = version[i];
+			if (!BLBN_BITSET_TEST (dirty, i)) {
+				BLBN_BITSET_CLEAR (state->model_dirty, i);
+			}
+		} else {
+			free (state->cpt_reference[i]);
+			state->cpt_reference[i] = cpt[i];
+			state->cpt_reference_version[i] = state->cpt_version[i];
+			cpt[i] = NULL;
 		}
 	}
-	return 0;
+	blbn_free_net_cpts (state, cpt);
 }
 
 /**
- * Determines whether or not the node with the specified index node_index is a
- * non-target node.
+ * Sets the likelihood vector of each node to the indicator of its finding in
+ * the specified row of findings (or to all ones if the finding is -1).
  */
-int blbn_is_non_target_node (blbn_state_t *state, unsigned int node_index) {
-	if (state != NULL) {
-		if (node_index != state->target) {
-			return 1;
+static void blbn_set_lambda_from_row (blbn_state_t *state, double **lambda, const int *findings) {
+
+	int i, k;
+
+	for (i = 0; i < state->node_count; ++i) {
+		for (k = 0; k < state->model->state_count[i]; ++k) {
+			lambda[i][k] = (findings[i] < 0 || k == findings[i] ? 1.0 : 0.0);
 		}
 	}
-	return 0;
 }
 
-char blbn_is_purchased_finding (blbn_state_t *state, unsigned int node_index, unsigned int case_index) {
-	if (blbn_is_valid_finding (state, node_index, case_index)) {
-		return ((state->flags[node_index][case_index] & BLBN_METADATA_FLAG_PURCHASED) == BLBN_METADATA_FLAG_PURCHASED ? 0x01 : 0x00);
-	}
-	return 0x00;
-}
+/**
+ * Evaluation of a block of packed validation cases (see
+ * blbn_get_model_test_metrics and blbn_get_test_metrics).
+ */
+typedef struct blbn_eval_worker {
+	blbn_state_t *state;
+	const double * const *cpt;
+	int state_count;         // number of target states
+	unsigned int row_begin;  // first packed case of the block
+	unsigned int row_end;    // one past the last packed case of the block
+	double **lambda;         // likelihood vectors of the block (NULL to query through the native model's, with blbn_get_model_target_posterior)
+	double *posterior;       // target posterior of the current case
+	double *probability;     // P(label) of each packed case (shared; each block writes its own entries)
+	double *score;           // P(target state 1) of each packed case (shared; NULL unless the target is binary)
+	unsigned int *confusion; // confusion counts of the block
+	unsigned int errors;     // number of misclassified cases of the block
+	double brier;            // total Brier score of the block
+} blbn_eval_worker_t;
 
-// Returns true if is target or purchased
-char blbn_is_available_finding (blbn_state_t *state, unsigned int node_index, unsigned int case_index) {
-	if (state != NULL) {
-		if (blbn_is_valid_finding (state, node_index, case_index)) {
-			//if (blbn_is_target_finding (state, node_index, case_index) || blbn_is_purchased_finding (state, node_index, case_index)) {
-			if (blbn_is_target_finding (state, node_index, case_index) || blbn_is_purchased_finding (state, node_index, case_index)) {
-				return 0x01;
-			}
+/**
+ * Adds the target posterior of the specified packed case to the totals of
+ * the worker, weighted by the number of validation cases with its pattern.
+ */
+static void blbn_eval_add_posterior (blbn_eval_worker_t *worker, unsigned int row) {
+
+	int label = worker->state->validation_labels[row];
+	unsigned int weight = worker->state->validation_weights[row];
+	int target_state_count = worker->state_count;
+	const double *posterior = worker->posterior;
+	int best, t;
+	double difference, brier = 0.0;
+
+	best = 0;
+	for (t = 1; t < target_state_count; ++t) {
+		if (posterior[t] > posterior[best]) {
+			best = t;
 		}
 	}
-	return 0x00;
+	if (best != label) {
+		worker->errors += weight;
+	}
+	worker->confusion[label * target_state_count + best] += weight;
+
+	for (t = 0; t < target_state_count; ++t) {
+		difference = posterior[t] - (t == label ? 1.0 : 0.0);
+		brier += difference * difference;
+	}
+	worker->brier += weight * brier;
+
+	worker->probability[row] = (posterior[label] > BLBN_LOG_LOSS_MIN_PROBABILITY ? posterior[label] : BLBN_LOG_LOSS_MIN_PROBABILITY);
+	if (worker->score != NULL) {
+		worker->score[row] = posterior[1];
+	}
 }
 
 /**
- * Checks if the specified node has a finding (i.e., if the node has been
- * instantiated with a value; if the node has been assigned a value).
+ * Sets the evidence to the findings of the specified packed validation case.
+ * With lambda NULL the evidence of the native model is set; otherwise the
+ * specified likelihood vectors are, without touching the model's evidence.
  */
-int blbn_has_finding_set (blbn_state_t *state, unsigned node_index) {
-	node_bn *node;
-	char *node_name = NULL;
-	state_bn node_finding = NO_FINDING;
-	if (state != NULL) {
-		if (blbn_is_valid_node (state, node_index)) {
-			node_name = blbn_get_node_name (state, node_index);
-			if (node_name) {
-				node = GetNodeNamed_bn (node_name, state->work_net);
-				if (node != NULL) {
-					node_finding = GetNodeFinding_bn (node); // Get finding for specified node (if any)
-					if (node_finding >= 0) { // Check if the specified node has a finding
-						return 1; // Return true if node has a finding (i.e., it has been instantiated with or assigned a value)
-					}
-				}
-			}
-		}
+static void blbn_set_row_evidence (blbn_state_t *state, double **lambda, unsigned int row) {
+
+	const int *findings = state->validation_packed + (size_t) row * state->node_count;
+
+	if (lambda == NULL) {
+		blbn_set_lambda_from_row (state, state->model_lambda, findings);
+		state->model_evidence_key = -1 - (long) row;
+	} else {
+		blbn_set_lambda_from_row (state, lambda, findings);
 	}
-	return 0;
 }
 
-char blbn_is_learned_finding (blbn_state_t *state, unsigned int node_index, unsigned int case_index) {
-	if (blbn_is_valid_finding (state, node_index, case_index)) {
-		return ((state->flags[node_index][case_index] & BLBN_METADATA_FLAG_LEARNED) == BLBN_METADATA_FLAG_LEARNED ? 0x01 : 0x00);
+/**
+ * Computes the target posterior of the specified packed validation case with
+ * native inference and the specified CPTs, given the evidence set by
+ * blbn_set_row_evidence.  Queries with their own likelihood vectors run
+ * concurrently (generated code and sliced elimination over the plans
+ * looked up by blbn_get_validation_plans keep no state between queries).
+ */
+static void blbn_get_row_target_posterior (blbn_state_t *state, const double * const *cpt, double **lambda, unsigned int row, double *posterior) {
+
+	if (lambda == NULL) {
+		blbn_get_model_target_posterior (state, cpt, posterior);
+	} else if (state->inference == BLBN_INFERENCE_SLICED) {
+		blbn_model_sliced_target_posterior (state->model, state->validation_plans[row], cpt, (const double * const *) lambda, posterior);
+	} else {
+		state->generated->posterior (cpt, (const double * const *) lambda, posterior);
 	}
-	return 0x00;
 }
 
-char blbn_has_cases_available (blbn_state_t *state, unsigned int node_index) {
-	int i;
-	if (state != NULL) {
-		if (blbn_is_valid_node (state, node_index)) {
-			for (i = 0; i < state->case_count; ++i) {
-				//printf ("case %d avail?: %d\n", i, blbn_is_available_finding (state, node_index, i));
-				if (blbn_is_available_finding (state, node_index, i)) {
-					return 0x01;
-				}
-			}
-		}
+/**
+ * Computes the target posterior of every packed validation case in the
+ * block of the worker with native inference.  Blocks with their own
+ * likelihood vectors run concurrently.
+ */
+static void* blbn_eval_run_worker (void *arg) {
+
+	blbn_eval_worker_t *worker = (blbn_eval_worker_t *) arg;
+	blbn_state_t *state = worker->state;
+	unsigned int r;
+
+	for (r = worker->row_begin; r < worker->row_end; ++r) {
+		blbn_set_row_evidence (state, worker->lambda, r);
+		blbn_get_row_target_posterior (state, worker->cpt, worker->lambda, r, worker->posterior);
+		blbn_eval_add_posterior (worker, r);
 	}
-	return 0x00;
+
+	return NULL;
 }
 
-char blbn_has_findings_available_in_case (blbn_state_t *state, unsigned int case_index) {
-	int i;
-	if (state != NULL) {
-		if (blbn_is_valid_case (state, case_index)) {
-			for (i = 0; i < state->node_count; ++i) {
-				if (blbn_is_available_finding (state, i, case_index)) {
-					return 0x01;
-				}
-			}
+#define BLBN_LOG_LANES 4 // independent partial sums of the log loss
+
+/**
+ * Returns the sum of the logs of the specified probabilities (each at least
+ * BLBN_LOG_LOSS_MIN_PROBABILITY), each weighted by the number of validation
+ * cases with its pattern.  The sum is split into BLBN_LOG_LANES independent
+ * partial sums (a loop the compiler vectorizes).
+ */
+static double blbn_sum_log (const double *probability, const unsigned int *weight, unsigned int count) {
+
+	double lane[BLBN_LOG_LANES];
+	double sum = 0.0;
+	unsigned int j, l;
+
+	for (l = 0; l < BLBN_LOG_LANES; ++l) {
+		lane[l] = 0.0;
+	}
+	for (j = 0; j + BLBN_LOG_LANES <= count; j += BLBN_LOG_LANES) {
+		for (l = 0; l < BLBN_LOG_LANES; ++l) {
+			lane[l] += weight[j + l] * log (probability[j + l]);
 		}
 	}
-	return 0x00;
+	for (; j < count; ++j) {
+		sum += weight[j] * log (probability[j]);
+	}
+	for (l = 0; l < BLBN_LOG_LANES; ++l) {
+		sum += lane[l];
+	}
+
+	return sum;
 }
 
-char blbn_has_findings_learned_in_case (blbn_state_t *state, unsigned int case_index) {
-	int i;
-	if (state != NULL) {
-		if (blbn_is_valid_case (state, case_index)) {
-			for (i = 0; i < state->node_count; ++i) {
-				if (blbn_is_learned_finding (state, i, case_index)) {
-					return 0x01;
-				}
-			}
-		}
-	}
-	return 0x00;
+typedef struct blbn_auc_case {
+	double score;
+	int positive;
+	unsigned int weight;
+} blbn_auc_case_t;
+
+static int blbn_compare_auc_cases (const void *a, const void *b) {
+	double x = ((const blbn_auc_case_t *) a)->score;
+	double y = ((const blbn_auc_case_t *) b)->score;
+	return (x < y ? -1 : (x > y ? 1 : 0));
 }
 
-char blbn_has_cases_purchased (blbn_state_t *state, unsigned int node_index) {
-	int i;
-	if (state != NULL) {
-		if (blbn_is_valid_node (state, node_index)) {
-			for (i = 0; i < state->case_count; ++i) {
-				if (blbn_is_purchased_finding (state, node_index, i)) {
-					return 0x01;
-				}
-			}
+/**
+ * Returns the area under the ROC curve of the specified scores of the
+ * packed validation cases (target state 1 is the positive class), computed
+ * from the rank sum of the positive cases with tied scores sharing their
+ * mean rank.  Each packed case stands for as many validation cases as its
+ * weight.  Returns -1 if there are no positive or no negative cases.
+ */
+static double blbn_get_auc (blbn_state_t *state, const double *score, unsigned int count) {
+
+	blbn_auc_case_t *cases = NULL;
+	unsigned int j, k;
+	double positives = 0.0, negatives = 0.0, rank_sum = 0.0;
+	double ranked = 0.0, tied = 0.0, tied_positives;
+
+	cases = (blbn_auc_case_t *) malloc ((count > 0 ? count : 1) * sizeof (blbn_auc_case_t));
+	for (j = 0; j < count; ++j) {
+		cases[j].score = score[j];
+		cases[j].positive = (state->validation_labels[j] == 1);
+		cases[j].weight = state->validation_weights[j];
+		if (cases[j].positive) {
+			positives += cases[j].weight;
+		} else {
+			negatives += cases[j].weight;
 		}
 	}
-	return 0x00;
-}
+	qsort (cases, count, sizeof (blbn_auc_case_t), blbn_compare_auc_cases);
 
-char blbn_has_cases_not_purchased (blbn_state_t *state, unsigned int node_index) {
-	int i;
-	if (state != NULL) {
-		if (blbn_is_valid_node (state, node_index)) {
-			for (i = 0; i < state->case_count; ++i) {
-				if (!blbn_is_purchased_finding (state, node_index, i)) {
-					return 0x01;
-				}
-			}
+	for (j = 0; j < count; j = k) {
+		tied = 0.0;
+		tied_positives = 0.0;
+		for (k = j; k < count && cases[k].score == cases[j].score; ++k) {
+			tied += cases[k].weight;
+			tied_positives += (cases[k].positive ? cases[k].weight : 0.0);
 		}
+		rank_sum += tied_positives * (2.0 * ranked + 1.0 + tied) / 2.0; // ranks ranked + 1 ... ranked + tied
+		ranked += tied;
 	}
-	return 0x00;
+	free (cases);
+
+	if (positives == 0.0 || negatives == 0.0) {
+		return -1.0;
+	}
+
+	return (rank_sum - positives * (positives + 1.0) / 2.0) / (positives * negatives);
 }
 
-char blbn_has_cases_learned (blbn_state_t *state, unsigned int node_index) {
-	int i;
-	if (state != NULL) {
-		if (blbn_is_valid_node (state, node_index)) {
-			for (i = 0; i < state->case_count; ++i) {
-				if (blbn_is_learned_finding (state, node_index, i)) {
-					return 0x01;
-				}
-			}
+/**
+ * Combines the totals of the workers into the metrics of the packed
+ * validation cases.
+ */
+static blbn_test_metrics_t* blbn_new_test_metrics (blbn_state_t *state, const blbn_eval_worker_t *workers, int worker_count, const double *probability, const double *score) {
+
+	blbn_test_metrics_t *metrics = NULL;
+	unsigned int count = state->validation_tested_count;
+	unsigned int errors = 0;
+	double brier = 0.0;
+	int w, k;
+
+	metrics = (blbn_test_metrics_t *) malloc (sizeof (blbn_test_metrics_t));
+	metrics->tested = count;
+	metrics->state_count = workers[0].state_count;
+	metrics->confusion = (unsigned int *) calloc (metrics->state_count * metrics->state_count, sizeof (unsigned int));
+
+	for (w = 0; w < worker_count; ++w) {
+		errors += workers[w].errors;
+		brier += workers[w].brier;
+		for (k = 0; k < metrics->state_count * metrics->state_count; ++k) {
+			metrics->confusion[k] += workers[w].confusion[k];
 		}
 	}
-	return 0x00;
+
+	metrics->error_rate = (count > 0 ? (double) errors / count : 1.0);
+	metrics->log_loss = (count > 0 ? -blbn_sum_log (probability, state->validation_weights, state->validation_packed_count) / count : DBL_MAX);
+	metrics->brier = (count > 0 ? brier / count : DBL_MAX);
+	metrics->auc = (score != NULL ? blbn_get_auc (state, score, state->validation_packed_count) : -1.0);
+
+	return metrics;
 }
 
-char blbn_has_cases_not_learned (blbn_state_t *state, unsigned int node_index) {
-	int i;
-	if (state != NULL) {
-		if (blbn_is_valid_node (state, node_index)) {
-			for (i = 0; i < state->case_count; ++i) {
-				if (!blbn_is_learned_finding (state, node_index, i)) {
-					return 0x01;
-				}
-			}
-		}
+void blbn_free_test_metrics (blbn_test_metrics_t *metrics) {
+	if (metrics == NULL) {
+		return;
 	}
-	return 0x00;
+	free (metrics->confusion);
+	free (metrics);
 }
 
-char blbn_has_findings_learned (blbn_state_t *state, unsigned int case_index) {
-	int i;
-	if (state != NULL) {
-		if (blbn_is_valid_case (state, case_index)) {
-			for (i = 0; i < state->node_count; ++i) {
-				if (blbn_is_learned_finding (state, i, case_index)) {
-					return 0x01;
-				}
-			}
-		}
+/**
+ * Looks up the sliced elimination plan of every packed validation case once,
+ * so that cases can be evaluated concurrently (the slice cache is not shared
+ * between threads).
+ */
+static void blbn_get_validation_plans (blbn_state_t *state) {
+
+	unsigned int r;
+
+	if (state->validation_plans != NULL) {
+		return;
+	}
+
+	state->validation_plans = (const blbn_ve_plan_t **) malloc ((state->validation_packed_count > 0 ? state->validation_packed_count : 1) * sizeof (blbn_ve_plan_t *));
+	for (r = 0; r < state->validation_packed_count; ++r) {
+		blbn_set_lambda_from_row (state, state->model_lambda, state->validation_packed + (size_t) r * state->node_count);
+		state->validation_plans[r] = blbn_get_sliced_plan (state);
 	}
-	return 0x00;
 }
 
-char blbn_has_findings_not_learned (blbn_state_t *state, unsigned int case_index) {
-	int i;
-	if (state != NULL) {
-		if (blbn_is_valid_case (state, case_index)) {
+/**
+ * Returns the error rate, logarithmic loss, Brier score, confusion counts
+ * and (for binary targets) AUC of the target node over the validation cases,
+ * computed in one pass with the native inference method and the specified
+ * CPTs.  Like the Netica tester, each case is classified as the most
+ * probable target state given the findings of every other node, and cases
+ * without a target finding are skipped.
+ *
+ * With generated or sliced inference the cases are split into blocks
+ * evaluated by state->eval_thread_count threads; the other engines keep
+ * state between queries and evaluate the cases in one thread.  If detached
+ * is non-zero, the evaluation never touches the evidence or caches of the
+ * native model, so it may run concurrently with other queries (generated or
+ * sliced inference only; the sliced plans must have been looked up with
+ * blbn_get_validation_plans).
+ */
+static blbn_test_metrics_t* blbn_get_model_test_metrics_from (blbn_state_t *state, const double * const *cpt, char detached) {
+
+	blbn_test_metrics_t *metrics = NULL;
+	blbn_eval_worker_t workers[BLBN_EVAL_MAX_THREADS];
+	pthread_t threads[BLBN_EVAL_MAX_THREADS];
+	unsigned int count = state->validation_packed_count;
+	int target_state_count = state->model->state_count[state->target];
+	int thread_count = state->eval_thread_count;
+	double *probability = NULL;
+	double *score = NULL;
+	int i, w;
+
+	// Only engines without state between queries are run concurrently
+	if (state->inference != BLBN_INFERENCE_GENERATED && state->inference != BLBN_INFERENCE_SLICED) {
+		thread_count = 1;
+	}
+	if (thread_count > BLBN_EVAL_MAX_THREADS) {
+		thread_count = BLBN_EVAL_MAX_THREADS;
+	}
+	if (thread_count > (int) count) {
+		thread_count = count;
+	}
+	if (thread_count < 1) {
+		thread_count = 1;
+	}
+
+	// Look up the sliced plan of every case once (the cache is not shared between threads)
+	if (thread_count > 1 && state->inference == BLBN_INFERENCE_SLICED && !detached) {
+		blbn_get_validation_plans (state);
+	}
+
+	probability = (double *) malloc ((count > 0 ? count : 1) * sizeof (double));
+	if (target_state_count == 2) {
+		score = (double *) malloc ((count > 0 ? count : 1) * sizeof (double));
+	}
+
+	for (w = 0; w < thread_count; ++w) {
+		workers[w].state = state;
+		workers[w].cpt = cpt;
+		workers[w].state_count = target_state_count;
+		workers[w].row_begin = (unsigned int) ((unsigned long) count * w / thread_count);
+		workers[w].row_end   = (unsigned int) ((unsigned long) count * (w + 1) / thread_count);
+		workers[w].lambda = NULL;
+		if (thread_count > 1 || detached) {
+			workers[w].lambda = (double **) malloc (state->node_count * sizeof (double *));
 			for (i = 0; i < state->node_count; ++i) {
-				if (!blbn_is_learned_finding (state, i, case_index)) {
-					return 0x01;
-				}
+				workers[w].lambda[i] = (double *) malloc (state->model->state_count[i] * sizeof (double));
 			}
 		}
+		workers[w].posterior = (double *) malloc (target_state_count * sizeof (double));
+		workers[w].probability = probability;
+		workers[w].score = score;
+		workers[w].confusion = (unsigned int *) calloc (target_state_count * target_state_count, sizeof (unsigned int));
+		workers[w].errors = 0;
+		workers[w].brier = 0.0;
 	}
-	return 0x00;
-}
 
-char blbn_has_findings_available_not_learned (blbn_state_t *state, unsigned int case_index) {
-	int i;
-	if (state != NULL) {
-		if (blbn_is_valid_case (state, case_index)) {
+	for (w = 1; w < thread_count; ++w) {
+		pthread_create (&threads[w], NULL, blbn_eval_run_worker, &workers[w]);
+	}
+	blbn_eval_run_worker (&workers[0]);
+	for (w = 1; w < thread_count; ++w) {
+		pthread_join (threads[w], NULL);
+	}
+
+	metrics = blbn_new_test_metrics (state, workers, thread_count, probability, score);
+
+	for (w = 0; w < thread_count; ++w) {
+		if (workers[w].lambda != NULL) {
 			for (i = 0; i < state->node_count; ++i) {
-				if (blbn_is_available_finding (state, i, case_index)) {
-					if (!blbn_is_learned_finding (state, i, case_index)) {
-						return 0x01;
-					}
-				}
+				free (workers[w].lambda[i]);
 			}
+			free (workers[w].lambda);
 		}
+		free (workers[w].posterior);
+		free (workers[w].confusion);
 	}
-	return 0x00;
+	free (probability);
+	free (score);
+
+	return metrics;
 }
 
-char blbn_has_findings_purchased (blbn_state_t *state) {
-	int i;
-	if (state != NULL) {
-		for (i = 0; i < state->case_count; ++i) {
-			if (blbn_has_findings_purchased_in_case (state, i)) {
-				return 0x01;
-			}
+blbn_test_metrics_t* blbn_get_model_test_metrics (blbn_state_t *state, const double * const *cpt) {
+	return blbn_get_model_test_metrics_from (state, cpt, 0);
+}
+
+/**
+ * Returns the test metrics of the specified compiled network with Netica
+ * inference: each case is entered as a batch of findings and the beliefs of
+ * the target node are read, so all metrics come from a single pass over the
+ * validation cases.  Only the specified network is touched.
+ */
+static blbn_test_metrics_t* blbn_get_net_test_metrics (blbn_state_t *state, net_bn *net) {
+
+	blbn_test_metrics_t *metrics = NULL;
+	blbn_eval_worker_t worker;
+	unsigned int count = state->validation_packed_count;
+	node_bn *target_node = NULL;
+	const prob_bn *beliefs = NULL;
+	unsigned int r;
+	int t;
+
+	target_node = blbn_get_net_node (state, net, state->target);
+
+	worker.state = state;
+	worker.cpt = NULL;
+	worker.state_count = GetNodeNumberStates_bn (target_node);
+	worker.row_begin = 0;
+	worker.row_end = count;
+	worker.lambda = NULL;
+	worker.posterior = (double *) malloc (worker.state_count * sizeof (double));
+	worker.probability = (double *) malloc ((count > 0 ? count : 1) * sizeof (double));
+	worker.score = (worker.state_count == 2 ? (double *) malloc ((count > 0 ? count : 1) * sizeof (double)) : NULL);
+	worker.confusion = (unsigned int *) calloc (worker.state_count * worker.state_count, sizeof (unsigned int));
+	worker.errors = 0;
+	worker.brier = 0.0;
+
+	for (r = 0; r < count; ++r) {
+		blbn_enter_net_findings (state, net, state->validation_packed + (size_t) r * state->node_count);
+		beliefs = GetNodeBeliefs_bn (target_node);
+		for (t = 0; t < worker.state_count; ++t) {
+			worker.posterior[t] = beliefs[t];
 		}
+		blbn_eval_add_posterior (&worker, r);
 	}
-	return 0x00;
+	RetractNetFindings_bn (net); // IMPORTANT: Otherwise any findings will be part of later tests !!
+
+	metrics = blbn_new_test_metrics (state, &worker, 1, worker.probability, worker.score);
+
+	free (worker.posterior);
+	free (worker.probability);
+	free (worker.score);
+	free (worker.confusion);
+
+	return metrics;
 }
 
-char blbn_has_findings_available (blbn_state_t *state) {
-	int i,j;
-	if (state != NULL) {
-		for (j = 0; j < state->case_count; ++j) {
-			for (i = 0; i < state->node_count; ++i) {
-				if (blbn_is_purchased_finding (state, i, j) || blbn_is_target_finding (state, i, j)) {
-					return 0x01;
-				}
-			}
+/**
+ * Returns the test metrics (see blbn_get_model_test_metrics) of the specified
+ * network: the working network or a copy with its structure (e.g., a
+ * lookahead network), with the native inference method if it is enabled or
+ * with Netica (see blbn_get_net_test_metrics).
+ */
+blbn_test_metrics_t* blbn_get_test_metrics (blbn_state_t *state, net_bn *net) {
+
+	blbn_test_metrics_t *metrics = NULL;
+	double **cpt = NULL;
+
+	// Evaluate with native inference if it is enabled (using the CPTs of the specified network)
+	if (state->inference != BLBN_INFERENCE_NETICA) {
+		if (net == state->work_net) {
+			blbn_sync_model (state);
+			return blbn_get_model_test_metrics (state, (const double * const *) state->model->cpt);
 		}
+		cpt = blbn_get_net_cpts (state, net);
+		metrics = blbn_get_model_test_metrics (state, (const double * const *) cpt);
+		blbn_free_net_cpts (state, cpt);
+		return metrics;
 	}
-	return 0x00;
+
+	blbn_compile_net (state, net);
+	return blbn_get_net_test_metrics (state, net);
 }
 
 /**
- * Returns true if at least one finding exists that is not purchased and is not a
- * finding for the target node.
+ * Returns an array of both the error rate and logarithmic loss of the target
+ * node over the validation cases, computed with the native inference method
+ * and the specified CPTs (see blbn_get_model_test_metrics).
  */
-char blbn_has_findings_not_available (blbn_state_t *state) {
-	int i,j;
-	if (state != NULL) {
-		for (j = 0; j < state->case_count; ++j) {
-			for (i = 0; i < state->node_count; ++i) {
-				if (!blbn_is_purchased_finding (state, i, j) && !blbn_is_target_finding (state, i, j)) {
-					return 0x01;
-				}
-			}
-		}
-	}
-	return 0x00;
-}
+double* blbn_get_model_test_rates (blbn_state_t *state, const double * const *cpt) {
 
-char blbn_has_findings_not_purchased (blbn_state_t *state) {
-	int i;
-	if (state != NULL) {
-		for (i = 0; i < state->case_count; ++i) {
-			if (blbn_has_findings_not_purchased_in_case (state, i)) {
-				return 0x01;
-			}
-		}
-	}
-	return 0x00;
-}
+	double *test_rates = NULL;
+	blbn_test_metrics_t *metrics = NULL;
 
-char blbn_has_findings_purchased_in_case (blbn_state_t *state, unsigned int case_index) {
-	int i;
-	if (state != NULL) {
-		if (blbn_is_valid_case (state, case_index)) {
-			for (i = 0; i < state->node_count; ++i) {
-				if (blbn_is_purchased_finding (state, i, case_index)) {
-					return 0x01;
-				}
-			}
-		}
-	}
-	return 0x00;
-}
+	metrics = blbn_get_model_test_metrics (state, cpt);
+	test_rates = (double *) malloc (2 * sizeof (double));
+	test_rates[0] = metrics->error_rate;
+	test_rates[1] = metrics->log_loss;
+	blbn_free_test_metrics (metrics);
 
-char blbn_has_findings_not_purchased_in_case (blbn_state_t *state, unsigned int case_index) {
-	int i;
-	if (state != NULL) {
-		if (blbn_is_valid_case (state, case_index)) {
-			for (i = 0; i < state->node_count; ++i) {
-				if (!blbn_is_purchased_finding (state, i, case_index)) {
-					return 0x01;
-				}
-			}
-		}
-	}
-	return 0x00;
+	return test_rates;
 }
 
-int blbn_get_node_finding (blbn_state_t *state, unsigned int node_index, unsigned int case_index) {
-	if (node_index < state->node_count && case_index < state->case_count) {
-		return state->state [node_index][case_index];
-	}
-	return -1;
-}
+/**
+ * Enables sampled validation for lookahead scoring (see
+ * blbn_util_get_expected_log_loss_sampled): the packed validation cases are
+ * streamed in a fixed random order, and the evaluation of a candidate stops
+ * once its loss is z standard errors above that of the best candidate so
+ * far.
+ */
+void blbn_enable_sampled_validation (blbn_state_t *state, double z) {
 
-char* blbn_get_node_name (blbn_state_t *state, unsigned int node_index) {
-	if (state != NULL) {
-		if (blbn_is_valid_node (state, node_index)) {
-			return state->nodes[node_index];
-		}
+	unsigned int r, s;
+	int swap;
+
+	state->sampled_validation_z = z;
+
+	free (state->validation_order);
+	state->validation_order = (int *) malloc ((state->validation_packed_count > 0 ? state->validation_packed_count : 1) * sizeof (int));
+	for (r = 0; r < state->validation_packed_count; ++r) {
+		state->validation_order[r] = r;
 	}
-	return NULL;
+	for (r = state->validation_packed_count; r > 1; --r) {
+		s = rand () % r;
+		swap = state->validation_order[r - 1];
+		state->validation_order[r - 1] = state->validation_order[s];
+		state->validation_order[s] = swap;
+	}
+
+	fprintf (log_fp, "Sampled validation: lookahead evaluation stops %f standard errors above the best candidate (after at least %d cases)\n", z, BLBN_SAMPLED_VALIDATION_MIN_CASES);
+	fflush (log_fp);
 }
 
 /**
- * Return the index of the node with the specified name.
+ * Packs the validation cases with a target finding row by row for one-pass
+ * evaluation, collapsing identical cases (same findings and label) into one
+ * pattern weighted by the number of cases.  Validation folds of small
+ * networks repeat the same rows many times, so each distinct posterior is
+ * computed once per evaluation.
  */
-int blbn_get_node_index (blbn_state_t *state, char* node_name) {
-	int i;
-	char* current_node_name = NULL;
-	if (state != NULL) {
-		for (i = 0; i < state->node_count; ++i) {
-			current_node_name = blbn_get_node_name (state, i); // Get name of current node at index i in the node list
-			if (current_node_name != NULL) { // Check if a valid character string was returned
-				if (strcmp (current_node_name, node_name) == 0) { // Compare the specified node name
-					return i; // Return the current index
-				}
-			}
+static void blbn_pack_validation (blbn_state_t *state) {
+
+	int n = state->node_count;
+	unsigned int bucket_count = (state->validation_case_count > 0 ? state->validation_case_count : 1);
+	int *buckets = NULL;
+	int *next = NULL;
+	int *row = NULL;
+	unsigned int hash;
+	unsigned int j;
+	int i, r;
+
+	state->validation_packed = (int *) malloc (bucket_count * n * sizeof (int));
+	state->validation_labels = (int *) malloc (bucket_count * sizeof (int));
+	state->validation_weights = (unsigned int *) malloc (bucket_count * sizeof (unsigned int));
+	state->validation_packed_count = 0;
+	state->validation_tested_count = 0;
+
+	// Patterns by hash of their findings and label (first pattern of each bucket, then next pattern in the same bucket)
+	buckets = (int *) malloc (bucket_count * sizeof (int));
+	next = (int *) malloc (bucket_count * sizeof (int));
+	for (j = 0; j < bucket_count; ++j) {
+		buckets[j] = -1;
+	}
+
+	for (j = 0; j < state->validation_case_count; ++j) {
+		if (state->validation_state[state->target][j] < 0) {
+			continue;
 		}
-	}
-	return -1;
-}
+		++state->validation_tested_count;
+
+		// Write the case into the next free row and look it up
+		r = state->validation_packed_count;
+		row = state->validation_packed + (size_t) r * n;
+		state->validation_labels[r] = state->validation_state[state->target][j];
+		hash = 2166136261u;
+		for (i = 0; i < n; ++i) {
+			row[i] = (i == state->target ? -1 : state->validation_state[i][j]);
+			hash = (hash ^ (unsigned int) row[i]) * 16777619u;
+		}
+		hash = ((hash ^ (unsigned int) state->validation_labels[r]) * 16777619u) % bucket_count;
 
-/**
- * Returns node index from static ordering in meta-data structure with the
- * specified name.  If the name isn't in the list, then -1 is returned.
- */
-int blbn_get_node_by_name (blbn_state_t *state, char *name) {
-	int i;
-	for (i = 0; i < state->node_count; i++) {
-		if (strcmp (state->nodes[i], name) == 0) {
-			return i;
+		for (i = buckets[hash]; i >= 0; i = next[i]) {
+			if (state->validation_labels[i] == state->validation_labels[r] && memcmp (state->validation_packed + (size_t) i * n, row, n * sizeof (int)) == 0) {
+				break;
+			}
+		}
+		if (i >= 0) {
+			++state->validation_weights[i];
+			continue;
 		}
+
+		state->validation_weights[r] = 1;
+		next[r] = buckets[hash];
+		buckets[hash] = r;
+		++state->validation_packed_count;
 	}
-	return -1;
+
+	free (buckets);
+	free (next);
 }
 
 /**
- * Returns an array of the node indices from the static ordering of nodes in
- * the state data structure that are d-separated from the node with the
- * specified index.  If
- *
- * Note that this function will free the memory array passed to it as an argument
- * and allocate new memory for storing the indices of the that are d-separated.
+ * Initializes meta-data used for "book-keeping" in budgeted learning algorithms.
  */
-int blbn_get_d_separated_nodes (blbn_state_t *state, unsigned int node_index, int **d_separated_node_indices) {
-
-	/* size (return this), array_of_indices */
-
-	int i;
-	int d_separated_node_candidate_count = 0;
-	int d_separated_node_count = 0;
-	int d_separated_node_index;
-
-	// Get a list of all of the node in the network
-	const nodelist_bn *d_separated_node_candidates = GetNetNodes_bn (state->work_net); // Initialize node list with all nodes in the network
-	nodelist_bn *d_separated_nodes = NewNodeList2_bn (0, state->work_net); // Initialize node list with all nodes in the network
-	//nodelist_bn *d_separated = NewNodeList2_bn(8, state->work_net);
+blbn_state_t* blbn_init_state (char *experiment_name, char *data_filepath, char *test_data_filepath, char *model_filepath, char *target_node_name, unsigned int budget, char *output_folder, int k, int f) {
 
-	// Get the node with the specified node index
-	node_bn *d_separated_node = NthNode_bn (d_separated_node_candidates, node_index); // Get specified node from static node list
+	net_bn *orig_net = NULL;
+	net_bn *net = NULL;
+	const nodelist_bn* orig_nodes;
+	nodelist_bn* copied_nodes = NULL;
+	int node_count = 0;
+	blbn_state_t *state = NULL;
+	const nodelist_bn *nodes = NULL;
+	node_bn *node = NULL;
+	char *node_name = NULL;
+	int node_name_length = 0;
+	caseposn_bn case_posn;
+	int i, j;
+	char graph_filename[128];
+	char log_filename[128];
+	stream_ns *data_stream = NULL;
+	stream_ns *validation_stream = NULL;
 
-	// TODO: Clear network findings?  Make this optional?  Clearing the findings may affect which nodes are d-separated from the node with the specified node index.
-		// NOTE: No, assume that findings that should be cleared were cleared before calling this function.
+	// Initialize random seed
+	srand (time (NULL));
 
-	// TODO: Add parameter to specify the "instantiated" nodes in the network?
-		// NOTE: No, assume that the nodes that should be instantiated are instantiated before calling this function.
+	// Create Netica network
+	orig_net = ReadNet_bn (NewFileStream_ns (model_filepath, env, NULL), NO_VISUAL_INFO);
+	orig_nodes = GetNetNodes_bn (orig_net);
+	SetNetAutoUpdate_bn (orig_net, 0);
+	//CHKERR
+	if (GetError_ns (env, ERROR_ERR, NULL)) {
+		//goto error;
+	}
 
-	// Find all the nodes that are d-connected with node, subtract them from the
-	// specified node list, and exclude the specified node from the node list.
-	// The remaining nodes will be those that are d-separated from the
-	// specified node.
-	GetRelatedNodes_bn (d_separated_node_candidates, "d_connected,subtract", d_separated_node); // Subtract node of interest and all nodes in the relation (d-connected) to the specified node of interest
+	net = NewNet_bn (GetNetName_bn (orig_net), env); // TODO: Update this!
+	copied_nodes = CopyNodes_bn (orig_nodes, net, NULL);
+	node_count = LengthNodeList_bn (copied_nodes);
 
-	// NOTE: At this point, the node list d_separated contains the nodes d-separated from the specified node of interest
+//	// Remove CPTs of nodes in learned_net, so new ones can be learned.
+//	for (i = 0;  i < node_count;  ++i) {
+//		DeleteNodeTables_bn (NthNode_bn (copied_nodes, i));
+//	}
 
-	// Iterate through list of d-separation candidate nodes and remove all
-	// instantiated nodes.  This list of candidate nodes includes all
-	// d-separated nodes as well as some instantiated nodes, which are also
-	// d-separated, strictly speaking, since they do not influence the conditional
-	// probability table (CPT) of the d-separated node.  These instantiated
-	// nodes are removed because they are typically considered the d-separating
-	// nodes, not d-separated nodes (i.e., they actually cause the d-separation).
-//	printf ("DEBUG: Adding candidate d-sep node to d-sep node list: { ");
-	d_separated_node_candidate_count = LengthNodeList_bn (d_separated_node_candidates);
-	for (i = 0; i < d_separated_node_candidate_count; ++i) {
-		// Check if node has been instantiated (i.e., check if it has a finding)
-		if (GetNodeFinding_bn (NthNode_bn (d_separated_node_candidates, i)) >= 0) { // Check if there are no findings for node
-			continue; // If node has been instantiated, do not add it to the list of d-separated nodes
-		}
+	// Open training and testing data sets
+	// TODO: Make sure these exist and if not, return NULL
+	data_stream       = NewFileStream_ns (data_filepath, env, NULL);
+	validation_stream = NewFileStream_ns (test_data_filepath, env, NULL);
 
-		// The node has not been instantiated, so add it to the list of d-separated nodes
-		AddNodeToList_bn (NthNode_bn (d_separated_node_candidates, i), d_separated_nodes, LAST_ENTRY);
-//		printf ("%s ", GetNodeName_bn (NthNode_bn (d_separated_node_candidates, i)));
+	// Make sure that the output directory exists (it must already exist)
+	if (!file_exists (output_folder)) {
+		printf ("Error: Output directory does not exist. Exiting.\n");
+		exit (1);
 	}
-//	printf ("}\n");
 
+	// Create log files
+	sprintf (graph_filename, "%s/graph.csv.%d", output_folder, f);
+	graph_fp = fopen (graph_filename, "w");
 
-	// Free memory occupied by the array to store d-separations
-	/*
-	if (*d_separated_node_indices != NULL) {
-		free (*d_separated_node_indices);
-		*d_separated_node_indices = NULL;
-	}
-	*/
+	sprintf (log_filename,   "%s/log.txt.%d", output_folder, f);
+	log_fp   = fopen (log_filename,   "w");
 
-	// Create an array with indices of d-separated nodes
-	// Iterate through nodes and get indices in static ordering of each of them
-//	printf ("DEBUG: d-separations for node %s: { ", blbn_get_node_name (state, node_index));
-	d_separated_node_count = LengthNodeList_bn (d_separated_nodes);
-	*d_separated_node_indices = (int *) malloc (d_separated_node_count * sizeof (int)); // Create array to hold d-separated node indices
-	for (i = 0; i < d_separated_node_count; ++i) {
-		d_separated_node_index = blbn_get_node_index (state, GetNodeName_bn (NthNode_bn (d_separated_nodes, i))); // Get index in static node ordering
-		(*d_separated_node_indices)[i] = d_separated_node_index; // Get index (from static ordering) corresponding to the current node at index i in the d-separated node list
-//		printf ("%s ", blbn_get_node_name (state, d_separated_node_index));
-	}
-//	printf ("}\n");
+	if (net != NULL) {
+		// Allocate space for meta-data structure
+		state = (blbn_state_t *) malloc  (sizeof (blbn_state_t));
 
-	// Delete Netica node list of d-separated nodes
-	DeleteNodeList_bn (d_separated_nodes);
+		if (state != NULL) {
 
-	return d_separated_node_count;
-}
+			// Copy original network (used as the "base" net from which to learn and revert to during unlearning)
+			state->orig_net = net;
 
-/**
- * Returns an array of the node indices from the static ordering of nodes in
- * the state data structure that are d-separated from the node with the
- * specified index.  If
- *
- * Note that this function will free the memory array passed to it as an argument
- * and allocate new memory for storing the indices of the that are d-separated.
- */
-int blbn_get_d_separated_nodes_and_separating_nodes (blbn_state_t *state, unsigned int node_index, int **d_separated_node_indices) {
-	/* size (return this), array_of_indices */
+			// Set Netica network data structures
+			state->prior_net = blbn_util_copy_net (state, state->orig_net);
 
-	int i;
-	int d_separated_node_count = 0;
-	int d_separated_node_index;
+			// Set Netica network data structures
+			state->work_net = blbn_util_copy_net (state, state->orig_net);
 
-	// Get a list of all of the node in the network
-	const nodelist_bn *d_separated_node_candidates = GetNetNodes_bn (state->work_net); // Initialize node list with all nodes in the network
-	nodelist_bn *d_separated_nodes = NewNodeList2_bn (0, state->work_net); // Initialize node list with all nodes in the network
-	//nodelist_bn *d_separated = NewNodeList2_bn(8, state->work_net);
+			// Get statically-ordered list (keep it around for reference throughout execution of program)
+			nodes = GetNetNodes_bn (net);
 
-	// Get the node with the specified node index
-	node_bn *d_separated_node = NthNode_bn (d_separated_node_candidates, node_index); // Get specified node from static node list
+			// Get number of nodes
+			state->node_count = LengthNodeList_bn (nodes);
+			printf ("Node count: %d\n", state->node_count);
 
-	// TODO: Clear network findings?  Make this optional?  Clearing the findings may affect which nodes are d-separated from the node with the specified node index.
-		// NOTE: No, assume that findings that should be cleared were cleared before calling this function.
+			// Create validation case set
+			state->validation_caseset  = NewCaseset_cs ("TestCases", env);
+			AddFileToCaseset_cs (state->validation_caseset, validation_stream, 1.0, NULL);
 
-	// TODO: Add parameter to specify the "instantiated" nodes in the network?
-		// NOTE: No, assume that the nodes that should be instantiated are instantiated before calling this function.
+			// Get node names
+			if (state->node_count > 0) {
+				state->nodes = (char **) malloc (state->node_count * sizeof (char *));
 
-	// Find all the nodes that are d-connected with node, subtract them from the
-	// specified node list, and exclude the specified node from the node list.
-	// The remaining nodes will be those that are d-separated from the
-	// specified node.
-	GetRelatedNodes_bn (d_separated_node_candidates, "d_connected,subtract", d_separated_node); // Subtract node of interest and all nodes in the relation (d-connected) to the specified node of interest
+				for (i = 0;  i < state->node_count;  ++i) {
+					node = NthNode_bn (nodes, i);
+					node_name = GetNodeName_bn (node);
+					node_name_length = strlen (node_name) + 1;
 
-	// NOTE: At this point, the node list d_separated contains the nodes d-separated from the specified node of interest
+					// Copy name into new array (including null-terminated character)
+					state->nodes[i] = (char *) malloc (node_name_length * sizeof (char));
+					strncpy (state->nodes[i], node_name, node_name_length);
 
-	// Free memory occupied by the array to store d-separations
-	/*
-	if (*d_separated_node_indices != NULL) {
-		free (*d_separated_node_indices);
-		*d_separated_node_indices = NULL;
-	}
-	*/
+					//printf ("Adding node to meta-model: %s\n", state->nodes[i]);
+				}
+			}
 
-	// Create an array with indices of d-separated nodes
-	// Iterate through nodes and get indices in static ordering of each of them
-//	printf ("DEBUG: d-separations for node %s: { ", blbn_get_node_name (state, node_index));
-	d_separated_node_count = LengthNodeList_bn (d_separated_node_candidates);
-	*d_separated_node_indices = (int *) malloc (d_separated_node_count * sizeof (int)); // Create array to hold d-separated node indices
-	for (i = 0; i < d_separated_node_count; ++i) {
-		d_separated_node_index = blbn_get_node_index (state, GetNodeName_bn (NthNode_bn (d_separated_node_candidates, i))); // Get index in static node ordering
-		(*d_separated_node_indices)[i] = d_separated_node_index; // Get index (from static ordering) corresponding to the current node at index i in the d-separated node list
-//		printf ("%s ", blbn_get_node_name (state, d_separated_node_index));
-	}
-//	printf ("}\n");
+			// Map node names to indices in the static ordering
+			blbn_init_node_names (state);
 
-	// Delete Netica node list of d-separated nodes
-	DeleteNodeList_bn (d_separated_node_candidates);
+			// Get parents and children of nodes in the static ordering
+			blbn_init_graph (state, nodes);
 
-	return d_separated_node_count;
-}
+			// Find target node index
+			for (i = 0; i <= state->node_count; ++i) {
+				if (i == state->node_count) {
+					// Target node not found
+					// TODO: Free memory (call blbln_free_metadata ())
+					return NULL;
+				} else {
+					if (strcasecmp (state->nodes[i], target_node_name) == 0) {
+						state->target = i;
+						printf ("Target set to index: %d\n", state->target);
+						printf ("Target set to node: %s\n", blbn_get_node_name (state, state->target));
+						break;
+					}
+				}
+			}
 
-void blbn_set_finding_target (blbn_state_t *state, unsigned int node_index, unsigned int case_index) {
-	if (blbn_is_valid_finding (state, node_index, case_index)) {
-		state->flags[node_index][case_index] |= BLBN_METADATA_FLAG_TARGET;
-	}
-}
+			// Count number of cases
+			state->case_count = 0;
+			case_posn = FIRST_CASE;
+			while (1) {
+				RetractNetFindings_bn (net); // Retracts all findings from net
+				ReadNetFindings_bn (&case_posn, data_stream, nodes, NULL, NULL); // Set findings
+				if (case_posn == NO_MORE_CASES)
+					break;
+				++state->case_count;
+				case_posn = NEXT_CASE;
 
-void blbn_set_finding_not_target (blbn_state_t *state, unsigned int node_index, unsigned int case_index) {
-	if (blbn_is_valid_finding (state, node_index, case_index)) {
-		state->flags[node_index][case_index] &= ~BLBN_METADATA_FLAG_TARGET;
-	}
-}
+				// TODO: CHKERR
+			}
+			printf ("Case count: %d\n", state->case_count);
 
-void blbn_set_finding_purchased (blbn_state_t *state, unsigned int node_index, unsigned int case_index) {
-	if (blbn_is_valid_finding (state, node_index, case_index)) {
-		state->flags[node_index][case_index] |= BLBN_METADATA_FLAG_PURCHASED;
-	}
-}
+			// Allocate space for state meta-data
+			state->state = (int **) malloc (state->node_count * sizeof (int *)); // n states (columns)
+			for (i = 0; i < state->node_count; i++) {
+				state->state[i] = (int *) malloc (state->case_count * sizeof (int)); // m cases (rows)
+			}
 
-void blbn_set_finding_not_purchased (blbn_state_t *state, unsigned int node_index, unsigned int case_index) {
-	if (blbn_is_valid_finding (state, node_index, case_index)) {
-		state->flags[node_index][case_index] &= ~BLBN_METADATA_FLAG_PURCHASED;
-	}
+			// Allocate space for property flag meta-data
+			state->flags = (unsigned int **) malloc (state->node_count * sizeof (unsigned int *)); // n states (columns)
+			for (i = 0; i < state->node_count; i++) {
+				state->flags[i] = (unsigned int *) malloc (state->case_count * sizeof (unsigned int)); // m cases (rows)
+			}
+
+			// Initialize working copy of data set and book-keeping meta-data
+			case_posn = FIRST_CASE;
+			j = 0; // used to count number of cases
+			while (1) {
+				RetractNetFindings_bn (net); // Retracts all findings from net
+				ReadNetFindings_bn (&case_posn, data_stream, nodes, NULL, NULL); // Set findings
+				if (case_posn == NO_MORE_CASES)
+					break;
+
+				// Gets the current state of nodes
+				for (i = 0; i < state->node_count; i++) {
+					state->state[i][j] = GetNodeFinding_bn (NthNode_bn (nodes, i)); // Initialize state from Netica stream_ns
+
+					// Initialize flags for target and non-target node findings in cases
+					if (i == state->target) {
+						state->flags[i][j] = 0x00000000 | BLBN_METADATA_FLAG_TARGET; // Initialize flags to zeros (i.e., not purchased, not target)
+					} else {
+						state->flags[i][j] = 0x00000000; // Initialize flags to zeros (i.e., not purchased, not target)
+					}
+
+					// Prints states and flags
+					//printf ("%d/%d  ", state->state[i][j], state->flags[i][j]);
+					//printf ("%d/%d/%d  ", blbn_is_purchased_finding(state,i,j), blbn_is_learned_finding(state,i,j), blbn_is_target_finding(state,i,j));
+				}
+				//printf ("\n");
+
+				++j;
+
+				case_posn = NEXT_CASE;
+
+				// TODO: CHKERR
+			}
+
+			// Allocate space for cost meta-data
+			state->cost = (unsigned int **) malloc (state->node_count * sizeof (unsigned int *)); // n states (columns)
+			for (i = 0; i < state->node_count; i++) {
+				state->cost[i] = (unsigned int *) malloc (state->case_count * sizeof (unsigned int)); // m cases (rows)
+			}
+
+			// Initialize cost meta-data
+			for (i = 0; i < state->node_count; i++) {
+				for (j = 0; j < state->case_count; j++) {
+					state->cost[i][j] = 1;
+				}
+			}
+
+			// Count number of validation cases
+			state->validation_case_count = 0;
+			case_posn = FIRST_CASE;
+			while (1) {
+				RetractNetFindings_bn (net); // Retracts all findings from net
+				ReadNetFindings_bn (&case_posn, validation_stream, nodes, NULL, NULL); // Set findings
+				if (case_posn == NO_MORE_CASES)
+					break;
+				++state->validation_case_count;
+				case_posn = NEXT_CASE;
+			}
+			printf ("Validation case count: %d\n", state->validation_case_count);
+
+			// Keep the validation cases in memory (used for evaluation with native inference)
+			state->validation_state = (int **) malloc (state->node_count * sizeof (int *)); // n states (columns)
+			for (i = 0; i < state->node_count; i++) {
+				state->validation_state[i] = (int *) malloc ((state->validation_case_count > 0 ? state->validation_case_count : 1) * sizeof (int)); // m cases (rows)
+			}
+
+			case_posn = FIRST_CASE;
+			j = 0;
+			while (1) {
+				RetractNetFindings_bn (net); // Retracts all findings from net
+				ReadNetFindings_bn (&case_posn, validation_stream, nodes, NULL, NULL); // Set findings
+				if (case_posn == NO_MORE_CASES)
+					break;
+				for (i = 0; i < state->node_count; i++) {
+					state->validation_state[i][j] = GetNodeFinding_bn (NthNode_bn (nodes, i));
+				}
+				++j;
+				case_posn = NEXT_CASE;
+			}
+			RetractNetFindings_bn (net);
+
+			// Pack the distinct validation cases with a target finding (see blbn_pack_validation)
+			state->validation_plans = NULL;
+			state->eval_thread_count = 1;
+			state->score_thread_count = 1;
+			state->sfl_pair_samples = 0;
+			state->score_pattern_count = 0;
+			state->score_case_count = 0;
+			state->score_candidate_count = 0;
+			state->score_budget = 0.0;
+			state->score_cache_tolerance = -1.0;
+			state->score_cache_refresh = 0;
+			state->score_cache_kind = -1;
+			state->score_cache_age = 0;
+			state->score_cache = NULL;
+			state->score_cache_cpt = NULL;
+			state->score_cache_pattern = NULL;
+			state->sampled_validation_z = 0.0;
+			state->validation_order = NULL;
+			state->sampled_candidate_count = 0;
+			state->sampled_stopped_count = 0;
+			state->sampled_case_fraction = 0.0;
+			state->sfl_last_score = NULL;
+			state->sfl_lazy = 0;
+			state->sfl_heap = NULL;
+			state->sfl_heap_count = 0;
+			state->eval_schedule = BLBN_EVAL_SCHEDULE_ALL;
+			state->eval_interval = 1;
+			state->eval_list = NULL;
+			state->eval_list_count = 0;
+			state->sfl_abandoned_count = 0;
+			state->sfl_lookahead_count = 0;
+			state->sfl_lookahead_skipped = 0;
+			blbn_pack_validation (state);
+			printf ("Validation patterns: %u distinct of %u cases with a target finding\n", state->validation_packed_count, state->validation_tested_count);
+
+			// Initialize budget
+			state->budget = budget;
+			state->initial_budget = budget;
+
+			// Initialize select action sequence
+			state->sel_action_seq = NULL;
+
+			// Native inference is enabled separately (see blbn_enable_generated_inference and blbn_enable_likelihood_weighting)
+			state->inference = BLBN_INFERENCE_NETICA;
+			state->model = NULL;
+			state->model_plan = NULL;
+			state->generated = NULL;
+			state->lw = NULL;
+			state->bp = NULL;
+			state->slice_cache = NULL;
+			state->model_lambda = NULL;
+			state->model_evidence_key = 0;
+			state->model_dirty = (unsigned int *) malloc (BLBN_BITSET_WORDS (state->node_count) * sizeof (unsigned int));
+			state->cpt_clock = 0;
+			state->cpt_version = (unsigned long *) malloc (state->node_count * sizeof (unsigned long));
+			state->cpt_reference = (double **) calloc (state->node_count, sizeof (double *));
+			state->cpt_reference_version = (unsigned long *) calloc (state->node_count, sizeof (unsigned long));
+			blbn_mark_cpts_changed (state, -1);
+
+			// Initialize the target posterior cache (entries are filled on first use)
+			state->posterior_cache = (blbn_posterior_cache_entry_t *) calloc (state->case_count, sizeof (blbn_posterior_cache_entry_t));
+			state->posterior_cache_hits = 0;
+			state->posterior_cache_misses = 0;
+
+			// Scratch findings for batched evidence entry (see blbn_enter_net_findings)
+			state->net_findings = (int *) malloc (state->node_count * sizeof (int));
+
+			// Initialize compilation counters
+			state->compile_count = 0;
+			state->compile_avoided_count = 0;
+
+			// Initialize likelihood weighting statistics
+			state->lw_query_count = 0;
+			state->lw_stats.sample_count = 0;
+			state->lw_stats.std_error = 0.0;
+			state->lw_stats.seconds = 0.0;
+
+			// Initialize loopy belief propagation statistics
+			state->bp_query_count = 0;
+			state->bp_iteration_count = 0;
+			state->bp_max_iterations = 0;
+			state->bp_warm_count = 0;
+			state->bp_unconverged_count = 0;
+		}
+	}
+
+	DeleteStream_ns (data_stream); // added this... I think I should b/c of what I read in documentation
+
+	return state;
+}
+
+void blbn_free_state (blbn_state_t *state) {
+
+	int i;
+	blbn_select_action_t *action = NULL;
+
+	if (state != NULL) {
+		// Free node names
+		for (i = 0; i < state->node_count; i++) {
+			free (state->nodes [i]);
+		}
+		free (state->nodes);
+		free (state->node_name_buckets);
+		free (state->node_name_next);
+
+		// Free space occupied by state meta-data
+		for (i = 0; i < state->node_count; i++) {
+			free (state->state[i]); // m cases (rows)
+		}
+		free (state->state); // n states (columns)
+
+		// Free space occupied by flag meta-data
+		for (i = 0; i < state->node_count; i++) {
+			free (state->flags[i]); // m cases (rows)
+		}
+		free (state->flags); // n states (columns)
+
+		// Free space occupied by cost meta-data
+		for (i = 0; i < state->node_count; i++) {
+			free (state->cost[i]); // m cases (rows)
+		}
+		free (state->cost); // n states (columns)
+
+		// Free network structure and d-separation cache
+		blbn_free_graph (state);
+
+		// Free native model and inference engines
+		blbn_free_model (state);
+		free (state->model_dirty);
+		free (state->cpt_version);
+		blbn_free_net_cpts (state, state->cpt_reference);
+		free (state->cpt_reference_version);
+		for (i = 0; i < state->case_count; i++) {
+			free (state->posterior_cache[i].evidence);
+			free (state->posterior_cache[i].families);
+		}
+		free (state->posterior_cache);
+		free (state->net_findings);
+
+		// Free space occupied by validation data
+		for (i = 0; i < state->node_count; i++) {
+			free (state->validation_state[i]);
+		}
+		free (state->validation_state);
+		free (state->validation_packed);
+		free (state->validation_labels);
+		free (state->validation_weights);
+		free (state->validation_order);
+		free (state->eval_list);
+		if (state->sfl_last_score != NULL) {
+			for (i = 0; i < state->node_count; i++) {
+				free (state->sfl_last_score[i]);
+			}
+			free (state->sfl_last_score);
+		}
+		blbn_free_score_cache (state);
+		free (state->sfl_heap);
+
+		// Free space occupied by Netica structures
+		action = state->sel_action_seq;
+		i = 0;
+		while (action != NULL) {
+			if (action->next != NULL) { // this is not the tail, b/c has next action
+				//printf ("deleting action %d\n", i);
+				action = action->next;
+				free (action->prev);
+				action->prev = NULL;
+			} else { // this is the tail action, so just delete the action
+				//printf ("deleting action %d\n", i);
+				free (action);
+				action = NULL;
+			}
+			i++;
+		}
+
+		// Finally, free the structure
+		free (state);
+		state = NULL;
+	}
+
+	// Close files pointers
+	fclose (graph_fp);
+	fclose (log_fp);
+}
+
+/**
+ * Learns all using basic Netica-supplied template function.
+ */
+void blbn_learn_all_v0 (stream_ns *casefile, net_bn *net, nodelist_bn *nodes, caseposn_bn *case_posn) {
+
+	// Set initial case position
+	if (case_posn == NULL) {
+		*case_posn = FIRST_CASE;
+	}
+
+	// Iterates through cases, sets findings in each case, and updates
+	// CPTS to reflect the findings for each case.
+	if (case_posn != NULL) { // Makes sure case_posn isn't NULL
+		*case_posn = FIRST_CASE;
+		while (1) {
+			RetractNetFindings_bn (net); // Retracts all findings from net
+			ReadNetFindings_bn (case_posn, casefile, nodes, NULL, NULL);
+
+			if (*case_posn == NO_MORE_CASES)
+				break;
+
+			// NOTE: This is the network parameterization before updating
+
+			ReviseCPTsByFindings_bn (nodes, 0, 1.0); // Learn (not unlearn) --- Update CPTs of network based on findings on the network
+
+			// NOTE: This is the network parameterization after updating
+
+			*case_posn = NEXT_CASE;
+			//CHKERR // TODO: Update this error-handlinge code
+			if (GetError_ns (env, ERROR_ERR, NULL)) {
+				//goto error;
+			}
+		}
+	}
+}
+
+/**
+ * blbn_set_uniform_prior ()
+ *
+ * This function sets a uniform prior and sets all experience values to the
+ * specified experience value.  Experience values are set (to the specified
+ * value) for all states of all nodes under all parent state combinations.
+ *
+ * Notes:
+ * - If node experience values are specified explicitly, the nodes CPTs must
+ *   also be specified.  This is a Netica requirement (Netica C API Manual,
+ *   p. 49).
+ */
+void blbn_set_uniform_prior (blbn_state_t *state, double experience) {
+
+	int i,j,k,p,parent_index,parent_state_combo_index,parent_state_index;
+	nodelist_bn* nodes = NULL;
+	node_bn* node = NULL;
+	nodelist_bn* parents = NULL;
+	node_bn* parent = NULL;
+	int parent_state_combo_count = 0;
+	int **parent_state_combos = NULL;
+	int node_count = 0;
+	int node_state_index, node_state_count;
+	int pn, parent_count;
+	prob_bn* uniform;
+	state_bn* parent_states;
+	int periodicity;
+
+	int *parent_state_count = NULL;
+
+	nodes = DupNodeList_bn (GetNetNodes_bn (state->prior_net));
+	node_count = LengthNodeList_bn (nodes);
+
+	// Set conditional probability tables (CPTs) for each node
+	for (i = 0; i < node_count; i++) {
+		node = NthNode_bn (nodes, i);
+		node_state_count = GetNodeNumberStates_bn (node);
+		parent_count = LengthNodeList_bn (GetNodeParents_bn (node));
+		uniform = malloc (node_state_count * sizeof (prob_bn));
+		parent_states = malloc (parent_count * sizeof (state_bn));
+		for (node_state_index = 0; node_state_index < node_state_count; ++node_state_index)
+			uniform[node_state_index] = 1.0 / node_state_count;
+		for (parent_index = 0; parent_index < parent_count; ++parent_index)
+			parent_states[parent_index] = EVERY_STATE;
+		SetNodeProbs_bn (node, parent_states, uniform);
+		SetNodeExperience_bn (node, parent_states, experience); // Set experience for node
+		free (uniform);
+		free (parent_states);
+	}
+
+	/*
+	// Set equivalent sample size of CPTs for each node and parent combination
+	for (i = 0; i < node_count; i++) {
+		node = NthNode_bn (nodes, i);
+		node_state_count = GetNodeNumberStates_bn (node);
+		parents = GetNodeParents_bn (node);
+		parent_count = LengthNodeList_bn (parents);
+
+		// Check if node has no parents
+		if (parent_count == 0) {
+			// Pass null for second argument (the parent states) since there are no parents
+			SetNodeExperience_bn (node, NULL, experience);
+			printf ("node %s has zero parents\n", GetNodeName_bn (node));
+		}
+
+		// Check if node has parents (at least one)
+		else if (parent_count > 0) {
+
+			printf ("node %s has %d parents\n", GetNodeName_bn (node), parent_count);
+
+			// Store the number of states for each of current nodes' parents
+			parent_state_count = (int *) malloc (parent_count * sizeof (int));
+			for (j = 0; j < parent_count; j++) {
+				parent = NthNode_bn (parents, j);
+
+				// TODO: Return failure if allocation fails to make code more robust (maybe assert with error message)
+				parent_state_count[j] = GetNodeNumberStates_bn (parent) + 1; // TODO: Add one to this to account for NO_FINDING state?
+
+				// Calculate running total number of parent state combinations
+				if (j == 0) {
+					parent_state_combo_count = parent_state_count[j];
+				} else {
+					parent_state_combo_count *= parent_state_count[j];
+				}
+			}
+
+			// TODO: Allocate parent_state_combos array (parent combinations count * parent count)
+			parent_state_combos = (int **) malloc (parent_state_combo_count * sizeof (int *));
+			for (j = 0; j < parent_state_combo_count; j++) {
+				parent_state_combos[j] = (int *) malloc (parent_count * sizeof (int));
+			}
+
+			// Iteratively compute all parent state combinations
+			periodicity = 1;
+			for (parent_index = 0; parent_index < parent_count; parent_index++) {
+				//printf ("periodicity = %d\n", periodicity);
+				for (parent_state_combo_index = 0; parent_state_combo_index < parent_state_combo_count; ) {
+					for (parent_state_index = 0; parent_state_index < parent_state_count[parent_index]; parent_state_index++) {
+						for (p = 0; p < periodicity; p++) {
+							if (parent_state_index < (parent_state_count[parent_index] - 1)) {
+								parent_state_combos[parent_state_combo_index][parent_index] = parent_state_index;
+							} else {
+								parent_state_combos[parent_state_combo_index][parent_index] = NO_FINDING;
+							}
+							parent_state_combo_index++;
+						}
+					}
+				}
+
+				if (parent_index < parent_count - 1) {
+					periodicity = periodicity * parent_state_count[parent_index];
+				}
+			}
+
+			// Set prior equivalent sample size (i.e., experience)
+			for (parent_state_combo_index = 0; parent_state_combo_index < parent_state_combo_count; parent_state_combo_index++) {
+				for (parent_index = 0; parent_index < parent_count; parent_index++) {
+					printf ("%d ", parent_state_combos[parent_state_combo_index][parent_index]);
+				}
+				printf ("\n");
+
+				// for ( each state of the node with the parents )
+				for (k = 0; k < node_state_count; k++) {
+					SetNodeExperience_bn (node, parent_state_combos[parent_state_combo_index], experience);
+				}
+			}
+
+
+//			// Try this on for size! (Netica's way)
+//			parent_states = (int *) malloc (parent_count * sizeof (int));
+//			for (j = 0; j < parent_count; j++) {
+//				parent = NthNode_bn (parents, j);
+//				parent_states[j] = EVERY_STATE;
+//			}
+//			SetNodeExperience_bn (node, parent_states, experience);
+
+
+			free (parent_state_count);
+
+			for (k = 0; k < parent_count; k++) {
+				free (parent_state_combos[k]);
+			}
+			free (parent_state_combos);
+		}
+	}
+	*/
+
+	/*
+	// Perform initial revision, just to initialize all tables
+	RetractNetFindings_bn (state->prior_net);
+	ReviseCPTsByFindings_bn (nodes, 0, 1.0);
+	*/
+
+	// Replace working network with the prior network
+	blbn_delete_net (state->work_net);
+	state->work_net = blbn_util_copy_net (state, state->prior_net);
+	blbn_mark_cpts_changed (state, -1);
+
+	DeleteNodeList_bn (nodes);
+}
+
+/**
+ * Sets distribution for target node using the target values
+ * for each combination of attributes.  The equivalent sample size of each of
+ * these observations is set the the specified ESS value.
+ */
+void blbn_learn_targets (blbn_state_t *state, double ess) {
+
+	// TODO: Implement this algorithm.
+
+}
+
+char blbn_is_valid_node (blbn_state_t *state, unsigned int node_index) {
+	if (node_index < state->node_count) {
+		return 0x01;
+	}
+	return 0x00;
+}
+
+char blbn_is_valid_case (blbn_state_t *state, unsigned int case_index) {
+	if (case_index < state->case_count) {
+		return 0x01;
+	}
+	return 0x00;
+}
+
+char blbn_is_valid_finding (blbn_state_t *state, unsigned int node_index, unsigned int case_index) {
+	if (node_index < state->node_count && case_index < state->case_count) {
+		return 0x01;
+	}
+	return 0x00;
+}
+
+char blbn_is_target_finding (blbn_state_t *state, unsigned int node_index, unsigned int case_index) {
+	if (blbn_is_valid_finding (state, node_index, case_index)) {
+		return ((state->flags[node_index][case_index] & BLBN_METADATA_FLAG_TARGET) == BLBN_METADATA_FLAG_TARGET ? 0x01 : 0x00);
+	}
+	return 0x00;
+}
+
+/**
+ * Determines whether or not the node with the specified index node_index is a
+ * target node.
+ */
+int blbn_is_target_node (blbn_state_t *state, unsigned int node_index) {
+	if (state != NULL) {
+		if (node_index == state->target) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/**
+ * Determines whether or not the node with the specified index node_index is a
+ * non-target node.
+ */
+int blbn_is_non_target_node (blbn_state_t *state, unsigned int node_index) {
+	if (state != NULL) {
+		if (node_index != state->target) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+char blbn_is_purchased_finding (blbn_state_t *state, unsigned int node_index, unsigned int case_index) {
+	if (blbn_is_valid_finding (state, node_index, case_index)) {
+		return ((state->flags[node_index][case_index] & BLBN_METADATA_FLAG_PURCHASED) == BLBN_METADATA_FLAG_PURCHASED ? 0x01 : 0x00);
+	}
+	return 0x00;
+}
+
+// Returns true if is target or purchased
+char blbn_is_available_finding (blbn_state_t *state, unsigned int node_index, unsigned int case_index) {
+	if (state != NULL) {
+		if (blbn_is_valid_finding (state, node_index, case_index)) {
+			//if (blbn_is_target_finding (state, node_index, case_index) || blbn_is_purchased_finding (state, node_index, case_index)) {
+			if (blbn_is_target_finding (state, node_index, case_index) || blbn_is_purchased_finding (state, node_index, case_index)) {
+				return 0x01;
+			}
+		}
+	}
+	return 0x00;
+}
+
+/**
+ * Checks if the specified node has a finding (i.e., if the node has been
+ * instantiated with a value; if the node has been assigned a value).
+ */
+int blbn_has_finding_set (blbn_state_t *state, unsigned node_index) {
+	node_bn *node;
+	state_bn node_finding = NO_FINDING;
+	if (state != NULL) {
+		node = blbn_get_work_node (state, node_index);
+		if (node != NULL) {
+			node_finding = GetNodeFinding_bn (node); // Get finding for specified node (if any)
+			if (node_finding >= 0) { // Check if the specified node has a finding
+				return 1; // Return true if node has a finding (i.e., it has been instantiated with or assigned a value)
+			}
+		}
+	}
+	return 0;
+}
+
+char blbn_is_learned_finding (blbn_state_t *state, unsigned int node_index, unsigned int case_index) {
+	if (blbn_is_valid_finding (state, node_index, case_index)) {
+		return ((state->flags[node_index][case_index] & BLBN_METADATA_FLAG_LEARNED) == BLBN_METADATA_FLAG_LEARNED ? 0x01 : 0x00);
+	}
+	return 0x00;
+}
+
+char blbn_has_cases_available (blbn_state_t *state, unsigned int node_index) {
+	int i;
+	if (state != NULL) {
+		if (blbn_is_valid_node (state, node_index)) {
+			for (i = 0; i < state->case_count; ++i) {
+				//printf ("case %d avail?: %d\n", i, blbn_is_available_finding (state, node_index, i));
+				if (blbn_is_available_finding (state, node_index, i)) {
+					return 0x01;
+				}
+			}
+		}
+	}
+	return 0x00;
+}
+
+char blbn_has_findings_available_in_case (blbn_state_t *state, unsigned int case_index) {
+	int i;
+	if (state != NULL) {
+		if (blbn_is_valid_case (state, case_index)) {
+			for (i = 0; i < state->node_count; ++i) {
+				if (blbn_is_available_finding (state, i, case_index)) {
+					return 0x01;
+				}
+			}
+		}
+	}
+	return 0x00;
+}
+
+char blbn_has_findings_learned_in_case (blbn_state_t *state, unsigned int case_index) {
+	int i;
+	if (state != NULL) {
+		if (blbn_is_valid_case (state, case_index)) {
+			for (i = 0; i < state->node_count; ++i) {
+				if (blbn_is_learned_finding (state, i, case_index)) {
+					return 0x01;
+				}
+			}
+		}
+	}
+	return 0x00;
+}
+
+char blbn_has_cases_purchased (blbn_state_t *state, unsigned int node_index) {
+	int i;
+	if (state != NULL) {
+		if (blbn_is_valid_node (state, node_index)) {
+			for (i = 0; i < state->case_count; ++i) {
+				if (blbn_is_purchased_finding (state, node_index, i)) {
+					return 0x01;
+				}
+			}
+		}
+	}
+	return 0x00;
+}
+
+char blbn_has_cases_not_purchased (blbn_state_t *state, unsigned int node_index) {
+	int i;
+	if (state != NULL) {
+		if (blbn_is_valid_node (state, node_index)) {
+			for (i = 0; i < state->case_count; ++i) {
+				if (!blbn_is_purchased_finding (state, node_index, i)) {
+					return 0x01;
+				}
+			}
+		}
+	}
+	return 0x00;
+}
+
+char blbn_has_cases_learned (blbn_state_t *state, unsigned int node_index) {
+	int i;
+	if (state != NULL) {
+		if (blbn_is_valid_node (state, node_index)) {
+			for (i = 0; i < state->case_count; ++i) {
+				if (blbn_is_learned_finding (state, node_index, i)) {
+					return 0x01;
+				}
+			}
+		}
+	}
+	return 0x00;
+}
+
+char blbn_has_cases_not_learned (blbn_state_t *state, unsigned int node_index) {
+	int i;
+	if (state != NULL) {
+		if (blbn_is_valid_node (state, node_index)) {
+			for (i = 0; i < state->case_count; ++i) {
+				if (!blbn_is_learned_finding (state, node_index, i)) {
+					return 0x01;
+				}
+			}
+		}
+	}
+	return 0x00;
+}
+
+char blbn_has_findings_learned (blbn_state_t *state, unsigned int case_index) {
+	int i;
+	if (state != NULL) {
+		if (blbn_is_valid_case (state, case_index)) {
+			for (i = 0; i < state->node_count; ++i) {
+				if (blbn_is_learned_finding (state, i, case_index)) {
+					return 0x01;
+				}
+			}
+		}
+	}
+	return 0x00;
+}
+
+char blbn_has_findings_not_learned (blbn_state_t *state, unsigned int case_index) {
+	int i;
+	if (state != NULL) {
+		if (blbn_is_valid_case (state, case_index)) {
+			for (i = 0; i < state->node_count; ++i) {
+				if (!blbn_is_learned_finding (state, i, case_index)) {
+					return 0x01;
+				}
+			}
+		}
+	}
+	return 0x00;
+}
+
+char blbn_has_findings_available_not_learned (blbn_state_t *state, unsigned int case_index) {
+	int i;
+	if (state != NULL) {
+		if (blbn_is_valid_case (state, case_index)) {
+			for (i = 0; i < state->node_count; ++i) {
+				if (blbn_is_available_finding (state, i, case_index)) {
+					if (!blbn_is_learned_finding (state, i, case_index)) {
+						return 0x01;
+					}
+				}
+			}
+		}
+	}
+	return 0x00;
+}
+
+char blbn_has_findings_purchased (blbn_state_t *state) {
+	int i;
+	if (state != NULL) {
+		for (i = 0; i < state->case_count; ++i) {
+			if (blbn_has_findings_purchased_in_case (state, i)) {
+				return 0x01;
+			}
+		}
+	}
+	return 0x00;
+}
+
+char blbn_has_findings_available (blbn_state_t *state) {
+	int i,j;
+	if (state != NULL) {
+		for (j = 0; j < state->case_count; ++j) {
+			for (i = 0; i < state->node_count; ++i) {
+				if (blbn_is_purchased_finding (state, i, j) || blbn_is_target_finding (state, i, j)) {
+					return 0x01;
+				}
+			}
+		}
+	}
+	return 0x00;
+}
+
+/**
+ * Returns true if at least one finding exists that is not purchased and is not a
+ * finding for the target node.
+ */
+char blbn_has_findings_not_available (blbn_state_t *state) {
+	int i,j;
+	if (state != NULL) {
+		for (j = 0; j < state->case_count; ++j) {
+			for (i = 0; i < state->node_count; ++i) {
+				if (!blbn_is_purchased_finding (state, i, j) && !blbn_is_target_finding (state, i, j)) {
+					return 0x01;
+				}
+			}
+		}
+	}
+	return 0x00;
+}
+
+char blbn_has_findings_not_purchased (blbn_state_t *state) {
+	int i;
+	if (state != NULL) {
+		for (i = 0; i < state->case_count; ++i) {
+			if (blbn_has_findings_not_purchased_in_case (state, i)) {
+				return 0x01;
+			}
+		}
+	}
+	return 0x00;
+}
+
+char blbn_has_findings_purchased_in_case (blbn_state_t *state, unsigned int case_index) {
+	int i;
+	if (state != NULL) {
+		if (blbn_is_valid_case (state, case_index)) {
+			for (i = 0; i < state->node_count; ++i) {
+				if (blbn_is_purchased_finding (state, i, case_index)) {
+					return 0x01;
+				}
+			}
+		}
+	}
+	return 0x00;
+}
+
+char blbn_has_findings_not_purchased_in_case (blbn_state_t *state, unsigned int case_index) {
+	int i;
+	if (state != NULL) {
+		if (blbn_is_valid_case (state, case_index)) {
+			for (i = 0; i < state->node_count; ++i) {
+				if (!blbn_is_purchased_finding (state, i, case_index)) {
+					return 0x01;
+				}
+			}
+		}
+	}
+	return 0x00;
+}
+
+int blbn_get_node_finding (blbn_state_t *state, unsigned int node_index, unsigned int case_index) {
+	if (node_index < state->node_count && case_index < state->case_count) {
+		return state->state [node_index][case_index];
+	}
+	return -1;
+}
+
+char* blbn_get_node_name (blbn_state_t *state, unsigned int node_index) {
+	if (state != NULL) {
+		if (blbn_is_valid_node (state, node_index)) {
+			return state->nodes[node_index];
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Return the index of the node with the specified name.
+ */
+int blbn_get_node_index (blbn_state_t *state, char* node_name) {
+	int i;
+	if (state != NULL && node_name != NULL) {
+		for (i = state->node_name_buckets[blbn_hash_node_name (state, node_name)]; i != -1; i = state->node_name_next[i]) {
+			if (strcmp (state->nodes[i], node_name) == 0) {
+				return i;
+			}
+		}
+	}
+	return -1;
+}
+
+/**
+ * Returns node index from static ordering in meta-data structure with the
+ * specified name.  If the name isn't in the list, then -1 is returned.
+ */
+int blbn_get_node_by_name (blbn_state_t *state, char *name) {
+	return blbn_get_node_index (state, name);
+}
+
+/**
+ * Returns the blbn data of the specified network (kept in the network's user
+ * data), creating it the first time it is requested for the network.  A copy
+ * of a network gets a new address, so the data of the original is never
+ * mistaken for that of the copy even if Netica copies the user data.
+ * Networks with data must be deleted with blbn_delete_net.
+ */
+blbn_net_data_t* blbn_get_net_data (blbn_state_t *state, net_bn *net) {
+	blbn_net_data_t *data = NULL;
+
+	data = (blbn_net_data_t *) GetNetUserData_bn (net, BLBN_NET_USER_DATA);
+	if (data != NULL && data->net == net) {
+		return data;
+	}
+
+	data = (blbn_net_data_t *) malloc (sizeof (blbn_net_data_t));
+	data->net = net;
+	data->nodes = NULL;
+	data->compiled = 0;
+	SetNetUserData_bn (net, BLBN_NET_USER_DATA, data);
+
+	return data;
+}
+
+/**
+ * Returns the handle table of the specified network: the node of the network
+ * with each index in the static ordering.  The table is built (by name) the
+ * first time it is requested for a network, so later node lookups on the
+ * network take constant time.
+ */
+node_bn** blbn_get_net_nodes (blbn_state_t *state, net_bn *net) {
+	blbn_net_data_t *data = NULL;
+	const nodelist_bn *nodes = NULL;
+	node_bn *node = NULL;
+	int i, j;
+
+	data = blbn_get_net_data (state, net);
+	if (data->nodes != NULL) {
+		return data->nodes;
+	}
+
+	data->nodes = (node_bn **) calloc (state->node_count > 0 ? state->node_count : 1, sizeof (node_bn *));
+
+	nodes = GetNetNodes_bn (net);
+	for (i = 0; i < LengthNodeList_bn (nodes); ++i) {
+		node = NthNode_bn (nodes, i);
+		j = blbn_get_node_index (state, GetNodeName_bn (node));
+		if (j != -1) {
+			data->nodes[j] = node;
+		}
+	}
+
+	return data->nodes;
+}
+
+/**
+ * Returns the node of the specified network with the specified index in the
+ * static ordering (NULL if the index is not valid).
+ */
+node_bn* blbn_get_net_node (blbn_state_t *state, net_bn *net, int node_index) {
+	if (state != NULL && net != NULL) {
+		if (blbn_is_valid_node (state, node_index)) {
+			return blbn_get_net_nodes (state, net)[node_index];
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Returns the node of the working network with the specified index in the
+ * static ordering (NULL if the index is not valid).
+ */
+node_bn* blbn_get_work_node (blbn_state_t *state, int node_index) {
+	return blbn_get_net_node (state, state->work_net, node_index);
+}
+
+/**
+ * Deletes the specified network and its blbn data (if any).
+ */
+void blbn_delete_net (net_bn *net) {
+	blbn_net_data_t *data = NULL;
+
+	data = (blbn_net_data_t *) GetNetUserData_bn (net, BLBN_NET_USER_DATA);
+	if (data != NULL && data->net == net) {
+		free (data->nodes);
+		free (data);
+	}
+
+	DeleteNet_bn (net);
+}
+
+/**
+ * Computes the nodes that are d-separated from the node with the specified
+ * index given the instantiated nodes in the evidence bitset.  This is a
+ * Bayes-ball (reachability) pass over the network structure: a ball is passed
+ * up from the node of interest, and passes through unobserved nodes in either
+ * direction, bounces back up from observed nodes (or nodes with an observed
+ * descendant) reached from a parent, and is blocked otherwise.  Every
+ * uninstantiated node the ball never reaches is d-separated.
+ *
+ * The evidence and separated bitsets hold BLBN_BITSET_WORDS (node_count)
+ * words.  A bit is set in separated for every uninstantiated node (other than
+ * node_index) that is d-separated from node_index.
+ */
+void blbn_get_d_separated_nodes_given_evidence (blbn_state_t *state, unsigned int node_index, const unsigned int *evidence, unsigned int *separated) {
+
+	int words = BLBN_BITSET_WORDS (state->node_count);
+	unsigned int *ancestors = NULL; // Instantiated nodes and their ancestors
+	unsigned int *visited_up = NULL; // Nodes the ball has reached from a child
+	unsigned int *visited_down = NULL; // Nodes the ball has reached from a parent
+	unsigned int *reachable = NULL; // Uninstantiated nodes the ball has reached
+	int *stack = NULL;
+	int stack_size = 0;
+	int i, p, node, direction;
+
+	ancestors    = (unsigned int *) calloc (words, sizeof (unsigned int));
+	visited_up   = (unsigned int *) calloc (words, sizeof (unsigned int));
+	visited_down = (unsigned int *) calloc (words, sizeof (unsigned int));
+	reachable    = (unsigned int *) calloc (words, sizeof (unsigned int));
+	stack        = (int *) malloc (2 * state->node_count * sizeof (int));
+
+	// Mark instantiated nodes and all of their ancestors
+	for (i = 0; i < state->node_count; ++i) {
+		if (BLBN_BITSET_TEST (evidence, i) && !BLBN_BITSET_TEST (ancestors, i)) {
+			BLBN_BITSET_SET (ancestors, i);
+			stack[stack_size++] = i;
+		}
+	}
+	while (stack_size > 0) {
+		node = stack[--stack_size];
+		for (p = 0; p < state->parent_count[node]; ++p) {
+			if (!BLBN_BITSET_TEST (ancestors, state->parents[node][p])) {
+				BLBN_BITSET_SET (ancestors, state->parents[node][p]);
+				stack[stack_size++] = state->parents[node][p];
+			}
+		}
+	}
+
+	// Pass the ball from the node of interest (stack entries are node * 2 + direction, where 0 is up and 1 is down)
+	BLBN_BITSET_SET (visited_up, node_index);
+	stack[stack_size++] = node_index * 2;
+	while (stack_size > 0) {
+		node = stack[--stack_size] / 2;
+		direction = stack[stack_size] % 2;
+
+		if (!BLBN_BITSET_TEST (evidence, node)) {
+			BLBN_BITSET_SET (reachable, node);
+		}
+
+		if (direction == 0 && !BLBN_BITSET_TEST (evidence, node)) {
+			// Arrived from a child at an unobserved node, so pass to parents and children
+			for (p = 0; p < state->parent_count[node]; ++p) {
+				i = state->parents[node][p];
+				if (!BLBN_BITSET_TEST (visited_up, i)) {
+					BLBN_BITSET_SET (visited_up, i);
+					stack[stack_size++] = i * 2;
+				}
+			}
+			for (p = 0; p < state->child_count[node]; ++p) {
+				i = state->children[node][p];
+				if (!BLBN_BITSET_TEST (visited_down, i)) {
+					BLBN_BITSET_SET (visited_down, i);
+					stack[stack_size++] = i * 2 + 1;
+				}
+			}
+		} else if (direction == 1) {
+			// Arrived from a parent, so pass through to children if unobserved...
+			if (!BLBN_BITSET_TEST (evidence, node)) {
+				for (p = 0; p < state->child_count[node]; ++p) {
+					i = state->children[node][p];
+					if (!BLBN_BITSET_TEST (visited_down, i)) {
+						BLBN_BITSET_SET (visited_down, i);
+						stack[stack_size++] = i * 2 + 1;
+					}
+				}
+			}
+			// ...and bounce back up to parents if the node or a descendant is observed (v-structure)
+			if (BLBN_BITSET_TEST (ancestors, node)) {
+				for (p = 0; p < state->parent_count[node]; ++p) {
+					i = state->parents[node][p];
+					if (!BLBN_BITSET_TEST (visited_up, i)) {
+						BLBN_BITSET_SET (visited_up, i);
+						stack[stack_size++] = i * 2;
+					}
+				}
+			}
+		}
+	}
+
+	// Every uninstantiated node that was not reached is d-separated
+	memset (separated, 0, words * sizeof (unsigned int));
+	for (i = 0; i < state->node_count; ++i) {
+		if (i != node_index && !BLBN_BITSET_TEST (evidence, i) && !BLBN_BITSET_TEST (reachable, i)) {
+			BLBN_BITSET_SET (separated, i);
+		}
+	}
+
+	free (ancestors);
+	free (visited_up);
+	free (visited_down);
+	free (reachable);
+	free (stack);
+}
+
+/**
+ * Returns a bitset of the nodes d-separated from the target node given the
+ * learned non-target findings in the specified case.  Since d-separation
+ * depends only on the network structure and on which nodes are instantiated,
+ * results are cached by evidence pattern and shared by all cases (and all
+ * iterations) with the same pattern.  The returned bitset is owned by the
+ * cache and must not be freed.
+ */
+const unsigned int* blbn_get_d_separated_from_target_in_case (blbn_state_t *state, unsigned int case_index) {
+
+	int words = BLBN_BITSET_WORDS (state->node_count);
+	unsigned int *evidence = NULL;
+	unsigned int hash = 2166136261u;
+	blbn_dsep_cache_entry_t *entry = NULL;
+	int i;
+
+	// Get the evidence pattern of the case
+	evidence = (unsigned int *) calloc (words, sizeof (unsigned int));
+	for (i = 0; i < state->node_count; ++i) {
+		if (i != state->target && blbn_is_learned_finding (state, i, case_index)) {
+			BLBN_BITSET_SET (evidence, i);
+		}
+	}
+
+	// Look up the evidence pattern in the cache
+	for (i = 0; i < words; ++i) {
+		hash = (hash ^ evidence[i]) * 16777619u;
+	}
+	hash %= BLBN_DSEP_CACHE_SIZE;
+
+	for (entry = state->dsep_cache[hash]; entry != NULL; entry = entry->next) {
+		if (memcmp (entry->evidence, evidence, words * sizeof (unsigned int)) == 0) {
+			state->dsep_cache_hits++;
+			free (evidence);
+			return entry->separated;
+		}
+	}
+
+	// Compute and cache the d-separated nodes for the evidence pattern
+	state->dsep_cache_misses++;
+	entry = (blbn_dsep_cache_entry_t *) malloc (sizeof (blbn_dsep_cache_entry_t));
+	entry->evidence = evidence;
+	entry->separated = (unsigned int *) malloc (words * sizeof (unsigned int));
+	blbn_get_d_separated_nodes_given_evidence (state, state->target, evidence, entry->separated);
+	entry->next = state->dsep_cache[hash];
+	state->dsep_cache[hash] = entry;
+
+	return entry->separated;
+}
+
+/**
+ * Returns a bitset of the nodes in the working network that have findings.
+ */
+unsigned int* blbn_get_net_evidence (blbn_state_t *state) {
+
+	const nodelist_bn *nodes = GetNetNodes_bn (state->work_net);
+	unsigned int *evidence = NULL;
+	int i;
+
+	evidence = (unsigned int *) calloc (BLBN_BITSET_WORDS (state->node_count), sizeof (unsigned int));
+	for (i = 0; i < state->node_count; ++i) {
+		if (GetNodeFinding_bn (NthNode_bn (nodes, i)) >= 0) {
+			BLBN_BITSET_SET (evidence, i);
+		}
+	}
+
+	return evidence;
+}
+
+/**
+ * Returns an array of the node indices from the static ordering of nodes in
+ * the state data structure that are d-separated from the node with the
+ * specified index, given the findings presently entered in the working
+ * network.  Instantiated nodes are not included (they are the d-separating
+ * nodes, not d-separated nodes).
+ *
+ * Note that this function allocates new memory for storing the indices of the
+ * nodes that are d-separated, which must be freed by the caller.
+ */
+int blbn_get_d_separated_nodes (blbn_state_t *state, unsigned int node_index, int **d_separated_node_indices) {
+
+	int i;
+	int d_separated_node_count = 0;
+	unsigned int *evidence = NULL;
+	unsigned int *separated = NULL;
+
+	// NOTE: Assume that the nodes that should be instantiated are instantiated before calling this function.
+	evidence = blbn_get_net_evidence (state);
+	separated = (unsigned int *) malloc (BLBN_BITSET_WORDS (state->node_count) * sizeof (unsigned int));
+	blbn_get_d_separated_nodes_given_evidence (state, node_index, evidence, separated);
+
+	// Create an array with indices of d-separated nodes
+	*d_separated_node_indices = (int *) malloc (state->node_count * sizeof (int));
+	for (i = 0; i < state->node_count; ++i) {
+		if (BLBN_BITSET_TEST (separated, i)) {
+			(*d_separated_node_indices)[d_separated_node_count++] = i;
+		}
+	}
+
+	free (evidence);
+	free (separated);
+
+	return d_separated_node_count;
+}
+
+/**
+ * Returns an array of the node indices from the static ordering of nodes in
+ * the state data structure that are d-separated from the node with the
+ * specified index, given the findings presently entered in the working
+ * network, together with the instantiated (d-separating) nodes.
+ *
+ * Note that this function allocates new memory for storing the indices of the
+ * nodes that are d-separated, which must be freed by the caller.
+ */
+int blbn_get_d_separated_nodes_and_separating_nodes (blbn_state_t *state, unsigned int node_index, int **d_separated_node_indices) {
+
+	int i;
+	int d_separated_node_count = 0;
+	unsigned int *evidence = NULL;
+	unsigned int *separated = NULL;
+
+	evidence = blbn_get_net_evidence (state);
+	separated = (unsigned int *) malloc (BLBN_BITSET_WORDS (state->node_count) * sizeof (unsigned int));
+	blbn_get_d_separated_nodes_given_evidence (state, node_index, evidence, separated);
+
+	// Create an array with indices of d-separated and instantiated nodes
+	*d_separated_node_indices = (int *) malloc (state->node_count * sizeof (int));
+	for (i = 0; i < state->node_count; ++i) {
+		if (i != node_index && (BLBN_BITSET_TEST (separated, i) || BLBN_BITSET_TEST (evidence, i))) {
+			(*d_separated_node_indices)[d_separated_node_count++] = i;
+		}
+	}
+
+	free (evidence);
+	free (separated);
+
+	return d_separated_node_count;
+}
+
+void blbn_set_finding_target (blbn_state_t *state, unsigned int node_index, unsigned int case_index) {
+	if (blbn_is_valid_finding (state, node_index, case_index)) {
+		state->flags[node_index][case_index] |= BLBN_METADATA_FLAG_TARGET;
+	}
+}
+
+void blbn_set_finding_not_target (blbn_state_t *state, unsigned int node_index, unsigned int case_index) {
+	if (blbn_is_valid_finding (state, node_index, case_index)) {
+		state->flags[node_index][case_index] &= ~BLBN_METADATA_FLAG_TARGET;
+	}
+}
+
+void blbn_set_finding_purchased (blbn_state_t *state, unsigned int node_index, unsigned int case_index) {
+	if (blbn_is_valid_finding (state, node_index, case_index)) {
+		state->flags[node_index][case_index] |= BLBN_METADATA_FLAG_PURCHASED;
+	}
+}
+
+void blbn_set_finding_not_purchased (blbn_state_t *state, unsigned int node_index, unsigned int case_index) {
+	if (blbn_is_valid_finding (state, node_index, case_index)) {
+		state->flags[node_index][case_index] &= ~BLBN_METADATA_FLAG_PURCHASED;
+	}
 }
 
 void blbn_set_finding_learned (blbn_state_t *state, unsigned int node_index, unsigned int case_index) {
@@ -1085,18 +2621,13 @@ void blbn_set_finding_not_learned (blbn_state_t *state, unsigned int node_index,
  */
 void blbn_set_node_finding_if_available (blbn_state_t *state, int node_index, int case_index) {
 
-	char *node_name = NULL;
 	node_bn *node = NULL;
 	int node_state = -1; // NOTE: typedef state_bn int; (so using int is fine)
 
 	if (state != NULL) {
 		if (state->work_net != NULL) {
-			// Get the node:
-			// 1. Get node name by indexing into mmodel
-			// 2. Get node by name from net_bn, if prev. step succeeded
-			// 3. Set state of node
-			node_name = blbn_get_node_name (state, node_index);
-			node = GetNodeNamed_bn (node_name, state->work_net);
+			// Get the node by its index, then set its state
+			node = blbn_get_work_node (state, node_index);
 
 			RetractNodeFindings_bn (node); // Retract node findings
 
@@ -1128,14 +2659,12 @@ void blbn_retract_findings (blbn_state_t *state) {
  */
 void blbn_retract_findings_not_target (blbn_state_t *state) {
 	int i;
-	char *node_name = NULL;
 	node_bn *node = NULL;
 	if (state != NULL) {
 		for (i = 0; i < state->node_count; ++i) {
 			if (!blbn_is_target_node (state, i)) {
 				// Get the node by with the specified index
-				node_name = blbn_get_node_name (state, i);
-				node = GetNodeNamed_bn (node_name, state->work_net);
+				node = blbn_get_work_node (state, i);
 
 				// Retract node findings (if any)
 				RetractNodeFindings_bn (node);
@@ -1150,14 +2679,12 @@ void blbn_retract_findings_not_target (blbn_state_t *state) {
  */
 void blbn_assert_node_finding (blbn_state_t *state, int node_index, int state_index) {
 
-	char *node_name = NULL;
 	node_bn *node = NULL;
 
 	if (state != NULL) {
 		if (state->work_net != NULL) {
 			// Get the node by with the specified index
-			node_name = blbn_get_node_name (state, node_index);
-			node = GetNodeNamed_bn (node_name, state->work_net);
+			node = blbn_get_work_node (state, node_index);
 
 			// Retract node findings (if any)
 			RetractNodeFindings_bn (node);
@@ -1177,14 +2704,12 @@ void blbn_assert_node_finding (blbn_state_t *state, int node_index, int state_in
  */
 void blbn_assert_node_finding_for_case (blbn_state_t *state, int node_index, int case_index, int state_index) {
 
-	char *node_name = NULL;
 	node_bn *node = NULL;
 
 	if (state != NULL) {
 		if (state->work_net != NULL) {
 			// Get the node by with the specified index
-			node_name = blbn_get_node_name (state, node_index);
-			node = GetNodeNamed_bn (node_name, state->work_net);
+			node = blbn_get_work_node (state, node_index);
 
 			// Retract node findings (if any)
 			RetractNodeFindings_bn (node);
@@ -1200,7 +2725,6 @@ void blbn_assert_node_finding_for_case (blbn_state_t *state, int node_index, int
 
 char blbn_has_parents_with_findings (blbn_state_t *state, int node_index, int case_index) {
 
-	char *node_name = NULL;
 	node_bn *node = NULL;
 	node_bn *parent = NULL;
 	nodelist_bn *parents = NULL;
@@ -1214,8 +2738,7 @@ char blbn_has_parents_with_findings (blbn_state_t *state, int node_index, int ca
 	*/
 
 	// Get the node
-	node_name = blbn_get_node_name (state, node_index);
-	node = GetNodeNamed_bn (node_name, state->work_net);
+	node = blbn_get_work_node (state, node_index);
 
 	// Get node's parents
 	parents = GetNodeParents_bn (node);
@@ -1242,94 +2765,102 @@ char blbn_has_parents_with_findings (blbn_state_t *state, int node_index, int ca
 }
 
 /**
- * Sets available findings in the specified case.
+ * Enters a batch of findings into the specified network as one transaction:
+ * all findings are retracted and findings[i] (if not -1) is entered as the
+ * finding of the node with static index i.  Auto-update is off for every
+ * network of the library (see blbn_util_copy_net), so Netica propagates the
+ * batch once, when the first belief is read, instead of after every finding.
  */
-void blbn_set_net_findings (blbn_state_t *state, int case_index) {
+void blbn_enter_net_findings (blbn_state_t *state, net_bn *net, const int *findings) {
 
 	int i;
+	node_bn **handles = NULL;
 
-	RetractNetFindings_bn (state->work_net); // Retracts all findings from net
+	handles = blbn_get_net_nodes (state, net);
 
-	for (i = 0; i < state->node_count; ++i) {
-		blbn_set_node_finding_if_available (state, i, case_index);
-	}
-}
-
-void blbn_set_net_findings_learned (blbn_state_t *state, int case_index) {
-
-	int i;
-
-	RetractNetFindings_bn (state->work_net); // Retracts all findings from net
+	RetractNetFindings_bn (net); // Retracts all findings from net
 
 	for (i = 0; i < state->node_count; ++i) {
-		if (blbn_is_learned_finding (state, i, case_index)) {
-			blbn_set_node_finding_if_available (state, i, case_index);
+		if (findings[i] != -1) {
+			EnterFinding_bn (handles[i], findings[i]);
 		}
 	}
 }
 
 /**
- * Sets all learned findings for the case except that for the the finding for
- * the target node.
+ * Collects the findings of the specified case into findings (e.g.,
+ * state->net_findings, for blbn_enter_net_findings).  A finding is collected if it is known and
+ * available, has every flag in required_flags, does not belong to except_node
+ * and, if with_parents is non-zero, the findings of all of the node's parents
+ * that precede it in the static ordering have been collected (i.e., nodes are
+ * checked in the same order as they used to be entered into the network).
  */
-void blbn_set_net_findings_learned_except_target (blbn_state_t *state, int case_index) {
+static void blbn_collect_case_findings (blbn_state_t *state, int *findings, int case_index, unsigned int required_flags, int except_node, char with_parents) {
 
-	int i;
+	int i, p;
+	int finding;
 
-	RetractNetFindings_bn (state->work_net); // Retracts all findings from net
+	for (i = 0; i < state->node_count; ++i) {
+		findings[i] = -1;
+	}
 
 	for (i = 0; i < state->node_count; ++i) {
-		if (blbn_is_learned_finding (state, i, case_index)) {
-			if (!blbn_is_target_finding(state, i, case_index)) {
-				blbn_set_node_finding_if_available (state, i, case_index);
+		if (i == except_node || !blbn_is_available_finding (state, i, case_index)) {
+			continue;
+		}
+		if ((state->flags[i][case_index] & required_flags) != required_flags) {
+			continue;
+		}
+		finding = blbn_get_node_finding (state, i, case_index);
+		if (with_parents) {
+			for (p = 0; p < state->parent_count[i]; ++p) {
+				if (findings[state->parents[i][p]] == -1) {
+					break;
+				}
+			}
+			if (p < state->parent_count[i]) {
+				continue;
 			}
 		}
+		findings[i] = finding;
 	}
 }
 
-void blbn_set_net_findings_learned_with_parents (blbn_state_t *state, int case_index) {
+/**
+ * Sets available findings in the specified case.
+ */
+void blbn_set_net_findings (blbn_state_t *state, int case_index) {
+	blbn_collect_case_findings (state, state->net_findings, case_index, 0, -1, 0);
+	blbn_enter_net_findings (state, state->work_net, state->net_findings);
+}
 
-	int i;
+void blbn_set_net_findings_learned (blbn_state_t *state, int case_index) {
+	blbn_collect_case_findings (state, state->net_findings, case_index, BLBN_METADATA_FLAG_LEARNED, -1, 0);
+	blbn_enter_net_findings (state, state->work_net, state->net_findings);
+}
 
-	RetractNetFindings_bn (state->work_net); // Retracts all findings from net
+/**
+ * Sets all learned findings for the case except that for the the finding for
+ * the target node.
+ */
+void blbn_set_net_findings_learned_except_target (blbn_state_t *state, int case_index) {
+	blbn_collect_case_findings (state, state->net_findings, case_index, BLBN_METADATA_FLAG_LEARNED, state->target, 0);
+	blbn_enter_net_findings (state, state->work_net, state->net_findings);
+}
 
-	for (i = 0; i < state->node_count; ++i) {
-		if (blbn_is_learned_finding (state, i, case_index)) {
-			printf ("<< %d >> ", blbn_has_parents_with_findings (state, i, case_index));
-			if (blbn_has_parents_with_findings (state, i, case_index)) {
-				blbn_set_node_finding_if_available (state, i, case_index);
-			}
-		}
-	}
-	printf ("\n");
+void blbn_set_net_findings_learned_with_parents (blbn_state_t *state, int case_index) {
+	blbn_collect_case_findings (state, state->net_findings, case_index, BLBN_METADATA_FLAG_LEARNED, -1, 1);
+	blbn_enter_net_findings (state, state->work_net, state->net_findings);
 }
 
 void blbn_set_net_findings_available (blbn_state_t *state, int case_index) {
-
-	int i;
-
-	RetractNetFindings_bn (state->work_net); // Retracts all findings from net
-
-	for (i = 0; i < state->node_count; ++i) {
-		if (blbn_is_available_finding (state, i, case_index)) { // Checks if finding is available (target or purchased)
-			blbn_set_node_finding_if_available (state, i, case_index);
-		}
-	}
+	blbn_collect_case_findings (state, state->net_findings, case_index, 0, -1, 0);
+	blbn_enter_net_findings (state, state->work_net, state->net_findings);
 }
 
 void blbn_set_net_findings_available_with_parents (blbn_state_t *state, int case_index) {
-
-	int i;
-
-	RetractNetFindings_bn (state->work_net); // Retracts all findings from net
-
-	for (i = 0; i < state->node_count; ++i) {
-		if (blbn_is_available_finding (state, i, case_index)) { // Checks if finding is available (target or purchased)
-			if (blbn_has_parents_with_findings (state, i, case_index)) {
-				blbn_set_node_finding_if_available (state, i, case_index);
-			}
-		}
-	}
+	blbn_collect_case_findings (state, state->net_findings, case_index, 0, -1, 1);
+	blbn_enter_net_findings (state, state->work_net, state->net_findings);
 }
 
 void blbn_set_prior_belief_state (blbn_state_t *state) {
@@ -1340,11 +2871,9 @@ void blbn_set_prior_belief_state (blbn_state_t *state) {
 void blbn_restore_prior_network (blbn_state_t *state) {
 	if (state != NULL) {
 		if (state->work_net != NULL && state->prior_net != NULL) {
-			DeleteNet_bn (state->work_net); // Deletes working copy of the network
-			state->work_net = CopyNet_bn (state->prior_net, GetNetName_bn (state->prior_net), env, "no_visual"); // Create new working copy of network from original network
-
-			// NOTE: THIS IS IMPORTANT!
-			state->nodelist = DupNodeList_bn (GetNetNodes_bn (state->work_net));
+			blbn_delete_net (state->work_net); // Deletes working copy of the network
+			state->work_net = blbn_util_copy_net (state, state->prior_net); // Create new working copy of network from original network
+			blbn_mark_cpts_changed (state, -1);
 		}
 	}
 }
@@ -1410,6 +2939,9 @@ void blbn_revise_by_case_findings_v1 (blbn_state_t *state, int case_index) {
  */
 void blbn_revise_by_case_findings_v2 (blbn_state_t *state, int case_index) {
 
+	unsigned long *version = NULL;
+	unsigned int *dirty = NULL;
+
 	/*
 	int i;
 	printf ("{ %d | ", blbn_has_findings_not_learned (state, case_index));
@@ -1424,6 +2956,12 @@ void blbn_revise_by_case_findings_v2 (blbn_state_t *state, int case_index) {
 	//if (blbn_has_findings_available (state, case_index)) {
 	//if (blbn_has_findings_not_learned (state, case_index)) {
 	if (blbn_has_findings_available_not_learned (state, case_index)) {
+		// Relearning marks every CPT as changed, so keep the versions it replaces
+		version = (unsigned long *) malloc (state->node_count * sizeof (unsigned long));
+		dirty = (unsigned int *) malloc (BLBN_BITSET_WORDS (state->node_count) * sizeof (unsigned int));
+		memcpy (version, state->cpt_version, state->node_count * sizeof (unsigned long));
+		memcpy (dirty, state->model_dirty, BLBN_BITSET_WORDS (state->node_count) * sizeof (unsigned int));
+
 		// Unlearn case with previously-known values
 		if (blbn_has_findings_learned (state, case_index)) {
 			blbn_unlearn_case_v2 (state, case_index);
@@ -1434,6 +2972,10 @@ void blbn_revise_by_case_findings_v2 (blbn_state_t *state, int case_index) {
 		if (blbn_has_findings_available_not_learned (state, case_index)) {
 			blbn_learn_case_v2 (state, case_index);
 		}
+
+		blbn_unmark_unchanged_cpts (state, version, dirty);
+		free (version);
+		free (dirty);
 	}
 }
 
@@ -1449,15 +2991,12 @@ void blbn_revise_by_case_findings_v2 (blbn_state_t *state, int case_index) {
  */
 void blbn_learn_case_v1 (blbn_state_t *state, int case_index) {
 
-	int i, j;
-	nodelist_bn *nodes = NULL;
-	node_bn *node = NULL;
+	int j;
+	node_bn **handles = NULL;
 	state_bn *node_finding = NULL;
-	char *node_name = NULL;
 
 	if (state != NULL) {
 		if (state->work_net != NULL) {
-			nodes = GetNetNodes_bn (state->work_net);
 
 			printf ("STORY> Updating with case %d: ", case_index);
 
@@ -1465,14 +3004,10 @@ void blbn_learn_case_v1 (blbn_state_t *state, int case_index) {
 			blbn_set_net_findings_available_with_parents (state, case_index);
 
 			// Set state of node to "learned"
-			for (i = 0; i < LengthNodeList_bn (nodes); i++) {
-				node = NthNode_bn (nodes, i);
-				node_finding = GetNodeFinding_bn (node);
+			handles = blbn_get_net_nodes (state, state->work_net);
+			for (j = 0; j < state->node_count; j++) {
+				node_finding = GetNodeFinding_bn (handles[j]);
 				if (node_finding >= 0) {
-					node_name = GetNodeName_bn (node);
-
-					j = blbn_get_node_by_name (state, node_name);
-
 					if (blbn_is_available_finding (state, j, case_index) && !blbn_is_learned_finding (state, j, case_index)) {
 						blbn_set_finding_learned (state, j, case_index);
 						printf ("[%d] ", j);
@@ -1482,6 +3017,7 @@ void blbn_learn_case_v1 (blbn_state_t *state, int case_index) {
 			printf ("\n");
 
 			// Revise CPTs
+			blbn_mark_cpts_changed_by_findings (state);
 			ReviseCPTsByFindings_bn (GetNetNodes_bn (state->work_net), 0, 1.0); // Learn (not unlearn) --- Update CPTs of network based on findings on the network
 		}
 	}
@@ -1506,9 +3042,8 @@ void blbn_learn_case_v2 (blbn_state_t *state, int case_index) {
 	caseposn_bn casepon;
 	caseset_cs  *caseset   = NULL; // Case set where temporary case output will be read into
 	nodelist_bn *nodes     = NULL;
-	node_bn     *node      = NULL;
+	node_bn     **handles   = NULL;
 	state_bn *node_finding = NULL;
-	char *node_name        = NULL;
 	learner_bn  *learner   = NULL;
 
 	// Get list of network's nodes
@@ -1530,14 +3065,10 @@ void blbn_learn_case_v2 (blbn_state_t *state, int case_index) {
 	//fprintf (log_fp, "\tLearning case %d\n\t\t", case_index);
 
 	// Set state of node to "not learned"
-	for (i = 0; i < LengthNodeList_bn (nodes); i++) {
-		node = NthNode_bn (nodes, i);
-		node_finding = GetNodeFinding_bn (node);
+	handles = blbn_get_net_nodes (state, state->work_net);
+	for (j = 0; j < state->node_count; j++) {
+		node_finding = GetNodeFinding_bn (handles[j]);
 		if (node_finding >= 0) {
-			node_name = GetNodeName_bn (node);
-
-			j = blbn_get_node_by_name (state, node_name);
-
 			if (blbn_is_available_finding (state, j, case_index)) {
 				blbn_set_finding_learned (state, j, case_index);
 				//fprintf (log_fp, "[%d] ", j);
@@ -1580,7 +3111,6 @@ void blbn_learn_case_v2 (blbn_state_t *state, int case_index) {
 	blbn_restore_prior_network (state);
 	// Get list of network's nodes
 	nodes = GetNetNodes_bn (state->work_net); // NOTE: THIS IS IMPORTANT!
-	//state->nodelist = DupNodeList_bn (nodes);
 
 	//printf ("--3> %d\t%f\t%f\n", i, blbn_get_error_rate (state), blbn_get_log_loss (state));
 
@@ -1636,14 +3166,13 @@ void blbn_learn_case_v2_cumulative (blbn_state_t *state, int case_index) {
 	// Create learner using EM method (NewLearner_bn)
 	// Learn cases using EM learner and saved CAS file (LearnCPTs_bn)
 
-	int i,j;
+	int j;
 	stream_ns   *casefile = NULL; // Used as temporary output location for case
 	caseposn_bn casepon;
 	caseset_cs  *caseset  = NULL; // Case set where temporary case output will be read into
 	nodelist_bn *nodes    = NULL;
-	node_bn     *node     = NULL;
+	node_bn     **handles  = NULL;
 	state_bn *node_finding = NULL;
-	char *node_name = NULL;
 	learner_bn  *learner  = NULL;
 
 	// Get list of network's nodes
@@ -1656,14 +3185,10 @@ void blbn_learn_case_v2_cumulative (blbn_state_t *state, int case_index) {
 	//printf ("Updating with case %d: ", case_index);
 
 	// Set state of node to "learned"
-	for (i = 0; i < LengthNodeList_bn (nodes); i++) {
-		node = NthNode_bn (nodes, i);
-		node_finding = GetNodeFinding_bn (node);
+	handles = blbn_get_net_nodes (state, state->work_net);
+	for (j = 0; j < state->node_count; j++) {
+		node_finding = GetNodeFinding_bn (handles[j]);
 		if (node_finding >= 0) {
-			node_name = GetNodeName_bn (node);
-
-			j = blbn_get_node_by_name (state, node_name);
-
 			if (blbn_is_available_finding (state, j, case_index) && !blbn_is_learned_finding (state, j, case_index)) {
 				blbn_set_finding_learned (state, j, case_index);
 				//fprintf (log_fp, "[%d] ", j);
@@ -1694,6 +3219,7 @@ void blbn_learn_case_v2_cumulative (blbn_state_t *state, int case_index) {
 
 	// Learn cases using EM learner and temporary case file
 	LearnCPTs_bn (learner, nodes, caseset, 1.0);
+	blbn_mark_cpts_changed (state, -1); // EM can revise every CPT
 
 	// Cleanup for function call
 	DeleteLearner_bn (learner);
@@ -1709,9 +3235,8 @@ void blbn_unlearn_case_v1 (blbn_state_t *state, int case_index) {
 
 	int i, j;
 	nodelist_bn *nodes = NULL;
-	node_bn *node = NULL;
+	node_bn **handles = NULL;
 	state_bn *node_finding = NULL;
-	char *node_name = NULL;
 
 	if (state != NULL) {
 		if (state->work_net != NULL) {
@@ -1729,14 +3254,10 @@ void blbn_unlearn_case_v1 (blbn_state_t *state, int case_index) {
 			printf (" >>>>>\n");
 
 			// Set state of node to "not learned"
-			for (i = 0; i < LengthNodeList_bn (nodes); i++) {
-				node = NthNode_bn (nodes, i);
-				node_finding = GetNodeFinding_bn (node);
+			handles = blbn_get_net_nodes (state, state->work_net);
+			for (j = 0; j < state->node_count; j++) {
+				node_finding = GetNodeFinding_bn (handles[j]);
 				if (node_finding >= 0) {
-					node_name = GetNodeName_bn (node);
-
-					j = blbn_get_node_by_name (state, node_name);
-
 					if (blbn_is_learned_finding (state, j, case_index)) {
 						blbn_set_finding_not_learned (state, j, case_index);
 						printf ("<%d> ", j);
@@ -1746,6 +3267,7 @@ void blbn_unlearn_case_v1 (blbn_state_t *state, int case_index) {
 			printf ("\n");
 
 			// Revise CPTs
+			blbn_mark_cpts_changed_by_findings (state);
 			ReviseCPTsByFindings_bn (GetNetNodes_bn (state->work_net), 0, -1.0); // Learn (not unlearn) --- Update CPTs of network based on findings on the network
 		}
 	}
@@ -1770,9 +3292,8 @@ void blbn_unlearn_case_v2 (blbn_state_t *state, int case_index) {
 	caseposn_bn casepon;
 	caseset_cs  *caseset   = NULL; // Case set where temporary case output will be read into
 	nodelist_bn *nodes     = NULL;
-	node_bn     *node      = NULL;
+	node_bn     **handles   = NULL;
 	state_bn *node_finding = NULL;
-	char *node_name        = NULL;
 	learner_bn  *learner   = NULL;
 
 	// Get list of network's nodes
@@ -1796,14 +3317,10 @@ void blbn_unlearn_case_v2 (blbn_state_t *state, int case_index) {
 //	//printf ("Unlearning case %d: ", case_index);
 
 	// Set state of node to "not learned"
-	for (i = 0; i < LengthNodeList_bn (nodes); i++) {
-		node = NthNode_bn (nodes, i);
-		node_finding = GetNodeFinding_bn (node);
+	handles = blbn_get_net_nodes (state, state->work_net);
+	for (j = 0; j < state->node_count; j++) {
+		node_finding = GetNodeFinding_bn (handles[j]);
 		if (node_finding >= 0) {
-			node_name = GetNodeName_bn (node);
-
-			j = blbn_get_node_by_name (state, node_name);
-
 			if (blbn_is_learned_finding (state, j, case_index)) {
 				blbn_set_finding_not_learned (state, j, case_index);
 //				fprintf ("<%d> ", j);
@@ -1839,7 +3356,6 @@ void blbn_unlearn_case_v2 (blbn_state_t *state, int case_index) {
 	blbn_restore_prior_network (state);
 	// Get list of network's nodes
 	nodes = GetNetNodes_bn (state->work_net); // NOTE: THIS IS IMPORTANT!
-	state->nodelist = DupNodeList_bn (nodes);
 
 	//printf ("--3> %d\t%f\t%f\n", i, blbn_get_error_rate (state), blbn_get_log_loss (state));
 
@@ -1870,39 +3386,14 @@ void blbn_unlearn_case_v2 (blbn_state_t *state, int case_index) {
  */
 double* blbn_get_test_rates (blbn_state_t *state) {
 
-	double* test_rates = NULL;
+	double *test_rates = NULL;
+	blbn_test_metrics_t *metrics = NULL;
 
+	metrics = blbn_get_test_metrics (state, state->work_net);
 	test_rates = (double *) malloc (2 * sizeof (double));
-
-	nodelist_bn* unobserved_nodes = NewNodeList2_bn (0, state->work_net);
-	nodelist_bn* test_nodes       = NewNodeList2_bn (0, state->work_net);
-	node_bn*     test_node        = GetNodeNamed_bn (blbn_get_node_name (state, state->target), state->work_net); // node_bn* test_node = GetNodeNamed_bn ("Cancer", net);
-
-	// Add test nodes
-	AddNodeToList_bn (test_node, test_nodes, LAST_ENTRY);
-
-	// Add unobserved nodes, if any (these are the other nodes not known during diagnosis/classification)
-	/*
-	e.g., AddNodeToList_bn (GetNodeNamed_bn ("Tuberculosis", net), unobsv_nodes, LAST_ENTRY);
-	e.g., AddNodeToList_bn (GetNodeNamed_bn ("Bronchitis", net), unobsv_nodes, LAST_ENTRY);
-	e.g., AddNodeToList_bn (GetNodeNamed_bn ("TbOrCa", net), unobsv_nodes, LAST_ENTRY);
-	*/
-
-	RetractNetFindings_bn (state->work_net); // IMPORTANT: Otherwise any findings will be part of tests !!
-	CompileNet_bn (state->work_net);
-
-	tester_bn* tester = NewNetTester_bn (test_nodes, unobserved_nodes, -1);
-
-	// Test with the validatio nset
-	TestWithCaseset_bn (tester, state->validation_caseset);
-
-	// Store error rates
-	test_rates[0] = GetTestErrorRate_bn (tester, test_node);
-	test_rates[1] = GetTestLogLoss_bn (tester, test_node);
-
-	DeleteNetTester_bn (tester);
-	DeleteNodeList_bn (unobserved_nodes);
-	DeleteNodeList_bn(test_nodes);
+	test_rates[0] = metrics->error_rate;
+	test_rates[1] = metrics->log_loss;
+	blbn_free_test_metrics (metrics);
 
 	return test_rates;
 }
@@ -1910,123 +3401,154 @@ double* blbn_get_test_rates (blbn_state_t *state) {
 double blbn_get_error_rate (blbn_state_t *state) {
 
 	double error_rate = 1.0;
+	blbn_test_metrics_t *metrics = NULL;
 
-	//net_bn* net = ReadNet_bn (NewFileStream_ns ("./data/Alarm/Alarm.dne", env, NULL), NO_VISUAL_INFO);
-	nodelist_bn* unobserved_nodes = NewNodeList2_bn (0, state->work_net);
-	nodelist_bn*   test_nodes = NewNodeList2_bn (0, state->work_net);
-	node_bn* test_node = GetNodeNamed_bn (blbn_get_node_name (state, state->target), state->work_net); // node_bn* test_node = GetNodeNamed_bn ("Cancer", net);
-
-	// Add test nodes
-	AddNodeToList_bn (test_node, test_nodes, LAST_ENTRY);
-
-	// Add unobserved nodes, if any (these are the other nodes not known during diagnosis/classification)
-	/*
-	e.g., AddNodeToList_bn (GetNodeNamed_bn ("Tuberculosis", net), unobsv_nodes, LAST_ENTRY);
-	e.g., AddNodeToList_bn (GetNodeNamed_bn ("Bronchitis", net), unobsv_nodes, LAST_ENTRY);
-	e.g., AddNodeToList_bn (GetNodeNamed_bn ("TbOrCa", net), unobsv_nodes, LAST_ENTRY);
-	*/
-
-	RetractNetFindings_bn (state->work_net); // IMPORTANT: Otherwise any findings will be part of tests !!
-	CompileNet_bn (state->work_net);
-
-	tester_bn* tester = NewNetTester_bn (test_nodes, unobserved_nodes, -1);
-
-	//stream_ns* casefile = NewFileStream_ns ("./data/Alarm/Alarm.cas", env, NULL);
-	//caseset_cs* caseset = NewCaseset_cs ("AlarmCases", env);
-	//AddFileToCaseset_cs (state->caseset, state->casefile, 1.0, NULL);
-	TestWithCaseset_bn (tester, state->validation_caseset);
-
-	//PrintConfusionMatrix (tester, test_node); // defined in example for GetTestConfusion_bn
-	error_rate = GetTestErrorRate_bn (tester, test_node);
-	//printf ("Error rate       = %f %\n", 100 * GetTestErrorRate_bn (tester, test_node));
-
-	DeleteNetTester_bn (tester);
-	DeleteNodeList_bn (unobserved_nodes);
-	DeleteNodeList_bn(test_nodes);
+	metrics = blbn_get_test_metrics (state, state->work_net);
+	error_rate = metrics->error_rate;
+	blbn_free_test_metrics (metrics);
 
 	return error_rate;
 }
 
 double blbn_get_log_loss (blbn_state_t *state) {
+	return blbn_util_get_log_loss (state, state->work_net);
+}
+
+double blbn_util_get_log_loss (blbn_state_t *state, net_bn *net) {
 
 	double log_loss = DBL_MAX;
+	blbn_test_metrics_t *metrics = NULL;
 
-	//net_bn* net = ReadNet_bn (NewFileStream_ns ("./data/Alarm/Alarm.dne", env, NULL), NO_VISUAL_INFO);
-	nodelist_bn* unobserved_nodes = NewNodeList2_bn (0, state->work_net);
-	nodelist_bn*   test_nodes = NewNodeList2_bn (0, state->work_net);
-	node_bn* test_node = GetNodeNamed_bn (blbn_get_node_name (state, state->target), state->work_net); // node_bn* test_node = GetNodeNamed_bn ("Cancer", net);
+	metrics = blbn_get_test_metrics (state, net);
+	log_loss = metrics->log_loss;
+	blbn_free_test_metrics (metrics);
 
-	// Add test nodes
-	AddNodeToList_bn (test_node, test_nodes, LAST_ENTRY);
-
-	// Add unobserved nodes, if any (these are the other nodes not known during diagnosis/classification)
-	/*
-	e.g., AddNodeToList_bn (GetNodeNamed_bn ("Tuberculosis", net), unobsv_nodes, LAST_ENTRY);
-	e.g., AddNodeToList_bn (GetNodeNamed_bn ("Bronchitis", net), unobsv_nodes, LAST_ENTRY);
-	e.g., AddNodeToList_bn (GetNodeNamed_bn ("TbOrCa", net), unobsv_nodes, LAST_ENTRY);
-	*/
+	return log_loss;
+}
 
-	RetractNetFindings_bn (state->work_net); // IMPORTANT: Otherwise any findings will be part of tests !!
-	CompileNet_bn (state->work_net);
+/**
+ * Writes a row of the graph file: the iteration, the selected (node, case)
+ * pair, the error rate, log loss, selection time, Brier score and AUC, and
+ * the confusion counts (row-major, by label then predicted state).  If
+ * metrics is NULL (the iteration was not evaluated, see
+ * blbn_is_evaluation_iteration), the metric columns are left blank so rows
+ * stay aligned.
+ */
+static void blbn_write_graph_row (blbn_state_t *state, int iteration, int node_index, int case_index, const blbn_test_metrics_t *metrics, double selection_time) {
 
-	tester_bn* tester = NewNetTester_bn (test_nodes, unobserved_nodes, -1);
+	int target_state_count = GetNodeNumberStates_bn (blbn_get_work_node (state, state->target));
+	int k;
 
-	//stream_ns* casefile = NewFileStream_ns ("./data/Alarm/Alarm.cas", env, NULL);
-	//caseset_cs* caseset = NewCaseset_cs ("AlarmCases", env);
-	//AddFileToCaseset_cs (state->caseset, state->casefile, 1.0, NULL);
-	TestWithCaseset_bn (tester, state->validation_caseset);
+	if (metrics == NULL) {
+		fprintf (graph_fp, "%i\t%d\t%d\t\t\t%f\t\t", iteration, node_index, case_index, selection_time);
+		for (k = 0; k < target_state_count * target_state_count; ++k) {
+			fprintf (graph_fp, "\t");
+		}
+		fprintf (graph_fp, "\n");
+		return;
+	}
 
-	//PrintConfusionMatrix (tester, test_node); // defined in example for GetTestConfusion_bn
-	log_loss = GetTestLogLoss_bn (tester, test_node);
-	//printf ("Error rate       = %f %\n", 100 * GetTestErrorRate_bn (tester, test_node));
-	//printf ("Logarithmic loss = %f\n", GetTestLogLoss_bn (tester, test_node));
+	fprintf (graph_fp, "%i\t%d\t%d\t%f\t%f\t%f\t%f\t%f", iteration, node_index, case_index, metrics->error_rate, metrics->log_loss, selection_time, metrics->brier, metrics->auc);
+	for (k = 0; k < metrics->state_count * metrics->state_count; ++k) {
+		fprintf (graph_fp, "\t%u", metrics->confusion[k]);
+	}
+	fprintf (graph_fp, "\n");
+}
 
-	DeleteNetTester_bn (tester);
-	DeleteNodeList_bn (unobserved_nodes);
-	DeleteNodeList_bn(test_nodes);
+/**
+ * Sets the iterations of the learning loop at which the working network is
+ * evaluated on the validation cases (the initial network, iteration 0, is
+ * always evaluated):
+ *
+ *   all              every iteration (the default)
+ *   every:<n>        every n-th iteration
+ *   log:<n>          log-spaced, about n iterations per power of ten
+ *   list:<i>,<j>,... the iterations whose purchase brings the budget spent to
+ *                    or past each listed budget
+ *
+ * Returns zero on success, or non-zero (leaving the schedule unchanged) if
+ * the schedule is not valid.
+ */
+int blbn_set_eval_schedule (blbn_state_t *state, const char *schedule) {
 
-	return log_loss;
-}
+	const char *list = NULL;
+	char *end = NULL;
+	int count, value;
 
-double blbn_util_get_log_loss (blbn_state_t *state, net_bn *net) {
+	if (strcmp (schedule, "all") == 0) {
+		state->eval_schedule = BLBN_EVAL_SCHEDULE_ALL;
+		return 0;
+	}
 
-	double log_loss = DBL_MAX;
+	if (strncmp (schedule, "every:", 6) == 0 || strncmp (schedule, "log:", 4) == 0) {
+		value = atoi (strchr (schedule, ':') + 1);
+		if (value < 1) {
+			printf ("Error: Evaluation schedule %s is not valid.\n", schedule);
+			return -1;
+		}
+		state->eval_schedule = (schedule[0] == 'e' ? BLBN_EVAL_SCHEDULE_EVERY : BLBN_EVAL_SCHEDULE_LOG);
+		state->eval_interval = value;
+		return 0;
+	}
 
-	//net_bn* net = ReadNet_bn (NewFileStream_ns ("./data/Alarm/Alarm.dne", env, NULL), NO_VISUAL_INFO);
-	nodelist_bn* unobserved_nodes = NewNodeList2_bn (0, net);
-	nodelist_bn*   test_nodes = NewNodeList2_bn (0, net);
-	node_bn* test_node = GetNodeNamed_bn (blbn_get_node_name (state, state->target), net); // node_bn* test_node = GetNodeNamed_bn ("Cancer", net);
+	if (strncmp (schedule, "list:", 5) == 0) {
+		list = schedule + 5;
+		count = 1;
+		for (end = (char *) list; *end != '\0'; ++end) {
+			count += (*end == ',');
+		}
+		free (state->eval_list);
+		state->eval_list = (int *) malloc (count * sizeof (int));
+		state->eval_list_count = 0;
+		while (*list != '\0') {
+			value = (int) strtol (list, &end, 10);
+			if (end == list || value < 0 || (*end != ',' && *end != '\0')) {
+				printf ("Error: Evaluation schedule %s is not valid.\n", schedule);
+				state->eval_list_count = 0;
+				return -1;
+			}
+			state->eval_list[state->eval_list_count++] = value;
+			list = (*end == ',' ? end + 1 : end);
+		}
+		state->eval_schedule = BLBN_EVAL_SCHEDULE_LIST;
+		return 0;
+	}
 
-	// Add test nodes
-	AddNodeToList_bn (test_node, test_nodes, LAST_ENTRY);
+	printf ("Error: Evaluation schedule %s is not valid.\n", schedule);
+	return -1;
+}
 
-	// Add unobserved nodes, if any (these are the other nodes not known during diagnosis/classification)
-	/*
-	e.g., AddNodeToList_bn (GetNodeNamed_bn ("Tuberculosis", net), unobsv_nodes, LAST_ENTRY);
-	e.g., AddNodeToList_bn (GetNodeNamed_bn ("Bronchitis", net), unobsv_nodes, LAST_ENTRY);
-	e.g., AddNodeToList_bn (GetNodeNamed_bn ("TbOrCa", net), unobsv_nodes, LAST_ENTRY);
-	*/
+/**
+ * Returns non-zero if the working network is evaluated at the specified
+ * iteration of the learning loop (see blbn_set_eval_schedule), whose purchase
+ * cost the specified amount and has already been taken from the budget.
+ */
+char blbn_is_evaluation_iteration (blbn_state_t *state, int iteration, unsigned int cost) {
 
-	RetractNetFindings_bn (net); // IMPORTANT: Otherwise any findings will be part of tests !!
-	CompileNet_bn (net);
+	unsigned int spent = state->initial_budget - state->budget;
+	int k;
 
-	tester_bn* tester = NewNetTester_bn (test_nodes, unobserved_nodes, -1);
+	if (iteration == 0 || state->eval_schedule == BLBN_EVAL_SCHEDULE_ALL) {
+		return 1;
+	}
 
-	//stream_ns* casefile = NewFileStream_ns ("./data/Alarm/Alarm.cas", env, NULL);
-	//caseset_cs* caseset = NewCaseset_cs ("AlarmCases", env);
-	//AddFileToCaseset_cs (state->caseset, state->casefile, 1.0, NULL);
-	TestWithCaseset_bn (tester, state->validation_caseset);
+	if (state->eval_schedule == BLBN_EVAL_SCHEDULE_EVERY) {
+		return (iteration % state->eval_interval == 0);
+	}
 
-	//PrintConfusionMatrix (tester, test_node); // defined in example for GetTestConfusion_bn
-	log_loss = GetTestLogLoss_bn (tester, test_node);
-	//printf ("Error rate       = %f %\n", 100 * GetTestErrorRate_bn (tester, test_node));
-	//printf ("Logarithmic loss = %f\n", GetTestLogLoss_bn (tester, test_node));
+	if (state->eval_schedule == BLBN_EVAL_SCHEDULE_LOG) {
+		// The first iteration of each step of 1/n of a power of ten
+		return (iteration == 1 || floor (state->eval_interval * log10 (iteration)) > floor (state->eval_interval * log10 (iteration - 1)));
+	}
 
-	DeleteNetTester_bn (tester);
-	DeleteNodeList_bn (unobserved_nodes);
-	DeleteNodeList_bn(test_nodes);
+	// The purchase spent the budgets in (spent - cost, spent]
+	for (k = 0; k < state->eval_list_count; ++k) {
+		if ((unsigned int) state->eval_list[k] <= spent && (unsigned int) state->eval_list[k] + cost > spent) {
+			return 1;
+		}
+	}
 
-	return log_loss;
+	return 0;
 }
 
 /**
@@ -2036,7 +3558,7 @@ void blbn_learn_baseline (blbn_state_t *state) {
 
 	int i, j;
 
-	double *test_rates = NULL;
+	blbn_test_metrics_t *metrics = NULL;
 
 	if (state != NULL) {
 		if (state->work_net != NULL) {
@@ -2057,15 +3579,15 @@ void blbn_learn_baseline (blbn_state_t *state) {
 		}
 
 		// Test network to get error rate and log loss to assess effect of selected action
-		test_rates = blbn_get_test_rates (state);
+		metrics = blbn_get_test_metrics (state, state->work_net);
 
 		// Write results to file
 		for (i = 0; i < state->budget; ++i) {
-			fprintf (graph_fp, "%i\t%d\t%d\t%f\t%f\t0\n", i, -1, -1, test_rates[0], test_rates[1]);
+			blbn_write_graph_row (state, i, -1, -1, metrics, 0.0);
 		}
 		fflush (graph_fp);
 
-		free (test_rates);
+		blbn_free_test_metrics (metrics);
 	}
 }
 
@@ -2190,6 +3712,140 @@ int blbn_count_actions (blbn_state_t *state) {
 /**
  * Learn all using BLBN library routines
  */
+/**
+ * Writes the statistics of the approximate inference queries made since the
+ * last call (in the specified iteration) to the log file and resets them.
+ */
+void blbn_log_inference_stats (blbn_state_t *state, int iteration) {
+
+	if (state->inference == BLBN_INFERENCE_LW) {
+		fprintf (log_fp, "Iteration %d: likelihood weighting %u queries, %ld samples, largest standard error %f, %f seconds\n", iteration, state->lw_query_count, state->lw_stats.sample_count, state->lw_stats.std_error, state->lw_stats.seconds);
+		fflush (log_fp);
+
+		state->lw_query_count = 0;
+		state->lw_stats.sample_count = 0;
+		state->lw_stats.std_error = 0.0;
+		state->lw_stats.seconds = 0.0;
+
+	} else if (state->inference == BLBN_INFERENCE_BP) {
+		fprintf (log_fp, "Iteration %d: loopy belief propagation %u queries, %f sweeps per query (at most %d), %u warm starts, %u not converged\n", iteration, state->bp_query_count, (state->bp_query_count > 0 ? (double) state->bp_iteration_count / state->bp_query_count : 0.0), state->bp_max_iterations, state->bp_warm_count, state->bp_unconverged_count);
+		fflush (log_fp);
+
+		state->bp_query_count = 0;
+		state->bp_iteration_count = 0;
+		state->bp_max_iterations = 0;
+		state->bp_warm_count = 0;
+		state->bp_unconverged_count = 0;
+
+	} else if (state->inference == BLBN_INFERENCE_SLICED) {
+		fprintf (log_fp, "Iteration %d: sliced variable elimination plan cache %u hits, %u misses\n", iteration, state->slice_cache_hits, state->slice_cache_misses);
+		fflush (log_fp);
+	}
+
+	if (state->posterior_cache_hits + state->posterior_cache_misses > 0) {
+		fprintf (log_fp, "Iteration %d: target posterior cache %u hits, %u misses (hit ratio %f)\n", iteration, state->posterior_cache_hits, state->posterior_cache_misses, (double) state->posterior_cache_hits / (state->posterior_cache_hits + state->posterior_cache_misses));
+		fflush (log_fp);
+
+		state->posterior_cache_hits = 0;
+		state->posterior_cache_misses = 0;
+	}
+}
+
+/**
+ * Evaluation of the working network after an iteration of the learning loop
+ * (see blbn_start_evaluation).
+ */
+typedef struct blbn_eval_future {
+	blbn_state_t *state;
+	double **cpt;                 // snapshot of the CPTs of the working network (NULL if evaluated synchronously)
+	int iteration;
+	int node_index;               // selected (node, case) pair of the iteration (-1 for the initial evaluation)
+	int case_index;
+	double selection_time;
+	blbn_test_metrics_t *metrics; // result of the evaluation
+	pthread_t thread;
+	char pending;                 // non-zero until the evaluation is waited on
+} blbn_eval_future_t;
+
+static void* blbn_run_evaluation (void *arg) {
+	blbn_eval_future_t *future = (blbn_eval_future_t *) arg;
+	future->metrics = blbn_get_model_test_metrics_from (future->state, (const double * const *) future->cpt, 1);
+	return NULL;
+}
+
+/**
+ * Starts the evaluation of the working network for the specified iteration.
+ * With generated or sliced inference, the evaluation runs on a worker thread
+ * against a snapshot of the CPTs, so the next action can be selected and
+ * learned meanwhile; the other inference methods share state between
+ * queries (and Netica is not thread-safe), so they evaluate before
+ * returning.  Only one evaluation may be pending at a time.
+ */
+static void blbn_start_evaluation (blbn_state_t *state, blbn_eval_future_t *future, int iteration, int node_index, int case_index, double selection_time) {
+
+	int i;
+
+	future->state = state;
+	future->iteration = iteration;
+	future->node_index = node_index;
+	future->case_index = case_index;
+	future->selection_time = selection_time;
+	future->cpt = NULL;
+	future->metrics = NULL;
+	future->pending = 1;
+
+	if (state->inference == BLBN_INFERENCE_GENERATED || state->inference == BLBN_INFERENCE_SLICED) {
+		blbn_sync_model (state);
+		future->cpt = (double **) malloc (state->node_count * sizeof (double *));
+		for (i = 0; i < state->node_count; ++i) {
+			future->cpt[i] = (double *) malloc (state->model->cpt_size[i] * sizeof (double));
+			memcpy (future->cpt[i], state->model->cpt[i], state->model->cpt_size[i] * sizeof (double));
+		}
+		if (state->inference == BLBN_INFERENCE_SLICED) {
+			blbn_get_validation_plans (state);
+		}
+		pthread_create (&future->thread, NULL, blbn_run_evaluation, future);
+	} else {
+		future->metrics = blbn_get_test_metrics (state, state->work_net);
+	}
+
+	blbn_log_inference_stats (state, iteration);
+}
+
+/**
+ * Waits for the pending evaluation (if any), updates the last and current
+ * log loss and writes the row of its iteration to the graph file.  Rows are
+ * written in iteration order because an evaluation is always waited on
+ * before the next one starts.
+ */
+static void blbn_wait_evaluation (blbn_eval_future_t *future) {
+
+	blbn_state_t *state = future->state;
+
+	if (!future->pending) {
+		return;
+	}
+
+	if (future->cpt != NULL) {
+		pthread_join (future->thread, NULL);
+		blbn_free_net_cpts (state, future->cpt);
+		future->cpt = NULL;
+	}
+
+	state->last_log_loss = state->curr_log_loss;
+	if (future->iteration > 0) {
+		state->curr_log_loss = future->metrics->log_loss;
+	}
+
+	// Write iteration data to log file for graphing
+	blbn_write_graph_row (state, future->iteration, future->node_index, future->case_index, future->metrics, future->selection_time);
+	fflush (graph_fp);
+
+	blbn_free_test_metrics (future->metrics);
+	future->metrics = NULL;
+	future->pending = 0;
+}
+
 void blbn_learn (blbn_state_t *state, int policy) {
 
 	int i;
@@ -2199,7 +3855,7 @@ void blbn_learn (blbn_state_t *state, int policy) {
 	time_t selection_begin_time;
 	time_t selection_end_time;
 	double selection_time;
-	double *test_rates = NULL; // [0] = error rate, [1] = log loss
+	blbn_eval_future_t evaluation; // evaluation of the last iteration (error rate, log loss, Brier score, AUC and confusion counts)
 
 	//------------------------------------------------------------------------------
 	// Write header to file
@@ -2207,21 +3863,14 @@ void blbn_learn (blbn_state_t *state, int policy) {
 
 	i = 0;
 	// Test network to get error rate and log loss to assess effect of selected action
-	test_rates = blbn_get_test_rates (state);
-
-	state->last_log_loss = state->curr_log_loss;
-	state->curr_log_loss = state->curr_log_loss;
-
 	selection_time = 0.0;
-	fprintf (graph_fp, "%i\t%d\t%d\t%f\t%f\t%f\n", i, -1, -1, test_rates[0], test_rates[1], selection_time);
+	blbn_start_evaluation (state, &evaluation, i, -1, -1, selection_time);
 
 //	fprintf (log_fp, "Iteration %d\n", i);
 //	if (BLBN_STDOUT) {
 //		printf ("Iteration %d\n", i);
 //	}
 
-	free (test_rates);
-
 	//------------------------------------------------------------------------------
 	// Learn a model from data using selection policy
 	//------------------------------------------------------------------------------
@@ -2236,6 +3885,9 @@ void blbn_learn (blbn_state_t *state, int policy) {
 
 		// Select next action using an action selection policy
 		selection_begin_time = time (NULL);
+		if (policy == BLBN_POLICY_BIASED_ROBIN) {
+			blbn_wait_evaluation (&evaluation); // Biased robin compares the last two log losses
+		}
 		if (policy == BLBN_POLICY_ROUND_ROBIN) {
 			curr_action = blbn_select_next_rr (state);
 		} else if (policy == BLBN_POLICY_BIASED_ROBIN) {
@@ -2281,32 +3933,42 @@ void blbn_learn (blbn_state_t *state, int policy) {
 		//blbn_revise_by_case_findings_v0 (state, curr_action->case_index);
 		blbn_revise_by_case_findings_v2 (state, curr_action->case_index);
 
-		// Test network to get error rate and log loss to assess effect of selected action
-		test_rates = blbn_get_test_rates (state);
-
-		state->last_log_loss = state->curr_log_loss;
-		state->curr_log_loss = test_rates[1];
-
 		selection_end_time = time (NULL);
 		selection_time = difftime (selection_end_time, selection_begin_time);
 
-		// Write iteration data to log file for graphing
-		fprintf (graph_fp, "%i\t%d\t%d\t%f\t%f\t%f\n", i, curr_action->node_index, curr_action->case_index, test_rates[0], test_rates[1], selection_time);
-		//printf ("%i\t%d\t%d\t%f\t%f\t%f\n", i, curr_action->node_index, curr_action->case_index, error_rate, log_loss, selection_time);
+		// Report the distinct learned-evidence patterns scored by the policy (see blbn_group_cases_by_pattern)
+		if (state->score_case_count > 0) {
+			fprintf (log_fp, "Iteration %d: selection time %f seconds, %u candidates scored, %u distinct evidence patterns scored for %u cases\n", i, selection_time, state->score_candidate_count, state->score_pattern_count, state->score_case_count);
+			fflush (log_fp);
+			state->score_candidate_count = 0;
+			state->score_pattern_count = 0;
+			state->score_case_count = 0;
+		}
 
-		free (test_rates);
+		// Test network to get error rate and log loss to assess effect of selected action
+		// (the row of the previous iteration is written first), unless the
+		// evaluation schedule skips this iteration
+		blbn_wait_evaluation (&evaluation);
+		if (blbn_is_evaluation_iteration (state, i, state->cost[curr_action->node_index][curr_action->case_index])) {
+			blbn_start_evaluation (state, &evaluation, i, curr_action->node_index, curr_action->case_index, selection_time);
+		} else {
+			blbn_write_graph_row (state, i, curr_action->node_index, curr_action->case_index, NULL, selection_time);
+			blbn_log_inference_stats (state, i);
+		}
+		//printf ("%i\t%d\t%d\t%f\t%f\t%f\n", i, curr_action->node_index, curr_action->case_index, error_rate, log_loss, selection_time);
 
 		//fprintf (log_fp, "\nIteration %d\n", i);
 		if (BLBN_STDOUT) {
 			printf ("\nIteration %d\n", i);
 		}
 
-		// Flush output files
-		fflush (graph_fp);
-
 		// Increment loop/selection counter
 		++i;
 	}
+	blbn_wait_evaluation (&evaluation);
+
+	fprintf (log_fp, "Compilation: %u networks compiled, %u compiles avoided\n", state->compile_count, state->compile_avoided_count);
+	fflush (log_fp);
 }
 
 /**
@@ -2437,12 +4099,10 @@ blbn_select_action_t* blbn_select_next_br (blbn_state_t *state) {
 int blbn_count_node_states (blbn_state_t *state, int node_index) {
 
 	int count = -1;
-	node_bn *node = NULL;
 
 	if (state != NULL) {
 		if (blbn_is_valid_node (state, node_index)) {
-			node = NthNode_bn (state->nodelist, node_index);
-			count = GetNodeNumberStates_bn (node);
+			count = state->state_count[node_index];
 		}
 	}
 
@@ -2451,8 +4111,7 @@ int blbn_count_node_states (blbn_state_t *state, int node_index) {
 
 double blbn_get_node_belief (blbn_state_t *state, int node_index, int state_index) {
 	RetractNetFindings_bn(state->work_net);
-	char *node_name = blbn_get_node_name (state, node_index);
-	node_bn* node = GetNodeNamed_bn (node_name, state->work_net);
+	node_bn* node = blbn_get_work_node (state, node_index);
 	char *state_name = GetNodeStateName_bn (node, state_index);
 	state_bn node_state = GetStateNamed_bn (state_name, node);
 	RetractNetFindings_bn(state->work_net);
@@ -2473,7 +4132,6 @@ double blbn_get_node_belief (blbn_state_t *state, int node_index, int state_inde
  */
 double blbn_get_node_state_probability_given_learned_states (blbn_state_t *state, int node_index, int case_index, int state_index) {
 
-	char *node_name = NULL;
 	node_bn *node = NULL;
 	char *state_name = NULL;
 	state_bn node_state;
@@ -2482,8 +4140,7 @@ double blbn_get_node_state_probability_given_learned_states (blbn_state_t *state
 	// Set all learned findings in the specified case
 	blbn_set_net_findings_learned (state, case_index);
 
-	node_name = blbn_get_node_name (state, node_index);
-	node = GetNodeNamed_bn (node_name, state->work_net);
+	node = blbn_get_work_node (state, node_index);
 	state_name = GetNodeStateName_bn (node, state_index);
 	node_state = GetStateNamed_bn (state_name, node);
 
@@ -2499,60 +4156,453 @@ double blbn_get_node_state_probability_given_learned_states (blbn_state_t *state
 
 /**
  * Computes the likelihood of the correct label for the specified case given
- * the learned findings in the case.
+ * the learned findings in the case (without the posterior cache).
+ */
+static double blbn_compute_target_node_belief_given_learned (blbn_state_t *state, int case_index) {
+	node_bn *node = NULL;
+	int state_index = -1;
+	char *state_name = NULL;
+	state_bn node_state;
+	double probability;
+	double *posterior = NULL;
+
+	// Use native inference if it is enabled
+	if (state->inference != BLBN_INFERENCE_NETICA) {
+		posterior = (double *) malloc (state->model->state_count[state->target] * sizeof (double));
+		blbn_sync_model (state);
+		blbn_set_model_findings_learned (state, case_index);
+		blbn_get_model_target_posterior (state, (const double * const *) state->model->cpt, posterior);
+		probability = posterior[state->state[state->target][case_index]];
+		free (posterior);
+		return probability;
+	}
+
+	// Set all learned findings in the specified case
+	blbn_set_net_findings_learned (state, case_index);
+
+	node = blbn_get_work_node (state, state->target);
+
+	state_index = state->state[state->target][case_index];
+	state_name = GetNodeStateName_bn (node, state_index);
+	node_state = GetStateNamed_bn (state_name, node);
+
+	// Calculate the probability that the specified node is in the specified
+	// state given the present findings.
+	probability = GetNodeBeliefs_bn (node) [node_state];
+
+	// Retract network findings
+	RetractNetFindings_bn(state->work_net);
+
+	return probability;
+}
+
+/**
+ * Returns the likelihood of the correct label for the specified case given
+ * the learned findings in the case.  The result is cached per case and is
+ * recomputed only if the learned findings of the case changed or the CPT of
+ * a family it depends on (the target, the evidence and their ancestors)
+ * changed since it was computed.
  */
 double blbn_get_target_node_belief_given_learned (blbn_state_t *state, int case_index) {
-	char *node_name = NULL;
+
+	blbn_posterior_cache_entry_t *entry = &state->posterior_cache[case_index];
+	int words = BLBN_BITSET_WORDS (state->node_count);
+	int *stack = NULL;
+	int stack_count = 0;
+	int i, p, w;
+	char stale = 0;
+
+	// Check the cached posterior against the current evidence and family versions
+	if (entry->evidence == NULL) {
+		entry->evidence = (unsigned int *) malloc (words * sizeof (unsigned int));
+		entry->families = (unsigned int *) malloc (words * sizeof (unsigned int));
+		stale = 1;
+	} else {
+		for (i = 0; i < state->node_count && !stale; ++i) {
+			if ((blbn_is_learned_finding (state, i, case_index) != 0) != (BLBN_BITSET_TEST (entry->evidence, i) != 0)) {
+				stale = 1;
+			} else if (BLBN_BITSET_TEST (entry->families, i) && state->cpt_version[i] > entry->computed) {
+				stale = 1;
+			}
+		}
+	}
+
+	if (!stale) {
+		++state->posterior_cache_hits;
+		return entry->probability;
+	}
+	++state->posterior_cache_misses;
+
+	// Record the evidence and the families the posterior depends on
+	memset (entry->evidence, 0, words * sizeof (unsigned int));
+	memset (entry->families, 0, words * sizeof (unsigned int));
+	stack = (int *) malloc (state->node_count * sizeof (int));
+	for (i = 0; i < state->node_count; ++i) {
+		if (blbn_is_learned_finding (state, i, case_index)) {
+			BLBN_BITSET_SET (entry->evidence, i);
+		}
+		if (i == state->target || blbn_is_learned_finding (state, i, case_index)) {
+			BLBN_BITSET_SET (entry->families, i);
+			stack[stack_count++] = i;
+		}
+	}
+	while (stack_count > 0) {
+		w = stack[--stack_count];
+		for (p = 0; p < state->parent_count[w]; ++p) {
+			if (!BLBN_BITSET_TEST (entry->families, state->parents[w][p])) {
+				BLBN_BITSET_SET (entry->families, state->parents[w][p]);
+				stack[stack_count++] = state->parents[w][p];
+			}
+		}
+	}
+	free (stack);
+
+	entry->probability = blbn_compute_target_node_belief_given_learned (state, case_index);
+	entry->computed = state->cpt_clock;
+
+	return entry->probability;
+}
+
+/**
+ * Computes the likelihood of the correct label for the specified case given
+ * the learned findings in the case.
+ */
+double blbn_get_target_node_belief_given_findings (blbn_state_t *state, int case_index) {
 	node_bn *node = NULL;
 	int state_index = -1;
 	char *state_name = NULL;
 	state_bn node_state;
 	double probability;
 
-	// Set all learned findings in the specified case
-	blbn_set_net_findings_learned (state, case_index);
+	node = blbn_get_work_node (state, state->target);
+
+	state_index = state->state[state->target][case_index];
+	state_name = GetNodeStateName_bn (node, state_index);
+	node_state = GetStateNamed_bn (state_name, node);
+
+	// Calculate the probability that the specified node is in the specified
+	// state given the present findings.
+	probability = GetNodeBeliefs_bn (node) [node_state];
+
+	return probability;
+}
+
+/**
+ * Allocates a joint table (see blbn_get_node_target_joint_given_learned) of
+ * zeros for each non-target node.
+ */
+static double** blbn_new_node_target_joint (blbn_state_t *state) {
+
+	double **joint = NULL;
+	int target_state_count = state->state_count[state->target];
+	int i;
+
+	joint = (double **) malloc (state->node_count * sizeof (double *));
+	for (i = 0; i < state->node_count; ++i) {
+		joint[i] = NULL;
+		if (blbn_is_non_target_node (state, i)) {
+			joint[i] = (double *) calloc (state->state_count[i] * target_state_count, sizeof (double));
+		}
+	}
+
+	return joint;
+}
+
+/**
+ * Computes the joint tables (see blbn_get_node_target_joint_given_learned)
+ * of the specified case with Netica, entering the findings into the
+ * specified compiled network (the working network or a copy) through the
+ * specified findings scratch.  Only the specified network is touched.
+ */
+static double** blbn_get_node_target_joint_in_net (blbn_state_t *state, net_bn *net, int *findings, int case_index) {
+
+	double **joint = NULL;
+	double *target_probability = NULL;
+	node_bn *target_node = NULL;
+	const prob_bn *beliefs = NULL;
+	int target_state_count = state->state_count[state->target];
+	int i, k, t;
+
+	joint = blbn_new_node_target_joint (state);
+	target_node = blbn_get_net_node (state, net, state->target);
+
+	// Set all learned findings in the specified case except the target finding
+	blbn_collect_case_findings (state, findings, case_index, BLBN_METADATA_FLAG_LEARNED, state->target, 0);
+	blbn_enter_net_findings (state, net, findings);
+
+	// Get P(target | findings) (the target is not instantiated at this point)
+	target_probability = (double *) malloc (target_state_count * sizeof (double));
+	beliefs = GetNodeBeliefs_bn (target_node);
+	for (t = 0; t < target_state_count; ++t) {
+		target_probability[t] = beliefs[t];
+	}
+
+	// Instantiate the target to each of its states and read P(node | findings, target)
+	for (t = 0; t < target_state_count; ++t) {
+
+		// Entering an impossible finding is an error in Netica, and the column is zero anyway
+		if (target_probability[t] <= 0.0) {
+			continue;
+		}
+
+		RetractNodeFindings_bn (target_node);
+		EnterFinding_bn (target_node, t);
+
+		for (i = 0; i < state->node_count; ++i) {
+			if (joint[i] != NULL) {
+				beliefs = GetNodeBeliefs_bn (blbn_get_net_node (state, net, i));
+				for (k = 0; k < state->state_count[i]; ++k) {
+					joint[i][k * target_state_count + t] = target_probability[t] * beliefs[k];
+				}
+			}
+		}
+	}
+
+	// Retract network findings
+	RetractNetFindings_bn (net);
+
+	free (target_probability);
+
+	return joint;
+}
+
+/**
+ * Computes the joint distribution P(node i, target | learned findings in the
+ * specified case, except the target finding) for every non-target node i.
+ *
+ * Rather than entering all learned findings and propagating once for every
+ * state k of every node i, this enters the learned findings once, reads the
+ * target beliefs, and then propagates once for each target state t with the
+ * target instantiated to t.  The beliefs of every node under T=t, weighted by
+ * P(T=t | findings), give column t of each node's joint table.  This costs
+ * (1 + target state count) propagations per case regardless of the number of
+ * candidate nodes.
+ *
+ * The returned array is indexed by node.  Each entry is a table of
+ * (node state count * target state count) probabilities stored row-major by
+ * node state, i.e., joint[i][k * target_state_count + t].  The entry for the
+ * target node is NULL.  Free the result with blbn_free_node_target_joint ().
+ */
+double** blbn_get_node_target_joint_given_learned (blbn_state_t *state, int case_index) {
+
+	double **joint = NULL;
+	double *target_probability = NULL;
+	blbn_lw_stats_t stats;
+	int target_state_count = state->state_count[state->target];
+	int i, k, t;
+
+	// Use Netica (with the working network) unless likelihood weighting or belief propagation is enabled
+	if (state->inference != BLBN_INFERENCE_LW && state->inference != BLBN_INFERENCE_BP) {
+		return blbn_get_node_target_joint_in_net (state, state->work_net, state->net_findings, case_index);
+	}
+
+	joint = blbn_new_node_target_joint (state);
+
+	// Use likelihood weighting if it is enabled (every joint table is estimated from the same samples)
+	if (state->inference == BLBN_INFERENCE_LW) {
+		target_probability = (double *) malloc (target_state_count * sizeof (double));
+		blbn_sync_model (state);
+		blbn_set_model_findings_learned_except_target (state, case_index);
+		blbn_lw_query (state->lw, (const double * const *) state->model->cpt, (const double * const *) state->model_lambda, state->target, target_probability, joint, &stats);
+		blbn_add_lw_stats (state, &stats);
+		free (target_probability);
+		return joint;
+	}
+
+	// Use loopy belief propagation (instantiating the target to each state, as with Netica)
+	target_probability = (double *) malloc (target_state_count * sizeof (double));
+	blbn_sync_model (state);
+	blbn_set_model_findings_learned_except_target (state, case_index);
+	blbn_run_bp (state, (const double * const *) state->model->cpt);
+	memcpy (target_probability, state->bp->beliefs[state->target], target_state_count * sizeof (double));
+
+	for (t = 0; t < target_state_count; ++t) {
+		if (target_probability[t] <= 0.0) {
+			continue;
+		}
+		for (k = 0; k < target_state_count; ++k) {
+			state->model_lambda[state->target][k] = (k == t ? 1.0 : 0.0);
+		}
+		blbn_run_bp (state, (const double * const *) state->model->cpt);
+
+		for (i = 0; i < state->node_count; ++i) {
+			if (joint[i] != NULL) {
+				for (k = 0; k < state->model->state_count[i]; ++k) {
+					joint[i][k * target_state_count + t] = target_probability[t] * state->bp->beliefs[i][k];
+				}
+			}
+		}
+	}
+
+	free (target_probability);
+	return joint;
+}
+
+void blbn_free_node_target_joint (blbn_state_t *state, double **joint) {
+	int i;
+	if (joint != NULL) {
+		for (i = 0; i < state->node_count; ++i) {
+			free (joint[i]);
+		}
+		free (joint);
+	}
+}
+
+/**
+ * Returns the probability that the specified node is in the specified state
+ * given the learned findings in the specified case, using a joint table
+ * computed by blbn_get_node_target_joint_given_learned ().  This is the same
+ * value computed by blbn_get_node_state_probability_given_learned_states ().
+ * That is, if the target finding has been learned in the case, the
+ * probability is conditioned on the case's label; otherwise the target is
+ * summed out.
+ */
+double blbn_get_joint_node_state_probability (blbn_state_t *state, double **joint, int node_index, int case_index, int state_index) {
+
+	int target_state_count = blbn_count_node_states (state, state->target);
+	int node_state_count = blbn_count_node_states (state, node_index);
+	int label = state->state[state->target][case_index];
+	double numerator = 0.0;
+	double denominator = 0.0;
+	int k, t;
+
+	if (blbn_is_learned_finding (state, state->target, case_index)) {
+		numerator = joint[node_index][state_index * target_state_count + label];
+		for (k = 0; k < node_state_count; ++k) {
+			denominator += joint[node_index][k * target_state_count + label];
+		}
+		return (denominator > 0.0 ? numerator / denominator : 0.0);
+	}
+
+	for (t = 0; t < target_state_count; ++t) {
+		numerator += joint[node_index][state_index * target_state_count + t];
+	}
+	return numerator;
+}
+
+/**
+ * Returns the probability of the correct label for the specified case given
+ * the learned findings in the case (except the target finding) and the
+ * specified node in the specified state, using a joint table computed by
+ * blbn_get_node_target_joint_given_learned ().  This is the value EMPG
+ * previously obtained by entering the lookahead finding and propagating.
+ */
+double blbn_get_joint_target_probability_given_node_state (blbn_state_t *state, double **joint, int node_index, int case_index, int state_index) {
+
+	int target_state_count = blbn_count_node_states (state, state->target);
+	int label = state->state[state->target][case_index];
+	double denominator = 0.0;
+	int t;
+
+	for (t = 0; t < target_state_count; ++t) {
+		denominator += joint[node_index][state_index * target_state_count + t];
+	}
+
+	return (denominator > 0.0 ? joint[node_index][state_index * target_state_count + label] / denominator : 0.0);
+}
+
+/**
+ * Returns the probability of the correct label for the specified case given
+ * the learned findings in the case (except the target finding), using the
+ * specified node's table in a joint computed by
+ * blbn_get_node_target_joint_given_learned () (i.e., the target marginal).
+ */
+double blbn_get_joint_target_probability (blbn_state_t *state, double **joint, int node_index, int case_index) {
+
+	int target_state_count = blbn_count_node_states (state, state->target);
+	int node_state_count = blbn_count_node_states (state, node_index);
+	int label = state->state[state->target][case_index];
+	double probability = 0.0;
+	int k;
+
+	for (k = 0; k < node_state_count; ++k) {
+		probability += joint[node_index][k * target_state_count + label];
+	}
+
+	return probability;
+}
+
+typedef struct blbn_sfl_order {
+	double score;
+	int index;
+} blbn_sfl_order_t;
 
-	node_name = blbn_get_node_name (state, state->target);
-	node = GetNodeNamed_bn (node_name, state->work_net);
+static int blbn_compare_sfl_order (const void *a, const void *b) {
+	const blbn_sfl_order_t *x = (const blbn_sfl_order_t *) a;
+	const blbn_sfl_order_t *y = (const blbn_sfl_order_t *) b;
+	if (x->score != y->score) {
+		return (x->score < y->score ? -1 : 1);
+	}
+	return x->index - y->index;
+}
 
-	state_index = state->state[state->target][case_index];
-	state_name = GetNodeStateName_bn (node, state_index);
-	node_state = GetStateNamed_bn (state_name, node);
+/**
+ * Returns the SFL scores of the last iteration (indexed [node][case];
+ * DBL_MAX if not scored yet), used to visit good candidates first.
+ */
+static double** blbn_get_sfl_last_scores (blbn_state_t *state) {
 
-	// Calculate the probability that the specified node is in the specified
-	// state given the present findings.
-	probability = GetNodeBeliefs_bn (node) [node_state];
+	int i, j;
 
-	// Retract network findings
-	RetractNetFindings_bn(state->work_net);
+	if (state->sfl_last_score == NULL) {
+		state->sfl_last_score = (double **) malloc (state->node_count * sizeof (double *));
+		for (i = 0; i < state->node_count; ++i) {
+			state->sfl_last_score[i] = (double *) malloc (state->case_count * sizeof (double));
+			for (j = 0; j < state->case_count; ++j) {
+				state->sfl_last_score[i][j] = DBL_MAX;
+			}
+		}
+	}
 
-	return probability;
+	return state->sfl_last_score;
 }
 
 /**
- * Computes the likelihood of the correct label for the specified case given
- * the learned findings in the case.
+ * Returns the nodes in ascending order of their last SFL score in the
+ * specified case or, if case_index is negative, the cases in ascending order
+ * of the best last SFL score of any of their nodes.
  */
-double blbn_get_target_node_belief_given_findings (blbn_state_t *state, int case_index) {
-	char *node_name = NULL;
-	node_bn *node = NULL;
-	int state_index = -1;
-	char *state_name = NULL;
-	state_bn node_state;
-	double probability;
+static int* blbn_get_sfl_order (blbn_state_t *state, int case_index) {
 
-	node_name = blbn_get_node_name (state, state->target);
-	node = GetNodeNamed_bn (node_name, state->work_net);
+	double **last_score = blbn_get_sfl_last_scores (state);
+	blbn_sfl_order_t *order = NULL;
+	int *indices = NULL;
+	int count = (case_index < 0 ? state->case_count : state->node_count);
+	int i, j;
 
-	state_index = state->state[state->target][case_index];
-	state_name = GetNodeStateName_bn (node, state_index);
-	node_state = GetStateNamed_bn (state_name, node);
+	order = (blbn_sfl_order_t *) malloc (count * sizeof (blbn_sfl_order_t));
+	for (j = 0; j < count; ++j) {
+		order[j].index = j;
+		if (case_index >= 0) {
+			order[j].score = last_score[j][case_index];
+		} else {
+			order[j].score = DBL_MAX;
+			for (i = 0; i < state->node_count; ++i) {
+				if (last_score[i][j] < order[j].score) {
+					order[j].score = last_score[i][j];
+				}
+			}
+		}
+	}
+	qsort (order, count, sizeof (blbn_sfl_order_t), blbn_compare_sfl_order);
 
-	// Calculate the probability that the specified node is in the specified
-	// state given the present findings.
-	probability = GetNodeBeliefs_bn (node) [node_state];
+	indices = (int *) malloc (count * sizeof (int));
+	for (j = 0; j < count; ++j) {
+		indices[j] = order[j].index;
+	}
+	free (order);
 
-	return probability;
+	return indices;
+}
+
+/**
+ * Writes the branch and bound statistics of the SFL scores to the log file.
+ */
+static void blbn_log_sfl_bound_stats (blbn_state_t *state) {
+	fprintf (log_fp, "SFL: %u candidates abandoned by branch and bound, %u of %u lookahead evaluations skipped\n", state->sfl_abandoned_count, state->sfl_lookahead_skipped, state->sfl_lookahead_count + state->sfl_lookahead_skipped);
+	state->sfl_abandoned_count = 0;
+	state->sfl_lookahead_count = 0;
+	state->sfl_lookahead_skipped = 0;
 }
 
 /**
@@ -2572,7 +4622,7 @@ blbn_select_action_t* blbn_select_next_sfl (blbn_state_t *state) {
 	int min_exp_loss_node_index = -1;
 	int min_exp_loss_case_index = -1;
 
-	double *sfl_values;
+	double **sfl_values;
 
 	// Move to the most recent previous select action
 	prev_action = state->sel_action_seq;
@@ -2594,28 +4644,37 @@ blbn_select_action_t* blbn_select_next_sfl (blbn_state_t *state) {
 		// smallest SFL value.
 		//------------------------------------------------------------------------------
 
-		for (j = 0; j < state->case_count; ++j) {
-
-			// Get SFL values for row
-			sfl_values = blbn_util_sfl_row (state, j);
+		// Get SFL values of (node, case) pairs or, if enabled, of (node, label)
+		// pairs at representative cases (only the smallest is exact)
+		if (state->sfl_pair_samples > 0) {
+			sfl_values = blbn_util_sfl_pairs (state, 1);
+		} else if (state->sfl_lazy) {
+			sfl_values = blbn_util_sfl_lazy (state, 1);
+		} else {
+			sfl_values = blbn_util_sfl (state, 1);
+		}
 
-			// Get minimum SFL value for row
+		// Get minimum SFL value (ties go to the first case and node in the static ordering)
+		for (j = 0; j < state->case_count; ++j) {
 			for (i = 0; i < state->node_count; ++i) {
 
 				// Check scores for values that are not for the target node or nodes that are already purchased
 				if (!blbn_is_available_finding (state, i, j)) {
 					// Update minimum if necessary
-					if (sfl_values[i] < min_exp_loss) {
-						min_exp_loss = sfl_values[i];
+					if (sfl_values[i][j] < min_exp_loss) {
+						min_exp_loss = sfl_values[i][j];
 						min_exp_loss_node_index = i;
 						min_exp_loss_case_index = j;
 					}
 				}
 			}
+		}
 
-			// Free SFL values for row
-			free (sfl_values);
+		// Free SFL values
+		for (i = 0; i < state->node_count; ++i) {
+			free (sfl_values[i]);
 		}
+		free (sfl_values);
 
 		// <TEMPORARY>
 		if (min_exp_loss_node_index < 0 || min_exp_loss_case_index < 0) {
@@ -2709,53 +4768,244 @@ blbn_select_action_t* blbn_select_next_gsfl (blbn_state_t *state) {
 		//------------------------------------------------------------------------------
 
 		// Get SFL values for row
-		sfl_values = blbn_util_sfl (state);
+		sfl_values = (state->sfl_lazy ? blbn_util_sfl_lazy (state, 1) : blbn_util_sfl (state, 1));
+
+		for (j = 0; j < state->case_count; ++j) {
+
+			// Get minimum SFL value for row
+			for (i = 0; i < state->node_count; ++i) {
+
+				// Check scores for values that are not for the target node or nodes that are already purchased
+				if (!blbn_is_available_finding (state, i, j)) {
+					// Update minimum if necessary
+					if (sfl_values[i][j] < min_exp_loss) {
+						min_exp_loss = sfl_values[i][j];
+						min_exp_loss_node_index = i;
+						min_exp_loss_case_index = j;
+					}
+				}
+			}
+		}
+
+		// Free SFL values for row
+		for (i = 0; i < state->node_count; ++i) {
+			free (sfl_values[i]);
+		}
+		free (sfl_values);
+
+		curr_action->node_index = min_exp_loss_node_index;
+		curr_action->case_index = min_exp_loss_case_index;
+	}
+
+	return curr_action;
+}
+
+/**
+ * RSFL Selection policy.
+ *
+ * K is the number of of best feature-class pairs to consider.
+ */
+blbn_select_action_t* blbn_select_next_rsfl (blbn_state_t *state, int K, double tao) {
+
+	blbn_select_action_t *prev_action = NULL;
+	blbn_select_action_t *curr_action = NULL;
+
+	int i,j,n,p;
+
+	double **sfl_values = NULL;
+
+	int candidate_count        = 0;
+	double *candidate_exp_loss = NULL;
+	int **candidate_actions    = NULL;
+	double *candidate_prob     = NULL;
+	double candidate_prob_sum  = 0;
+
+	double random_selection = 0;
+	double random_selection_sum = 0;
+
+	// Allocate space to store probability of selecting candidate actions
+	candidate_prob = (double *) malloc (K * sizeof (double));
+
+	// Initialize probabilities of selection candidate actions
+	for (i = 0; i < K; ++i) {
+		candidate_prob[i] = DBL_MAX;
+	}
+
+	// Allocate space to store expected loss of candidate actions
+	candidate_exp_loss = (double *) malloc (K * sizeof (double));
+
+	// Initialize expected loss of candidate actions
+	for (i = 0; i < K; ++i) {
+		candidate_exp_loss[i] = DBL_MAX;
+	}
+
+	// Allocate space to store candidate actions
+	candidate_actions = (int **) malloc (K * sizeof (int *));
+	for (i = 0;  i < K;  ++i) {
+		candidate_actions[i] = (int *) malloc (2 * sizeof (int));
+
+		// Initialize candidate actions
+		for (j = 0; j < 2; ++j) {
+			candidate_actions[i][j] = -1;
+		}
+	}
+
+	// Move to the most recent previous select action
+	prev_action = state->sel_action_seq;
+	if (prev_action != NULL) {
+		while (prev_action->next != NULL) {
+			prev_action = prev_action->next;
+		}
+	}
+
+	// Allocate space for current selection and initialize structure
+	curr_action = (blbn_select_action_t *) malloc (sizeof (blbn_select_action_t));
+	curr_action->prev = NULL; // no previous action (this is the first action)
+	curr_action->next = NULL; // no next action (this is the newest action)
+
+	if (curr_action != NULL) {
+
+		// Get SFL values for rows and columns or, if enabled, for (node, label)
+		// pairs at representative cases
+		if (state->sfl_pair_samples > 0) {
+			sfl_values = blbn_util_sfl_pairs (state, 0);
+		} else if (state->sfl_lazy) {
+			sfl_values = blbn_util_sfl_lazy (state, K);
+		} else {
+			sfl_values = blbn_util_sfl (state, 0);
+		}
+
+		for (j = 0; j < state->case_count; ++j) {
+
+			// Get minimum SFL value for row
+			for (i = 0; i < state->node_count; ++i) {
+
+				// Check scores for values that are not for the target node or nodes that are already purchased
+				if (!blbn_is_available_finding (state, i, j)) {
+
+					// Place candidate solution (if its loss is low enough)
+					for (n = 0; n < K; ++n) {
+						if (sfl_values[i][j] < candidate_exp_loss[n]) {
+
+							// Shift elements to the right of the list
+							for (p = K - 1; p > n; --p) {
+								candidate_exp_loss[p]    = candidate_exp_loss[p - 1];
+								candidate_actions [p][0] = candidate_actions [p - 1][0];
+								candidate_actions [p][1] = candidate_actions [p - 1][1];
+							}
+
+							// Store new candidate into previous candidate's location
+							candidate_exp_loss[n] = sfl_values[i][j];
+							candidate_actions[n][0] = i;
+							candidate_actions[n][1] = j;
+
+							// Count this element (if not reached desired number of candidates)
+							if (candidate_count < K) {
+								++candidate_count;
+							}
+
+							break;
+						}
+					}
+				}
+			}
+		}
+
+		// Free SFL values for rows and columns
+		for (i = 0; i < state->node_count; ++i) {
+			free (sfl_values[i]);
+		}
+		free (sfl_values);
+
+		// Calculate RSFL probability vector
+		candidate_prob_sum = 0;
+		for (i = 0; i < candidate_count; ++i) {
+			candidate_prob[i] = exp ((-1.0 * candidate_exp_loss[i]) / tao);
+			candidate_prob_sum += candidate_prob[i];
+		}
+		for (i = 0; i < candidate_count; ++i) {
+			candidate_prob[i] /= candidate_prob_sum;
+		}
+
+//		for (n = 0; n < kount; ++n) {
+//			printf ("%f ", candidate_exp_loss[n]);
+//		}
+//		printf ("\n");
+//
+//		for (n = 0; n < kount; ++n) {
+//			printf ("%f ", candidate_prob[n]);
+//		}
+//		printf ("\n");
+//
+//		for (n = 0; n < kount; ++n) {
+//			printf ("(%d,%d) ", candidate_actions[n][0], candidate_actions[n][1]);
+//		}
+//		printf ("\n");
+
+		random_selection = ((double) rand () / (double) RAND_MAX);
+//		printf ("RAND: %f\n", random_selection);
+
+		// Randomly select the (node,case) pair from which a random instance from node with the label of thise pair will be purchased
+		random_selection_sum = 0.0;
+		for (i = 0; i < candidate_count; ++i) {
+			random_selection_sum += candidate_prob[i];
+			if (random_selection < random_selection_sum) {
+
+				// Store node index of action
+				curr_action->node_index = candidate_actions[i][0];
+
+				// NOTE: In (non-generalized) RSFL, the feature with with the lowest loss is
+				//       selected, but the instance is selected randomly from that feature
+				//       where the label matches that of the instance with the lowest SFL score
+				//       for feature that feature.
+				// NOTE: The selected (node,case) pair will always be available, which
+				//       implies that there will always be at least one case for the node that
+				//       is available for purchase.
+				curr_action->case_index = candidate_actions[i][1];
+
+				//printf ("CHOSE: (%d,%d) with LOSS = %f\n", curr_action->node_index, curr_action->case_index);
+				break;
+			}
+		}
+
+//		printf ("%d -> ", curr_action->case_index);
+
+		// Select random non-purchased case uniformly at random from selected node
+		curr_action->case_index = blbn_get_random_finding_not_purchased_in_node_with_label (state, curr_action->node_index, state->state[state->target][curr_action->case_index]);
 
-		for (j = 0; j < state->case_count; ++j) {
+//		printf ("%d\n", curr_action->case_index);
 
-			// Get minimum SFL value for row
-			for (i = 0; i < state->node_count; ++i) {
+//		printf ("CHOSE: (%d,%d)\n", curr_action->node_index, curr_action->case_index);
+	}
 
-				// Check scores for values that are not for the target node or nodes that are already purchased
-				if (!blbn_is_available_finding (state, i, j)) {
-					// Update minimum if necessary
-					if (sfl_values[i][j] < min_exp_loss) {
-						min_exp_loss = sfl_values[i][j];
-						min_exp_loss_node_index = i;
-						min_exp_loss_case_index = j;
-					}
-				}
-			}
-		}
+	// Free candidate probabilities
+	free (candidate_prob);
 
-		// Free SFL values for row
-		for (i = 0; i < state->node_count; ++i) {
-			free (sfl_values[i]);
-		}
-		free (sfl_values);
+	// Free probabilities of selection candidate actions
+	free (candidate_exp_loss);
 
-		curr_action->node_index = min_exp_loss_node_index;
-		curr_action->case_index = min_exp_loss_case_index;
+	// Free space to store candidate actions
+	for (i = 0;  i < K;  ++i) {
+		free (candidate_actions[i]);
 	}
+	free (candidate_actions);
 
 	return curr_action;
 }
 
 /**
- * RSFL Selection policy.
+ * Generalized RSFL Selection policy.
  *
- * K is the number of of best feature-class pairs to consider.
+ * K is the number of of best feature-class pairsto consider.
  */
-blbn_select_action_t* blbn_select_next_rsfl (blbn_state_t *state, int K, double tao) {
+blbn_select_action_t* blbn_select_next_grsfl (blbn_state_t *state, int K, double tao) {
 
 	blbn_select_action_t *prev_action = NULL;
 	blbn_select_action_t *curr_action = NULL;
 
 	int i,j,n,p;
+	int kount = 0;
 
-	double **sfl_values = NULL;
-
-	int candidate_count        = 0;
 	double *candidate_exp_loss = NULL;
 	int **candidate_actions    = NULL;
 	double *candidate_prob     = NULL;
@@ -2764,6 +5014,8 @@ blbn_select_action_t* blbn_select_next_rsfl (blbn_state_t *state, int K, double
 	double random_selection = 0;
 	double random_selection_sum = 0;
 
+	double **sfl_values = NULL;
+
 	// Allocate space to store probability of selecting candidate actions
 	candidate_prob = (double *) malloc (K * sizeof (double));
 
@@ -2807,7 +5059,7 @@ blbn_select_action_t* blbn_select_next_rsfl (blbn_state_t *state, int K, double
 	if (curr_action != NULL) {
 
 		// Get SFL values for rows and columns
-		sfl_values = blbn_util_sfl (state);
+		sfl_values = (state->sfl_lazy ? blbn_util_sfl_lazy (state, K) : blbn_util_sfl (state, 0));
 
 		for (j = 0; j < state->case_count; ++j) {
 
@@ -2834,8 +5086,8 @@ blbn_select_action_t* blbn_select_next_rsfl (blbn_state_t *state, int K, double
 							candidate_actions[n][1] = j;
 
 							// Count this element (if not reached desired number of candidates)
-							if (candidate_count < K) {
-								++candidate_count;
+							if (kount < K) {
+								++kount;
 							}
 
 							break;
@@ -2853,1150 +5105,2409 @@ blbn_select_action_t* blbn_select_next_rsfl (blbn_state_t *state, int K, double
 
 		// Calculate RSFL probability vector
 		candidate_prob_sum = 0;
-		for (i = 0; i < candidate_count; ++i) {
+		for (i = 0; i < kount; ++i) {
 			candidate_prob[i] = exp ((-1.0 * candidate_exp_loss[i]) / tao);
 			candidate_prob_sum += candidate_prob[i];
 		}
-		for (i = 0; i < candidate_count; ++i) {
+		for (i = 0; i < kount; ++i) {
 			candidate_prob[i] /= candidate_prob_sum;
 		}
 
-//		for (n = 0; n < kount; ++n) {
-//			printf ("%f ", candidate_exp_loss[n]);
+//		for (p = 0; p < kount; ++p) {
+//			printf ("%f ", candidate_exp_loss[p]);
 //		}
 //		printf ("\n");
 //
-//		for (n = 0; n < kount; ++n) {
-//			printf ("%f ", candidate_prob[n]);
+//		for (p = 0; p < kount; ++p) {
+//			printf ("%f ", candidate_prob[p]);
 //		}
 //		printf ("\n");
 //
-//		for (n = 0; n < kount; ++n) {
-//			printf ("(%d,%d) ", candidate_actions[n][0], candidate_actions[n][1]);
+//		for (p = 0; p < kount; ++p) {
+//			printf ("(%d,%d) ", candidate_actions[p][0], candidate_actions[p][1]);
 //		}
 //		printf ("\n");
 
 		random_selection = ((double) rand () / (double) RAND_MAX);
 //		printf ("RAND: %f\n", random_selection);
 
-		// Randomly select the (node,case) pair from which a random instance from node with the label of thise pair will be purchased
+		// Select the random action
 		random_selection_sum = 0.0;
-		for (i = 0; i < candidate_count; ++i) {
+		for (i = 0; i < kount; ++i) {
 			random_selection_sum += candidate_prob[i];
 			if (random_selection < random_selection_sum) {
-
-				// Store node index of action
 				curr_action->node_index = candidate_actions[i][0];
-
-				// NOTE: In (non-generalized) RSFL, the feature with with the lowest loss is
-				//       selected, but the instance is selected randomly from that feature
-				//       where the label matches that of the instance with the lowest SFL score
-				//       for feature that feature.
-				// NOTE: The selected (node,case) pair will always be available, which
-				//       implies that there will always be at least one case for the node that
-				//       is available for purchase.
 				curr_action->case_index = candidate_actions[i][1];
-
-				//printf ("CHOSE: (%d,%d) with LOSS = %f\n", curr_action->node_index, curr_action->case_index);
+//				printf ("CHOSE: (%d,%d) with LOSS = %f\n", curr_action->node_index, curr_action->case_index);
 				break;
 			}
 		}
+	}
+
+
+	// Free candidate probabilities
+	free (candidate_prob);
+
+	// Free probabilities of selection candidate actions
+	free (candidate_exp_loss);
+
+	// Free space to store candidate actions
+	for (i = 0;  i < K;  ++i) {
+		free (candidate_actions[i]);
+	}
+	free (candidate_actions);
+
+	return curr_action;
+}
+
+/**
+ * Expected Maximum Purchase Gain (EMPG)
+ * i.e., the "Tell Me What I Want To Hear" algorithm
+ */
+blbn_select_action_t* blbn_select_next_empg (blbn_state_t *state) {
+
+	blbn_select_action_t *prev_action = NULL;
+	blbn_select_action_t *curr_action = NULL;
+
+	int i,j;
+
+	double max_exp_gain = 0;
+
+	double **gain_values;
+
+	// Move to the most recent previous select action
+	prev_action = state->sel_action_seq;
+	if (prev_action != NULL) {
+		while (prev_action->next != NULL) {
+			prev_action = prev_action->next;
+		}
+	}
+
+	// Allocate space for current selection and initialize structure
+	curr_action = (blbn_select_action_t *) malloc (sizeof (blbn_select_action_t));
+	curr_action->prev = NULL; // no previous action (this is the first action)
+	curr_action->next = NULL; // no next action (this is the newest action)
+
+	if (curr_action != NULL) {
+
+		//------------------------------------------------------------------------------
+		// This is the first selection, so select /first/ node
+		//------------------------------------------------------------------------------
+
+		// Randomly select node to make first purchase from
+		curr_action->node_index = rand () % state->node_count;
+
+		while ((curr_action->node_index == state->target) || blbn_count_findings_in_node_not_purchased (state, curr_action->node_index) <= 0) {
+			curr_action->node_index = (curr_action->node_index + 1) % state->node_count; // select initial node uniformly at random
+		}
+
+		// Select random case
+		curr_action->case_index = blbn_get_random_finding_not_purchased_in_node (state, curr_action->node_index);
+
+		//------------------------------------------------------------------------------
+		// Select the next action (i.e., select a (node,case) tuple) with the
+		// smallest SFL value.
+		//------------------------------------------------------------------------------
+
+		// Get SFL values for row
+		gain_values = blbn_util_empg (state);
+
+		for (j = 0; j < state->case_count; ++j) {
+
+			// Get minimum SFL value for row
+			for (i = 0; i < state->node_count; ++i) {
+
+				// Check scores for values that are not for the target node or nodes that are already purchased
+				if (!blbn_is_available_finding (state, i, j)) {
+					// Update minimum if necessary
+					if (gain_values[i][j] > max_exp_gain) {
+						max_exp_gain = gain_values[i][j];
+						curr_action->node_index = i;
+						curr_action->case_index = j;
+					}
+				}
+			}
+		}
+
+		//printf ("selected (%d, %d)\n", curr_action->node_index, curr_action->case_index);
+
+		// Free SFL values for row
+		for (i = 0; i < state->node_count; ++i) {
+			free (gain_values[i]);
+		}
+		free (gain_values);
+	}
+
+	return curr_action;
+}
+
+/**
+ * Cheating algorithm (a variant of the "Tell Me What I Want To Hear"
+ * algorithm used to evaluate performance of other algorithms).
+ *
+ * - Uses test set for loss function
+ * - Not optimal (so, this is unlike Bayes optimal)
+ *   - Optimality would require checking all possible sequences of purchases until budget has been exhausted (or until all possible purchases are made)
+ */
+blbn_select_action_t* blbn_select_next_cheating (blbn_state_t *state) {
+
+	blbn_select_action_t *prev_action = NULL;
+	blbn_select_action_t *curr_action = NULL;
+
+	int i,j;
+
+	double max_exp_gain = 0;
+
+	double **gain_values;
+
+	// Move to the most recent previous select action
+	prev_action = state->sel_action_seq;
+	if (prev_action != NULL) {
+		while (prev_action->next != NULL) {
+			prev_action = prev_action->next;
+		}
+	}
+
+	// Allocate space for current selection and initialize structure
+	curr_action = (blbn_select_action_t *) malloc (sizeof (blbn_select_action_t));
+	curr_action->prev = NULL; // no previous action (this is the first action)
+	curr_action->next = NULL; // no next action (this is the newest action)
+
+	if (curr_action != NULL) {
+
+		//------------------------------------------------------------------------------
+		// This is the first selection, so select /first/ node
+		//------------------------------------------------------------------------------
+
+		// Randomly select node to make first purchase from
+		curr_action->node_index = rand () % state->node_count;
+
+		while ((curr_action->node_index == state->target) || blbn_count_findings_in_node_not_purchased (state, curr_action->node_index) <= 0) {
+			curr_action->node_index = (curr_action->node_index + 1) % state->node_count; // select initial node uniformly at random
+		}
+
+		// Select random case
+		curr_action->case_index = blbn_get_random_finding_not_purchased_in_node (state, curr_action->node_index);
+
+		//------------------------------------------------------------------------------
+		// Select the next action (i.e., select a (node,case) tuple) with the
+		// smallest SFL value.
+		//------------------------------------------------------------------------------
+
+		// Get "cheat" values for row
+		printf ("START: %d, %d\n", curr_action->case_index, curr_action->node_index);
+		fprintf (log_fp, "START: %d, %d\n", curr_action->case_index, curr_action->node_index);
+		gain_values = blbn_util_cheat (state);
+		printf ("DONE\n");
+		fprintf (log_fp, "DONE\n");
+		fflush (log_fp);
+
+		for (j = 0; j < state->case_count; ++j) {
+
+			// Get minimum SFL value for row
+			for (i = 0; i < state->node_count; ++i) {
+
+				// Check scores for values that are not for the target node or nodes that are already purchased
+				if (!blbn_is_available_finding (state, i, j)) {
+					// Update minimum if necessary
+					if (gain_values[i][j] > max_exp_gain) {
+						max_exp_gain = gain_values[i][j];
+						curr_action->node_index = i;
+						curr_action->case_index = j;
+					}
+				}
+			}
+		}
 
-//		printf ("%d -> ", curr_action->case_index);
-
-		// Select random non-purchased case uniformly at random from selected node
-		curr_action->case_index = blbn_get_random_finding_not_purchased_in_node_with_label (state, curr_action->node_index, state->state[state->target][curr_action->case_index]);
+		printf ("COMPLETE\n");
+		fprintf (log_fp, "COMPLETE\n");
+		fflush (log_fp);
 
-//		printf ("%d\n", curr_action->case_index);
+		//printf ("selected (%d, %d)\n", curr_action->node_index, curr_action->case_index);
 
-//		printf ("CHOSE: (%d,%d)\n", curr_action->node_index, curr_action->case_index);
+		// Free SFL values for row
+		for (i = 0; i < state->node_count; ++i) {
+			free (gain_values[i]);
+		}
+		free (gain_values);
 	}
 
-	// Free candidate probabilities
-	free (candidate_prob);
+	return curr_action;
+}
 
-	// Free probabilities of selection candidate actions
-	free (candidate_exp_loss);
+/**
+ * Returns index of random non-purchased case for node with specified index or
+ * returns -1 if no non-purchases case remains.
+ */
+int blbn_get_random_finding_not_purchased_in_node (blbn_state_t *state, int node_index) {
+	int i;
+	int count = 0; // number of findings not purchased
+	int *cases = NULL;
+	int case_index = -1;
 
-	// Free space to store candidate actions
-	for (i = 0;  i < K;  ++i) {
-		free (candidate_actions[i]);
+	count = blbn_get_findings_not_purchased_for_node (state, node_index, &cases);
+	if (count > 0 && cases != NULL) {
+		i = rand () % count;
+		case_index = cases[i];
+		free (cases);
 	}
-	free (candidate_actions);
 
-	return curr_action;
+	return case_index;
 }
 
 /**
- * Generalized RSFL Selection policy.
- *
- * K is the number of of best feature-class pairsto consider.
+ * Returns index of random non-purchased case for node with specified index or
+ * returns -1 if no non-purchases case remains.
  */
-blbn_select_action_t* blbn_select_next_grsfl (blbn_state_t *state, int K, double tao) {
+int blbn_get_random_finding_not_purchased_in_node_with_label (blbn_state_t *state, int node_index, int target_state) {
+	int i;
+	int count = 0; // number of findings not purchased
+	int *cases = NULL;
+	int case_index = -1;
 
-	blbn_select_action_t *prev_action = NULL;
-	blbn_select_action_t *curr_action = NULL;
+	int n;
 
-	int i,j,n,p;
-	int kount = 0;
+	count = blbn_get_findings_not_purchased_for_node (state, node_index, &cases);
+	if (count > 0 && cases != NULL) {
+		i = rand () % count;
 
-	double *candidate_exp_loss = NULL;
-	int **candidate_actions    = NULL;
-	double *candidate_prob     = NULL;
-	double candidate_prob_sum  = 0;
+		// Starting at the random selection, iterate over the remaining non-purchased findings until one is found in an instance where the target state is equal to the specified target state
+		for (n = 0; n < count && state->state[state->target][cases[i]] != target_state; ++n) {
+			i = (i + 1) % count;
+		}
 
-	double random_selection = 0;
-	double random_selection_sum = 0;
+		if (n < count) {
+			case_index = cases[i];
+		}
+		free (cases);
+	}
 
-	double **sfl_values = NULL;
+	return case_index;
+}
 
-	// Allocate space to store probability of selecting candidate actions
-	candidate_prob = (double *) malloc (K * sizeof (double));
+/**
+ * Copies the specified network and returns a pointer to the copy.  Does not
+ * modify original network.  Returns NULL if cannot copy.
+ */
+net_bn* blbn_util_copy_net (blbn_state_t *state, net_bn* net) {
+	net_bn *copied_net = NULL;
 
-	// Initialize probabilities of selection candidate actions
-	for (i = 0; i < K; ++i) {
-		candidate_prob[i] = DBL_MAX;
-	}
+	if (state != NULL && net != NULL) {
 
-	// Allocate space to store expected loss of candidate actions
-	candidate_exp_loss = (double *) malloc (K * sizeof (double));
+		// Copy the network (with auto-update off, so findings are entered in batches)
+		copied_net = CopyNet_bn (net, GetNetName_bn (net), env, "no_visual");
+		SetNetAutoUpdate_bn (copied_net, 0);
 
-	// Initialize expected loss of candidate actions
-	for (i = 0; i < K; ++i) {
-		candidate_exp_loss[i] = DBL_MAX;
 	}
 
-	// Allocate space to store candidate actions
-	candidate_actions = (int **) malloc (K * sizeof (int *));
-	for (i = 0;  i < K;  ++i) {
-		candidate_actions[i] = (int *) malloc (2 * sizeof (int));
-
-		// Initialize candidate actions
-		for (j = 0; j < 2; ++j) {
-			candidate_actions[i][j] = -1;
-		}
-	}
+	return copied_net;
+}
 
-	// Move to the most recent previous select action
-	prev_action = state->sel_action_seq;
-	if (prev_action != NULL) {
-		while (prev_action->next != NULL) {
-			prev_action = prev_action->next;
-		}
-	}
+/**
+ * Learns the cases written to the specified memory stream into the specified
+ * network using Netica's EM_LEARNING algorithm, and deletes the stream.
+ */
+static void blbn_net_learn_stream (net_bn *net, stream_ns *casefile) {
 
-	// Allocate space for current selection and initialize structure
-	curr_action = (blbn_select_action_t *) malloc (sizeof (blbn_select_action_t));
-	curr_action->prev = NULL; // no previous action (this is the first action)
-	curr_action->next = NULL; // no next action (this is the newest action)
+	caseset_cs *caseset = NULL; // Case set where the cases written to the stream will be read into
+	learner_bn *learner = NULL;
 
-	if (curr_action != NULL) {
+	// Load the cases in the stream into a new case set
+	caseset = NewCaseset_cs (NULL, env);
+	AddFileToCaseset_cs (caseset, casefile, 1.0, NULL);
 
-		// Get SFL values for rows and columns
-		sfl_values = blbn_util_sfl (state);
+	// Retract findings from the network (before learning)
+	RetractNetFindings_bn (net);
 
-		for (j = 0; j < state->case_count; ++j) {
+	// Create learner using EM learning method (updates CPTs in EM style)
+	learner = NewLearner_bn (EM_LEARNING, NULL, env);
 
-			// Get minimum SFL value for row
-			for (i = 0; i < state->node_count; ++i) {
+	// Learn cases using EM learner and the case set
+	LearnCPTs_bn (learner, GetNetNodes_bn (net), caseset, 1.0); // Degree must be greater than zero
 
-				// Check scores for values that are not for the target node or nodes that are already purchased
-				if (!blbn_is_available_finding (state, i, j)) {
+	// Free allocated structures from memory
+	DeleteLearner_bn (learner);
+	DeleteCaseset_cs (caseset);
+	DeleteStream_ns  (casefile);
 
-					// Place candidate solution (if its loss is low enough)
-					for (n = 0; n < K; ++n) {
-						if (sfl_values[i][j] < candidate_exp_loss[n]) {
+	// Retract findings from the network (after learning)
+	RetractNetFindings_bn (net);
+}
 
-							// Shift elements to the right of the list
-							for (p = K - 1; p > n; --p) {
-								candidate_exp_loss[p]    = candidate_exp_loss[p - 1];
-								candidate_actions [p][0] = candidate_actions [p - 1][0];
-								candidate_actions [p][1] = candidate_actions [p - 1][1];
-							}
+/**
+ * Learns the available findings of every case that has learned findings,
+ * except the specified case, into the specified network (a copy of the prior
+ * network, see blbn_util_copy_net_unlearn_case).  Each case is written to a
+ * memory stream by entering its findings into the network itself through the
+ * specified findings scratch, so no other network is touched.
+ */
+static void blbn_net_learn_cases_except (blbn_state_t *state, net_bn *net, int *findings, int case_index) {
 
-							// Store new candidate into previous candidate's location
-							candidate_exp_loss[n] = sfl_values[i][j];
-							candidate_actions[n][0] = i;
-							candidate_actions[n][1] = j;
+	stream_ns *casefile = NULL; // Used as temporary output location for the cases
+	const nodelist_bn *nodes = GetNetNodes_bn (net);
+	int i;
 
-							// Count this element (if not reached desired number of candidates)
-							if (kount < K) {
-								++kount;
-							}
+	casefile = NewMemoryStream_ns ("lookahead.cas", env, NULL);
 
-							break;
-						}
-					}
-				}
+	for (i = 0; i < state->case_count; ++i) {
+		if (i != case_index) { // Prevents the case being unlearned from being written
+			if (blbn_has_findings_learned_in_case (state, i)) { // Prevents writing cases that have no available findings
+				blbn_collect_case_findings (state, findings, i, 0, -1, 0);
+				blbn_enter_net_findings (state, net, findings);
+				WriteNetFindings_bn (nodes, casefile, i, 1.0);
 			}
 		}
+	}
 
-		// Free SFL values for rows and columns
-		for (i = 0; i < state->node_count; ++i) {
-			free (sfl_values[i]);
-		}
-		free (sfl_values);
+	blbn_net_learn_stream (net, casefile);
+}
 
-		// Calculate RSFL probability vector
-		candidate_prob_sum = 0;
-		for (i = 0; i < kount; ++i) {
-			candidate_prob[i] = exp ((-1.0 * candidate_exp_loss[i]) / tao);
-			candidate_prob_sum += candidate_prob[i];
-		}
-		for (i = 0; i < kount; ++i) {
-			candidate_prob[i] /= candidate_prob_sum;
-		}
+/**
+ * Learns the available findings of the specified case into the specified
+ * network, with the finding of node_index set to state_index (a lookahead
+ * finding) unless node_index is -1.  The case is written through the network
+ * itself, as in blbn_net_learn_cases_except.
+ */
+static void blbn_net_learn_case_findings (blbn_state_t *state, net_bn *net, int *findings, int case_index, int node_index, int state_index) {
 
-//		for (p = 0; p < kount; ++p) {
-//			printf ("%f ", candidate_exp_loss[p]);
-//		}
-//		printf ("\n");
-//
-//		for (p = 0; p < kount; ++p) {
-//			printf ("%f ", candidate_prob[p]);
-//		}
-//		printf ("\n");
-//
-//		for (p = 0; p < kount; ++p) {
-//			printf ("(%d,%d) ", candidate_actions[p][0], candidate_actions[p][1]);
-//		}
-//		printf ("\n");
+	stream_ns *casefile = NULL; // Used as temporary output location for the case
 
-		random_selection = ((double) rand () / (double) RAND_MAX);
-//		printf ("RAND: %f\n", random_selection);
+	casefile = NewMemoryStream_ns ("available_with_lookahead.cas", env, NULL);
 
-		// Select the random action
-		random_selection_sum = 0.0;
-		for (i = 0; i < kount; ++i) {
-			random_selection_sum += candidate_prob[i];
-			if (random_selection < random_selection_sum) {
-				curr_action->node_index = candidate_actions[i][0];
-				curr_action->case_index = candidate_actions[i][1];
-//				printf ("CHOSE: (%d,%d) with LOSS = %f\n", curr_action->node_index, curr_action->case_index);
-				break;
-			}
-		}
+	// Enters the available findings in the case and the lookahead node's state as one batch
+	blbn_collect_case_findings (state, findings, case_index, 0, -1, 0);
+	if (node_index >= 0) {
+		findings[node_index] = state_index;
 	}
+	blbn_enter_net_findings (state, net, findings);
 
+	// Writes the findings to memory (including lookahead)
+	WriteNetFindings_bn (GetNetNodes_bn (net), casefile, case_index, 1.0);
 
-	// Free candidate probabilities
-	free (candidate_prob);
+	blbn_net_learn_stream (net, casefile);
+}
+
+/**
+ * Copies the working network in the blbn_state_t structure and unlearns the
+ * specified case.  Returns pointer to copied network.  Original network is
+ * not modified.
+ *
+ * The copy does not explicitly copy the working network in the blbn_state_t
+ * structure since unlearning is not possible when using Netica's EM_LEARNING
+ * algorithm with a Netica learner_bn learner.  INSTEAD, we copy the "prior
+ * network" which was saved during initialization.  The "prior network" is the
+ * network that has been re-parameterized with a prior distribution before any
+ * learning takes place (using one of the functions for setting the prior
+ * distribution).  "Unlearning" is really done by first (1) forgetting
+ * everything that has been learned, then (2) re-learning everything except
+ * that which should be unlearned.
+ */
+net_bn* blbn_util_copy_net_unlearn_case (blbn_state_t *state, int case_index) {
+
+	net_bn* copied_net = NULL;
+
+	if (state != NULL && state->prior_net != NULL) {
+		copied_net = blbn_util_copy_net (state, state->prior_net);
+		blbn_net_learn_cases_except (state, copied_net, state->net_findings, case_index);
+	}
+
+	return copied_net;
+}
+
+/**
+ * Learns the specified case using Netica's EM_LEARNING algorithm using the
+ * specified net_bn network.  This does not perform any unlearning before
+ * learning.  That is, findings that are available in the specified case
+ * (according to the blbn_state_t structure) are written to a steam_ns
+ * casefile in memory and learned using the EM_LEARNING algorithm).
+ */
+void blbn_util_net_learn_case (blbn_state_t *state, net_bn* net, int case_index) {
+	if (state != NULL) {
+		blbn_net_learn_case_findings (state, net, state->net_findings, case_index, -1, 0);
+	}
+}
+
+/**
+ * This routine updates the learned network by learning from the specified
+ * case (i.e., the case with index case_index) with the specified node
+ * (i.e., the node with index node_index) set to the specified state (i.e.,
+ * the state with state_index) and any nodes with available (i.e., purchased)
+ * state values (or findings) set to the known values.  The findings for nodes
+ * with no available findings will not be specified.  Therefore, all presently
+ * available findings as well as the specified "lookahead" state will be
+ * learned.
+ *
+ * Notes:
+ * - This algorithm does not perform any unlearning (specifically, it doesn't
+ *   perform unlearning before learning).
+ */
+void blbn_util_net_learn_case_with_lookahead (blbn_state_t *state, net_bn* net, int node_index, int case_index, int state_index) {
+	if (state != NULL) {
+		blbn_net_learn_case_findings (state, net, state->net_findings, case_index, node_index, state_index);
+	}
+}
+
+//------------------------------------------------------------------------------
+// Candidate scoring
+//
+// The SFL, EMPG and cheating scores of the candidate (node, case) pairs are
+// independent given the working network, so the cases are handed out one at
+// a time to a pool of workers (an idle worker takes the next case).  Every
+// worker has its own copy of the working network, lookahead networks,
+// findings scratch and likelihood vectors, so the working network and the
+// evidence of the native model are never touched while scoring, and the
+// scores do not depend on the number of workers.  Queries that go through
+// shared caches (the posterior and d-separation caches) are made before the
+// workers start.  Netica is not thread-safe, so the workers make their
+// Netica calls (copying, learning, compiling and querying networks) one at a
+// time, and only the evaluation of lookahead CPTs with native inference runs
+// concurrently.  Netica inference, likelihood weighting and belief
+// propagation score with a single worker (the latter two keep engine state
+// between queries, and query the engines as before).
+//------------------------------------------------------------------------------
+
+#define BLBN_SCORE_SFL   0 // SFL expected losses (see blbn_util_sfl)
+#define BLBN_SCORE_EMPG  1 // EMPG expected gains (see blbn_util_empg)
+#define BLBN_SCORE_CHEAT 2 // expected loss reductions of the cheating policy (see blbn_util_cheat)
+
+typedef struct blbn_score_job {
+	int kind;                       // BLBN_SCORE_*
+	char argmin;                    // non-zero if only the smallest SFL score is needed (see blbn_util_sfl)
+	double bound;                   // SFL scores above bound may be abandoned
+	char **mask;                    // candidates to score (indexed [node][case]; NULL for every candidate)
+	const int *cases;               // cases to score, in the order they are handed out
+	int case_count;                 // number of cases to score
+	int next;                       // next case to hand out (guarded by lock)
+	char *prepared;                 // non-zero for the cases whose shared queries have been made
+	const unsigned int **separated; // nodes d-separated from the target in each case (NULL unless pruning)
+	double *probability;            // probability of the correct label of each case given its learned findings (EMPG)
+	double current_loss;            // log loss of the working network (cheating)
+	double **score;                 // scores (indexed [node][case])
+	int pruned_count;               // number of d-separated candidates pruned
+	pthread_mutex_t lock;           // guards next
+	pthread_mutex_t netica_lock;    // serializes the Netica calls of the workers (see blbn_score_lock_netica)
+} blbn_score_job_t;
+
+typedef struct blbn_score_worker {
+	blbn_state_t *state;
+	blbn_score_job_t *job;   // job of the worker (NULL for a single query, e.g., blbn_util_get_expected_log_loss_sampled)
+	char detached;           // non-zero if the worker never touches the working network or the native model's evidence
+	int *findings;           // findings scratch of one case
+	net_bn *net;             // copy of the working network for joint tables (NULL unless detached)
+	double **lambda;         // likelihood vectors of validation cases (NULL unless detached with native inference)
+	double *posterior;       // target posterior of a validation case
+	net_bn **lookahead_nets; // lookahead networks of every state of a candidate (sampled validation)
+	double *state_probs;     // probability of every state of a candidate (sampled validation)
+	pthread_t thread;
+
+	// Statistics, added to the state's when the worker finishes
+	unsigned int compile_count;
+	unsigned int compile_avoided_count;
+	unsigned int lookahead_count;
+	unsigned int lookahead_skipped;
+	unsigned int abandoned_count;
+	unsigned int sampled_candidate_count;
+	unsigned int sampled_stopped_count;
+	double sampled_case_fraction;
+	int pruned_count;
+} blbn_score_worker_t;
+
+/**
+ * Initializes the scratch space of a scoring worker.  A detached worker gets
+ * its own copy of the working network (copied here, before any worker runs).
+ */
+static void blbn_score_worker_init (blbn_score_worker_t *worker, blbn_state_t *state, blbn_score_job_t *job, char detached) {
 
-	// Free probabilities of selection candidate actions
-	free (candidate_exp_loss);
+	int max_state_count = 1;
+	int i;
 
-	// Free space to store candidate actions
-	for (i = 0;  i < K;  ++i) {
-		free (candidate_actions[i]);
+	worker->state = state;
+	worker->job = job;
+	worker->detached = detached;
+	worker->findings = (int *) malloc (state->node_count * sizeof (int));
+	worker->net = NULL;
+	worker->lambda = NULL;
+	if (detached) {
+		worker->net = blbn_util_copy_net (state, state->work_net);
+		if (state->inference != BLBN_INFERENCE_NETICA) {
+			worker->lambda = (double **) malloc (state->node_count * sizeof (double *));
+			for (i = 0; i < state->node_count; ++i) {
+				worker->lambda[i] = (double *) malloc (state->state_count[i] * sizeof (double));
+			}
+		}
 	}
-	free (candidate_actions);
-
-	return curr_action;
+	for (i = 0; i < state->node_count; ++i) {
+		if (state->state_count[i] > max_state_count) {
+			max_state_count = state->state_count[i];
+		}
+	}
+	worker->posterior = (double *) malloc (state->state_count[state->target] * sizeof (double));
+	worker->lookahead_nets = (net_bn **) malloc (max_state_count * sizeof (net_bn *));
+	worker->state_probs = (double *) malloc (max_state_count * sizeof (double));
+
+	worker->compile_count = 0;
+	worker->compile_avoided_count = 0;
+	worker->lookahead_count = 0;
+	worker->lookahead_skipped = 0;
+	worker->abandoned_count = 0;
+	worker->sampled_candidate_count = 0;
+	worker->sampled_stopped_count = 0;
+	worker->sampled_case_fraction = 0.0;
+	worker->pruned_count = 0;
 }
 
 /**
- * Expected Maximum Purchase Gain (EMPG)
- * i.e., the "Tell Me What I Want To Hear" algorithm
+ * Adds the statistics of a scoring worker to those of the state (and its
+ * job) and frees its scratch space.
  */
-blbn_select_action_t* blbn_select_next_empg (blbn_state_t *state) {
+static void blbn_score_worker_finish (blbn_score_worker_t *worker) {
 
-	blbn_select_action_t *prev_action = NULL;
-	blbn_select_action_t *curr_action = NULL;
+	blbn_state_t *state = worker->state;
+	int i;
 
-	int i,j;
+	state->compile_count += worker->compile_count;
+	state->compile_avoided_count += worker->compile_avoided_count;
+	state->sfl_lookahead_count += worker->lookahead_count;
+	state->sfl_lookahead_skipped += worker->lookahead_skipped;
+	state->sfl_abandoned_count += worker->abandoned_count;
+	state->sampled_candidate_count += worker->sampled_candidate_count;
+	state->sampled_stopped_count += worker->sampled_stopped_count;
+	state->sampled_case_fraction += worker->sampled_case_fraction;
+	if (worker->job != NULL) {
+		worker->job->pruned_count += worker->pruned_count;
+	}
 
-	double max_exp_gain = 0;
+	if (worker->net != NULL) {
+		blbn_delete_net (worker->net);
+	}
+	if (worker->lambda != NULL) {
+		for (i = 0; i < state->node_count; ++i) {
+			free (worker->lambda[i]);
+		}
+		free (worker->lambda);
+	}
+	free (worker->findings);
+	free (worker->posterior);
+	free (worker->lookahead_nets);
+	free (worker->state_probs);
+}
 
-	double **gain_values;
+/**
+ * Netica is not thread-safe, so every Netica call of a scoring worker
+ * (copying, learning, compiling, querying and deleting networks) is made
+ * between blbn_score_lock_netica and blbn_score_unlock_netica, one worker at
+ * a time.  Calls must not be nested.
+ */
+static void blbn_score_lock_netica (blbn_score_worker_t *worker) {
+	if (worker->job != NULL) {
+		pthread_mutex_lock (&worker->job->netica_lock);
+	}
+}
 
-	// Move to the most recent previous select action
-	prev_action = state->sel_action_seq;
-	if (prev_action != NULL) {
-		while (prev_action->next != NULL) {
-			prev_action = prev_action->next;
-		}
+static void blbn_score_unlock_netica (blbn_score_worker_t *worker) {
+	if (worker->job != NULL) {
+		pthread_mutex_unlock (&worker->job->netica_lock);
 	}
+}
 
-	// Allocate space for current selection and initialize structure
-	curr_action = (blbn_select_action_t *) malloc (sizeof (blbn_select_action_t));
-	curr_action->prev = NULL; // no previous action (this is the first action)
-	curr_action->next = NULL; // no next action (this is the newest action)
+/**
+ * Deletes the specified network of a scoring worker.
+ */
+static void blbn_score_delete_net (blbn_score_worker_t *worker, net_bn *net) {
+	blbn_score_lock_netica (worker);
+	blbn_delete_net (net);
+	blbn_score_unlock_netica (worker);
+}
 
-	if (curr_action != NULL) {
+/**
+ * Returns a copy of the specified network that has learned the findings of
+ * the specified case with node_index in state_index (see
+ * blbn_net_learn_case_findings) for a scoring worker.
+ */
+static net_bn* blbn_score_copy_net_learn_case (blbn_score_worker_t *worker, net_bn *net, int case_index, int node_index, int state_index) {
 
-		//------------------------------------------------------------------------------
-		// This is the first selection, so select /first/ node
-		//------------------------------------------------------------------------------
+	net_bn *copied_net = NULL;
 
-		// Randomly select node to make first purchase from
-		curr_action->node_index = rand () % state->node_count;
+	blbn_score_lock_netica (worker);
+	copied_net = blbn_util_copy_net (worker->state, net);
+	blbn_net_learn_case_findings (worker->state, copied_net, worker->findings, case_index, node_index, state_index);
+	blbn_score_unlock_netica (worker);
 
-		while ((curr_action->node_index == state->target) || blbn_count_findings_in_node_not_purchased (state, curr_action->node_index) <= 0) {
-			curr_action->node_index = (curr_action->node_index + 1) % state->node_count; // select initial node uniformly at random
-		}
+	return copied_net;
+}
 
-		// Select random case
-		curr_action->case_index = blbn_get_random_finding_not_purchased_in_node (state, curr_action->node_index);
+/**
+ * Returns the CPTs of the specified network (see blbn_get_net_cpts) for a
+ * scoring worker.
+ */
+static double** blbn_score_get_net_cpts (blbn_score_worker_t *worker, net_bn *net) {
 
-		//------------------------------------------------------------------------------
-		// Select the next action (i.e., select a (node,case) tuple) with the
-		// smallest SFL value.
-		//------------------------------------------------------------------------------
+	double **cpt = NULL;
 
-		// Get SFL values for row
-		gain_values = blbn_util_empg (state);
+	blbn_score_lock_netica (worker);
+	cpt = blbn_get_net_cpts (worker->state, net);
+	blbn_score_unlock_netica (worker);
 
-		for (j = 0; j < state->case_count; ++j) {
+	return cpt;
+}
 
-			// Get minimum SFL value for row
-			for (i = 0; i < state->node_count; ++i) {
+/**
+ * Compiles the specified network of a scoring worker (the caller holds the
+ * Netica lock).
+ */
+static void blbn_score_compile_net (blbn_score_worker_t *worker, net_bn *net) {
+	blbn_compile_net_counted (worker->state, net, &worker->compile_count, &worker->compile_avoided_count);
+}
 
-				// Check scores for values that are not for the target node or nodes that are already purchased
-				if (!blbn_is_available_finding (state, i, j)) {
-					// Update minimum if necessary
-					if (gain_values[i][j] > max_exp_gain) {
-						max_exp_gain = gain_values[i][j];
-						curr_action->node_index = i;
-						curr_action->case_index = j;
-					}
-				}
-			}
-		}
+/**
+ * Returns a copy of the working network with the specified case unlearned
+ * (see blbn_util_copy_net_unlearn_case) for a scoring worker.
+ */
+static net_bn* blbn_score_copy_net_unlearn_case (blbn_score_worker_t *worker, int case_index) {
 
-		//printf ("selected (%d, %d)\n", curr_action->node_index, curr_action->case_index);
+	blbn_state_t *state = worker->state;
+	net_bn *copied_net = NULL;
 
-		// Free SFL values for row
-		for (i = 0; i < state->node_count; ++i) {
-			free (gain_values[i]);
-		}
-		free (gain_values);
+	if (state->prior_net == NULL) {
+		return NULL;
 	}
 
-	return curr_action;
+	blbn_score_lock_netica (worker);
+	copied_net = blbn_util_copy_net (state, state->prior_net);
+	blbn_net_learn_cases_except (state, copied_net, worker->findings, case_index);
+	blbn_score_unlock_netica (worker);
+
+	return copied_net;
 }
 
 /**
- * Cheating algorithm (a variant of the "Tell Me What I Want To Hear"
- * algorithm used to evaluate performance of other algorithms).
- *
- * - Uses test set for loss function
- * - Not optimal (so, this is unlike Bayes optimal)
- *   - Optimality would require checking all possible sequences of purchases until budget has been exhausted (or until all possible purchases are made)
+ * Returns the joint tables of the specified case (see
+ * blbn_get_node_target_joint_given_learned) for a scoring worker: a detached
+ * worker computes them with its own copy of the working network.
  */
-blbn_select_action_t* blbn_select_next_cheating (blbn_state_t *state) {
-
-	blbn_select_action_t *prev_action = NULL;
-	blbn_select_action_t *curr_action = NULL;
+static double** blbn_score_get_joint (blbn_score_worker_t *worker, int case_index) {
 
-	int i,j;
+	double **joint = NULL;
 
-	double max_exp_gain = 0;
+	blbn_score_lock_netica (worker);
+	if (worker->net != NULL) {
+		blbn_score_compile_net (worker, worker->net);
+		joint = blbn_get_node_target_joint_in_net (worker->state, worker->net, worker->findings, case_index);
+	} else {
+		joint = blbn_get_node_target_joint_given_learned (worker->state, case_index);
+	}
+	blbn_score_unlock_netica (worker);
 
-	double **gain_values;
+	return joint;
+}
 
-	// Move to the most recent previous select action
-	prev_action = state->sel_action_seq;
-	if (prev_action != NULL) {
-		while (prev_action->next != NULL) {
-			prev_action = prev_action->next;
-		}
-	}
+/**
+ * Returns the log loss of the specified lookahead network (see
+ * blbn_util_get_log_loss) for a scoring worker.  A detached worker evaluates
+ * it without touching the native model's evidence (see
+ * blbn_get_model_test_metrics_from).
+ */
+static double blbn_score_get_log_loss (blbn_score_worker_t *worker, net_bn *net) {
 
-	// Allocate space for current selection and initialize structure
-	curr_action = (blbn_select_action_t *) malloc (sizeof (blbn_select_action_t));
-	curr_action->prev = NULL; // no previous action (this is the first action)
-	curr_action->next = NULL; // no next action (this is the newest action)
+	blbn_state_t *state = worker->state;
+	blbn_test_metrics_t *metrics = NULL;
+	double **cpt = NULL;
+	double log_loss;
 
-	if (curr_action != NULL) {
+	if (state->inference == BLBN_INFERENCE_NETICA) {
+		blbn_score_lock_netica (worker);
+		blbn_score_compile_net (worker, net);
+		metrics = blbn_get_net_test_metrics (state, net);
+		blbn_score_unlock_netica (worker);
+	} else {
+		cpt = blbn_score_get_net_cpts (worker, net);
+		metrics = blbn_get_model_test_metrics_from (state, (const double * const *) cpt, worker->detached);
+		blbn_free_net_cpts (state, cpt);
+	}
 
-		//------------------------------------------------------------------------------
-		// This is the first selection, so select /first/ node
-		//------------------------------------------------------------------------------
+	log_loss = metrics->log_loss;
+	blbn_free_test_metrics (metrics);
 
-		// Randomly select node to make first purchase from
-		curr_action->node_index = rand () % state->node_count;
+	return log_loss;
+}
 
-		while ((curr_action->node_index == state->target) || blbn_count_findings_in_node_not_purchased (state, curr_action->node_index) <= 0) {
-			curr_action->node_index = (curr_action->node_index + 1) % state->node_count; // select initial node uniformly at random
-		}
+/**
+ * Returns the loss of a copy of the specified lookahead base network (i.e., a
+ * network that has not learned the specified case) after learning the
+ * available findings of the case without any lookahead finding.  This
+ * approximates the loss expected from purchasing a finding that is
+ * d-separated from the target in the case: the finding does not change the
+ * target posterior of the case, but learning it still changes the CPT of its
+ * family, so the exact loss may be higher or lower.
+ */
+static double blbn_score_get_no_lookahead_log_loss (blbn_score_worker_t *worker, net_bn *lookahead_base_net, int case_index) {
 
-		// Select random case
-		curr_action->case_index = blbn_get_random_finding_not_purchased_in_node (state, curr_action->node_index);
+	net_bn *net = NULL;
+	double log_loss;
 
-		//------------------------------------------------------------------------------
-		// Select the next action (i.e., select a (node,case) tuple) with the
-		// smallest SFL value.
-		//------------------------------------------------------------------------------
+	net = blbn_score_copy_net_learn_case (worker, lookahead_base_net, case_index, -1, 0);
+	log_loss = blbn_score_get_log_loss (worker, net);
+	blbn_score_delete_net (worker, net);
 
-		// Get "cheat" values for row
-		printf ("START: %d, %d\n", curr_action->case_index, curr_action->node_index);
-		fprintf (log_fp, "START: %d, %d\n", curr_action->case_index, curr_action->node_index);
-		gain_values = blbn_util_cheat (state);
-		printf ("DONE\n");
-		fprintf (log_fp, "DONE\n");
-		fflush (log_fp);
+	return log_loss;
+}
 
-		for (j = 0; j < state->case_count; ++j) {
+/**
+ * Returns the expected log loss of the specified lookahead networks over the
+ * sampled validation cases for a scoring worker (see
+ * blbn_util_get_expected_log_loss_sampled).
+ */
+static double blbn_score_get_expected_log_loss_sampled (blbn_score_worker_t *worker, net_bn **nets, const double *probability, int net_count, double bound, char *exact) {
+
+	blbn_state_t *state = worker->state;
+	double ***cpt = NULL;
+	double *posterior = worker->posterior;
+	const prob_bn *beliefs = NULL;
+	node_bn *target_node = NULL;
+	const int *findings = NULL;
+	unsigned int n, r;
+	int label, k;
+	double loss, p, weight, delta;
+	double total = 0.0, mean = 0.0, m2 = 0.0, se;
+	double case_count = state->validation_tested_count;
+
+	*exact = 0;
+
+	if (state->inference != BLBN_INFERENCE_NETICA) {
+		cpt = (double ***) malloc (net_count * sizeof (double **));
+		for (k = 0; k < net_count; ++k) {
+			cpt[k] = blbn_score_get_net_cpts (worker, nets[k]);
+		}
+	} else {
+		blbn_score_lock_netica (worker);
+		for (k = 0; k < net_count; ++k) {
+			blbn_score_compile_net (worker, nets[k]);
+		}
+		blbn_score_unlock_netica (worker);
+	}
 
-			// Get minimum SFL value for row
-			for (i = 0; i < state->node_count; ++i) {
+	for (n = 0; n < state->validation_packed_count; ++n) {
+		r = state->validation_order[n];
+		findings = state->validation_packed + (size_t) r * state->node_count;
+		label = state->validation_labels[r];
 
-				// Check scores for values that are not for the target node or nodes that are already purchased
-				if (!blbn_is_available_finding (state, i, j)) {
-					// Update minimum if necessary
-					if (gain_values[i][j] > max_exp_gain) {
-						max_exp_gain = gain_values[i][j];
-						curr_action->node_index = i;
-						curr_action->case_index = j;
-					}
-				}
+		// Loss of the case, in expectation over the lookahead networks
+		loss = 0.0;
+		if (cpt != NULL) {
+			blbn_set_row_evidence (state, worker->lambda, r);
+		}
+		for (k = 0; k < net_count; ++k) {
+			if (cpt != NULL) {
+				blbn_get_row_target_posterior (state, (const double * const *) cpt[k], worker->lambda, r, posterior);
+				p = posterior[label];
+			} else {
+				blbn_score_lock_netica (worker);
+				target_node = blbn_get_net_node (state, nets[k], state->target);
+				blbn_enter_net_findings (state, nets[k], findings);
+				beliefs = GetNodeBeliefs_bn (target_node);
+				p = beliefs[label];
+				blbn_score_unlock_netica (worker);
 			}
+			loss -= probability[k] * log (p > BLBN_LOG_LOSS_MIN_PROBABILITY ? p : BLBN_LOG_LOSS_MIN_PROBABILITY);
 		}
 
-		printf ("COMPLETE\n");
-		fprintf (log_fp, "COMPLETE\n");
-		fflush (log_fp);
+		// Update the running mean and variance (weighted by the number of cases with the pattern)
+		weight = state->validation_weights[r];
+		total += weight;
+		delta = loss - mean;
+		mean += weight / total * delta;
+		m2 += weight * delta * (loss - mean);
+
+		// Stop once the mean is confidently above the bound (standard error with finite population correction)
+		if (total >= BLBN_SAMPLED_VALIDATION_MIN_CASES && total < case_count) {
+			se = sqrt (m2 / (total - 1.0) / total * (1.0 - total / case_count));
+			if (mean - state->sampled_validation_z * se > bound) {
+				++worker->sampled_stopped_count;
+				break;
+			}
+		}
+	}
+	if (n == state->validation_packed_count) {
+		*exact = 1;
+	}
 
-		//printf ("selected (%d, %d)\n", curr_action->node_index, curr_action->case_index);
+	++worker->sampled_candidate_count;
+	worker->sampled_case_fraction += (case_count > 0 ? total / case_count : 1.0);
 
-		// Free SFL values for row
-		for (i = 0; i < state->node_count; ++i) {
-			free (gain_values[i]);
+	if (cpt != NULL) {
+		for (k = 0; k < net_count; ++k) {
+			blbn_free_net_cpts (state, cpt[k]);
 		}
-		free (gain_values);
+		free (cpt);
+	} else {
+		blbn_score_lock_netica (worker);
+		for (k = 0; k < net_count; ++k) {
+			RetractNetFindings_bn (nets[k]);
+		}
+		blbn_score_unlock_netica (worker);
 	}
 
-	return curr_action;
+	return (total > 0.0 ? mean : DBL_MAX);
 }
 
 /**
- * Returns index of random non-purchased case for node with specified index or
- * returns -1 if no non-purchases case remains.
+ * Computes the log loss (see blbn_score_get_log_loss) of each of the
+ * specified networks into log_loss in one pass over the validation cases:
+ * the evidence of each case is set once, and the target posterior of every
+ * network is computed from it.
  */
-int blbn_get_random_finding_not_purchased_in_node (blbn_state_t *state, int node_index) {
-	int i;
-	int count = 0; // number of findings not purchased
-	int *cases = NULL;
-	int case_index = -1;
+static void blbn_score_get_log_losses (blbn_score_worker_t *worker, net_bn **nets, int net_count, double *log_loss) {
+
+	blbn_state_t *state = worker->state;
+	double ***cpt = NULL;
+	double **probability = NULL;
+	double *posterior = worker->posterior;
+	const prob_bn *beliefs = NULL;
+	const int *findings = NULL;
+	unsigned int count = state->validation_packed_count;
+	unsigned int r;
+	int label, k;
+	double p;
+
+	probability = (double **) malloc (net_count * sizeof (double *));
+	for (k = 0; k < net_count; ++k) {
+		probability[k] = (double *) malloc ((count > 0 ? count : 1) * sizeof (double));
+	}
+
+	if (state->inference != BLBN_INFERENCE_NETICA) {
+		cpt = (double ***) malloc (net_count * sizeof (double **));
+		for (k = 0; k < net_count; ++k) {
+			cpt[k] = blbn_score_get_net_cpts (worker, nets[k]);
+		}
+	} else {
+		blbn_score_lock_netica (worker);
+		for (k = 0; k < net_count; ++k) {
+			blbn_score_compile_net (worker, nets[k]);
+		}
+		blbn_score_unlock_netica (worker);
+	}
 
-	count = blbn_get_findings_not_purchased_for_node (state, node_index, &cases);
-	if (count > 0 && cases != NULL) {
-		i = rand () % count;
-		case_index = cases[i];
-		free (cases);
+	for (r = 0; r < count; ++r) {
+		findings = state->validation_packed + (size_t) r * state->node_count;
+		label = state->validation_labels[r];
+
+		if (cpt != NULL) {
+			blbn_set_row_evidence (state, worker->lambda, r);
+		}
+		for (k = 0; k < net_count; ++k) {
+			if (cpt != NULL) {
+				blbn_get_row_target_posterior (state, (const double * const *) cpt[k], worker->lambda, r, posterior);
+				p = posterior[label];
+			} else {
+				blbn_score_lock_netica (worker);
+				blbn_enter_net_findings (state, nets[k], findings);
+				beliefs = GetNodeBeliefs_bn (blbn_get_net_node (state, nets[k], state->target));
+				p = beliefs[label];
+				blbn_score_unlock_netica (worker);
+			}
+			probability[k][r] = (p > BLBN_LOG_LOSS_MIN_PROBABILITY ? p : BLBN_LOG_LOSS_MIN_PROBABILITY);
+		}
 	}
 
-	return case_index;
+	for (k = 0; k < net_count; ++k) {
+		log_loss[k] = (state->validation_tested_count > 0 ? -blbn_sum_log (probability[k], state->validation_weights, count) / state->validation_tested_count : DBL_MAX);
+		free (probability[k]);
+	}
+	free (probability);
+
+	if (cpt != NULL) {
+		for (k = 0; k < net_count; ++k) {
+			blbn_free_net_cpts (state, cpt[k]);
+		}
+		free (cpt);
+	} else {
+		blbn_score_lock_netica (worker);
+		for (k = 0; k < net_count; ++k) {
+			RetractNetFindings_bn (nets[k]);
+		}
+		blbn_score_unlock_netica (worker);
+	}
 }
 
 /**
- * Returns index of random non-purchased case for node with specified index or
- * returns -1 if no non-purchases case remains.
+ * Returns the expected log loss sum_k probability[k] * loss (nets[k]) of the
+ * specified lookahead networks (e.g., one per state of a lookahead finding)
+ * over the validation cases, streaming the packed cases in the fixed random
+ * order of sampled validation (see blbn_enable_sampled_validation).  A
+ * running mean and variance of the loss per case is kept, and streaming
+ * stops as soon as the lower confidence bound of the mean exceeds bound
+ * (e.g., the exact loss of the best candidate so far), returning the mean
+ * of the cases consumed.  Sets exact to non-zero if every case was consumed,
+ * in which case the result is the exact expected loss.
  */
-int blbn_get_random_finding_not_purchased_in_node_with_label (blbn_state_t *state, int node_index, int target_state) {
-	int i;
-	int count = 0; // number of findings not purchased
-	int *cases = NULL;
-	int case_index = -1;
-
-	count = blbn_get_findings_not_purchased_for_node (state, node_index, &cases);
-	if (count > 0 && cases != NULL) {
-		i = rand () % count;
+double blbn_util_get_expected_log_loss_sampled (blbn_state_t *state, net_bn **nets, const double *probability, int net_count, double bound, char *exact) {
 
-		// Starting at the random selection, iterate over the remaining non-purchased findings until one is found in an instance where the target state is equal to the specified target state
-		while (state->state[state->target][i] != target_state) {
-			i = (i + 1) % count;
-		}
+	blbn_score_worker_t worker;
+	double expected_loss;
 
-		case_index = cases[i];
-		free (cases);
-	}
+	blbn_score_worker_init (&worker, state, NULL, 0);
+	expected_loss = blbn_score_get_expected_log_loss_sampled (&worker, nets, probability, net_count, bound, exact);
+	blbn_score_worker_finish (&worker);
 
-	return case_index;
+	return expected_loss;
 }
 
 /**
- * Copies the specified network and returns a pointer to the copy.  Does not
- * modify original network.  Returns NULL if cannot copy.
+ * Returns the expected loss sum_k P(k) * loss_k of purchasing the finding of
+ * the specified node in the specified case, where P(k) is the probability of
+ * state k given the learned findings of the case (from joint) and loss_k is
+ * the loss after learning the case with the finding in state k.
+ *
+ * States are looked ahead in descending order of P(k).  Losses are
+ * non-negative, so the partial sum is a lower bound on the expected loss,
+ * and the computation is abandoned (returning the partial sum) as soon as
+ * it exceeds bound (e.g., the expected loss of the best candidate so far).
  */
-net_bn* blbn_util_copy_net (blbn_state_t *state, net_bn* net) {
-	net_bn *copied_net = NULL;
+static double blbn_score_get_lookahead_expected_loss (blbn_score_worker_t *worker, net_bn *lookahead_base_net, double **joint, int node_index, int case_index, double bound) {
+
+	blbn_state_t *state = worker->state;
+	net_bn *lookahead_net = NULL;
+	int node_state_count = state->state_count[node_index];
+	double *state_prob = worker->state_probs;
+	int *order = NULL;
+	double expected_loss = 0.0;
+	int k, n, swap;
+
+	// Order the states by descending probability
+	order = (int *) malloc (node_state_count * sizeof (int));
+	for (k = 0; k < node_state_count; ++k) {
+		state_prob[k] = blbn_get_joint_node_state_probability (state, joint, node_index, case_index, k);
+		order[k] = k;
+		for (n = k; n > 0 && state_prob[order[n]] > state_prob[order[n - 1]]; --n) {
+			swap = order[n];
+			order[n] = order[n - 1];
+			order[n - 1] = swap;
+		}
+	}
+
+	for (n = 0; n < node_state_count; ++n) {
+		k = order[n];
+
+		// Copy base lookahead network for this particular lookahead
+		lookahead_net = blbn_score_copy_net_learn_case (worker, lookahead_base_net, case_index, node_index, k);
+
+		// Add the loss of the lookahead network, weighted by the probability of state k
+		expected_loss += state_prob[k] * blbn_score_get_log_loss (worker, lookahead_net);
+		++worker->lookahead_count;
+
+		// Deletes copy of the lookahead network
+		blbn_score_delete_net (worker, lookahead_net);
+
+		if (expected_loss > bound && n + 1 < node_state_count) {
+			worker->lookahead_skipped += node_state_count - n - 1;
+			++worker->abandoned_count;
+			break;
+		}
+	}
+
+	free (order);
 
-	if (state != NULL && net != NULL) {
+	return expected_loss;
+}
 
-		// Copy the network
-		copied_net = CopyNet_bn (net, GetNetName_bn (net), env, "no_visual");
+/**
+ * Makes the queries of the specified case that go through caches shared by
+ * the workers (d-separation, target posteriors) for a scoring job.
+ */
+static void blbn_score_prepare_case (blbn_state_t *state, blbn_score_job_t *job, int case_index) {
 
+	if (state->prune_d_separated) {
+		job->separated[case_index] = blbn_get_d_separated_from_target_in_case (state, case_index);
 	}
-
-	return copied_net;
+	if (job->kind == BLBN_SCORE_EMPG) {
+		job->probability[case_index] = blbn_get_target_node_belief_given_learned (state, case_index);
+	}
+	job->prepared[case_index] = 1;
 }
 
 /**
- * Copies the working network in the blbn_state_t structure and unlearns the
- * specified case.  Returns pointer to copied network.  Original network is
- * not modified.
+ * Computes the SFL score of every node in the specified case into the score
+ * matrix of the job.  Nodes are visited in ascending order of their last
+ * score, and if only the smallest score is needed, the score of a node is
+ * abandoned (leaving a lower bound) once it exceeds the bound of the job or
+ * the best score of the case so far.
  */
-net_bn* blbn_util_copy_net_unlearn_case (blbn_state_t *state, int case_index) {
+static void blbn_score_sfl_case (blbn_score_worker_t *worker, int case_index) {
+
+	blbn_state_t *state = worker->state;
+	blbn_score_job_t *job = worker->job;
+	double bound = job->bound;
+	int i, k, n;
+	int node_state_count;
+	int *node_order = NULL;
+	net_bn *lookahead_base_net = NULL;
+	double **joint = NULL;
+	const unsigned int *separated = job->separated[case_index];
+	double no_lookahead_loss = -1.0;
+	double sfl_value;
+	char exact;
 
-	int i;
-	net_bn* copied_net = NULL;
+	// Get P(node, target | learned findings) for every node in the case
+	joint = blbn_score_get_joint (worker, case_index);
 
-	stream_ns   *casefile  = NULL; // Used as temporary output location for case
-	caseposn_bn casepon;
-	caseset_cs  *caseset   = NULL; // Case set where temporary case output will be read into
-	nodelist_bn *nodes     = NULL;
-	learner_bn  *learner   = NULL;
+	// Copy base network from which to perform lookahead for this case
+	lookahead_base_net = blbn_score_copy_net_unlearn_case (worker, case_index);
 
-	if (state != NULL) {
+	// Visit the nodes with the best scores in the last iteration first
+	node_order = blbn_get_sfl_order (state, case_index);
 
-		//------------------------------------------------------------------------------
-		// Unlearn findings
-		//------------------------------------------------------------------------------
+	for (n = 0; n < state->node_count; ++n) {
+		i = node_order[n];
 
-		// Get list of network's nodes
-		nodes = GetNetNodes_bn (state->work_net);
+		sfl_value = DBL_MAX; // Initialize SFL score to "infinite"
 
-		// Write findings to a temporary *.cas file (in memory)
-		//if (remove ("lookahead.cas") == -1) {
-		//	// Error deleting file
-		//}
-		//casefile = NewFileStream_ns ("lookahead.cas", env, NULL); // TODO: Update to state->env
-		casefile = NewMemoryStream_ns ("lookahead.cas", env, NULL); // TODO: Update to state->env
+		// Only compute SFL score if node i in the case is available for purchase (and is to be scored)
+		if (!blbn_is_available_finding (state, i, case_index) && (job->mask == NULL || job->mask[i][case_index])) {
 
-		//------------------------------------------------------------------------------
-		// Write findings of cases that have learned findings, except the case
-		// being that was specified to be unlearned.
-		//------------------------------------------------------------------------------
+			if (separated != NULL && BLBN_BITSET_TEST (separated, i)) {
 
-		for (i = 0; i < state->case_count; ++i) {
-			if (i != case_index) { // Prevents the case being unlearned from being copied into temporary case set
-				if (blbn_has_findings_learned_in_case (state, i)) { // Prevents copying cases that have no available findings
-					//printf ("writing case %d\n", i);
-					//blbn_has_findings_available_in_case (state, i);
-					blbn_set_net_findings_available (state, i);
-					casepon = WriteNetFindings_bn (nodes, casefile, i, 1.0);
+				// Node i is d-separated from the target in this case, so its purchase
+				// is scored as learning the case without a lookahead finding instead
+				// of looking ahead on each of its states.  This is an approximation,
+				// not a bound: learning the finding still changes the CPT of its
+				// family, and so the validation loss
+				if (no_lookahead_loss < 0.0) {
+					no_lookahead_loss = blbn_score_get_no_lookahead_log_loss (worker, lookahead_base_net, case_index);
+				}
+				sfl_value = no_lookahead_loss;
+				++worker->pruned_count;
+
+			} else if (state->sampled_validation_z > 0.0) {
+
+				// Evaluate the lookahead networks of every state together on a sample
+				// of the validation cases, stopping once the candidate is confidently
+				// worse than the best exact candidate so far
+				node_state_count = state->state_count[i];
+				for (k = 0; k < node_state_count; ++k) {
+					worker->lookahead_nets[k] = blbn_score_copy_net_learn_case (worker, lookahead_base_net, case_index, i, k);
+					worker->state_probs[k] = blbn_get_joint_node_state_probability (state, joint, i, case_index, k);
 				}
+				sfl_value = blbn_score_get_expected_log_loss_sampled (worker, worker->lookahead_nets, worker->state_probs, node_state_count, (job->argmin ? bound : DBL_MAX), &exact);
+				for (k = 0; k < node_state_count; ++k) {
+					blbn_score_delete_net (worker, worker->lookahead_nets[k]);
+				}
+
+			} else {
+				sfl_value = blbn_score_get_lookahead_expected_loss (worker, lookahead_base_net, joint, i, case_index, (job->argmin ? bound : DBL_MAX));
+			}
+
+			if (sfl_value < bound) {
+				bound = sfl_value;
 			}
 		}
 
-		//------------------------------------------------------------------------------
-		// Creates the copy network.  This network does not explicitly copy the
-		// working network in the blbn_state_t structure since unlearning is not
-		// possible when using Netica's EM_LEARNING algorithm with a Netica
-		// learner_bn learner.  INSTEAD, we copy the "prior network" which was saved
-		// during initialization.  The "prior network" is the network that has been
-		// re-parameterized with a prior distribution before any learning takes place
-		// (using one of the functions for setting the prior distribution).
-		//------------------------------------------------------------------------------
+		job->score[i][case_index] = sfl_value;
+	}
+
+	free (node_order);
+	blbn_score_delete_net (worker, lookahead_base_net);
+	blbn_free_node_target_joint (state, joint);
+}
+
+/**
+ * Computes the EMPG score (the expected percent increase in the probability
+ * of the correct label) of every node in the specified case into the score
+ * matrix of the job.
+ */
+static void blbn_score_empg_case (blbn_score_worker_t *worker, int case_index) {
+
+	blbn_state_t *state = worker->state;
+	blbn_score_job_t *job = worker->job;
+	int i, k;
+	int node_state_count;
+	double **joint = NULL;
+	const unsigned int *separated = job->separated[case_index];
+	double state_probability;
+	double target_probability;
+	double current_target_probability = job->probability[case_index];
+	double expected_target_probability;
+
+	// Get P(node, target | learned findings) for every node in the case
+	joint = blbn_score_get_joint (worker, case_index);
 
-		// Creates copy of the "prior network" as a basis for learning all cases
-		// that have already been learned in the "working network" except the case
-		// that we wish to unlearn.  Therefore, "unlearning" is really done by first
-		// (1) forgetting everything that has been learned, then (2) re-learning
-		// everything except that which should be unlearned.  The "prior network" is
-		// the network that "doesn't know anything".  That is, this is the network
-		// from which learning begins.  To "forget everything", simply copy this
-		// network and use that copy instead of the network that should forget all
-		// it knows.  That is, delete the network that should unlearn everything
-		// that is has learned, and simply copy the "prior network" to use instead.
-		// In essence, this "short circuits" the unlearning process (which Netica
-		// doesn't allow using it's EM_LEARNING algorithm with its learner_bn
-		// learner, anyway --- that is, negative experience can't be specified).
+	for (i = 0; i < state->node_count; ++i) {
 
-		if (state->prior_net != NULL) {
-			copied_net = blbn_util_copy_net (state, state->prior_net);
+		if (job->mask != NULL && !job->mask[i][case_index] && !blbn_is_available_finding (state, i, case_index)) {
+			continue;
 		}
 
-		//------------------------------------------------------------------------------
-		// Learn the "to learn" cases that were written to memory
-		//------------------------------------------------------------------------------
+		// Only score node i if it is available for purchase in the case
+		if (!blbn_is_available_finding (state, i, case_index)) {
 
-		// Get list of network's nodes
-		nodes = GetNetNodes_bn (copied_net); // NOTE: THIS IS IMPORTANT!
+			expected_target_probability = 0.0;
 
-		// Load case in temporary *.cas file into new case set (contains only that single case)
-		caseset = NewCaseset_cs (NULL, env);
-		AddFileToCaseset_cs (caseset, casefile, 1.0, NULL);
+			node_state_count = state->state_count[i];
 
-		// Retract findings from copied network (before learning)
-		RetractNetFindings_bn (copied_net);
+			if (separated != NULL && BLBN_BITSET_TEST (separated, i)) {
 
-		// Create learner using EM learning method (updates CPTs in EM style)
-		learner = NewLearner_bn (EM_LEARNING, NULL, env); // TODO: Update to state->env
+				// Node i is d-separated from the target in the case, so the expected
+				// probability of the correct label is its present probability
+				expected_target_probability = blbn_get_joint_target_probability (state, joint, i, case_index);
+				++worker->pruned_count;
+
+			} else {
 
-		// Learn cases using EM learner and temporary case file
-		LearnCPTs_bn (learner, nodes, caseset, 1.0); // Degree must be greater than zero
+				for (k = 0; k < node_state_count; ++k) {
 
-		// Free allocated structures from memory
-		DeleteLearner_bn (learner);
-		DeleteCaseset_cs (caseset);
-		DeleteStream_ns  (casefile);
+					// Get probability that node i is in state k (given purchased findings in the case)
+					state_probability = blbn_get_joint_node_state_probability (state, joint, i, case_index, k);
 
-		// Retract findings from copied network (after learning)
-		RetractNetFindings_bn (copied_net);
+					// Get probability of the target given the purchased/learned values and node i in state k
+					target_probability = blbn_get_joint_target_probability_given_node_state (state, joint, i, case_index, k);
 
-		//------------------------------------------------------------------------------
-		// Return new network
-		//------------------------------------------------------------------------------
+					// Update calculation of expected probability of predicting correct label
+					if (k == 0) {
+						expected_target_probability = target_probability * state_probability;
+					} else {
+						expected_target_probability += target_probability * state_probability;
+					}
+				}
+			}
+
+			// Calculate percent difference between probability of case being predicted correctly
+			job->score[i][case_index] = (expected_target_probability - current_target_probability) / current_target_probability;
 
-		return copied_net;
+		} else {
+
+			job->score[i][case_index] = -1;
 
+		}
 	}
 
-	return NULL;
+	blbn_free_node_target_joint (state, joint);
 }
 
 /**
- * Learns the specified case using Netica's EM_LEARNING algorithm using the
- * specified net_bn network.  This does not perform any unlearning before
- * learning.  That is, findings that have been learned in the specified case
- * (according to the blbn_state_t structure) are written to a steam_ns
- * casefile in memory and learned using the EM_LEARNING algorithm).
+ * Computes the score of the cheating policy (the expected reduction of the
+ * log loss) of every node in the specified case into the score matrix of the
+ * job.  The lookahead networks of every state of every node in the case are
+ * learned and evaluated together in one pass over the validation cases (see
+ * blbn_score_get_log_losses), and the score of a node is the reduction of
+ * the current loss expected over its states.
  */
-void blbn_util_net_learn_case (blbn_state_t *state, net_bn* net, int case_index) {
+static void blbn_score_cheat_case (blbn_score_worker_t *worker, int case_index) {
+
+	blbn_state_t *state = worker->state;
+	blbn_score_job_t *job = worker->job;
+	int i, k, n;
+	int net_count = 0;
+	int max_net_count = 1;
+	double **joint = NULL;
+	net_bn *lookahead_base_net = NULL;
+	net_bn **nets = NULL;
+	int *first_net = NULL;   // index of the lookahead network of the first state of each node (-1 if not looked ahead)
+	double *log_loss = NULL;
+	const unsigned int *separated = job->separated[case_index];
+	int no_lookahead_net = -1;
+	double expected_loss;
 
-	stream_ns   *casefile  = NULL; // Used as temporary output location for case
-	caseposn_bn casepon;
-	caseset_cs  *caseset   = NULL; // Case set where temporary case output will be read into
-	nodelist_bn *nodes     = NULL;
-	learner_bn  *learner   = NULL;
+	// Get P(node, target | learned findings) for every node in the case
+	joint = blbn_score_get_joint (worker, case_index);
 
-	if (state != NULL) {
+	lookahead_base_net = blbn_score_copy_net_unlearn_case (worker, case_index);
 
-		//------------------------------------------------------------------------------
-		// Unlearn findings
-		//------------------------------------------------------------------------------
+	for (i = 0; i < state->node_count; ++i) {
+		max_net_count += state->state_count[i];
+	}
+	nets = (net_bn **) malloc (max_net_count * sizeof (net_bn *));
+	first_net = (int *) malloc (state->node_count * sizeof (int));
 
-		// Get list of network's nodes
-		nodes = GetNetNodes_bn (state->work_net);
+	// Learn the lookahead network of every state of every node to be scored
+	for (i = 0; i < state->node_count; ++i) {
+		first_net[i] = -1;
 
-		// Write findings to a temporary *.cas file (in memory)
-		casefile = NewMemoryStream_ns ("available.cas", env, NULL);
+		// Only score node i if it is available for purchase in the case (and is to be scored)
+		if (blbn_is_available_finding (state, i, case_index) || (job->mask != NULL && !job->mask[i][case_index])) {
+			continue;
+		}
 
-		//------------------------------------------------------------------------------
-		// Write available findings of case to be learned.
-		//------------------------------------------------------------------------------
+		if (separated != NULL && BLBN_BITSET_TEST (separated, i)) {
 
-		// Sets the findings in the case that have been learned
-		blbn_set_net_findings_available (state, case_index);
+			// Node i is d-separated from the target in the case, so its purchase is
+			// scored as one that learns the case without the lookahead finding.
+			// This is an approximation, not a bound (see blbn_score_sfl_case)
+			if (no_lookahead_net < 0) {
+				no_lookahead_net = net_count;
+				nets[net_count++] = blbn_score_copy_net_learn_case (worker, lookahead_base_net, case_index, -1, 0);
+			}
+			first_net[i] = no_lookahead_net;
+			++worker->pruned_count;
 
-		// Writes the findings to the file
-		casepon = WriteNetFindings_bn (nodes, casefile, case_index, 1.0);
+		} else {
 
-		//------------------------------------------------------------------------------
-		// Learn the "to learn" cases that were written to memory
-		//------------------------------------------------------------------------------
+			first_net[i] = net_count;
+			for (k = 0; k < state->state_count[i]; ++k) {
+				nets[net_count++] = blbn_score_copy_net_learn_case (worker, lookahead_base_net, case_index, i, k);
+			}
+		}
+	}
+
+	// Evaluate every lookahead network in one pass
+	log_loss = (double *) malloc (max_net_count * sizeof (double));
+	if (net_count > 0) {
+		blbn_score_get_log_losses (worker, nets, net_count, log_loss);
+	}
+
+	for (i = 0; i < state->node_count; ++i) {
+
+		if (first_net[i] < 0) {
+			if (blbn_is_available_finding (state, i, case_index)) {
+				job->score[i][case_index] = -1;
+			}
+			continue;
+		}
 
-		// Get list of network's nodes
-		nodes = GetNetNodes_bn (net);
+		// Expected loss over the states of node i (given purchased findings in the case)
+		if (first_net[i] == no_lookahead_net) {
+			expected_loss = log_loss[no_lookahead_net];
+		} else {
+			expected_loss = 0.0;
+			for (k = 0; k < state->state_count[i]; ++k) {
+				expected_loss += blbn_get_joint_node_state_probability (state, joint, i, case_index, k) * log_loss[first_net[i] + k];
+			}
+		}
 
-		// Load case in temporary *.cas file into new case set (contains only that single case)
-		caseset = NewCaseset_cs (NULL, env);
-		AddFileToCaseset_cs (caseset, casefile, 1.0, NULL);
+		// e.g., Let current_loss be 1.3 and expected_loss be 0.8.
+		//       Then the expected loss reduction will be (1.3 - 0.8) or 0.5.
+		job->score[i][case_index] = job->current_loss - expected_loss;
+	}
 
-		// Retract findings from copied network (before learning)
-		RetractNetFindings_bn (net);
+	for (n = 0; n < net_count; ++n) {
+		blbn_score_delete_net (worker, nets[n]);
+	}
+	free (nets);
+	free (first_net);
+	free (log_loss);
 
-		// Create learner using EM learning method (updates CPTs in EM style)
-		learner = NewLearner_bn (EM_LEARNING, NULL, env);
+	// Delete base network for case (network with current case in "not learned" state)
+	blbn_score_delete_net (worker, lookahead_base_net);
+	blbn_free_node_target_joint (state, joint);
+}
 
-		// Learn cases using EM learner and temporary case file
-		LearnCPTs_bn (learner, nodes, caseset, 1.0); // Degree must be greater than zero
+static void blbn_score_case (blbn_score_worker_t *worker, int case_index) {
 
-		// Free allocated structures from memory
-		DeleteLearner_bn (learner);
-		DeleteCaseset_cs (caseset);
-		DeleteStream_ns  (casefile);
+	// A worker that queries the shared engines makes the shared queries of the case as it goes
+	if (!worker->job->prepared[case_index]) {
+		blbn_score_prepare_case (worker->state, worker->job, case_index);
+	}
 
-		// Retract findings from copied network (after learning)
-		RetractNetFindings_bn (net);
+	if (worker->job->kind == BLBN_SCORE_SFL) {
+		blbn_score_sfl_case (worker, case_index);
+	} else if (worker->job->kind == BLBN_SCORE_EMPG) {
+		blbn_score_empg_case (worker, case_index);
+	} else {
+		blbn_score_cheat_case (worker, case_index);
 	}
 }
 
 /**
- * This routine updates the learned network by learning from the specified
- * case (i.e., the case with index case_index) with the specified node
- * (i.e., the node with index node_index) set to the specified state (i.e.,
- * the state with state_index) and any nodes with available (i.e., purchased)
- * state values (or findings) set to the known values.  The findings for nodes
- * with no available findings will not be specified.  Therefore, all presently
- * available findings as well as the specified "lookahead" state will be
- * learned.
- *
- * Notes:
- * - This algorithm does not perform any unlearning (specifically, it doesn't
- *   perform unlearning before learning).
+ * Scores the cases of the job handed out to the worker until every case has
+ * been handed out.
  */
-void blbn_util_net_learn_case_with_lookahead (blbn_state_t *state, net_bn* net, int node_index, int case_index, int state_index) {
+static void* blbn_score_run_worker (void *arg) {
 
-	node_bn *lookahead_node = NULL;
-
-	stream_ns   *casefile  = NULL; // Used as temporary output location for case
-	caseposn_bn casepon;
-	caseset_cs  *caseset   = NULL; // Case set where temporary case output will be read into
-	nodelist_bn *nodes     = NULL;
-	learner_bn  *learner   = NULL;
+	blbn_score_worker_t *worker = (blbn_score_worker_t *) arg;
+	blbn_score_job_t *job = worker->job;
+	int m;
 
-	if (state != NULL) {
+	for (;;) {
+		pthread_mutex_lock (&job->lock);
+		m = job->next++;
+		pthread_mutex_unlock (&job->lock);
 
-		//------------------------------------------------------------------------------
-		// Unlearn findings
-		//------------------------------------------------------------------------------
+		if (m >= job->case_count) {
+			break;
+		}
+		blbn_score_case (worker, job->cases[m]);
+	}
 
-		nodes = GetNetNodes_bn (state->work_net);
+	return NULL;
+}
 
-		// Create a temporary *.cas file in memory
-		casefile = NewMemoryStream_ns ("available_with_lookahead.cas", env, NULL);
+/**
+ * Returns non-zero if the specified cases have the same learned-evidence
+ * pattern: the same flags and, for the available findings, the same states.
+ */
+static char blbn_case_patterns_equal (blbn_state_t *state, int a, int b) {
 
-		//------------------------------------------------------------------------------
-		// Write available findings of case to be learned.
-		//------------------------------------------------------------------------------
+	int i;
 
-		// Sets the findings in the case that have been learned
-		RetractNetFindings_bn (state->work_net);
-		blbn_set_net_findings_available (state, case_index);
-		//blbn_set_net_findings_learned (state, case_index);
+	for (i = 0; i < state->node_count; ++i) {
+		if (state->flags[i][a] != state->flags[i][b]) {
+			return 0;
+		}
+		if (blbn_is_available_finding (state, i, a) && blbn_get_node_finding (state, i, a) != blbn_get_node_finding (state, i, b)) {
+			return 0;
+		}
+	}
 
-		// Set the lookahead node's state
-		lookahead_node = NthNode_bn (nodes, node_index);
-		//lookahead_node = GetNodeNamed_bn (blbn_get_node_name (state, node_index), state->work_net);
-		//RetractNetFindings_bn (state->work_net);
+	return 1;
+}
 
-		RetractNodeFindings_bn (lookahead_node); // Retract node findings
+/**
+ * Returns the FNV-1a hash of the learned-evidence pattern of the specified
+ * case (see blbn_case_patterns_equal).
+ */
+static unsigned long long blbn_get_case_pattern_hash (blbn_state_t *state, int case_index) {
 
-		// Get the state from the data set
-		//node_state = blbn_get_finding (state, node_index, case_index);
-		EnterFinding_bn (lookahead_node, state_index);
-		//EnterFinding_bn (lookahead_node, lookahead_state_index);
-		//blbn_set_node_finding (state, lookahead_node_index, lookahead_state_index);
+	unsigned long long hash = 14695981039346656037ull;
+	int i;
 
-		// Writes the findings to memory (including lookahead)
-		casepon = WriteNetFindings_bn (nodes, casefile, case_index, 1.0);
+	for (i = 0; i < state->node_count; ++i) {
+		hash = (hash ^ state->flags[i][case_index]) * 1099511628211ull;
+		hash = (hash ^ (unsigned int) (blbn_is_available_finding (state, i, case_index) ? blbn_get_node_finding (state, i, case_index) : -1)) * 1099511628211ull;
+	}
 
-		//------------------------------------------------------------------------------
-		// Learn the "to learn" cases that were written to memory
-		//------------------------------------------------------------------------------
+	return hash;
+}
 
-		// Get list of network's nodes
-		nodes = GetNetNodes_bn (net);
+/**
+ * Groups the specified cases by learned-evidence pattern.  The SFL, EMPG and
+ * cheating scores of a candidate depend on its case only through the case's
+ * learned-evidence pattern (the joint tables, the network with the case
+ * unlearned and the lookahead findings are the same for every case with the
+ * pattern), so cases with the same pattern have the same scores.
+ *
+ * Sets representative[j] of every specified case j to the first specified
+ * case with its pattern, stores the representatives (in order) in distinct
+ * and returns their number.
+ */
+static int blbn_group_cases_by_pattern (blbn_state_t *state, const int *cases, int case_count, int *representative, int *distinct) {
 
-		// Load case in temporary *.cas file into new case set (contains only that single case)
-		caseset = NewCaseset_cs (NULL, env);
-		AddFileToCaseset_cs (caseset, casefile, 1.0, NULL);
+	int *table = NULL;
+	int table_size = 1;
+	int distinct_count = 0;
+	int j, m, slot;
 
-		// Retract findings from copied network (before learning)
-		RetractNetFindings_bn (net);
+	while (table_size < 2 * case_count) {
+		table_size <<= 1;
+	}
+	table = (int *) malloc (table_size * sizeof (int));
+	for (slot = 0; slot < table_size; ++slot) {
+		table[slot] = -1;
+	}
 
-		// Create learner using EM learning method (updates CPTs in EM style)
-		learner = NewLearner_bn (EM_LEARNING, NULL, env);
+	for (m = 0; m < case_count; ++m) {
+		j = cases[m];
 
-		// Learn cases using EM learner and temporary case file
-		LearnCPTs_bn (learner, nodes, caseset, 1.0); // Degree must be greater than zero
+		// Find the pattern in the table (linear probing), or add it
+		slot = (int) (blbn_get_case_pattern_hash (state, j) & (table_size - 1));
+		while (table[slot] != -1 && !blbn_case_patterns_equal (state, table[slot], j)) {
+			slot = (slot + 1) & (table_size - 1);
+		}
+		if (table[slot] == -1) {
+			table[slot] = j;
+			distinct[distinct_count++] = j;
+		}
+		representative[j] = table[slot];
+	}
 
-		// Free allocated structures from memory
-		DeleteLearner_bn (learner);
-		DeleteCaseset_cs (caseset);
-		DeleteStream_ns  (casefile);
+	free (table);
 
-		// Retract findings from copied network (after learning)
-		RetractNetFindings_bn (net);
-	}
+	return distinct_count;
 }
 
 /**
- * Returns an array with the SFL score for each node in the specified case.
+ * Returns the scores of the specified kind (BLBN_SCORE_*) of every candidate
+ * in the specified cases (all cases, in index order, if cases is NULL),
+ * indexed [node][case], computed by state->score_thread_count workers.
+ *
+ * If mask is not NULL, only the candidates with a non-zero mask entry
+ * (indexed [node][case]) are scored.  SFL scores above bound may be
+ * abandoned.  If argmin is non-zero, only the
+ * smallest SFL score is needed: the first case is scored before the others
+ * and its best score bounds every other case (as well as the best score of
+ * each case so far), so the scores do not depend on the number of workers.
+ *
+ * Only the first case of each learned-evidence pattern is scored, and its
+ * scores are copied to the other cases with the pattern (see
+ * blbn_group_cases_by_pattern).
  */
-double* blbn_util_sfl_row (blbn_state_t *state, int case_index) {
-
-	double *sfl_values = NULL;
-	int i = 0, k = 0;
-	int node_state_count = 0;
+static double** blbn_score_candidates (blbn_state_t *state, int kind, char argmin, const int *cases, int case_count, double bound, char **mask) {
+
+	blbn_score_job_t job;
+	blbn_score_worker_t workers[BLBN_SCORE_MAX_THREADS];
+	int *all_cases = NULL;
+	int *representative = NULL;
+	int *distinct = NULL;
+	int distinct_count;
+	char **distinct_mask = NULL;
+	int thread_count = state->score_thread_count;
+	char detached = (state->inference != BLBN_INFERENCE_LW && state->inference != BLBN_INFERENCE_BP);
+	int i, j, m, r, w;
+
+	if (cases == NULL) {
+		all_cases = (int *) malloc ((case_count > 0 ? case_count : 1) * sizeof (int));
+		for (m = 0; m < case_count; ++m) {
+			all_cases[m] = m;
+		}
+		cases = all_cases;
+	}
 
-	net_bn *lookahead_base_net = NULL;
-	net_bn *lookahead_net = NULL;
+	// Score each learned-evidence pattern once
+	representative = (int *) malloc ((state->case_count > 0 ? state->case_count : 1) * sizeof (int));
+	distinct = (int *) malloc ((case_count > 0 ? case_count : 1) * sizeof (int));
+	distinct_count = blbn_group_cases_by_pattern (state, cases, case_count, representative, distinct);
+	state->score_pattern_count += distinct_count;
+	state->score_case_count += case_count;
+	for (m = 0; m < case_count; ++m) {
+		for (i = 0; i < state->node_count; ++i) {
+			if (!blbn_is_available_finding (state, i, cases[m]) && (mask == NULL || mask[i][cases[m]])) {
+				++state->score_candidate_count;
+			}
+		}
+	}
 
-	double sfl_value;
-	double exp_loss;
-	double state_prob;
+	// The representative of a pattern scores the candidates of every case with the pattern
+	if (mask != NULL && distinct_count < case_count) {
+		distinct_mask = (char **) malloc (state->node_count * sizeof (char *));
+		for (i = 0; i < state->node_count; ++i) {
+			distinct_mask[i] = (char *) calloc (state->case_count, sizeof (char));
+			for (m = 0; m < case_count; ++m) {
+				distinct_mask[i][representative[cases[m]]] |= mask[i][cases[m]];
+			}
+		}
+	}
 
-	// Initialize SFL values
-	sfl_values = (double *) malloc (state->node_count * sizeof (double));
+	// Only workers that never touch the shared engines are run concurrently,
+	// and with Netica inference every query goes through Netica
+	if (!detached || state->inference == BLBN_INFERENCE_NETICA || thread_count < 1) {
+		thread_count = 1;
+	}
+	if (thread_count > BLBN_SCORE_MAX_THREADS) {
+		thread_count = BLBN_SCORE_MAX_THREADS;
+	}
+	if (thread_count > distinct_count && distinct_count > 0) {
+		thread_count = distinct_count;
+	}
 
-	// Copy base network from which to perform lookahead for this case
-	lookahead_base_net = blbn_util_copy_net_unlearn_case (state, case_index);
+	job.kind = kind;
+	job.argmin = argmin;
+	job.bound = bound;
+	job.mask = (distinct_mask != NULL ? distinct_mask : mask);
+	job.cases = distinct;
+	job.case_count = distinct_count;
+	job.next = 0;
+	job.prepared = (char *) calloc (state->case_count, sizeof (char));
+	job.separated = (const unsigned int **) calloc (state->case_count, sizeof (unsigned int *));
+	job.probability = (double *) malloc (state->case_count * sizeof (double));
+	job.current_loss = 0.0;
+	job.pruned_count = 0;
+	pthread_mutex_init (&job.lock, NULL);
+	pthread_mutex_init (&job.netica_lock, NULL);
 
+	job.score = (double **) malloc (state->node_count * sizeof (double *));
 	for (i = 0; i < state->node_count; ++i) {
-		node_state_count = blbn_count_node_states (state, i);
+		job.score[i] = (double *) malloc (state->case_count * sizeof (double));
+		for (j = 0; j < state->case_count; ++j) {
+			job.score[i][j] = DBL_MAX;
+		}
+	}
 
-		sfl_value = DBL_MAX;
-		sfl_values[i] = DBL_MAX; // Initialize SFL score to "infinite"
+	// Make the queries that go through shared caches and the working network first
+	if (kind == BLBN_SCORE_SFL) {
+		blbn_get_sfl_last_scores (state);
+	}
+	if (kind == BLBN_SCORE_CHEAT) {
+		job.current_loss = blbn_get_log_loss (state);
+	}
+	if (detached) {
+		if (state->inference == BLBN_INFERENCE_SLICED) {
+			blbn_get_validation_plans (state);
+		}
+		for (m = 0; m < distinct_count; ++m) {
+			blbn_score_prepare_case (state, &job, distinct[m]);
+		}
+	}
 
-		// Check if node i in case case_index is NOT a target and is NOT already purchased
-		// i.e., only compute SFL score if it is available for purchase
-		if (!blbn_is_available_finding (state, i, case_index)) {
-		//if (!blbn_is_purchased_finding(state, i, case_index)) {
-			for (k = 0; k < node_state_count; ++k) {
+	for (w = 0; w < thread_count; ++w) {
+		blbn_score_worker_init (&workers[w], state, &job, detached);
+	}
+
+	// Score the first case first, so that it bounds every other case
+	if (kind == BLBN_SCORE_SFL && argmin && distinct_count > 1) {
+		blbn_score_case (&workers[0], distinct[0]);
+		for (i = 0; i < state->node_count; ++i) {
+			if (job.score[i][distinct[0]] < job.bound) {
+				job.bound = job.score[i][distinct[0]];
+			}
+		}
+		job.next = 1;
+	}
 
-				// Copy base lookahead network for this particular lookahead
-				lookahead_net = blbn_util_copy_net (state, lookahead_base_net);
-				blbn_util_net_learn_case_with_lookahead (state, lookahead_net, i, case_index, k);
+	for (w = 1; w < thread_count; ++w) {
+		pthread_create (&workers[w].thread, NULL, blbn_score_run_worker, &workers[w]);
+	}
+	blbn_score_run_worker (&workers[0]);
+	for (w = 1; w < thread_count; ++w) {
+		pthread_join (workers[w].thread, NULL);
+	}
 
-				// Get loss of lookahead network
-				exp_loss = blbn_util_get_log_loss (state, lookahead_net);
+	for (w = 0; w < thread_count; ++w) {
+		blbn_score_worker_finish (&workers[w]);
+	}
 
-				// Get probability of network (probability of state k)
-				state_prob = blbn_get_node_state_probability_given_learned_states (state, i, case_index, k);
+	// Copy the scores of each representative to the other cases with its pattern
+	for (m = 0; m < case_count; ++m) {
+		j = cases[m];
+		r = representative[j];
+		if (r == j) {
+			continue;
+		}
+		for (i = 0; i < state->node_count; ++i) {
+			if (mask == NULL || mask[i][j]) {
+				job.score[i][j] = job.score[i][r];
+			}
+		}
+	}
 
-				//printf ("k=%d: %f * %f\t", i, state_prob, exp_loss);
-				//printf ("%f    ", exp_loss);
+	// Leave the candidates of the representatives that were only scored for other cases unscored
+	if (distinct_mask != NULL) {
+		for (m = 0; m < distinct_count; ++m) {
+			j = distinct[m];
+			for (i = 0; i < state->node_count; ++i) {
+				if (!mask[i][j]) {
+					job.score[i][j] = DBL_MAX;
+				}
+			}
+		}
+		for (i = 0; i < state->node_count; ++i) {
+			free (distinct_mask[i]);
+		}
+		free (distinct_mask);
+	}
 
-				if (k == 0) {
-					sfl_value = exp_loss * state_prob;
-				} else {
-					sfl_value += exp_loss * state_prob;
+	// Keep the last SFL scores of the requested candidates only (the others
+	// may be keys of the lazy-greedy heap; see blbn_util_sfl_lazy)
+	if (kind == BLBN_SCORE_SFL) {
+		for (m = 0; m < case_count; ++m) {
+			j = cases[m];
+			for (i = 0; i < state->node_count; ++i) {
+				if ((mask == NULL || mask[i][j]) && job.score[i][j] != DBL_MAX) {
+					state->sfl_last_score[i][j] = job.score[i][j];
 				}
+			}
+		}
+	}
+
+	if (state->prune_d_separated) {
+		fprintf (log_fp, "%s: %d d-separated candidates pruned (d-separation cache: %u hits, %u misses)\n", (kind == BLBN_SCORE_SFL ? "SFL" : (kind == BLBN_SCORE_EMPG ? "EMPG" : "Cheating")), job.pruned_count, state->dsep_cache_hits, state->dsep_cache_misses);
+	}
+
+	if (kind == BLBN_SCORE_SFL && state->sampled_validation_z > 0.0) {
+		fprintf (log_fp, "SFL: sampled validation consumed %f of the validation cases per candidate (%u candidates, %u stopped early)\n",
+				(state->sampled_candidate_count > 0 ? state->sampled_case_fraction / state->sampled_candidate_count : 0.0), state->sampled_candidate_count, state->sampled_stopped_count);
+		state->sampled_candidate_count = 0;
+		state->sampled_stopped_count = 0;
+		state->sampled_case_fraction = 0.0;
+	}
+
+	pthread_mutex_destroy (&job.lock);
+	pthread_mutex_destroy (&job.netica_lock);
+	free (job.prepared);
+	free (job.separated);
+	free (job.probability);
+	free (all_cases);
+	free (representative);
+	free (distinct);
+
+	return job.score;
+}
 
-				//printf ("CHOSE: (%d,%d) with LOSS = %f\n", min_exp_loss_node_index, min_exp_loss_case_index, min_exp_loss);
+/**
+ * Returns a mask (indexed [node][case]) of a sample of the specified number
+ * of candidates (findings available for purchase), drawn by stratified
+ * sampling over the nodes and target labels: the sample of each (node,
+ * label) stratum is proportional to its number of candidates (largest
+ * remainders get the candidates left over) and drawn uniformly at random.
+ */
+static char** blbn_sample_candidates (blbn_state_t *state, int sample_count, int candidate_count) {
+
+	char **mask = NULL;
+	int label_count = state->state_count[state->target];
+	int stratum_count = state->node_count * label_count;
+	int *stratum_size = NULL;
+	int *quota = NULL;
+	int *offset = NULL;
+	int *cells = NULL;
+	int allotted = 0;
+	int best, i, j, k, m, s, label, swap;
+	double remainder, best_remainder;
+
+	mask = (char **) malloc (state->node_count * sizeof (char *));
+	for (i = 0; i < state->node_count; ++i) {
+		mask[i] = (char *) calloc ((state->case_count > 0 ? state->case_count : 1), sizeof (char));
+	}
 
-				// Deletes copy of the lookahead network
-				DeleteNet_bn (lookahead_net);
+	// Size of each (node, label) stratum
+	stratum_size = (int *) calloc (stratum_count, sizeof (int));
+	for (i = 0; i < state->node_count; ++i) {
+		for (j = 0; j < state->case_count; ++j) {
+			if (!blbn_is_available_finding (state, i, j)) {
+				label = state->state[state->target][j];
+				++stratum_size[i * label_count + (label >= 0 && label < label_count ? label : 0)];
 			}
 		}
+	}
 
-		sfl_values[i] = sfl_value;
+	// Proportional allocation of the sample (largest remainder)
+	quota = (int *) malloc (stratum_count * sizeof (int));
+	for (s = 0; s < stratum_count; ++s) {
+		quota[s] = (int) ((double) sample_count * stratum_size[s] / candidate_count);
+		allotted += quota[s];
+	}
+	for (; allotted < sample_count; ++allotted) {
+		best = -1;
+		best_remainder = -1.0;
+		for (s = 0; s < stratum_count; ++s) {
+			remainder = (double) sample_count * stratum_size[s] / candidate_count - quota[s];
+			if (quota[s] < stratum_size[s] && remainder > best_remainder) {
+				best = s;
+				best_remainder = remainder;
+			}
+		}
+		if (best < 0) {
+			break;
+		}
+		++quota[best];
+	}
 
-		//printf ("%f ", sfl_values[i]);
-		//printf ("|    ");
+	// Draw the sample of each stratum (a partial Fisher-Yates shuffle of its candidates)
+	offset = (int *) malloc ((label_count + 1) * sizeof (int));
+	cells = (int *) malloc ((state->case_count > 0 ? state->case_count : 1) * sizeof (int));
+	for (i = 0; i < state->node_count; ++i) {
+		offset[0] = 0;
+		for (label = 0; label < label_count; ++label) {
+			offset[label + 1] = offset[label] + stratum_size[i * label_count + label];
+		}
+		for (j = 0; j < state->case_count; ++j) {
+			if (!blbn_is_available_finding (state, i, j)) {
+				label = state->state[state->target][j];
+				label = (label >= 0 && label < label_count ? label : 0);
+				cells[offset[label]++] = j;
+			}
+		}
+		for (label = label_count - 1; label >= 0; --label) {
+			offset[label + 1] = offset[label];
+		}
+		offset[0] = 0;
+
+		for (label = 0; label < label_count; ++label) {
+			s = i * label_count + label;
+			for (k = 0; k < quota[s]; ++k) {
+				m = k + rand () % (stratum_size[s] - k);
+				swap = cells[offset[label] + k];
+				cells[offset[label] + k] = cells[offset[label] + m];
+				cells[offset[label] + m] = swap;
+				mask[i][cells[offset[label] + k]] = 1;
+			}
+		}
 	}
-	//printf ("\n");
 
-	DeleteNet_bn (lookahead_base_net);
+	free (stratum_size);
+	free (quota);
+	free (offset);
+	free (cells);
 
-	return sfl_values;
+	return mask;
 }
 
 /**
- * Returns an array with the SFL score for each node in the specified case.
+ * Returns the scores of the specified kind (BLBN_SCORE_*) of the candidates,
+ * as blbn_score_candidates, with the cases handed out in the specified order
+ * (index order if cases is NULL).  If a scoring budget is set
+ * (state->score_budget: a number of candidates if at least one, or else a
+ * fraction of the candidates), only a stratified sample of that many
+ * candidates is scored (see blbn_sample_candidates), and the others are
+ * left unscored: DBL_MAX for SFL and -DBL_MAX for EMPG and cheating, so
+ * they are never selected.
  */
-double** blbn_util_sfl (blbn_state_t *state) {
-
-	double **sfl_values = NULL;
-	int i = 0, j = 0, k = 0;
-	int node_state_count = 0;
+static double** blbn_score_candidates_sampled (blbn_state_t *state, int kind, char argmin, const int *cases) {
 
-	net_bn *lookahead_base_net = NULL;
-	net_bn *lookahead_net = NULL;
-
-	double sfl_value;
-	double exp_loss;
-	double state_prob;
+	double **scores = NULL;
+	char **mask = NULL;
+	int *sampled_cases = NULL;
+	int sampled_case_count = 0;
+	int candidate_count = 0;
+	int sample_count;
+	int i, j, m;
 
-	// Initialize SFL values
-	sfl_values = (double **) malloc (state->node_count * sizeof (double *));
-	for (i = 0; i < state->node_count; ++i) {
-		sfl_values[i] = (double *) malloc (state->case_count * sizeof (double));
+	if (state->score_budget <= 0.0) {
+		return blbn_score_candidates (state, kind, argmin, cases, state->case_count, DBL_MAX, NULL);
 	}
 
-	for (j = 0; j < state->case_count; ++j) {
-
-		// Copy base network from which to perform lookahead for this case
-		lookahead_base_net = blbn_util_copy_net_unlearn_case (state, j);
-
-		for (i = 0; i < state->node_count; ++i) {
-
-			node_state_count = blbn_count_node_states (state, i);
-
-			sfl_value = DBL_MAX;
-			sfl_values[i][j] = DBL_MAX; // Initialize SFL score to "infinite"
-
-			// Check if node i in case j is NOT a target and is NOT already purchased
-			// i.e., only compute SFL score if it is available for purchase
+	for (i = 0; i < state->node_count; ++i) {
+		for (j = 0; j < state->case_count; ++j) {
 			if (!blbn_is_available_finding (state, i, j)) {
+				++candidate_count;
+			}
+		}
+	}
+	sample_count = (state->score_budget >= 1.0 ? (int) state->score_budget : (int) ceil (state->score_budget * candidate_count));
+	if (sample_count >= candidate_count) {
+		return blbn_score_candidates (state, kind, argmin, cases, state->case_count, DBL_MAX, NULL);
+	}
 
-				for (k = 0; k < node_state_count; ++k) {
-
-					// Copy base lookahead network for this particular lookahead
-					lookahead_net = blbn_util_copy_net (state, lookahead_base_net);
-					blbn_util_net_learn_case_with_lookahead (state, lookahead_net, i, j, k);
-
-					// Get loss of lookahead network
-					exp_loss = blbn_util_get_log_loss (state, lookahead_net);
+	mask = blbn_sample_candidates (state, sample_count, candidate_count);
 
-					// Get probability of network (probability of state k)
-					state_prob = blbn_get_node_state_probability_given_learned_states (state, i, j, k);
+	// Score the cases with sampled candidates (in the specified order)
+	sampled_cases = (int *) malloc ((state->case_count > 0 ? state->case_count : 1) * sizeof (int));
+	for (m = 0; m < state->case_count; ++m) {
+		j = (cases != NULL ? cases[m] : m);
+		for (i = 0; i < state->node_count && !mask[i][j]; ++i);
+		if (i < state->node_count) {
+			sampled_cases[sampled_case_count++] = j;
+		}
+	}
+	scores = blbn_score_candidates (state, kind, argmin, sampled_cases, sampled_case_count, DBL_MAX, mask);
 
-					//printf ("k=%d: %f * %f\t", i, state_prob, exp_loss);
-					//printf ("%f    ", exp_loss);
+	for (i = 0; i < state->node_count; ++i) {
+		for (j = 0; j < state->case_count; ++j) {
+			if (!mask[i][j] && !blbn_is_available_finding (state, i, j)) {
+				scores[i][j] = (kind == BLBN_SCORE_SFL ? DBL_MAX : -DBL_MAX);
+			}
+		}
+		free (mask[i]);
+	}
+	free (mask);
+	free (sampled_cases);
 
-					if (k == 0) {
-						sfl_value = exp_loss * state_prob;
-					} else {
-						sfl_value += exp_loss * state_prob;
-					}
+	fprintf (log_fp, "%s: %d of %d candidates sampled for scoring\n", (kind == BLBN_SCORE_SFL ? "SFL" : (kind == BLBN_SCORE_EMPG ? "EMPG" : "Cheating")), sample_count, candidate_count);
 
-					//printf ("CHOSE: (%d,%d) with LOSS = %f\n", min_exp_loss_node_index, min_exp_loss_case_index, min_exp_loss);
+	return scores;
+}
 
-					// Deletes copy of the lookahead network
-					DeleteNet_bn (lookahead_net);
-				}
-			}
+/**
+ * Frees the incremental score matrix (see blbn_score_candidates_cached).
+ */
+void blbn_free_score_cache (blbn_state_t *state) {
 
-			sfl_values[i][j] = sfl_value;
+	int i;
 
-			//printf ("%f ", sfl_values[i][j]);
-			//printf ("|    ");
+	if (state->score_cache != NULL) {
+		for (i = 0; i < state->node_count; ++i) {
+			free (state->score_cache[i]);
 		}
-		//printf ("\n");
-
-		DeleteNet_bn (lookahead_base_net);
+		free (state->score_cache);
+		blbn_free_net_cpts (state, state->score_cache_cpt);
 	}
-	printf ("\n");
+	free (state->score_cache_pattern);
 
-	return sfl_values;
+	state->score_cache = NULL;
+	state->score_cache_cpt = NULL;
+	state->score_cache_pattern = NULL;
+	state->score_cache_kind = -1;
+	state->score_cache_age = 0;
 }
 
-void blbn_util_print_findings (blbn_state_t *state) {
-	int i;
-	printf ("( ");
-	for (i = 0; i < state->node_count; ++i) {
-		printf ("%d ", GetNodeFinding_bn (NthNode_bn (state->nodelist, i)));
-	}
-	printf (")\n");
+/**
+ * Converts a cheating score (see blbn_score_cheat_case) to the expected loss
+ * it was computed from given the current log loss, or back (the conversion is
+ * its own inverse).  Unscored entries (DBL_MAX or -DBL_MAX) are kept.
+ */
+static double blbn_score_cache_convert (double value, double current_loss) {
+	return (fabs (value) == DBL_MAX ? value : current_loss - value);
 }
 
 /**
- * EMPG - Expected Maximum Prediction (Performance) Gain
+ * Returns the exact scores of the specified kind (BLBN_SCORE_*) of every
+ * candidate (indexed [node][case]), as blbn_score_candidates, from the
+ * incremental score matrix of the state if it is enabled
+ * (state->score_cache_tolerance is not negative).
  *
- * This algorithm selects a non-purchased (node i, case j) pair with a
- * maximal expected percent increase in the probability of predicting the
- * correct target value.
+ * The score matrix persists across iterations.  After the first scoring,
+ * only the candidates whose inputs changed are rescored: every candidate of
+ * a case whose learned-evidence pattern changed (e.g., the purchased case)
+ * and every candidate of a node whose CPT moved by more than the tolerance
+ * (in any entry) since its candidates were last scored.  Changes to other
+ * CPTs are ignored, so the scores drift from the exact scores; every
+ * candidate is rescored every state->score_cache_refresh iterations (unless
+ * it is zero) to limit the drift.  Cheating scores are cached as expected
+ * losses, so kept scores are relative to the current log loss.
  */
-double** blbn_util_empg (blbn_state_t *state) {
-
-	double **percent_diff_values = NULL;
-	int i = 0, j = 0, k = 0;
-	int node_state_count = 0;
+static double** blbn_score_candidates_cached (blbn_state_t *state, int kind, const int *cases) {
 
-	//double exp_loss;
-	double state_probability;
-	double target_probability;
-	double current_target_probability;
-	double expected_target_probability;
+	double **scores = NULL;
+	double **cpt = NULL;
+	char **mask = NULL;
+	char *moved = NULL;
+	int *stale_cases = NULL;
+	int stale_count = 0;
+	unsigned int rescored_count = 0;
+	double current_loss = 0.0;
+	char full, stale;
+	int i, j, k, m, size, rescored;
 
-	// Initialize SFL values
-	percent_diff_values = (double **) malloc (state->node_count * sizeof (double *));
-	for (i = 0; i < state->node_count; ++i) {
-		percent_diff_values[i] = (double *) malloc (state->case_count * sizeof (double));
+	if (state->score_cache_tolerance < 0.0) {
+		return blbn_score_candidates_sampled (state, kind, 0, cases);
 	}
 
-	// Iterate over cases
-	for (j = 0; j < state->case_count; ++j) {
-
-		// Calculate probability of the target node
-		current_target_probability = blbn_get_target_node_belief_given_learned (state, j);
-
-		// Iterate over nodes
-		for (i = 0; i < state->node_count; ++i) {
-
-			// Check if the current node is a target node (if so, do not predict a value)
-			if (!blbn_is_available_finding (state, i, j)) {
+	cpt = blbn_get_net_cpts (state, state->work_net);
+	if (kind == BLBN_SCORE_CHEAT) {
+		current_loss = blbn_get_log_loss (state);
+	}
 
-				expected_target_probability = 0.0;
+	++state->score_cache_age;
+	full = (state->score_cache == NULL || state->score_cache_kind != kind || (state->score_cache_refresh > 0 && state->score_cache_age >= state->score_cache_refresh));
 
-				node_state_count = blbn_count_node_states (state, i);
+	if (full) {
 
-				for (k = 0; k < node_state_count; ++k) {
+		blbn_free_score_cache (state);
+		state->score_cache = blbn_score_candidates (state, kind, 0, cases, state->case_count, DBL_MAX, NULL);
+		state->score_cache_cpt = cpt;
+		state->score_cache_kind = kind;
+		state->score_cache_pattern = (unsigned long long *) malloc ((state->case_count > 0 ? state->case_count : 1) * sizeof (unsigned long long));
+		rescored_count = state->node_count * state->case_count;
 
-					// Get probability that node i is in state k (given purchased findings in case j)
-					state_probability = blbn_get_node_state_probability_given_learned_states (state, i, j, k);
+	} else {
 
-					// Set known findings in case except for target
-					blbn_set_net_findings_learned_except_target (state, j);
+		// Nodes whose CPTs moved by more than the tolerance
+		moved = (char *) calloc (state->node_count, sizeof (char));
+		for (i = 0; i < state->node_count; ++i) {
+			size = blbn_get_cpt_size (state, i);
+			for (k = 0; k < size && !moved[i]; ++k) {
+				moved[i] = (fabs (cpt[i][k] - state->score_cache_cpt[i][k]) > state->score_cache_tolerance);
+			}
+		}
 
-					// Get probability of the target given the purchased/learned values
-					blbn_assert_node_finding_for_case (state, i, j, k);
-					target_probability = blbn_get_target_node_belief_given_findings (state, j);
+		// Candidates of the cases whose patterns changed and of the moved nodes
+		mask = (char **) malloc (state->node_count * sizeof (char *));
+		for (i = 0; i < state->node_count; ++i) {
+			mask[i] = (char *) calloc (state->case_count, sizeof (char));
+		}
+		stale_cases = (int *) malloc ((state->case_count > 0 ? state->case_count : 1) * sizeof (int));
+		for (m = 0; m < state->case_count; ++m) {
+			j = (cases != NULL ? cases[m] : m);
+			stale = (blbn_get_case_pattern_hash (state, j) != state->score_cache_pattern[j]);
+			rescored = 0;
+			for (i = 0; i < state->node_count; ++i) {
+				mask[i][j] = (stale || moved[i]);
+				rescored += mask[i][j];
+			}
+			if (rescored > 0) {
+				stale_cases[stale_count++] = j;
+				rescored_count += rescored;
+			}
+		}
 
-					// Update calculation of expected probability of predicting correct label
-					if (k == 0) {
-						expected_target_probability = target_probability * state_probability;
-					} else {
-						expected_target_probability += target_probability * state_probability;
+		// Rescore them
+		if (stale_count > 0) {
+			scores = blbn_score_candidates (state, kind, 0, stale_cases, stale_count, DBL_MAX, mask);
+			for (m = 0; m < stale_count; ++m) {
+				j = stale_cases[m];
+				for (i = 0; i < state->node_count; ++i) {
+					if (mask[i][j]) {
+						state->score_cache[i][j] = (kind == BLBN_SCORE_CHEAT ? blbn_score_cache_convert (scores[i][j], current_loss) : scores[i][j]);
 					}
-
-					//printf ("(%f - %f)    ", expected_target_probability, current_target_probability);
 				}
+			}
+			for (i = 0; i < state->node_count; ++i) {
+				free (scores[i]);
+			}
+			free (scores);
+		}
 
-				// Calculate percent difference between probability of case being predicted correctly
-				percent_diff_values[i][j] = (expected_target_probability - current_target_probability) / current_target_probability;
+		// Only the CPTs of the rescored nodes are taken as their new reference
+		for (i = 0; i < state->node_count; ++i) {
+			if (moved[i]) {
+				free (state->score_cache_cpt[i]);
+				state->score_cache_cpt[i] = cpt[i];
+				cpt[i] = NULL;
+			}
+		}
+		blbn_free_net_cpts (state, cpt);
 
-				//printf ("%f -> %f / %f    ", current_target_probability, expected_target_probability, percent_diff_values[i][j]);
-				//printf ("%f , (%f * %f), %f, %f    ", current_target_probability, target_probability, state_probability, expected_target_probability, percent_diff_values[i][j]);
-				//printf ("%f    ", percent_diff_values[i][j]);
+		for (i = 0; i < state->node_count; ++i) {
+			free (mask[i]);
+		}
+		free (mask);
+		free (moved);
+		free (stale_cases);
+	}
 
-			} else {
+	for (j = 0; j < state->case_count; ++j) {
+		state->score_cache_pattern[j] = blbn_get_case_pattern_hash (state, j);
+	}
+	if (full) {
+		state->score_cache_age = 0;
+		if (kind == BLBN_SCORE_CHEAT) {
+			for (i = 0; i < state->node_count; ++i) {
+				for (j = 0; j < state->case_count; ++j) {
+					state->score_cache[i][j] = blbn_score_cache_convert (state->score_cache[i][j], current_loss);
+				}
+			}
+		}
+	}
 
-				percent_diff_values[i][j] = -1;
+	fprintf (log_fp, "%s: %u of %d candidates rescored (%s)\n", (kind == BLBN_SCORE_SFL ? "SFL" : (kind == BLBN_SCORE_EMPG ? "EMPG" : "Cheating")), rescored_count, state->node_count * state->case_count, (full ? "full" : "incremental"));
 
+	// Return a copy (the caller frees the scores)
+	scores = (double **) malloc (state->node_count * sizeof (double *));
+	for (i = 0; i < state->node_count; ++i) {
+		scores[i] = (double *) malloc ((state->case_count > 0 ? state->case_count : 1) * sizeof (double));
+		memcpy (scores[i], state->score_cache[i], state->case_count * sizeof (double));
+		if (kind == BLBN_SCORE_CHEAT) {
+			for (j = 0; j < state->case_count; ++j) {
+				scores[i][j] = blbn_score_cache_convert (scores[i][j], current_loss);
 			}
-
-			//printf ("%f    ", percent_diff_values[i][j]);
-			//printf ("|    ");
 		}
-		//printf ("\n");
 	}
-	//printf ("\n");
 
-	return percent_diff_values;
+	return scores;
 }
 
 /**
- * "Cheating algorithm"
+ * Returns an array with the SFL score for each node in the specified case.
  *
- * (OLD DESCRIPTION) FROM EMPG:
- * This algorithm computes the probability of each possible state k of node i
- * in case j weighted by (i.e., multiplied by) the expected log loss
- * reduction (i.e., improvement).  Note that the weight value (i.e., the log
- * loss value) must be negated so a reduction in loss will be measured as an
- * a greater weight value (i.e., an improvement).
+ * Only scores up to bound are exact: nodes are visited in ascending order of
+ * their last score, and the score of a node is abandoned (leaving a lower
+ * bound above the best score) once it exceeds bound or the best score found
+ * in the case so far (pass DBL_MAX for exact scores of every node).
  */
-double** blbn_util_cheat (blbn_state_t *state) {
+double* blbn_util_sfl_row (blbn_state_t *state, int case_index, double bound) {
 
-	double **expected_loss_probability_values = NULL;
-	int i = 0, j = 0, k = 0;
-	int node_state_count = 0;
+	double *sfl_values = NULL;
+	double **scores = NULL;
+	int i;
 
-	//double exp_loss;
-	double state_probability;
-	double current_target_probability;
-	double expected_loss_probability;
+	scores = blbn_score_candidates (state, BLBN_SCORE_SFL, 1, &case_index, 1, bound, NULL);
 
-	// Initialize SFL values
-	expected_loss_probability_values = (double **) malloc (state->node_count * sizeof (double *));
+	sfl_values = (double *) malloc (state->node_count * sizeof (double));
 	for (i = 0; i < state->node_count; ++i) {
-		expected_loss_probability_values[i] = (double *) malloc (state->case_count * sizeof (double));
+		sfl_values[i] = scores[i][case_index];
+		free (scores[i]);
 	}
+	free (scores);
 
-	// Iterate over cases
-	for (j = 0; j < state->case_count; ++j) {
+	return sfl_values;
+}
 
-		// Calculate probability of the target node
-		current_target_probability = blbn_get_target_node_belief_given_learned (state, j);
+/**
+ * Returns the SFL score of every (node, case) pair (indexed [node][case];
+ * DBL_MAX if the finding is not available for purchase).
+ *
+ * If argmin is non-zero, only the smallest score is needed (SFL, GSFL):
+ * candidates are visited in ascending order of their last score, and the
+ * score of a candidate is abandoned (leaving a lower bound above the best
+ * score) as soon as it exceeds the best score of its case or of the first
+ * case so far (see blbn_score_candidates).  Otherwise every score is exact
+ * (RSFL, GRSFL).  With the incremental score matrix, every score is exact
+ * and only the candidates whose inputs changed are rescored (see
+ * blbn_score_candidates_cached).
+ */
+double** blbn_util_sfl (blbn_state_t *state, char argmin) {
 
-		net_bn *lookahead_base_net = blbn_util_copy_net_unlearn_case (state, j);
+	double **sfl_values = NULL;
+	int *case_order = NULL;
 
-		// Iterate over nodes
-		for (i = 0; i < state->node_count; ++i) {
+	// Visit the cases with the best scores in the last iteration first
+	case_order = blbn_get_sfl_order (state, -1);
 
-			// Check if the current node is a target node (if so, do not predict a value)
-			if (!blbn_is_available_finding (state, i, j)) {
+	// The incremental score matrix holds exact scores, so it is not bounded
+	if (state->score_cache_tolerance >= 0.0) {
+		sfl_values = blbn_score_candidates_cached (state, BLBN_SCORE_SFL, case_order);
+	} else {
+		sfl_values = blbn_score_candidates_sampled (state, BLBN_SCORE_SFL, argmin, case_order);
+	}
+	printf ("\n");
+	free (case_order);
 
-				expected_loss_probability = 0.0;
+	if (argmin && state->score_cache_tolerance < 0.0) {
+		blbn_log_sfl_bound_stats (state);
+	}
 
-				node_state_count = blbn_count_node_states (state, i);
+	return sfl_values;
+}
 
-				for (k = 0; k < node_state_count; ++k) {
+#define BLBN_SFL_LAZY_BATCH 8 // largest number of stale candidates rescored together by lazy-greedy SFL (see blbn_util_sfl_lazy)
 
-					// Get probability that node i is in state k (given purchased findings in case j)
-					state_probability = blbn_get_node_state_probability_given_learned_states (state, i, j, k);
+/**
+ * Returns non-zero if candidate a (j * node_count + i for node i in case j)
+ * precedes candidate b in the lazy-greedy heap: if its last SFL score is
+ * smaller or, on ties, if it comes first in case and then node order.
+ */
+static char blbn_sfl_heap_precedes (blbn_state_t *state, int a, int b) {
 
-//					// Set known findings in case except for target
-//					blbn_set_net_findings_learned_except_target (state, j);
-//
-//					// Get probability of the target given the purchased/learned values
-//					blbn_assert_node_finding (state, i, j, k);
+	double score_a = state->sfl_last_score[a % state->node_count][a / state->node_count];
+	double score_b = state->sfl_last_score[b % state->node_count][b / state->node_count];
 
-					// TODO: Update target_probability to be the expected test improvement with new model (assuming node i is in state k)
-					double current_loss = blbn_get_log_loss (state);
+	return (score_a < score_b || (score_a == score_b && a < b));
+}
 
-					//------------------------------------------------------------------------------
-					// Learn new model assuming node i is in state k
-					//------------------------------------------------------------------------------
+static void blbn_sfl_heap_sift_down (blbn_state_t *state, int n) {
 
-//					fprintf (log_fp, "blbn_util_cheat 1\n");
-//					fflush (log_fp);
+	int *heap = state->sfl_heap;
+	int child, swap;
 
-					// Copy base lookahead network for this particular lookahead
-					net_bn *lookahead_net = blbn_util_copy_net (state, lookahead_base_net);
-					//blbn_util_net_learn_case_with_lookahead (state, lookahead_net, i, j, k);
+	for (;;) {
+		child = 2 * n + 1;
+		if (child >= state->sfl_heap_count) {
+			break;
+		}
+		if (child + 1 < state->sfl_heap_count && blbn_sfl_heap_precedes (state, heap[child + 1], heap[child])) {
+			++child;
+		}
+		if (!blbn_sfl_heap_precedes (state, heap[child], heap[n])) {
+			break;
+		}
+		swap = heap[n];
+		heap[n] = heap[child];
+		heap[child] = swap;
+		n = child;
+	}
+}
 
-//					fprintf (log_fp, "blbn_util_cheat 2\n");
-//					fflush (log_fp);
+static void blbn_sfl_heap_push (blbn_state_t *state, int candidate) {
 
-					// Get loss of lookahead network
-					double expected_loss = blbn_util_get_log_loss (state, lookahead_net);
+	int *heap = state->sfl_heap;
+	int n = state->sfl_heap_count++;
 
-//					fprintf (log_fp, "blbn_util_cheat 3\n");
-//					fflush (log_fp);
+	heap[n] = candidate;
+	while (n > 0 && blbn_sfl_heap_precedes (state, heap[n], heap[(n - 1) / 2])) {
+		heap[n] = heap[(n - 1) / 2];
+		heap[(n - 1) / 2] = candidate;
+		n = (n - 1) / 2;
+	}
+}
 
-					// Compute loss reduction assuming node i in row j is in state k
-					// e.g., Let current_loss be 1.3 and expected_loss be 0.8.
-					//       Then the expected_loss_reduction will be (1.3 - 0.8) or 0.5.
-					//       Note that this is a positive number.  This positive number
-					//       will be multiplied by the probability of state k for node i
-					//       in case j, given the current conditional probability tables
-					//       of the Bayesian network.
-					double expected_loss_reduction = current_loss - expected_loss;
+static int blbn_sfl_heap_pop (blbn_state_t *state) {
 
-					// Delete networks
-					DeleteNet_bn (lookahead_net);
+	int candidate = state->sfl_heap[0];
 
-					//printf ("%f\t%f\n", current_loss, expected_log_loss);
+	state->sfl_heap[0] = state->sfl_heap[--state->sfl_heap_count];
+	blbn_sfl_heap_sift_down (state, 0);
 
+	return candidate;
+}
 
+/**
+ * Returns the SFL scores of the K best candidates, found by lazy-greedy
+ * (CELF-style) selection, in the layout of blbn_util_sfl (every other entry
+ * is DBL_MAX).
+ *
+ * The candidates are kept across iterations in a heap ordered by their last
+ * SFL score (state->sfl_last_score), which is stale once a finding has been
+ * purchased.  Only the best candidates are rescored: if the fresh score of
+ * the best candidate still precedes the next stale score, it is one of the K
+ * best, otherwise it goes back into the heap with its fresh score.  The
+ * stale candidates at the top of the heap (up to BLBN_SFL_LAZY_BATCH) are
+ * rescored together, so that the candidates of a case share its unlearned
+ * network and different cases are scored by different threads.  This assumes that the scores of
+ * candidates only get worse as findings are purchased (as the gains of
+ * submodular functions do), which is an approximation for SFL.  Every
+ * candidate is scored on the first call, except those left out by the
+ * scoring budget (see blbn_score_candidates_sampled): they enter the heap
+ * stale, keyed by the best score of the first call, and are scored when they
+ * reach the top.
+ */
+double** blbn_util_sfl_lazy (blbn_state_t *state, int K) {
 
-					// Update calculation of "expected loss-probability" of predicting correct label
-					if (k == 0) {
-						expected_loss_probability = expected_loss_reduction * state_probability;
+	double **sfl_values = NULL;
+	double **scores = NULL;
+	double **last_score = blbn_get_sfl_last_scores (state);
+	char **mask = NULL;
+	char *fresh = NULL;
+	int *top = NULL;
+	int *batch = NULL;
+	int *batch_cases = NULL;
+	int top_count = 0;
+	int batch_count, batch_case_count;
+	int candidate_count = state->node_count * state->case_count;
+	int rescored_count = 0;
+	double best;
+	int c, i, j, m;
+
+	fresh = (char *) calloc ((candidate_count > 0 ? candidate_count : 1), sizeof (char));
+
+	// Score every candidate on the first call
+	if (state->sfl_heap == NULL) {
+		sfl_values = blbn_util_sfl (state, 0);
+		state->sfl_heap = (int *) malloc ((candidate_count > 0 ? candidate_count : 1) * sizeof (int));
+		state->sfl_heap_count = 0;
+		best = DBL_MAX;
+		for (j = 0; j < state->case_count; ++j) {
+			for (i = 0; i < state->node_count; ++i) {
+				if (!blbn_is_available_finding (state, i, j) && sfl_values[i][j] < best) {
+					best = sfl_values[i][j];
+				}
+			}
+		}
+		if (best == DBL_MAX) {
+			best = 0.0;
+		}
+		for (j = 0; j < state->case_count; ++j) {
+			for (i = 0; i < state->node_count; ++i) {
+				if (!blbn_is_available_finding (state, i, j)) {
+					c = j * state->node_count + i;
+					state->sfl_heap[state->sfl_heap_count++] = c;
+					if (sfl_values[i][j] < DBL_MAX) {
+						last_score[i][j] = sfl_values[i][j];
+						fresh[c] = 1;
+						++rescored_count;
 					} else {
-						expected_loss_probability += expected_loss_reduction * state_probability;
+						last_score[i][j] = best;
 					}
+				}
+			}
+		}
+		for (m = state->sfl_heap_count / 2 - 1; m >= 0; --m) {
+			blbn_sfl_heap_sift_down (state, m);
+		}
+		for (i = 0; i < state->node_count; ++i) {
+			free (sfl_values[i]);
+		}
+		free (sfl_values);
+	}
+
+	sfl_values = (double **) malloc (state->node_count * sizeof (double *));
+	mask = (char **) malloc (state->node_count * sizeof (char *));
+	for (i = 0; i < state->node_count; ++i) {
+		sfl_values[i] = (double *) malloc ((state->case_count > 0 ? state->case_count : 1) * sizeof (double));
+		for (j = 0; j < state->case_count; ++j) {
+			sfl_values[i][j] = DBL_MAX;
+		}
+		mask[i] = (char *) calloc ((state->case_count > 0 ? state->case_count : 1), sizeof (char));
+	}
+	top = (int *) malloc ((K > 0 ? K : 1) * sizeof (int));
+	batch = (int *) malloc (BLBN_SFL_LAZY_BATCH * sizeof (int));
+	batch_cases = (int *) malloc (BLBN_SFL_LAZY_BATCH * sizeof (int));
 
-					//printf ("(%f - %f)    ", expected_target_probability, current_target_probability);
+	// Take the best candidate until K fresh candidates have been taken
+	while (top_count < K && state->sfl_heap_count > 0) {
+		c = blbn_sfl_heap_pop (state);
+		i = c % state->node_count;
+		j = c / state->node_count;
+
+		// Purchased candidates leave the heap
+		if (blbn_is_available_finding (state, i, j)) {
+			continue;
+		}
+
+		if (fresh[c]) {
+			sfl_values[i][j] = last_score[i][j];
+			top[top_count++] = c;
+			continue;
+		}
 
-//					fprintf (log_fp, "blbn_util_cheat 4\n");
-//					fflush (log_fp);
+		// Take the stale candidates at the top of the heap with this one
+		batch_count = 0;
+		batch_case_count = 0;
+		for (;;) {
+			if (!blbn_is_available_finding (state, i, j)) {
+				for (m = 0; m < batch_case_count && batch_cases[m] != j; ++m);
+				if (m == batch_case_count) {
+					batch_cases[batch_case_count++] = j;
 				}
+				mask[i][j] = 1;
+				batch[batch_count++] = c;
+			}
+			if (batch_count == BLBN_SFL_LAZY_BATCH || state->sfl_heap_count == 0 || fresh[state->sfl_heap[0]]) {
+				break;
+			}
+			c = blbn_sfl_heap_pop (state);
+			i = c % state->node_count;
+			j = c / state->node_count;
+		}
+
+		// Rescore them in one pass over their cases and put them back
+		scores = blbn_score_candidates (state, BLBN_SCORE_SFL, 0, batch_cases, batch_case_count, DBL_MAX, mask);
+		for (m = 0; m < batch_count; ++m) {
+			c = batch[m];
+			i = c % state->node_count;
+			j = c / state->node_count;
+			mask[i][j] = 0;
+			last_score[i][j] = scores[i][j];
+			fresh[c] = 1;
+			blbn_sfl_heap_push (state, c);
+		}
+		for (m = 0; m < state->node_count; ++m) {
+			free (scores[m]);
+		}
+		free (scores);
+		rescored_count += batch_count;
+	}
 
-				//printf ("%f\n", expected_target_probability);
+	// The best candidates stay in the heap (with their fresh scores)
+	for (m = 0; m < top_count; ++m) {
+		blbn_sfl_heap_push (state, top[m]);
+	}
 
-				// Calculate percent difference between probability of case being predicted correctly
-				//percent_diff_values[i][j] = (expected_target_probability - current_target_probability) / current_target_probability;
-				expected_loss_probability_values[i][j] = expected_loss_probability;
+	fprintf (log_fp, "SFL: lazy greedy rescored %d of %d candidates\n", rescored_count, state->sfl_heap_count);
 
-				//printf ("%f -> %f / %f    ", current_target_probability, expected_target_probability, percent_diff_values[i][j]);
-				//printf ("%f , (%f * %f), %f, %f    ", current_target_probability, target_probability, state_probability, expected_target_probability, percent_diff_values[i][j]);
-				//printf ("%f    ", percent_diff_values[i][j]);
+	for (i = 0; i < state->node_count; ++i) {
+		free (mask[i]);
+	}
+	free (mask);
+	free (fresh);
+	free (top);
+	free (batch);
+	free (batch_cases);
 
-//				fprintf (log_fp, "blbn_util_cheat 5.1\n");
-//				fflush (log_fp);
+	return sfl_values;
+}
 
-			} else {
+/**
+ * Returns the SFL scores of (node, label) pairs, as in the published
+ * definition of SFL and RSFL, where the case of a purchase is drawn at
+ * random from the cases with the label once its pair is selected.  Each
+ * pair is scored on up to state->sfl_pair_samples cases drawn at random from
+ * the cases with the label whose finding of the node is available for
+ * purchase, and its score is the mean of their SFL scores.
+ *
+ * The scores are returned in the layout of blbn_util_sfl: the score of each
+ * pair is stored at the first case drawn for it (its representative), and
+ * every other entry is DBL_MAX.  If argmin is non-zero and one case is drawn
+ * per pair, the scores are bounded as in blbn_util_sfl; otherwise every
+ * score is exact.
+ */
+double** blbn_util_sfl_pairs (blbn_state_t *state, char argmin) {
 
-				expected_loss_probability_values[i][j] = -1;
+	double **sfl_values = NULL;
+	double **pair_values = NULL;
+	char **mask = NULL;
+	int *case_order = NULL;
+	int *cases = NULL;
+	int *drawn = NULL;
+	int *pair_cases = NULL;   // cases drawn for pair (node i, label) at [(i * label_count + label) * sample_count]
+	int *pair_counts = NULL;  // number of cases drawn for each pair
+	int sample_count = state->sfl_pair_samples;
+	int label_count = state->state_count[state->target];
+	int case_count = 0, drawn_count, pair_count = 0;
+	int i, j, k, m, label, pair, swap;
+	double total;
+
+	pair_values = (double **) malloc (state->node_count * sizeof (double *));
+	mask = (char **) malloc (state->node_count * sizeof (char *));
+	for (i = 0; i < state->node_count; ++i) {
+		pair_values[i] = (double *) malloc (state->case_count * sizeof (double));
+		for (j = 0; j < state->case_count; ++j) {
+			pair_values[i][j] = DBL_MAX;
+		}
+		mask[i] = (char *) calloc (state->case_count, sizeof (char));
+	}
+	drawn = (int *) malloc ((state->case_count > 0 ? state->case_count : 1) * sizeof (int));
+	pair_cases = (int *) malloc (state->node_count * label_count * sample_count * sizeof (int));
+	pair_counts = (int *) calloc (state->node_count * label_count, sizeof (int));
 
-//				fprintf (log_fp, "blbn_util_cheat 5.2\n");
-//				fflush (log_fp);
+	// Draw the cases of each pair (a partial Fisher-Yates shuffle of the cases with the label)
+	for (i = 0; i < state->node_count; ++i) {
+		for (label = 0; label < label_count; ++label) {
+			drawn_count = 0;
+			for (j = 0; j < state->case_count; ++j) {
+				if (!blbn_is_available_finding (state, i, j) && state->state[state->target][j] == label) {
+					drawn[drawn_count++] = j;
+				}
+			}
+			if (drawn_count > sample_count) {
+				for (k = 0; k < sample_count; ++k) {
+					m = k + rand () % (drawn_count - k);
+					swap = drawn[k];
+					drawn[k] = drawn[m];
+					drawn[m] = swap;
+				}
+				drawn_count = sample_count;
+			}
 
+			pair = i * label_count + label;
+			pair_counts[pair] = drawn_count;
+			for (k = 0; k < drawn_count; ++k) {
+				pair_cases[pair * sample_count + k] = drawn[k];
+				mask[i][drawn[k]] = 1;
+			}
+			if (drawn_count > 0) {
+				++pair_count;
 			}
+		}
+	}
 
-			//printf ("%f    ", percent_diff_values[i][j]);
-			//printf ("|    ");
+	// Score the drawn cases, visiting the cases with the best scores in the last iteration first
+	case_order = blbn_get_sfl_order (state, -1);
+	cases = (int *) malloc ((state->case_count > 0 ? state->case_count : 1) * sizeof (int));
+	for (m = 0; m < state->case_count; ++m) {
+		j = case_order[m];
+		for (i = 0; i < state->node_count && !mask[i][j]; ++i);
+		if (i < state->node_count) {
+			cases[case_count++] = j;
 		}
-		//printf ("\n");
+	}
+	sfl_values = blbn_score_candidates (state, BLBN_SCORE_SFL, (argmin && sample_count == 1), cases, case_count, DBL_MAX, mask);
 
-		// Delete base network for case (network with current case in "not learned" state)
-		DeleteNet_bn (lookahead_base_net);
+	// Store the mean score of each pair at its representative case
+	for (i = 0; i < state->node_count; ++i) {
+		for (label = 0; label < label_count; ++label) {
+			pair = i * label_count + label;
+			if (pair_counts[pair] > 0) {
+				total = 0.0;
+				for (k = 0; k < pair_counts[pair]; ++k) {
+					total += sfl_values[i][pair_cases[pair * sample_count + k]];
+				}
+				pair_values[i][pair_cases[pair * sample_count]] = total / pair_counts[pair];
+			}
+		}
+	}
 
-//		fprintf (log_fp, "blbn_util_cheat 6\n");
-//		fflush (log_fp);
+	fprintf (log_fp, "SFL: %d (node, label) pairs scored on %d cases\n", pair_count, case_count);
+	if (argmin && sample_count == 1) {
+		blbn_log_sfl_bound_stats (state);
 	}
-	//printf ("\n");
-//	fprintf (log_fp, "blbn_util_cheat 7\n");
-//	fflush (log_fp);
 
-	return expected_loss_probability_values;
+	for (i = 0; i < state->node_count; ++i) {
+		free (sfl_values[i]);
+		free (mask[i]);
+	}
+	free (sfl_values);
+	free (mask);
+	free (case_order);
+	free (cases);
+	free (drawn);
+	free (pair_cases);
+	free (pair_counts);
+
+	return pair_values;
+}
+
+void blbn_util_print_findings (blbn_state_t *state) {
+	int i;
+	printf ("( ");
+	for (i = 0; i < state->node_count; ++i) {
+		printf ("%d ", GetNodeFinding_bn (blbn_get_work_node (state, i)));
+	}
+	printf (")\n");
+}
+
+/**
+ * EMPG - Expected Maximum Prediction (Performance) Gain
+ *
+ * This algorithm selects a non-purchased (node i, case j) pair with a
+ * maximal expected percent increase in the probability of predicting the
+ * correct target value.
+ */
+double** blbn_util_empg (blbn_state_t *state) {
+	return blbn_score_candidates_cached (state, BLBN_SCORE_EMPG, NULL);
+}
+
+/**
+ * "Cheating algorithm"
+ *
+ * (OLD DESCRIPTION) FROM EMPG:
+ * This algorithm computes the probability of each possible state k of node i
+ * in case j weighted by (i.e., multiplied by) the expected log loss
+ * reduction (i.e., improvement).  Note that the weight value (i.e., the log
+ * loss value) must be negated so a reduction in loss will be measured as an
+ * a greater weight value (i.e., an improvement).
+ *
+ * The current loss is computed once per call, and the lookahead networks
+ * of every candidate in a case (with the lookahead finding learned) are
+ * evaluated together in one pass over the validation cases (see
+ * blbn_score_cheat_case).
+ */
+double** blbn_util_cheat (blbn_state_t *state) {
+	return blbn_score_candidates_cached (state, BLBN_SCORE_CHEAT, NULL);
 }
 
 /**
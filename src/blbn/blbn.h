@@ -19,8 +19,13 @@
 #include <float.h>
 #include <math.h>
 #include <sys/stat.h>
+#include <pthread.h>
 #include "../netica/Netica.h"
 #include "../netica/NeticaEx.h"
+#include "blbn_model.h"
+#include "blbn_codegen.h"
+#include "blbn_lw.h"
+#include "blbn_bp.h"
 
 // Indicates whether or not to print output to stdout
 #define BLBN_STDOUT 0
@@ -31,6 +36,33 @@
 #define BLBN_METADATA_FLAG_PURCHASED 0x02
 #define BLBN_METADATA_FLAG_LEARNED   0x04
 
+// Fixed-size bitsets over the static node ordering (used for evidence patterns and d-separation)
+#define BLBN_BITSET_WORDS(n)   (((n) + 31) / 32)
+#define BLBN_BITSET_SET(b, i)   ((b)[(i) >> 5] |= (1u << ((i) & 31)))
+#define BLBN_BITSET_CLEAR(b, i) ((b)[(i) >> 5] &= ~(1u << ((i) & 31)))
+#define BLBN_BITSET_TEST(b, i)  (((b)[(i) >> 5] >> ((i) & 31)) & 1u)
+
+#define BLBN_DSEP_CACHE_SIZE 1024 // Number of buckets in the d-separation cache
+#define BLBN_SLICE_CACHE_SIZE 1024 // Number of buckets in the sliced elimination plan cache
+
+#define BLBN_NET_USER_DATA 0 // Kind of network user data holding the blbn_net_data_t of a network (see blbn_get_net_data)
+
+#define BLBN_INFERENCE_NETICA    0 // Junction tree inference in Netica
+#define BLBN_INFERENCE_GENERATED 1 // Generated and compiled variable elimination code (see blbn_codegen.h)
+#define BLBN_INFERENCE_LW        2 // Likelihood weighting (see blbn_lw.h)
+#define BLBN_INFERENCE_BP        3 // Loopy belief propagation (see blbn_bp.h)
+#define BLBN_INFERENCE_SLICED    4 // Variable elimination over CPTs sliced by the findings (see blbn_model.h)
+
+#define BLBN_LOG_LOSS_MIN_PROBABILITY 1.0e-12 // Smallest probability used in native log loss (avoids infinite loss)
+#define BLBN_CPT_CHANGE_TOLERANCE 1.0e-9 // Largest change of a CPT entry in a relearning that leaves the CPT version of its family unchanged
+#define BLBN_EVAL_MAX_THREADS 64 // Largest number of threads evaluating validation cases with native inference
+#define BLBN_SCORE_MAX_THREADS 64 // Largest number of threads scoring candidates
+#define BLBN_EVAL_SCHEDULE_ALL   0 // Evaluate every iteration of the learning loop
+#define BLBN_EVAL_SCHEDULE_EVERY 1 // Evaluate every eval_interval-th iteration
+#define BLBN_EVAL_SCHEDULE_LOG   2 // Evaluate log-spaced iterations (about eval_interval per power of ten)
+#define BLBN_EVAL_SCHEDULE_LIST  3 // Evaluate the iterations whose purchase reaches a budget spent in eval_list
+#define BLBN_SAMPLED_VALIDATION_MIN_CASES 30 // Validation cases consumed before a sampled lookahead evaluation may stop early
+
 #define BLBN_POLICY_ROUND_ROBIN  0 // Round Robin
 #define BLBN_POLICY_BIASED_ROBIN 1 // Biased Robin
 #define BLBN_POLICY_SFL          2 // Single-Feature Lookahead
@@ -56,15 +88,58 @@ typedef struct blbn_select_action {
 
 } blbn_select_action_t;
 
+typedef struct blbn_dsep_cache_entry {
+	unsigned int *evidence;  // Bitset of instantiated nodes (the key)
+	unsigned int *separated; // Bitset of uninstantiated nodes d-separated from the target given the evidence
+
+	struct blbn_dsep_cache_entry *next; // next entry in the same bucket
+
+} blbn_dsep_cache_entry_t;
+
+typedef struct blbn_slice_cache_entry {
+	unsigned int *evidence; // Bitset of nodes with hard findings, except the target (the key)
+	blbn_ve_plan_t *plan;   // Elimination plan over the CPTs sliced by those findings
+
+	struct blbn_slice_cache_entry *next; // next entry in the same bucket
+
+} blbn_slice_cache_entry_t;
+
+typedef struct blbn_posterior_cache_entry {
+	unsigned int *evidence;  // Bitset of learned findings of the case when the posterior was computed (NULL if never computed)
+	unsigned int *families;  // Bitset of families the posterior depends on (the target, the evidence and their ancestors)
+	unsigned long computed;  // CPT clock when the posterior was computed
+	double probability;      // Posterior probability of the target label of the case
+} blbn_posterior_cache_entry_t;
+
+typedef struct blbn_test_metrics {
+	unsigned int tested;     // number of validation cases with a target finding
+	double error_rate;       // fraction of tested cases whose most probable target state is not the label
+	double log_loss;         // mean of -log P(label)
+	double brier;            // mean of the squared distance between the target posterior and the indicator of the label
+	double auc;              // area under the ROC curve of P(target state 1) (binary targets with both labels tested; -1 otherwise)
+	int state_count;         // number of target states
+	unsigned int *confusion; // confusion[label * state_count + predicted]: number of tested cases
+} blbn_test_metrics_t;
+
+typedef struct blbn_net_data {
+	const net_bn *net; // Network the data belongs to (user data may be copied along with the network)
+	node_bn **nodes;   // Node of the network with each index in the static ordering
+	char compiled;     // Non-zero if the network has been compiled
+} blbn_net_data_t;
+
 typedef struct blbn_state {
 	unsigned int node_count; // number of nodes columns (i.e., variable n in a matrix)
 	unsigned int case_count; // number of cases rows (i.e., variable m in a matrix)
 
 	char **nodes; // Character string array of node names (this is the static ordering used in BLBN library)
+	int node_name_bucket_count;
+	int *node_name_buckets; // first node index in each bucket of the node name map (-1 if the bucket is empty)
+	int *node_name_next;    // next node index in the same bucket (-1 at the end of the bucket)
 	int **state; // 2D array of states
 	unsigned int **cost; // 2D array of costs for each (node, case) pair
 
 	unsigned int budget; // Current budget
+	unsigned int initial_budget; // Budget before any purchase
 
 	int target; // Target node index
 
@@ -72,6 +147,63 @@ typedef struct blbn_state {
 
 	blbn_select_action_t *sel_action_seq; // Pointer to head of linked list of select actions (in order of selection)
 
+	// Network structure in the static node ordering (the structure never changes after initialization)
+	int *state_count;  // number of states of each node
+	int *parent_count; // number of parents of each node
+	int **parents;     // indices of the parents of each node
+	int *child_count;  // number of children of each node
+	int **children;    // indices of the children of each node
+
+	// Cache of nodes d-separated from the target, keyed by evidence pattern
+	blbn_dsep_cache_entry_t **dsep_cache;
+	unsigned int dsep_cache_hits;
+	unsigned int dsep_cache_misses;
+	char prune_d_separated; // Skip lookahead for candidates d-separated from the target in their case (if non-zero)
+
+	// Inference method used for target posterior queries and evaluation (BLBN_INFERENCE_*)
+	int inference;
+
+	// Native copy of the working network and native inference engines (NULL unless enabled)
+	blbn_model_t *model;        // structure and CPTs of the working network
+	blbn_ve_plan_t *model_plan; // elimination plan for the target posterior
+	blbn_codegen_t *generated;  // compiled target posterior routine
+	blbn_lw_t *lw;              // likelihood weighting engine
+	blbn_bp_t *bp;              // loopy belief propagation engine
+	double **model_lambda;      // likelihood vector of each node (evidence passed to native inference)
+	long model_evidence_key;    // case of the evidence in model_lambda (training case index, or -1 - index for validation cases)
+
+	// Cache of sliced elimination plans, keyed by evidence pattern (NULL unless sliced inference is enabled)
+	blbn_slice_cache_entry_t **slice_cache;
+	unsigned int slice_cache_hits;
+	unsigned int slice_cache_misses;
+	unsigned int *model_dirty;  // bitset of nodes whose CPTs changed in the working network since they were copied into the model
+
+	// Version of each family's CPT (the CPT clock when it last changed) and cached
+	// target posteriors of the training cases, recomputed when their evidence or
+	// a family they depend on changes
+	unsigned long cpt_clock;
+	unsigned long *cpt_version;
+	double **cpt_reference;              // CPT of each family when its version was last set by a relearning (NULL rows if none; see blbn_unmark_unchanged_cpts)
+	unsigned long *cpt_reference_version; // version of each family when its reference CPT was taken
+	blbn_posterior_cache_entry_t *posterior_cache; // one entry per training case
+	unsigned int posterior_cache_hits;
+	unsigned int posterior_cache_misses;
+
+	// Compilation tracking (networks are compiled once; CPT changes do not require recompilation)
+	unsigned int compile_count;         // number of networks compiled
+	unsigned int compile_avoided_count; // number of compiles skipped because the network was already compiled
+
+	// Likelihood weighting statistics (since they were last written to the log)
+	unsigned int lw_query_count;
+	blbn_lw_stats_t lw_stats; // total samples, largest standard error and total time of the queries
+
+	// Loopy belief propagation statistics (since they were last written to the log)
+	unsigned int bp_query_count;
+	unsigned long bp_iteration_count;  // total number of sweeps
+	int bp_max_iterations;             // largest number of sweeps of a query
+	unsigned int bp_warm_count;        // number of queries started from cached messages
+	unsigned int bp_unconverged_count; // number of queries that reached the iteration cap
+
 	double last_log_loss;
 	double curr_log_loss;
 
@@ -82,9 +214,60 @@ typedef struct blbn_state {
 	net_bn *orig_net; // Original network with parameters read from the DNE or NETA file (not modified during execution of program)
 	net_bn *prior_net; // Network parameterized according to specified prior distribution (e.g., uniform, noisy).  The structure of this network is identical to that of the original network.
 	net_bn *work_net; // Network parameterized using available data (i.e., target values and purchased non-target node values) selected by a selection policy (e.g., round robin, biased robin, etc.)
-	nodelist_bn *nodelist;
+	int *net_findings; // Scratch findings of one case (-1 if none) entered as a batch by blbn_enter_net_findings
 
 	caseset_cs* validation_caseset;
+	unsigned int validation_case_count; // number of validation cases
+	int **validation_state;             // 2D array of validation case states (indexed [node][case], -1 if missing)
+
+	// Distinct validation cases with a target finding, packed row by row for one-pass evaluation (see blbn_pack_validation)
+	unsigned int validation_tested_count; // number of validation cases with a target finding
+	unsigned int validation_packed_count; // number of packed cases (distinct patterns of findings and label)
+	int *validation_packed;               // findings of packed case r at [r * node_count + node] (the target's is -1)
+	int *validation_labels;               // target finding of each packed case
+	unsigned int *validation_weights;     // number of validation cases with the pattern of each packed case
+	const blbn_ve_plan_t **validation_plans; // sliced elimination plan of each packed case (NULL until evaluated with sliced inference)
+	int eval_thread_count;                // number of threads evaluating blocks of packed cases with native inference
+
+	// Iterations of the learning loop at which the working network is evaluated (see blbn_set_eval_schedule)
+	int eval_schedule;                    // BLBN_EVAL_SCHEDULE_*
+	int eval_interval;                    // interval of BLBN_EVAL_SCHEDULE_EVERY, or iterations per power of ten of BLBN_EVAL_SCHEDULE_LOG
+	int *eval_list;                       // budgets spent of BLBN_EVAL_SCHEDULE_LIST
+	int eval_list_count;
+
+	// Sampled validation for lookahead scoring (see blbn_enable_sampled_validation)
+	double sampled_validation_z;          // width of the confidence bound in standard errors (0 if disabled)
+	int *validation_order;                // fixed random order in which packed cases are streamed
+	unsigned int sampled_candidate_count; // number of candidates evaluated (since last written to the log)
+	unsigned int sampled_stopped_count;   // number of candidates stopped early
+	double sampled_case_fraction;         // total fraction of validation cases consumed by the candidates
+
+	// Branch and bound of SFL scores (see blbn_util_sfl)
+	double **sfl_last_score;              // last SFL score of each (node, case) pair (indexed [node][case]; NULL until first scored)
+	unsigned int sfl_abandoned_count;     // number of candidates abandoned (since last written to the log)
+	unsigned int sfl_lookahead_count;     // number of lookahead networks evaluated
+	unsigned int sfl_lookahead_skipped;   // number of lookahead networks skipped by abandoned candidates
+
+	// Lazy-greedy selection of SFL candidates (see blbn_util_sfl_lazy)
+	char sfl_lazy;                        // non-zero to rescore only the best candidates of the heap
+	int *sfl_heap;                        // heap of candidates (j * node_count + i for node i in case j) by last SFL score (NULL until first scored)
+	int sfl_heap_count;                   // number of candidates in the heap
+
+	int score_thread_count;               // number of threads scoring the candidates of SFL, EMPG and cheating (see blbn_score_candidates)
+	int sfl_pair_samples;                 // cases scored per (node, label) pair by SFL and RSFL (0 to score every (node, case) pair; see blbn_util_sfl_pairs)
+	unsigned int score_pattern_count;     // distinct learned-evidence patterns scored (since last written to the log)
+	unsigned int score_case_count;        // cases scored, including those sharing a pattern (since last written to the log)
+	unsigned int score_candidate_count;   // candidates scored (since last written to the log)
+	double score_budget;                  // candidates scored per call: a count if at least 1, else a fraction of the candidates (0 for every candidate; see blbn_score_candidates_sampled)
+
+	// Incremental score matrix of SFL, EMPG and cheating (see blbn_score_candidates_cached)
+	double score_cache_tolerance;         // largest change of a CPT entry that leaves the scores of its node valid (negative to rescore every candidate)
+	int score_cache_refresh;              // iterations between full rescorings (0 for never)
+	int score_cache_kind;                 // kind of the cached scores (-1 if none)
+	int score_cache_age;                  // iterations since the last full rescoring
+	double **score_cache;                 // cached scores (indexed [node][case]; NULL if none)
+	double **score_cache_cpt;             // CPTs of the working network when the scores were cached
+	unsigned long long *score_cache_pattern; // learned-evidence pattern hash of each case when the scores were cached
 
 } blbn_state_t;
 
@@ -116,6 +299,7 @@ void blbn_retract_findings_not_target (blbn_state_t *state);
 void blbn_set_net_findings_available (blbn_state_t *state, int case_index);
 void blbn_set_net_findings_learned (blbn_state_t *state, int case_index);
 void blbn_set_net_findings (blbn_state_t *state, int case_index);
+void blbn_enter_net_findings (blbn_state_t *state, net_bn *net, const int *findings);
 void blbn_set_node_finding_if_available (blbn_state_t *state, int node_index, int case_index);
 void blbn_set_finding_not_learned (blbn_state_t *state, unsigned int node_index, unsigned int case_index);
 void blbn_set_finding_learned (blbn_state_t *state, unsigned int node_index, unsigned int case_index);
@@ -132,6 +316,11 @@ int blbn_get_random_finding_not_purchased_in_node (blbn_state_t *state, int node
 int blbn_get_random_finding_not_purchased_in_node_with_label (blbn_state_t *mdata, int node_index, int target_state);
 char* blbn_get_node_name (blbn_state_t *state, unsigned int node_index);
 int blbn_get_node_by_name (blbn_state_t *state, char *name);
+blbn_net_data_t* blbn_get_net_data (blbn_state_t *state, net_bn *net);
+node_bn** blbn_get_net_nodes (blbn_state_t *state, net_bn *net);
+node_bn* blbn_get_net_node (blbn_state_t *state, net_bn *net, int node_index);
+node_bn* blbn_get_work_node (blbn_state_t *state, int node_index);
+void blbn_delete_net (net_bn *net);
 int blbn_get_node_finding (blbn_state_t *state, unsigned int node_index, unsigned int case_index);
 int blbn_get_node_index (blbn_state_t *state, char* node_name);
 double blbn_get_error_rate (blbn_state_t *state);
@@ -171,7 +360,38 @@ int blbn_is_non_target_node (blbn_state_t *state, unsigned int node_index);
 void blbn_assert_node_finding (blbn_state_t *state, int node_index, int state_index);
 void blbn_assert_node_finding_for_case (blbn_state_t *state, int node_index, int case_index, int state_index);
 
+double** blbn_get_node_target_joint_given_learned (blbn_state_t *state, int case_index);
+void blbn_free_node_target_joint (blbn_state_t *state, double **joint);
+double blbn_get_joint_node_state_probability (blbn_state_t *state, double **joint, int node_index, int case_index, int state_index);
+double blbn_get_joint_target_probability_given_node_state (blbn_state_t *state, double **joint, int node_index, int case_index, int state_index);
+double blbn_get_joint_target_probability (blbn_state_t *state, double **joint, int node_index, int case_index);
+
 int blbn_get_d_separated_nodes (blbn_state_t *state, unsigned int node_index, int **d_separated_node_indices);
+void blbn_get_d_separated_nodes_given_evidence (blbn_state_t *state, unsigned int node_index, const unsigned int *evidence, unsigned int *separated);
+void blbn_init_model (blbn_state_t *state);
+void blbn_free_model (blbn_state_t *state);
+void blbn_free_score_cache (blbn_state_t *state);
+int blbn_enable_generated_inference (blbn_state_t *state, const char *cache_dir);
+int blbn_enable_likelihood_weighting (blbn_state_t *state, const blbn_lw_options_t *options);
+int blbn_enable_loopy_belief_propagation (blbn_state_t *state, const blbn_bp_options_t *options);
+int blbn_enable_sliced_inference (blbn_state_t *state);
+void blbn_sync_model (blbn_state_t *state);
+void blbn_mark_cpts_changed (blbn_state_t *state, int node_index);
+void blbn_mark_cpts_changed_by_findings (blbn_state_t *state);
+void blbn_compile_net (blbn_state_t *state, net_bn *net);
+void blbn_set_model_findings_learned (blbn_state_t *state, int case_index);
+void blbn_set_model_findings_learned_except_target (blbn_state_t *state, int case_index);
+void blbn_set_model_findings_validation (blbn_state_t *state, int validation_case_index);
+double blbn_get_model_target_posterior (blbn_state_t *state, const double * const *cpt, double *posterior);
+double* blbn_get_model_test_rates (blbn_state_t *state, const double * const *cpt);
+blbn_test_metrics_t* blbn_get_model_test_metrics (blbn_state_t *state, const double * const *cpt);
+blbn_test_metrics_t* blbn_get_test_metrics (blbn_state_t *state, net_bn *net);
+void blbn_free_test_metrics (blbn_test_metrics_t *metrics);
+void blbn_enable_sampled_validation (blbn_state_t *state, double z);
+int blbn_set_eval_schedule (blbn_state_t *state, const char *schedule);
+char blbn_is_evaluation_iteration (blbn_state_t *state, int iteration, unsigned int cost);
+void blbn_log_inference_stats (blbn_state_t *state, int iteration);
+const unsigned int* blbn_get_d_separated_from_target_in_case (blbn_state_t *state, unsigned int case_index);
 int blbn_get_d_separated_nodes_and_separating_nodes (blbn_state_t *state, unsigned int node_index, int **d_separated_node_indices);
 
 blbn_select_action_t* blbn_select_next_rr       (blbn_state_t *state);
@@ -183,8 +403,13 @@ blbn_select_action_t* blbn_select_next_grsfl    (blbn_state_t *state, int K, dou
 blbn_select_action_t* blbn_select_next_empg     (blbn_state_t *state);
 blbn_select_action_t* blbn_select_next_cheating (blbn_state_t *state);
 
-double** blbn_util_sfl     (blbn_state_t *state);
-double*  blbn_util_sfl_row (blbn_state_t *state, int case_index);
+net_bn*  blbn_util_copy_net (blbn_state_t *state, net_bn* net);
+double   blbn_util_get_log_loss (blbn_state_t *state, net_bn *net);
+double   blbn_util_get_expected_log_loss_sampled (blbn_state_t *state, net_bn **nets, const double *probability, int net_count, double bound, char *exact);
+double** blbn_util_sfl     (blbn_state_t *state, char argmin);
+double** blbn_util_sfl_pairs (blbn_state_t *state, char argmin);
+double** blbn_util_sfl_lazy (blbn_state_t *state, int K);
+double*  blbn_util_sfl_row (blbn_state_t *state, int case_index, double bound);
 double** blbn_util_empg    (blbn_state_t *state);
 double** blbn_util_cheat   (blbn_state_t *state);
 
@@ -0,0 +1,391 @@
+/*
+ * blbn_bp.c
+ *
+ *  Loopy belief propagation with cached messages.  See blbn_bp.h.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "blbn_bp.h"
+
+#define BLBN_BP_WORDS(n)   (((n) + 31) / 32)
+#define BLBN_BP_SET(b, i)  ((b)[(i) >> 5] |= (1u << ((i) & 31)))
+
+void blbn_bp_default_options (blbn_bp_options_t *options) {
+	options->max_iterations = 100;
+	options->damping = 0.2;
+	options->tolerance = 1.0e-6;
+	options->cache_size = 1024;
+}
+
+/**
+ * Creates a loopy belief propagation engine for the model.  The model's
+ * structure must not change while the engine is used (CPTs may).
+ */
+blbn_bp_t* blbn_bp_new (const blbn_model_t *model, const blbn_bp_options_t *options) {
+
+	blbn_bp_t *bp = NULL;
+	int n = model->node_count;
+	int i, p, v, family_count, scratch_size = 0, max_family_count = 0;
+
+	bp = (blbn_bp_t *) malloc (sizeof (blbn_bp_t));
+	bp->model = model;
+	bp->options = *options;
+	if (bp->options.cache_size < 0) {
+		bp->options.cache_size = 0;
+	}
+
+	// Lay out the factor-to-variable messages and index the factors of each variable
+	bp->message_size = 0;
+	bp->offset = (int **) malloc (n * sizeof (int *));
+	bp->var_factor_count = (int *) calloc (n, sizeof (int));
+	for (i = 0; i < n; ++i) {
+		family_count = model->parent_count[i] + 1;
+		bp->offset[i] = (int *) malloc (family_count * sizeof (int));
+		for (p = 0; p < family_count; ++p) {
+			v = model->family[i][p];
+			bp->offset[i][p] = bp->message_size;
+			bp->message_size += model->state_count[v];
+			++bp->var_factor_count[v];
+		}
+		if (family_count > max_family_count) {
+			max_family_count = family_count;
+		}
+	}
+
+	bp->var_factors = (int **) malloc (n * sizeof (int *));
+	bp->var_positions = (int **) malloc (n * sizeof (int *));
+	for (v = 0; v < n; ++v) {
+		bp->var_factors[v] = (int *) malloc (bp->var_factor_count[v] * sizeof (int));
+		bp->var_positions[v] = (int *) malloc (bp->var_factor_count[v] * sizeof (int));
+		bp->var_factor_count[v] = 0;
+	}
+	for (i = 0; i < n; ++i) {
+		family_count = model->parent_count[i] + 1;
+		for (p = 0; p < family_count; ++p) {
+			v = model->family[i][p];
+			bp->var_factors[v][bp->var_factor_count[v]] = i;
+			bp->var_positions[v][bp->var_factor_count[v]] = p;
+			++bp->var_factor_count[v];
+		}
+		if (bp->offset[i][family_count - 1] + model->state_count[i] - bp->offset[i][0] > scratch_size) {
+			scratch_size = bp->offset[i][family_count - 1] + model->state_count[i] - bp->offset[i][0];
+		}
+	}
+
+	bp->messages = (double *) malloc (bp->message_size * sizeof (double));
+	bp->incoming = (double *) malloc (scratch_size * sizeof (double));
+	bp->outgoing = (double *) malloc (scratch_size * sizeof (double));
+	bp->states = (int *) malloc (max_family_count * sizeof (int));
+	bp->beliefs = (double **) malloc (n * sizeof (double *));
+	for (v = 0; v < n; ++v) {
+		bp->beliefs[v] = (double *) malloc (model->state_count[v] * sizeof (double));
+	}
+
+	// Message cache
+	bp->pattern_words = BLBN_BP_WORDS (n);
+	bp->pattern = (unsigned int *) malloc (bp->pattern_words * sizeof (unsigned int));
+	bp->entries = NULL;
+	bp->buckets = NULL;
+	bp->next_entry = 0;
+	if (bp->options.cache_size > 0) {
+		bp->entries = (blbn_bp_cache_entry_t *) calloc (bp->options.cache_size, sizeof (blbn_bp_cache_entry_t));
+		bp->buckets = (blbn_bp_cache_entry_t **) calloc (bp->options.cache_size, sizeof (blbn_bp_cache_entry_t *));
+	}
+
+	return bp;
+}
+
+void blbn_bp_free (blbn_bp_t *bp) {
+
+	int i;
+
+	if (bp == NULL) {
+		return;
+	}
+
+	for (i = 0; i < bp->model->node_count; ++i) {
+		free (bp->offset[i]);
+		free (bp->var_factors[i]);
+		free (bp->var_positions[i]);
+		free (bp->beliefs[i]);
+	}
+	free (bp->offset);
+	free (bp->var_factor_count);
+	free (bp->var_factors);
+	free (bp->var_positions);
+	free (bp->beliefs);
+	free (bp->messages);
+	free (bp->incoming);
+	free (bp->outgoing);
+	free (bp->states);
+	free (bp->pattern);
+
+	for (i = 0; i < bp->options.cache_size; ++i) {
+		free (bp->entries[i].pattern);
+		free (bp->entries[i].messages);
+	}
+	free (bp->entries);
+	free (bp->buckets);
+
+	free (bp);
+}
+
+static int blbn_bp_bucket (const blbn_bp_t *bp, long key) {
+	return (int) ((unsigned long) key % (unsigned long) bp->options.cache_size);
+}
+
+/**
+ * Returns the number of nodes in which two evidence patterns differ.
+ */
+static int blbn_bp_pattern_distance (const blbn_bp_t *bp, const unsigned int *a, const unsigned int *b) {
+
+	int w, distance = 0;
+	unsigned int x;
+
+	for (w = 0; w < bp->pattern_words; ++w) {
+		for (x = a[w] ^ b[w]; x != 0; x &= x - 1) {
+			++distance;
+		}
+	}
+
+	return distance;
+}
+
+/**
+ * Finds the cached messages of the query with the same key and the nearest
+ * evidence pattern.  Sets *exact if the pattern is the same.
+ */
+static blbn_bp_cache_entry_t* blbn_bp_cache_find (blbn_bp_t *bp, long key, char *exact) {
+
+	blbn_bp_cache_entry_t *entry = NULL;
+	blbn_bp_cache_entry_t *nearest = NULL;
+	int distance, nearest_distance = 0;
+
+	*exact = 0;
+	if (bp->options.cache_size == 0) {
+		return NULL;
+	}
+
+	for (entry = bp->buckets[blbn_bp_bucket (bp, key)]; entry != NULL; entry = entry->next) {
+		if (entry->key != key) {
+			continue;
+		}
+		distance = blbn_bp_pattern_distance (bp, entry->pattern, bp->pattern);
+		if (nearest == NULL || distance < nearest_distance) {
+			nearest = entry;
+			nearest_distance = distance;
+		}
+	}
+
+	*exact = (nearest != NULL && nearest_distance == 0);
+	return nearest;
+}
+
+/**
+ * Stores the current messages under the key and evidence pattern of the
+ * current query, replacing the oldest entry when the cache is full.
+ */
+static void blbn_bp_cache_store (blbn_bp_t *bp, long key, blbn_bp_cache_entry_t *entry) {
+
+	blbn_bp_cache_entry_t **link = NULL;
+
+	if (bp->options.cache_size == 0) {
+		return;
+	}
+
+	if (entry == NULL) {
+		entry = &bp->entries[bp->next_entry];
+		bp->next_entry = (bp->next_entry + 1) % bp->options.cache_size;
+
+		if (entry->used) {
+			// Unlink the replaced entry from its bucket
+			for (link = &bp->buckets[blbn_bp_bucket (bp, entry->key)]; *link != entry; link = &(*link)->next);
+			*link = entry->next;
+		} else {
+			entry->pattern = (unsigned int *) malloc (bp->pattern_words * sizeof (unsigned int));
+			entry->messages = (double *) malloc (bp->message_size * sizeof (double));
+			entry->used = 1;
+		}
+
+		entry->key = key;
+		memcpy (entry->pattern, bp->pattern, bp->pattern_words * sizeof (unsigned int));
+		entry->next = bp->buckets[blbn_bp_bucket (bp, key)];
+		bp->buckets[blbn_bp_bucket (bp, key)] = entry;
+	}
+
+	memcpy (entry->messages, bp->messages, bp->message_size * sizeof (double));
+}
+
+/**
+ * Normalizes a message to sum to one (a zero message becomes uniform).
+ */
+static void blbn_bp_normalize (double *message, int count) {
+
+	int k;
+	double sum = 0.0;
+
+	for (k = 0; k < count; ++k) {
+		sum += message[k];
+	}
+	for (k = 0; k < count; ++k) {
+		message[k] = (sum > 0.0 ? message[k] / sum : 1.0 / count);
+	}
+}
+
+/**
+ * Recomputes the messages from factor i to every variable of its family and
+ * returns the largest change of a message entry.
+ */
+static double blbn_bp_update_factor (blbn_bp_t *bp, const double *cpt, const double * const *lambda, int i) {
+
+	const blbn_model_t *model = bp->model;
+	int family_count = model->parent_count[i] + 1;
+	const int *family = model->family[i];
+	int base = bp->offset[i][0];
+	int *states = bp->states;
+	int p, q, v, g, k, e;
+	double product, change = 0.0, value;
+
+	// Variable-to-factor messages: the variable's evidence times the messages from its other factors
+	for (p = 0; p < family_count; ++p) {
+		v = family[p];
+		for (k = 0; k < model->state_count[v]; ++k) {
+			bp->incoming[bp->offset[i][p] - base + k] = (lambda != NULL && lambda[v] != NULL ? lambda[v][k] : 1.0);
+		}
+		for (g = 0; g < bp->var_factor_count[v]; ++g) {
+			if (bp->var_factors[v][g] == i) {
+				continue;
+			}
+			q = bp->offset[bp->var_factors[v][g]][bp->var_positions[v][g]];
+			for (k = 0; k < model->state_count[v]; ++k) {
+				bp->incoming[bp->offset[i][p] - base + k] *= bp->messages[q + k];
+			}
+		}
+		blbn_bp_normalize (&bp->incoming[bp->offset[i][p] - base], model->state_count[v]);
+	}
+
+	// Factor-to-variable messages: sum over the CPT entries (the node's own state changes fastest)
+	memset (bp->outgoing, 0, (bp->offset[i][family_count - 1] + model->state_count[i] - base) * sizeof (double));
+	memset (states, 0, family_count * sizeof (int));
+	for (e = 0; e < model->cpt_size[i]; ++e) {
+		if (cpt[e] != 0.0) {
+			for (p = 0; p < family_count; ++p) {
+				product = cpt[e];
+				for (q = 0; q < family_count; ++q) {
+					if (q != p) {
+						product *= bp->incoming[bp->offset[i][q] - base + states[q]];
+					}
+				}
+				bp->outgoing[bp->offset[i][p] - base + states[p]] += product;
+			}
+		}
+
+		for (p = family_count - 1; p >= 0; --p) {
+			if (++states[p] < model->state_count[family[p]]) {
+				break;
+			}
+			states[p] = 0;
+		}
+	}
+
+	// Damped update
+	for (p = 0; p < family_count; ++p) {
+		v = family[p];
+		blbn_bp_normalize (&bp->outgoing[bp->offset[i][p] - base], model->state_count[v]);
+		for (k = 0; k < model->state_count[v]; ++k) {
+			value = (1.0 - bp->options.damping) * bp->outgoing[bp->offset[i][p] - base + k] + bp->options.damping * bp->messages[bp->offset[i][p] + k];
+			if (fabs (value - bp->messages[bp->offset[i][p] + k]) > change) {
+				change = fabs (value - bp->messages[bp->offset[i][p] + k]);
+			}
+			bp->messages[bp->offset[i][p] + k] = value;
+		}
+	}
+
+	return change;
+}
+
+/**
+ * Runs loopy belief propagation with the specified CPTs (NULL for the
+ * model's CPTs) and likelihood vectors (lambda[i] is NULL if node i has no
+ * finding).  The posterior of every node is written to bp->beliefs.  key
+ * identifies the query for warm starts (queries with the same key should
+ * differ in few findings, e.g., key the queries of a case by its index).
+ * Returns the number of sweeps.
+ */
+int blbn_bp_query (blbn_bp_t *bp, const double * const *cpt, const double * const *lambda, long key, blbn_bp_stats_t *stats) {
+
+	const blbn_model_t *model = bp->model;
+	blbn_bp_cache_entry_t *entry = NULL;
+	char exact = 0, warm_start = BLBN_BP_COLD_START;
+	int n = model->node_count;
+	int iteration, o, i, g, k, v;
+	double change;
+	char converged = 0;
+
+	if (cpt == NULL) {
+		cpt = (const double * const *) model->cpt;
+	}
+
+	// Evidence pattern (nodes whose likelihood vector is not all ones)
+	memset (bp->pattern, 0, bp->pattern_words * sizeof (unsigned int));
+	for (v = 0; v < n && lambda != NULL; ++v) {
+		for (k = 0; lambda[v] != NULL && k < model->state_count[v]; ++k) {
+			if (lambda[v][k] != 1.0) {
+				BLBN_BP_SET (bp->pattern, v);
+				break;
+			}
+		}
+	}
+
+	// Start from cached messages if possible
+	entry = blbn_bp_cache_find (bp, key, &exact);
+	if (entry != NULL) {
+		memcpy (bp->messages, entry->messages, bp->message_size * sizeof (double));
+		warm_start = (exact ? BLBN_BP_WARM_EXACT : BLBN_BP_WARM_NEAREST);
+	} else {
+		for (i = 0; i < n; ++i) {
+			for (o = 0; o <= model->parent_count[i]; ++o) {
+				v = model->family[i][o];
+				for (k = 0; k < model->state_count[v]; ++k) {
+					bp->messages[bp->offset[i][o] + k] = 1.0 / model->state_count[v];
+				}
+			}
+		}
+	}
+
+	// Sweep over the factors, alternating between forward and backward order
+	for (iteration = 0; iteration < bp->options.max_iterations && !converged; ++iteration) {
+		change = 0.0;
+		for (o = 0; o < n; ++o) {
+			i = (iteration % 2 == 0 ? o : n - 1 - o);
+			change = fmax (change, blbn_bp_update_factor (bp, cpt[i], lambda, i));
+		}
+		converged = (change <= bp->options.tolerance);
+	}
+
+	// Beliefs: evidence times all incoming factor-to-variable messages
+	for (v = 0; v < n; ++v) {
+		for (k = 0; k < model->state_count[v]; ++k) {
+			bp->beliefs[v][k] = (lambda != NULL && lambda[v] != NULL ? lambda[v][k] : 1.0);
+		}
+		for (g = 0; g < bp->var_factor_count[v]; ++g) {
+			o = bp->offset[bp->var_factors[v][g]][bp->var_positions[v][g]];
+			for (k = 0; k < model->state_count[v]; ++k) {
+				bp->beliefs[v][k] *= bp->messages[o + k];
+			}
+		}
+		blbn_bp_normalize (bp->beliefs[v], model->state_count[v]);
+	}
+
+	blbn_bp_cache_store (bp, key, (exact ? entry : NULL));
+
+	if (stats != NULL) {
+		stats->iterations = iteration;
+		stats->converged = converged;
+		stats->warm_start = warm_start;
+	}
+
+	return iteration;
+}
@@ -0,0 +1,75 @@
+/*
+ * blbn_bp.h
+ *
+ *  Loopy belief propagation (approximate inference) over the factor graph
+ *  of a native model (see blbn_model.h).  Every CPT is a factor over the
+ *  node's family and evidence enters as likelihood vectors on the variables.
+ *
+ *  Converged messages are cached per query key (e.g., a case) and evidence
+ *  pattern (the set of nodes with findings).  A query starts from the cached
+ *  messages of the same key and pattern or, failing that, of the same key
+ *  and the nearest pattern, so a what-if query that differs from an earlier
+ *  one by a single finding usually converges in a few sweeps.
+ */
+
+#ifndef BLBN_BP_H_
+#define BLBN_BP_H_
+
+#include "blbn_model.h"
+
+#define BLBN_BP_COLD_START    0 // messages started uniform
+#define BLBN_BP_WARM_EXACT    1 // messages started from a query with the same key and evidence pattern
+#define BLBN_BP_WARM_NEAREST  2 // messages started from a query with the same key and the nearest evidence pattern
+
+typedef struct blbn_bp_options {
+	int max_iterations; // maximum number of sweeps per query
+	double damping;     // weight of the previous message in each update (0 disables damping)
+	double tolerance;   // converged when no message entry changes by more than this in a sweep
+	int cache_size;     // number of message sets kept for warm starts (0 disables the cache)
+} blbn_bp_options_t;
+
+typedef struct blbn_bp_stats {
+	int iterations;  // number of sweeps
+	char converged;  // non-zero if the messages converged
+	char warm_start; // how the messages were started (BLBN_BP_COLD_START, BLBN_BP_WARM_*)
+} blbn_bp_stats_t;
+
+typedef struct blbn_bp_cache_entry {
+	long key;                // query key
+	unsigned int *pattern;   // bitset of nodes with evidence
+	double *messages;        // converged factor-to-variable messages
+	char used;               // non-zero if the entry holds messages
+
+	struct blbn_bp_cache_entry *next; // next entry in the same bucket
+} blbn_bp_cache_entry_t;
+
+typedef struct blbn_bp {
+	const blbn_model_t *model;
+	blbn_bp_options_t options;
+
+	int message_size;      // number of entries of all factor-to-variable messages
+	int **offset;          // offset[i][p]: start of the message from factor i (the CPT of node i) to family[i][p]
+	int *var_factor_count; // number of factors containing each variable
+	int **var_factors;     // factors containing each variable
+	int **var_positions;   // position of the variable in the family of each of those factors
+
+	double *messages;      // current factor-to-variable messages
+	double *incoming;      // scratch space for variable-to-factor messages of one factor
+	double *outgoing;      // scratch space for factor-to-variable messages of one factor
+	int *states;           // scratch space for the states of one family
+	double **beliefs;      // posterior of every node after the last query
+
+	int pattern_words;
+	unsigned int *pattern; // evidence pattern of the current query
+	blbn_bp_cache_entry_t *entries;  // cache entries (replaced first in, first out)
+	blbn_bp_cache_entry_t **buckets; // cache entries by key
+	int next_entry;                  // next entry to replace
+} blbn_bp_t;
+
+void blbn_bp_default_options (blbn_bp_options_t *options);
+blbn_bp_t* blbn_bp_new (const blbn_model_t *model, const blbn_bp_options_t *options);
+void blbn_bp_free (blbn_bp_t *bp);
+
+int blbn_bp_query (blbn_bp_t *bp, const double * const *cpt, const double * const *lambda, long key, blbn_bp_stats_t *stats);
+
+#endif /* BLBN_BP_H_ */
@@ -0,0 +1,257 @@
+/*
+ * blbn_codegen.c
+ *
+ *  Generated and compiled target posterior code.  See blbn_codegen.h.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <dlfcn.h>
+#include "blbn_codegen.h"
+
+/**
+ * Writes the index expression of the factor with the specified scope for the
+ * current values of the loop variables (v<node>), with variable var fixed to
+ * state_index (var may be -1).
+ */
+static void blbn_codegen_write_index (FILE *fp, const blbn_model_t *model, const int *scope, int scope_count, int var, int state_index) {
+
+	int v, stride = 1, constant = 0, terms = 0;
+	char buffer[64];
+
+	// Strides are computed from the last (fastest) variable
+	for (v = scope_count - 1; v >= 0; --v) {
+		if (scope[v] == var) {
+			constant += state_index * stride;
+		} else {
+			if (stride == 1) {
+				sprintf (buffer, "v%d", scope[v]);
+			} else {
+				sprintf (buffer, "v%d * %d", scope[v], stride);
+			}
+			fprintf (fp, "%s%s", (terms > 0 ? " + " : ""), buffer);
+			++terms;
+		}
+		stride *= model->state_count[scope[v]];
+	}
+
+	if (constant > 0 || terms == 0) {
+		fprintf (fp, "%s%d", (terms > 0 ? " + " : ""), constant);
+	}
+}
+
+/**
+ * Writes the value expression of the factor with the specified id (see
+ * blbn_ve_step_t) with variable var fixed to state_index.
+ */
+static void blbn_codegen_write_factor (FILE *fp, const blbn_model_t *model, const blbn_ve_plan_t *plan, int factor_id, int var, int state_index) {
+
+	const int *scope = NULL;
+	int scope_count = blbn_model_factor_scope (model, plan, factor_id, &scope);
+
+	if (factor_id < model->node_count) {
+		fprintf (fp, "cpt[%d][", factor_id);
+		blbn_codegen_write_index (fp, model, scope, scope_count, var, state_index);
+		if (factor_id == var) {
+			fprintf (fp, "] * lambda[%d][%d]", factor_id, state_index);
+		} else {
+			fprintf (fp, "] * lambda[%d][v%d]", factor_id, factor_id);
+		}
+	} else {
+		fprintf (fp, "f%d[", factor_id - model->node_count);
+		blbn_codegen_write_index (fp, model, scope, scope_count, var, state_index);
+		fprintf (fp, "]");
+	}
+}
+
+/**
+ * Writes C source code that computes the target posterior by executing the
+ * elimination plan with every table size, stride and state count compiled
+ * in.  The states of each eliminated variable and of the target are unrolled
+ * into straight-line sums of products.  Returns zero on success and non-zero
+ * if the plan's intermediate factors are too large to compile.
+ */
+int blbn_codegen_write (const blbn_model_t *model, const blbn_ve_plan_t *plan, FILE *fp) {
+
+	int s, f, v, x, t;
+	int depth;
+	int target = plan->target;
+	int target_states = model->state_count[target];
+
+	if (plan->total_size > BLBN_CODEGEN_MAX_TOTAL_SIZE) {
+		return -1;
+	}
+
+	fprintf (fp, "/*\n * Generated by blbn_codegen.c for a network with %d nodes (structure hash %lx,\n * target node %d).  Do not edit.\n */\n\n", model->node_count, blbn_model_structure_hash (model), target);
+	fprintf (fp, "double blbn_generated_posterior (const double * const *cpt, const double * const *lambda, double *result) {\n\n");
+
+	// Loop variables for every node and one table per elimination step
+	fprintf (fp, "\tint");
+	for (v = 0; v < model->node_count; ++v) {
+		fprintf (fp, "%s v%d", (v > 0 ? "," : ""), v);
+	}
+	fprintf (fp, ";\n\tdouble sum;\n");
+	for (s = 0; s < plan->step_count; ++s) {
+		fprintf (fp, "\tdouble f%d[%d];\n", s, plan->steps[s].size);
+	}
+
+	for (s = 0; s < plan->step_count; ++s) {
+		const blbn_ve_step_t *step = &plan->steps[s];
+
+		fprintf (fp, "\n\t// Step %d: sum out node %d\n", s, step->var);
+		for (v = 0; v < step->scope_count; ++v) {
+			fprintf (fp, "\t");
+			for (depth = 0; depth < v; ++depth) {
+				fprintf (fp, "\t");
+			}
+			fprintf (fp, "for (v%d = 0; v%d < %d; ++v%d) {\n", step->scope[v], step->scope[v], model->state_count[step->scope[v]], step->scope[v]);
+		}
+
+		depth = step->scope_count + 1;
+		for (v = 0; v < depth; ++v) {
+			fprintf (fp, "\t");
+		}
+		fprintf (fp, "f%d[", s);
+		blbn_codegen_write_index (fp, model, step->scope, step->scope_count, -1, 0);
+		fprintf (fp, "] =");
+		for (x = 0; x < model->state_count[step->var]; ++x) {
+			fprintf (fp, "\n");
+			for (v = 0; v <= depth; ++v) {
+				fprintf (fp, "\t");
+			}
+			fprintf (fp, "%s", (x > 0 ? "+ " : ""));
+			for (f = 0; f < step->input_count; ++f) {
+				fprintf (fp, "%s", (f > 0 ? " * " : ""));
+				blbn_codegen_write_factor (fp, model, plan, step->inputs[f], step->var, x);
+			}
+		}
+		fprintf (fp, ";\n");
+
+		for (v = step->scope_count - 1; v >= 0; --v) {
+			fprintf (fp, "\t");
+			for (depth = 0; depth < v; ++depth) {
+				fprintf (fp, "\t");
+			}
+			fprintf (fp, "}\n");
+		}
+	}
+
+	// Multiply the remaining factors for every target state
+	fprintf (fp, "\n\t// Remaining factors over the target\n");
+	for (t = 0; t < target_states; ++t) {
+		fprintf (fp, "\tresult[%d] = 1.0", t);
+		for (f = 0; f < plan->final_count; ++f) {
+			fprintf (fp, " * ");
+			blbn_codegen_write_factor (fp, model, plan, plan->finals[f], target, t);
+		}
+		fprintf (fp, ";\n");
+	}
+
+	fprintf (fp, "\n\tsum = result[0]");
+	for (t = 1; t < target_states; ++t) {
+		fprintf (fp, " + result[%d]", t);
+	}
+	fprintf (fp, ";\n\tif (sum > 0.0) {\n");
+	for (t = 0; t < target_states; ++t) {
+		fprintf (fp, "\t\tresult[%d] /= sum;\n", t);
+	}
+	fprintf (fp, "\t}\n\n\treturn sum;\n}\n");
+
+	return 0;
+}
+
+/**
+ * Loads the generated target posterior routine for the model and plan from
+ * the cache directory, generating and compiling it first if the cache does
+ * not contain it.  Returns NULL if the code cannot be generated, compiled or
+ * loaded (the caller should fall back to another inference method).
+ */
+blbn_codegen_t* blbn_codegen_load (const blbn_model_t *model, const blbn_ve_plan_t *plan, const char *cache_dir) {
+
+	blbn_codegen_t *codegen = NULL;
+	char source_path[512];
+	char temp_path[600];
+	char command[2048];
+	const char *compiler = NULL;
+	struct stat buffer;
+	FILE *fp = NULL;
+	int result;
+
+	codegen = (blbn_codegen_t *) malloc (sizeof (blbn_codegen_t));
+	codegen->handle = NULL;
+	codegen->posterior = NULL;
+	codegen->compiled = 0;
+
+	snprintf (codegen->path, sizeof (codegen->path), "%s/blbn_gen_%lx_%d.so", cache_dir, blbn_model_structure_hash (model), plan->target);
+
+	if (stat (codegen->path, &buffer) != 0) {
+
+		// Generate the source code
+		snprintf (source_path, sizeof (source_path), "%s/blbn_gen_%lx_%d.%d.c", cache_dir, blbn_model_structure_hash (model), plan->target, (int) getpid ());
+		fp = fopen (source_path, "w");
+		if (fp == NULL) {
+			printf ("Error: Could not write generated code to %s.\n", source_path);
+			free (codegen);
+			return NULL;
+		}
+		result = blbn_codegen_write (model, plan, fp);
+		fclose (fp);
+		if (result != 0) {
+			printf ("Error: Elimination plan is too large to generate code (%d entries).\n", plan->total_size);
+			remove (source_path);
+			free (codegen);
+			return NULL;
+		}
+
+		// Compile into a temporary file and rename it, so concurrent
+		// experiments sharing the cache never load a partial object
+		compiler = getenv ("BLBN_CC");
+		if (compiler == NULL || strlen (compiler) == 0) {
+			compiler = "cc";
+		}
+		snprintf (temp_path, sizeof (temp_path), "%s.%d.tmp", codegen->path, (int) getpid ());
+		snprintf (command, sizeof (command), "%s -O2 -shared -fPIC -o \"%s\" \"%s\"", compiler, temp_path, source_path);
+		result = system (command);
+		remove (source_path);
+		if (result != 0 || rename (temp_path, codegen->path) != 0) {
+			printf ("Error: Could not compile generated code (%s).\n", command);
+			remove (temp_path);
+			free (codegen);
+			return NULL;
+		}
+
+		codegen->compiled = 1;
+	}
+
+	codegen->handle = dlopen (codegen->path, RTLD_NOW | RTLD_LOCAL);
+	if (codegen->handle == NULL) {
+		printf ("Error: Could not load generated code (%s).\n", dlerror ());
+		free (codegen);
+		return NULL;
+	}
+
+	codegen->posterior = (blbn_generated_posterior_fn) dlsym (codegen->handle, "blbn_generated_posterior");
+	if (codegen->posterior == NULL) {
+		printf ("Error: Generated code in %s has no posterior routine.\n", codegen->path);
+		dlclose (codegen->handle);
+		free (codegen);
+		return NULL;
+	}
+
+	return codegen;
+}
+
+void blbn_codegen_free (blbn_codegen_t *codegen) {
+
+	if (codegen == NULL) {
+		return;
+	}
+
+	if (codegen->handle != NULL) {
+		dlclose (codegen->handle);
+	}
+	free (codegen);
+}
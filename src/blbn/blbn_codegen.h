@@ -0,0 +1,44 @@
+/*
+ * blbn_codegen.h
+ *
+ *  Generates straight-line C code for the target posterior of a specific
+ *  network structure (from a variable elimination plan), compiles it into a
+ *  shared object with the local compiler and loads it with dlopen.
+ *
+ *  Only the structure is compiled in; CPT values and evidence are passed at
+ *  run time, so the generated code stays valid while CPTs are learned.
+ *  Shared objects are cached in a directory, keyed by the structure hash and
+ *  the target node, so each network is compiled once.
+ *
+ *  The compiler command defaults to "cc" and can be overridden with the
+ *  BLBN_CC environment variable.
+ */
+
+#ifndef BLBN_CODEGEN_H_
+#define BLBN_CODEGEN_H_
+
+#include <stdio.h>
+#include "blbn_model.h"
+
+#define BLBN_CODEGEN_MAX_TOTAL_SIZE (1 << 15) // Largest total size (in entries) of the intermediate factors of generated code
+
+/**
+ * Signature of the generated routine.  cpt[i] is the CPT of node i (see
+ * blbn_model_t) and lambda[i] the likelihood vector of node i (all ones if
+ * node i has no finding; never NULL).  Writes the normalized target
+ * posterior to result and returns the probability of the evidence.
+ */
+typedef double (*blbn_generated_posterior_fn) (const double * const *cpt, const double * const *lambda, double *result);
+
+typedef struct blbn_codegen {
+	void *handle;                          // dlopen handle of the shared object
+	blbn_generated_posterior_fn posterior; // generated target posterior routine
+	char path[512];                        // path of the shared object
+	char compiled;                         // non-zero if the shared object was compiled (rather than found in the cache)
+} blbn_codegen_t;
+
+int blbn_codegen_write (const blbn_model_t *model, const blbn_ve_plan_t *plan, FILE *fp);
+blbn_codegen_t* blbn_codegen_load (const blbn_model_t *model, const blbn_ve_plan_t *plan, const char *cache_dir);
+void blbn_codegen_free (blbn_codegen_t *codegen);
+
+#endif /* BLBN_CODEGEN_H_ */
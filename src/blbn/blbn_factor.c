@@ -0,0 +1,596 @@
+/*
+ * blbn_factor.c
+ *
+ *  Factor (discrete potential table) kernels.  See blbn_factor.h.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "blbn_factor.h"
+
+#if !defined(BLBN_FACTOR_NO_SIMD) && defined(__AVX2__)
+#define BLBN_FACTOR_AVX2 1
+#include <immintrin.h>
+#elif !defined(BLBN_FACTOR_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64))
+#define BLBN_FACTOR_SSE2 1
+#include <emmintrin.h>
+#endif
+
+const char* blbn_factor_simd_name () {
+#if defined(BLBN_FACTOR_AVX2)
+	return "avx2";
+#elif defined(BLBN_FACTOR_SSE2)
+	return "sse2";
+#else
+	return "scalar";
+#endif
+}
+
+//------------------------------------------------------------------------------
+// Kernels over contiguous arrays
+//------------------------------------------------------------------------------
+
+/**
+ * dst[i] = a[i] * b[i] for i in [0, n).  dst may alias a or b.
+ */
+void blbn_kernel_mul (double *dst, const double *a, const double *b, int n) {
+	int i = 0;
+
+#if defined(BLBN_FACTOR_AVX2)
+	for (; i + 4 <= n; i += 4) {
+		_mm256_storeu_pd (dst + i, _mm256_mul_pd (_mm256_loadu_pd (a + i), _mm256_loadu_pd (b + i)));
+	}
+#elif defined(BLBN_FACTOR_SSE2)
+	for (; i + 2 <= n; i += 2) {
+		_mm_storeu_pd (dst + i, _mm_mul_pd (_mm_loadu_pd (a + i), _mm_loadu_pd (b + i)));
+	}
+#endif
+
+	for (; i < n; ++i) {
+		dst[i] = a[i] * b[i];
+	}
+}
+
+/**
+ * dst[i] *= b[i] for i in [0, n).
+ */
+void blbn_kernel_mul_inplace (double *dst, const double *b, int n) {
+	blbn_kernel_mul (dst, dst, b, n);
+}
+
+/**
+ * dst[i] *= s for i in [0, n).
+ */
+void blbn_kernel_scale (double *dst, double s, int n) {
+	int i = 0;
+
+#if defined(BLBN_FACTOR_AVX2)
+	__m256d v = _mm256_set1_pd (s);
+	for (; i + 4 <= n; i += 4) {
+		_mm256_storeu_pd (dst + i, _mm256_mul_pd (_mm256_loadu_pd (dst + i), v));
+	}
+#elif defined(BLBN_FACTOR_SSE2)
+	__m128d v = _mm_set1_pd (s);
+	for (; i + 2 <= n; i += 2) {
+		_mm_storeu_pd (dst + i, _mm_mul_pd (_mm_loadu_pd (dst + i), v));
+	}
+#endif
+
+	for (; i < n; ++i) {
+		dst[i] *= s;
+	}
+}
+
+/**
+ * dst[i] = a[i] + b[i] for i in [0, n).  dst may alias a or b.
+ */
+static void blbn_kernel_add (double *dst, const double *a, const double *b, int n) {
+	int i = 0;
+
+#if defined(BLBN_FACTOR_AVX2)
+	for (; i + 4 <= n; i += 4) {
+		_mm256_storeu_pd (dst + i, _mm256_add_pd (_mm256_loadu_pd (a + i), _mm256_loadu_pd (b + i)));
+	}
+#elif defined(BLBN_FACTOR_SSE2)
+	for (; i + 2 <= n; i += 2) {
+		_mm_storeu_pd (dst + i, _mm_add_pd (_mm_loadu_pd (a + i), _mm_loadu_pd (b + i)));
+	}
+#endif
+
+	for (; i < n; ++i) {
+		dst[i] = a[i] + b[i];
+	}
+}
+
+/**
+ * dst[i] += b[i] for i in [0, n).
+ */
+void blbn_kernel_add_inplace (double *dst, const double *b, int n) {
+	blbn_kernel_add (dst, dst, b, n);
+}
+
+/**
+ * Returns the sum of a[i] for i in [0, n).
+ */
+double blbn_kernel_sum (const double *a, int n) {
+	int i = 0;
+	double sum = 0.0;
+
+#if defined(BLBN_FACTOR_AVX2)
+	__m256d acc = _mm256_setzero_pd ();
+	double lanes[4];
+	for (; i + 4 <= n; i += 4) {
+		acc = _mm256_add_pd (acc, _mm256_loadu_pd (a + i));
+	}
+	_mm256_storeu_pd (lanes, acc);
+	sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#elif defined(BLBN_FACTOR_SSE2)
+	__m128d acc = _mm_setzero_pd ();
+	double lanes[2];
+	for (; i + 2 <= n; i += 2) {
+		acc = _mm_add_pd (acc, _mm_loadu_pd (a + i));
+	}
+	_mm_storeu_pd (lanes, acc);
+	sum = lanes[0] + lanes[1];
+#endif
+
+	for (; i < n; ++i) {
+		sum += a[i];
+	}
+
+	return sum;
+}
+
+/**
+ * Sums out the fastest-changing variable of a table laid out as
+ * [outer][card], i.e., dst[o] = sum_k src[o * card + k].
+ */
+void blbn_kernel_sum_out_inner (double *dst, const double *src, int outer, int card) {
+	int o = 0, k = 0;
+	double sum;
+
+	switch (card) {
+	case 2:
+#if defined(BLBN_FACTOR_AVX2)
+		// hadd of two rows of pairs gives [r0, r1, r2, r3] in lane order 0, 2, 1, 3
+		for (; o + 4 <= outer; o += 4) {
+			__m256d h = _mm256_hadd_pd (_mm256_loadu_pd (src + 2 * o), _mm256_loadu_pd (src + 2 * o + 4));
+			_mm256_storeu_pd (dst + o, _mm256_permute4x64_pd (h, 0xD8));
+		}
+#elif defined(BLBN_FACTOR_SSE2)
+		for (; o + 2 <= outer; o += 2) {
+			__m128d x = _mm_loadu_pd (src + 2 * o);
+			__m128d y = _mm_loadu_pd (src + 2 * o + 2);
+			_mm_storeu_pd (dst + o, _mm_add_pd (_mm_unpacklo_pd (x, y), _mm_unpackhi_pd (x, y)));
+		}
+#endif
+		for (; o < outer; ++o) {
+			dst[o] = src[2 * o] + src[2 * o + 1];
+		}
+		break;
+	case 3:
+		for (; o < outer; ++o) {
+			dst[o] = src[3 * o] + src[3 * o + 1] + src[3 * o + 2];
+		}
+		break;
+	case 4:
+		for (; o < outer; ++o) {
+			dst[o] = (src[4 * o] + src[4 * o + 1]) + (src[4 * o + 2] + src[4 * o + 3]);
+		}
+		break;
+	default:
+		for (; o < outer; ++o) {
+			sum = 0.0;
+			for (k = 0; k < card; ++k) {
+				sum += src[o * card + k];
+			}
+			dst[o] = sum;
+		}
+		break;
+	}
+}
+
+/**
+ * Sums out a variable of a table laid out as [outer][card][inner], i.e.,
+ * dst[o * inner + i] = sum_k src[(o * card + k) * inner + i].
+ */
+void blbn_kernel_sum_out_strided (double *dst, const double *src, int outer, int card, int inner) {
+	int o = 0, k = 0;
+	int block = card * inner;
+
+	if (inner == 1) {
+		blbn_kernel_sum_out_inner (dst, src, outer, card);
+		return;
+	}
+
+	for (o = 0; o < outer; ++o) {
+		const double *s = src + o * block;
+		double *d = dst + o * inner;
+
+		switch (card) {
+		case 1:
+			memcpy (d, s, inner * sizeof (double));
+			break;
+		case 2:
+			blbn_kernel_add (d, s, s + inner, inner);
+			break;
+		case 3:
+			blbn_kernel_add (d, s, s + inner, inner);
+			blbn_kernel_add (d, d, s + 2 * inner, inner);
+			break;
+		case 4:
+			blbn_kernel_add (d, s, s + inner, inner);
+			blbn_kernel_add (d, d, s + 2 * inner, inner);
+			blbn_kernel_add (d, d, s + 3 * inner, inner);
+			break;
+		default:
+			blbn_kernel_add (d, s, s + inner, inner);
+			for (k = 2; k < card; ++k) {
+				blbn_kernel_add (d, d, s + k * inner, inner);
+			}
+			break;
+		}
+	}
+}
+
+/**
+ * Selects one state of the fastest-changing variable of a table laid out as
+ * [outer][card], i.e., dst[o] = src[o * card + state_index].
+ */
+void blbn_kernel_reduce_inner (double *dst, const double *src, int outer, int card, int state_index) {
+	int o = 0;
+	const double *s = src + state_index;
+
+	switch (card) {
+	case 2:
+		for (o = 0; o < outer; ++o) {
+			dst[o] = s[2 * o];
+		}
+		break;
+	case 3:
+		for (o = 0; o < outer; ++o) {
+			dst[o] = s[3 * o];
+		}
+		break;
+	case 4:
+		for (o = 0; o < outer; ++o) {
+			dst[o] = s[4 * o];
+		}
+		break;
+	default:
+		for (o = 0; o < outer; ++o) {
+			dst[o] = s[o * card];
+		}
+		break;
+	}
+}
+
+/**
+ * Selects one state of a variable of a table laid out as
+ * [outer][card][inner], i.e., dst[o * inner + i] = src[(o * card + state_index) * inner + i].
+ */
+void blbn_kernel_reduce_strided (double *dst, const double *src, int outer, int card, int inner, int state_index) {
+	int o = 0;
+
+	if (inner == 1) {
+		blbn_kernel_reduce_inner (dst, src, outer, card, state_index);
+		return;
+	}
+
+	for (o = 0; o < outer; ++o) {
+		memcpy (dst + o * inner, src + (o * card + state_index) * inner, inner * sizeof (double));
+	}
+}
+
+//------------------------------------------------------------------------------
+// Factors
+//------------------------------------------------------------------------------
+
+/**
+ * Computes the strides and table size of the factor from its state counts.
+ */
+static void blbn_factor_init_strides (blbn_factor_t *factor) {
+	int v = 0;
+
+	factor->size = 1;
+	for (v = factor->var_count - 1; v >= 0; --v) {
+		factor->stride[v] = factor->size;
+		factor->size *= factor->card[v];
+	}
+}
+
+/**
+ * Allocates a factor over the specified variables with the specified state
+ * counts.  The table is zero-initialized.
+ */
+blbn_factor_t* blbn_factor_new (int var_count, const int *vars, const int *card) {
+	blbn_factor_t *factor = NULL;
+
+	if (var_count < 0 || var_count > BLBN_FACTOR_MAX_VARS) {
+		return NULL;
+	}
+
+	factor = (blbn_factor_t *) malloc (sizeof (blbn_factor_t));
+	factor->var_count = var_count;
+	factor->vars = (int *) malloc ((var_count + 1) * sizeof (int));
+	factor->card = (int *) malloc ((var_count + 1) * sizeof (int));
+	factor->stride = (int *) malloc ((var_count + 1) * sizeof (int));
+	if (var_count > 0) {
+		memcpy (factor->vars, vars, var_count * sizeof (int));
+		memcpy (factor->card, card, var_count * sizeof (int));
+	}
+	blbn_factor_init_strides (factor);
+	factor->values = (double *) calloc (factor->size, sizeof (double));
+
+	return factor;
+}
+
+blbn_factor_t* blbn_factor_copy (const blbn_factor_t *factor) {
+	blbn_factor_t *copy = blbn_factor_new (factor->var_count, factor->vars, factor->card);
+	memcpy (copy->values, factor->values, factor->size * sizeof (double));
+	return copy;
+}
+
+void blbn_factor_free (blbn_factor_t *factor) {
+	if (factor == NULL) {
+		return;
+	}
+	free (factor->vars);
+	free (factor->card);
+	free (factor->stride);
+	free (factor->values);
+	free (factor);
+}
+
+/**
+ * Returns the position of the variable in the factor's scope, or -1 if the
+ * variable is not in the scope.
+ */
+int blbn_factor_index_of_var (const blbn_factor_t *factor, int var) {
+	int v = 0;
+
+	for (v = 0; v < factor->var_count; ++v) {
+		if (factor->vars[v] == var) {
+			return v;
+		}
+	}
+
+	return -1;
+}
+
+void blbn_factor_fill (blbn_factor_t *factor, double value) {
+	int i = 0;
+
+	for (i = 0; i < factor->size; ++i) {
+		factor->values[i] = value;
+	}
+}
+
+double blbn_factor_sum (const blbn_factor_t *factor) {
+	return blbn_kernel_sum (factor->values, factor->size);
+}
+
+/**
+ * Scales the factor so that its entries sum to one and returns the sum
+ * before scaling.  A factor that sums to zero is left unchanged.
+ */
+double blbn_factor_normalize (blbn_factor_t *factor) {
+	double sum = blbn_factor_sum (factor);
+
+	if (sum > 0.0) {
+		blbn_kernel_scale (factor->values, 1.0 / sum, factor->size);
+	}
+
+	return sum;
+}
+
+/**
+ * Multiplies the entries of dst (over the scope of dst) by the entries of b,
+ * where b_stride[v] is the stride in b of the v-th variable of dst (zero if
+ * the variable is not in the scope of b).  This is the general index walk
+ * used when neither of the contiguous special cases applies.
+ */
+static void blbn_factor_multiply_walk (double *dst, const double *a, const blbn_factor_t *scope, const double *b, const int *b_stride) {
+	int assignment[BLBN_FACTOR_MAX_VARS];
+	int i = 0, v = 0;
+	int j = 0;
+	int last = scope->var_count - 1;
+
+	memset (assignment, 0, sizeof (assignment));
+
+	// Walk the fastest-changing variable in an unrolled inner loop
+	if (last < 0) {
+		dst[0] = a[0] * b[0];
+		return;
+	}
+
+	for (i = 0; i < scope->size; ) {
+		int card = scope->card[last];
+		int step = b_stride[last];
+		int k = 0;
+
+		for (k = 0; k < card; ++k) {
+			dst[i + k] = a[i + k] * b[j + k * step];
+		}
+		i += card;
+
+		// Advance the odometer over the remaining variables
+		for (v = last - 1; v >= 0; --v) {
+			j += b_stride[v];
+			if (++assignment[v] < scope->card[v]) {
+				break;
+			}
+			j -= assignment[v] * b_stride[v];
+			assignment[v] = 0;
+		}
+	}
+}
+
+/**
+ * Returns the strides of the variables of scope in factor b (zero for
+ * variables not in the scope of b).
+ */
+static void blbn_factor_map_strides (const blbn_factor_t *scope, const blbn_factor_t *b, int *b_stride) {
+	int v = 0, w = 0;
+
+	for (v = 0; v < scope->var_count; ++v) {
+		w = blbn_factor_index_of_var (b, scope->vars[v]);
+		b_stride[v] = (w < 0 ? 0 : b->stride[w]);
+	}
+}
+
+/**
+ * Multiplies the factor b into the factor a in place.  The scope of b must
+ * be a subset of the scope of a.  Returns without modifying a otherwise.
+ */
+void blbn_factor_multiply_in (blbn_factor_t *a, const blbn_factor_t *b) {
+	int b_stride[BLBN_FACTOR_MAX_VARS];
+	int v = 0, o = 0;
+	int offset = a->var_count - b->var_count;
+	int prefix = 1, suffix = 1;
+
+	if (offset < 0) {
+		return;
+	}
+
+	// Check whether b's scope is a contiguous suffix or prefix of a's scope
+	for (v = 0; v < b->var_count; ++v) {
+		if (a->vars[offset + v] != b->vars[v]) {
+			suffix = 0;
+		}
+		if (a->vars[v] != b->vars[v]) {
+			prefix = 0;
+		}
+	}
+
+	if (suffix) {
+		// b varies fastest: multiply each contiguous block of a by b
+		for (o = 0; o < a->size; o += b->size) {
+			blbn_kernel_mul_inplace (a->values + o, b->values, b->size);
+		}
+	} else if (prefix) {
+		// b varies slowest: scale each contiguous block of a by one entry of b
+		int block = a->size / b->size;
+		for (o = 0; o < b->size; ++o) {
+			blbn_kernel_scale (a->values + o * block, b->values[o], block);
+		}
+	} else {
+		for (v = 0; v < b->var_count; ++v) {
+			if (blbn_factor_index_of_var (a, b->vars[v]) < 0) {
+				return;
+			}
+		}
+		blbn_factor_map_strides (a, b, b_stride);
+		blbn_factor_multiply_walk (a->values, a->values, a, b->values, b_stride);
+	}
+}
+
+/**
+ * Returns the product of factors a and b.  The scope of the product is the
+ * scope of a followed by the variables of b that are not in a.
+ */
+blbn_factor_t* blbn_factor_product (const blbn_factor_t *a, const blbn_factor_t *b) {
+	int vars[BLBN_FACTOR_MAX_VARS];
+	int card[BLBN_FACTOR_MAX_VARS];
+	int a_stride[BLBN_FACTOR_MAX_VARS];
+	int var_count = a->var_count;
+	int v = 0;
+	blbn_factor_t *product = NULL;
+
+	memcpy (vars, a->vars, a->var_count * sizeof (int));
+	memcpy (card, a->card, a->var_count * sizeof (int));
+	for (v = 0; v < b->var_count; ++v) {
+		if (blbn_factor_index_of_var (a, b->vars[v]) < 0) {
+			if (var_count == BLBN_FACTOR_MAX_VARS) {
+				return NULL;
+			}
+			vars[var_count] = b->vars[v];
+			card[var_count] = b->card[v];
+			++var_count;
+		}
+	}
+
+	product = blbn_factor_new (var_count, vars, card);
+
+	if (var_count == a->var_count) {
+		// Scope of b is contained in a
+		memcpy (product->values, a->values, a->size * sizeof (double));
+		blbn_factor_multiply_in (product, b);
+		return product;
+	}
+
+	// Broadcast a over the product's scope, then multiply b into it
+	blbn_factor_map_strides (product, a, a_stride);
+	blbn_factor_fill (product, 1.0);
+	blbn_factor_multiply_walk (product->values, product->values, product, a->values, a_stride);
+	blbn_factor_multiply_in (product, b);
+
+	return product;
+}
+
+/**
+ * Returns the factor with the specified variable summed out.  Returns a copy
+ * of the factor if the variable is not in its scope.
+ */
+blbn_factor_t* blbn_factor_marginalize (const blbn_factor_t *factor, int var) {
+	int vars[BLBN_FACTOR_MAX_VARS];
+	int card[BLBN_FACTOR_MAX_VARS];
+	int v = blbn_factor_index_of_var (factor, var);
+	int w = 0, n = 0;
+	int outer = 1;
+	blbn_factor_t *result = NULL;
+
+	if (v < 0) {
+		return blbn_factor_copy (factor);
+	}
+
+	for (w = 0; w < factor->var_count; ++w) {
+		if (w != v) {
+			vars[n] = factor->vars[w];
+			card[n] = factor->card[w];
+			++n;
+		}
+		if (w < v) {
+			outer *= factor->card[w];
+		}
+	}
+
+	result = blbn_factor_new (n, vars, card);
+	blbn_kernel_sum_out_strided (result->values, factor->values, outer, factor->card[v], factor->stride[v]);
+
+	return result;
+}
+
+/**
+ * Returns the factor reduced by the evidence that the specified variable is
+ * in the specified state (the variable is removed from the scope).  Returns a
+ * copy of the factor if the variable is not in its scope.
+ */
+blbn_factor_t* blbn_factor_reduce (const blbn_factor_t *factor, int var, int state_index) {
+	int vars[BLBN_FACTOR_MAX_VARS];
+	int card[BLBN_FACTOR_MAX_VARS];
+	int v = blbn_factor_index_of_var (factor, var);
+	int w = 0, n = 0;
+	int outer = 1;
+	blbn_factor_t *result = NULL;
+
+	if (v < 0) {
+		return blbn_factor_copy (factor);
+	}
+
+	for (w = 0; w < factor->var_count; ++w) {
+		if (w != v) {
+			vars[n] = factor->vars[w];
+			card[n] = factor->card[w];
+			++n;
+		}
+		if (w < v) {
+			outer *= factor->card[w];
+		}
+	}
+
+	result = blbn_factor_new (n, vars, card);
+	blbn_kernel_reduce_strided (result->values, factor->values, outer, factor->card[v], factor->stride[v], state_index);
+
+	return result;
+}
@@ -0,0 +1,64 @@
+/*
+ * blbn_factor.h
+ *
+ *  Factor (discrete potential table) kernels shared by the native inference,
+ *  learning and evaluation code.  This module does not depend on Netica.
+ *
+ *  Tables are stored row-major over the factor's variables: the last
+ *  variable changes fastest, so the stride of variable v is the product of
+ *  the state counts of the variables after it.  This matches the ordering
+ *  Netica uses for the parent configurations of a CPT.
+ *
+ *  Kernels are vectorized with AVX2 or SSE2 when the compiler targets them
+ *  (e.g., -mavx2 or -msse2) and fall back to scalar code otherwise.  Define
+ *  BLBN_FACTOR_NO_SIMD to force the scalar kernels.  Summing out or reducing
+ *  a variable with 2, 3 or 4 states (the common case for the networks in
+ *  data/dne) uses unrolled kernels specialized for that state count.
+ */
+
+#ifndef BLBN_FACTOR_H_
+#define BLBN_FACTOR_H_
+
+#define BLBN_FACTOR_MAX_VARS 32 // Maximum number of variables in a single factor
+
+typedef struct blbn_factor {
+	int var_count; // number of variables in the factor's scope
+	int *vars;     // variable (node) indices in the factor's scope, in table order
+	int *card;     // number of states of each variable
+	int *stride;   // stride of each variable in the table
+	int size;      // number of entries in the table (product of card)
+	double *values; // table of values
+} blbn_factor_t;
+
+/**
+ * Returns the name of the kernel instruction set selected at compile time
+ * ("avx2", "sse2" or "scalar").
+ */
+const char* blbn_factor_simd_name ();
+
+blbn_factor_t* blbn_factor_new (int var_count, const int *vars, const int *card);
+blbn_factor_t* blbn_factor_copy (const blbn_factor_t *factor);
+void blbn_factor_free (blbn_factor_t *factor);
+
+int blbn_factor_index_of_var (const blbn_factor_t *factor, int var);
+void blbn_factor_fill (blbn_factor_t *factor, double value);
+double blbn_factor_sum (const blbn_factor_t *factor);
+double blbn_factor_normalize (blbn_factor_t *factor);
+
+blbn_factor_t* blbn_factor_product (const blbn_factor_t *a, const blbn_factor_t *b);
+void blbn_factor_multiply_in (blbn_factor_t *a, const blbn_factor_t *b);
+blbn_factor_t* blbn_factor_marginalize (const blbn_factor_t *factor, int var);
+blbn_factor_t* blbn_factor_reduce (const blbn_factor_t *factor, int var, int state_index);
+
+// Low-level kernels over contiguous arrays (used by the factor operations)
+void blbn_kernel_mul (double *dst, const double *a, const double *b, int n);
+void blbn_kernel_mul_inplace (double *dst, const double *b, int n);
+void blbn_kernel_scale (double *dst, double s, int n);
+void blbn_kernel_add_inplace (double *dst, const double *b, int n);
+double blbn_kernel_sum (const double *a, int n);
+void blbn_kernel_sum_out_inner (double *dst, const double *src, int outer, int card);
+void blbn_kernel_sum_out_strided (double *dst, const double *src, int outer, int card, int inner);
+void blbn_kernel_reduce_inner (double *dst, const double *src, int outer, int card, int state_index);
+void blbn_kernel_reduce_strided (double *dst, const double *src, int outer, int card, int inner, int state_index);
+
+#endif /* BLBN_FACTOR_H_ */
@@ -0,0 +1,365 @@
+/*
+ * blbn_lw.c
+ *
+ *  Parallel likelihood weighting.  See blbn_lw.h.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include "blbn_lw.h"
+
+#define BLBN_LW_CLAMP_NONE -1 // node has no evidence (sampled, no weight)
+#define BLBN_LW_CLAMP_SOFT -2 // node has likelihood evidence (sampled, weighted by its likelihood)
+
+typedef struct blbn_lw_worker {
+	blbn_lw_t *lw;
+	const double * const *cpt;
+	const double * const *lambda;
+	const int *clamp;       // clamped state of each node (or BLBN_LW_CLAMP_*)
+	int target;
+	unsigned long long key; // random stream key of the query
+	long sample_begin;      // first sample index drawn by this worker in the current round
+	long sample_end;        // one past the last sample index drawn by this worker in the current round
+
+	int *sample;            // current sample (state of each node)
+	double weight;          // sum of weights
+	double weight_sq;       // sum of squared weights
+	double *target_weight;    // sum of weights by target state
+	double *target_weight_sq; // sum of squared weights by target state
+	double **joint;         // sum of weights by (node state, target state), or NULL
+} blbn_lw_worker_t;
+
+/**
+ * SplitMix64 finalizer (a bijective 64-bit mixing function).
+ */
+static unsigned long long blbn_lw_hash (unsigned long long x) {
+	x += 0x9E3779B97F4A7C15ULL;
+	x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+	return x ^ (x >> 31);
+}
+
+/**
+ * Returns the counter-th uniform random number in [0, 1) of the stream with
+ * the specified key.  No state is kept, so any thread can draw any part of
+ * any stream.
+ */
+static double blbn_lw_uniform (unsigned long long key, unsigned long long counter) {
+	return (blbn_lw_hash (key ^ blbn_lw_hash (counter)) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static double blbn_lw_seconds () {
+	struct timespec now;
+	clock_gettime (CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec * 1.0e-9;
+}
+
+void blbn_lw_default_options (blbn_lw_options_t *options) {
+	options->sample_count = 100000;
+	options->round_size = 4096;
+	options->max_std_error = 0.005;
+	options->thread_count = 1;
+	options->seed = 1;
+}
+
+/**
+ * Creates a likelihood weighting engine for the model.  The model's
+ * structure must not change while the engine is used (CPTs may).
+ */
+blbn_lw_t* blbn_lw_new (const blbn_model_t *model, const blbn_lw_options_t *options) {
+
+	blbn_lw_t *lw = NULL;
+	int *indegree = NULL;
+	int i, j, p, count, head;
+
+	lw = (blbn_lw_t *) malloc (sizeof (blbn_lw_t));
+	lw->model = model;
+	lw->options = *options;
+	lw->query_count = 0;
+
+	if (lw->options.thread_count < 1) {
+		lw->options.thread_count = 1;
+	} else if (lw->options.thread_count > BLBN_LW_MAX_THREADS) {
+		lw->options.thread_count = BLBN_LW_MAX_THREADS;
+	}
+	if (lw->options.round_size < lw->options.thread_count) {
+		lw->options.round_size = lw->options.thread_count;
+	}
+
+	// Topological order (parents before children)
+	lw->order = (int *) malloc (model->node_count * sizeof (int));
+	indegree = (int *) malloc (model->node_count * sizeof (int));
+	count = 0;
+	for (i = 0; i < model->node_count; ++i) {
+		indegree[i] = model->parent_count[i];
+		if (indegree[i] == 0) {
+			lw->order[count++] = i;
+		}
+	}
+	for (head = 0; head < count; ++head) {
+		for (j = 0; j < model->node_count; ++j) {
+			for (p = 0; p < model->parent_count[j]; ++p) {
+				if (model->parents[j][p] == lw->order[head] && --indegree[j] == 0) {
+					lw->order[count++] = j;
+				}
+			}
+		}
+	}
+	free (indegree);
+
+	return lw;
+}
+
+void blbn_lw_free (blbn_lw_t *lw) {
+	if (lw == NULL) {
+		return;
+	}
+	free (lw->order);
+	free (lw);
+}
+
+/**
+ * Draws the worker's samples for the current round and accumulates their
+ * weights.
+ */
+static void* blbn_lw_run_worker (void *argument) {
+
+	blbn_lw_worker_t *worker = (blbn_lw_worker_t *) argument;
+	const blbn_model_t *model = worker->lw->model;
+	int n = model->node_count;
+	int target_states = model->state_count[worker->target];
+	long s;
+	int o, i, p, k, row, card;
+	double w, u, cumulative;
+	const double *probs = NULL;
+
+	for (s = worker->sample_begin; s < worker->sample_end; ++s) {
+		w = 1.0;
+
+		for (o = 0; o < n && w > 0.0; ++o) {
+			i = worker->lw->order[o];
+			card = model->state_count[i];
+
+			row = 0;
+			for (p = 0; p < model->parent_count[i]; ++p) {
+				row = row * model->state_count[model->parents[i][p]] + worker->sample[model->parents[i][p]];
+			}
+			probs = worker->cpt[i] + row * card;
+
+			if (worker->clamp[i] >= 0) {
+				// Observed node: fix its state and weight by its likelihood
+				k = worker->clamp[i];
+				w *= probs[k] * worker->lambda[i][k];
+			} else {
+				// Sample the node's state from its CPT row
+				u = blbn_lw_uniform (worker->key, (unsigned long long) s * n + o);
+				cumulative = 0.0;
+				for (k = 0; k < card - 1; ++k) {
+					cumulative += probs[k];
+					if (u < cumulative) {
+						break;
+					}
+				}
+				if (worker->clamp[i] == BLBN_LW_CLAMP_SOFT) {
+					w *= worker->lambda[i][k];
+				}
+			}
+			worker->sample[i] = k;
+		}
+
+		if (w <= 0.0) {
+			continue;
+		}
+
+		k = worker->sample[worker->target];
+		worker->weight += w;
+		worker->weight_sq += w * w;
+		worker->target_weight[k] += w;
+		worker->target_weight_sq[k] += w * w;
+
+		if (worker->joint != NULL) {
+			for (i = 0; i < n; ++i) {
+				if (i != worker->target) {
+					worker->joint[i][worker->sample[i] * target_states + k] += w;
+				}
+			}
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * Estimates the posterior distribution of the target node given the
+ * evidence by likelihood weighting and returns the estimated probability of
+ * the evidence.
+ *
+ * cpt holds the CPT of every node (in the layout of blbn_model_t); pass NULL
+ * to use the model's CPTs.  lambda[i] is the likelihood vector of node i or
+ * NULL if node i has no finding.  The posterior is written to posterior
+ * (one entry per target state).  If joint is not NULL, joint[i] (for every
+ * node i other than the target) receives the estimated joint distribution
+ * P(node i, target | evidence) stored as joint[i][k * target_states + t].
+ * Statistics of the query are written to stats if it is not NULL.
+ */
+double blbn_lw_query (blbn_lw_t *lw, const double * const *cpt, const double * const *lambda, int target, double *posterior, double **joint, blbn_lw_stats_t *stats) {
+
+	const blbn_model_t *model = lw->model;
+	blbn_lw_worker_t workers[BLBN_LW_MAX_THREADS];
+	pthread_t threads[BLBN_LW_MAX_THREADS];
+	int thread_count = lw->options.thread_count;
+	int n = model->node_count;
+	int target_states = model->state_count[target];
+	int *clamp = NULL;
+	int i, k, t, w, nonzero;
+	long drawn = 0, chunk;
+	double weight, weight_sq, target_weight, target_weight_sq, p, se, max_se;
+	double begin = blbn_lw_seconds ();
+
+	if (cpt == NULL) {
+		cpt = (const double * const *) model->cpt;
+	}
+
+	// Classify the evidence of each node
+	clamp = (int *) malloc (n * sizeof (int));
+	for (i = 0; i < n; ++i) {
+		clamp[i] = BLBN_LW_CLAMP_NONE;
+		if (lambda == NULL || lambda[i] == NULL) {
+			continue;
+		}
+		nonzero = 0;
+		for (k = 0; k < model->state_count[i]; ++k) {
+			if (lambda[i][k] != 0.0) {
+				clamp[i] = k;
+				++nonzero;
+			}
+		}
+		if (nonzero != 1) {
+			clamp[i] = BLBN_LW_CLAMP_SOFT;
+		}
+	}
+
+	for (w = 0; w < thread_count; ++w) {
+		workers[w].lw = lw;
+		workers[w].cpt = cpt;
+		workers[w].lambda = lambda;
+		workers[w].clamp = clamp;
+		workers[w].target = target;
+		workers[w].key = blbn_lw_hash (lw->options.seed ^ blbn_lw_hash (lw->query_count));
+		workers[w].sample = (int *) calloc (n, sizeof (int));
+		workers[w].weight = 0.0;
+		workers[w].weight_sq = 0.0;
+		workers[w].target_weight = (double *) calloc (target_states, sizeof (double));
+		workers[w].target_weight_sq = (double *) calloc (target_states, sizeof (double));
+		workers[w].joint = NULL;
+		if (joint != NULL) {
+			workers[w].joint = (double **) malloc (n * sizeof (double *));
+			for (i = 0; i < n; ++i) {
+				workers[w].joint[i] = (double *) calloc (model->state_count[i] * target_states, sizeof (double));
+			}
+		}
+	}
+	++lw->query_count;
+
+	max_se = 1.0;
+	while (drawn < lw->options.sample_count) {
+
+		// Split the next round of samples into contiguous ranges, one per thread
+		chunk = lw->options.round_size;
+		if (drawn + chunk > lw->options.sample_count) {
+			chunk = lw->options.sample_count - drawn;
+		}
+		for (w = 0; w < thread_count; ++w) {
+			workers[w].sample_begin = drawn + chunk * w / thread_count;
+			workers[w].sample_end   = drawn + chunk * (w + 1) / thread_count;
+		}
+
+		if (thread_count == 1) {
+			blbn_lw_run_worker (&workers[0]);
+		} else {
+			for (w = 1; w < thread_count; ++w) {
+				pthread_create (&threads[w], NULL, blbn_lw_run_worker, &workers[w]);
+			}
+			blbn_lw_run_worker (&workers[0]);
+			for (w = 1; w < thread_count; ++w) {
+				pthread_join (threads[w], NULL);
+			}
+		}
+		drawn += chunk;
+
+		// Standard error of each target posterior entry (ratio estimator)
+		weight = weight_sq = 0.0;
+		for (w = 0; w < thread_count; ++w) {
+			weight += workers[w].weight;
+			weight_sq += workers[w].weight_sq;
+		}
+		max_se = (weight > 0.0 ? 0.0 : 1.0);
+		for (t = 0; t < target_states && weight > 0.0; ++t) {
+			target_weight = target_weight_sq = 0.0;
+			for (w = 0; w < thread_count; ++w) {
+				target_weight += workers[w].target_weight[t];
+				target_weight_sq += workers[w].target_weight_sq[t];
+			}
+			p = target_weight / weight;
+			se = sqrt (target_weight_sq * (1.0 - p) * (1.0 - p) + (weight_sq - target_weight_sq) * p * p) / weight;
+			if (se > max_se) {
+				max_se = se;
+			}
+		}
+
+		if (lw->options.max_std_error > 0.0 && max_se < lw->options.max_std_error) {
+			break;
+		}
+	}
+
+	// Combine the workers' sums (in thread order, so results are reproducible)
+	weight = 0.0;
+	for (w = 0; w < thread_count; ++w) {
+		weight += workers[w].weight;
+	}
+	for (t = 0; t < target_states; ++t) {
+		target_weight = 0.0;
+		for (w = 0; w < thread_count; ++w) {
+			target_weight += workers[w].target_weight[t];
+		}
+		posterior[t] = (weight > 0.0 ? target_weight / weight : 1.0 / target_states);
+	}
+	if (joint != NULL) {
+		for (i = 0; i < n; ++i) {
+			if (i == target || joint[i] == NULL) {
+				continue;
+			}
+			for (k = 0; k < model->state_count[i] * target_states; ++k) {
+				joint[i][k] = 0.0;
+				for (w = 0; w < thread_count; ++w) {
+					joint[i][k] += workers[w].joint[i][k];
+				}
+				joint[i][k] = (weight > 0.0 ? joint[i][k] / weight : 0.0);
+			}
+		}
+	}
+
+	for (w = 0; w < thread_count; ++w) {
+		free (workers[w].sample);
+		free (workers[w].target_weight);
+		free (workers[w].target_weight_sq);
+		if (workers[w].joint != NULL) {
+			for (i = 0; i < n; ++i) {
+				free (workers[w].joint[i]);
+			}
+			free (workers[w].joint);
+		}
+	}
+	free (clamp);
+
+	if (stats != NULL) {
+		stats->sample_count = drawn;
+		stats->std_error = max_se;
+		stats->seconds = blbn_lw_seconds () - begin;
+	}
+
+	return (drawn > 0 ? weight / drawn : 0.0);
+}
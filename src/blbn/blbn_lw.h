@@ -0,0 +1,50 @@
+/*
+ * blbn_lw.h
+ *
+ *  Parallel likelihood weighting (approximate inference) over a native
+ *  model (see blbn_model.h).
+ *
+ *  Random numbers are counter based: the random number used for node n of
+ *  sample s of query q is a hash of (seed, q, s, n).  Each thread draws a
+ *  disjoint range of samples, so no generator state is shared and the
+ *  samples do not depend on the thread count or on thread scheduling.
+ *  Samples are drawn in rounds; after each round the
+ *  standard error of the target posterior is checked and sampling stops
+ *  early once it falls below the configured threshold.
+ */
+
+#ifndef BLBN_LW_H_
+#define BLBN_LW_H_
+
+#include "blbn_model.h"
+
+#define BLBN_LW_MAX_THREADS 64
+
+typedef struct blbn_lw_options {
+	long sample_count;     // maximum number of samples per query
+	long round_size;       // number of samples drawn (over all threads) between early stopping checks
+	double max_std_error;  // stop when the standard error of every target posterior entry is below this (0 disables early stopping)
+	int thread_count;      // number of sampling threads
+	unsigned long long seed;
+} blbn_lw_options_t;
+
+typedef struct blbn_lw_stats {
+	long sample_count;     // number of samples drawn
+	double std_error;      // largest standard error of a target posterior entry
+	double seconds;        // wall-clock time of the query
+} blbn_lw_stats_t;
+
+typedef struct blbn_lw {
+	const blbn_model_t *model;
+	blbn_lw_options_t options;
+	int *order;                 // nodes in topological order
+	unsigned long long query_count; // number of queries (used to give each query its own streams)
+} blbn_lw_t;
+
+void blbn_lw_default_options (blbn_lw_options_t *options);
+blbn_lw_t* blbn_lw_new (const blbn_model_t *model, const blbn_lw_options_t *options);
+void blbn_lw_free (blbn_lw_t *lw);
+
+double blbn_lw_query (blbn_lw_t *lw, const double * const *cpt, const double * const *lambda, int target, double *posterior, double **joint, blbn_lw_stats_t *stats);
+
+#endif /* BLBN_LW_H_ */
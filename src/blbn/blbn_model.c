@@ -0,0 +1,551 @@
+/*
+ * blbn_model.c
+ *
+ *  Native model and variable elimination plans.  See blbn_model.h.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "blbn_model.h"
+#include "blbn_factor.h"
+
+/**
+ * Allocates a model with the specified structure.  CPTs are allocated and
+ * set to uniform distributions.
+ */
+blbn_model_t* blbn_model_new (int node_count, const int *state_count, const int *parent_count, int * const *parents) {
+
+	blbn_model_t *model = NULL;
+	int i, p, k;
+
+	model = (blbn_model_t *) malloc (sizeof (blbn_model_t));
+	model->node_count   = node_count;
+	model->state_count  = (int *) malloc (node_count * sizeof (int));
+	model->parent_count = (int *) malloc (node_count * sizeof (int));
+	model->parents      = (int **) malloc (node_count * sizeof (int *));
+	model->family       = (int **) malloc (node_count * sizeof (int *));
+	model->cpt_size     = (int *) malloc (node_count * sizeof (int));
+	model->cpt          = (double **) malloc (node_count * sizeof (double *));
+
+	memcpy (model->state_count, state_count, node_count * sizeof (int));
+	memcpy (model->parent_count, parent_count, node_count * sizeof (int));
+
+	for (i = 0; i < node_count; ++i) {
+		model->parents[i] = (int *) malloc ((parent_count[i] + 1) * sizeof (int));
+		model->family[i]  = (int *) malloc ((parent_count[i] + 1) * sizeof (int));
+		model->cpt_size[i] = state_count[i];
+		for (p = 0; p < parent_count[i]; ++p) {
+			model->parents[i][p] = parents[i][p];
+			model->family[i][p]  = parents[i][p];
+			model->cpt_size[i] *= state_count[parents[i][p]];
+		}
+		model->family[i][parent_count[i]] = i;
+
+		model->cpt[i] = (double *) malloc (model->cpt_size[i] * sizeof (double));
+		for (k = 0; k < model->cpt_size[i]; ++k) {
+			model->cpt[i][k] = 1.0 / state_count[i];
+		}
+	}
+
+	return model;
+}
+
+void blbn_model_free (blbn_model_t *model) {
+
+	int i;
+
+	if (model == NULL) {
+		return;
+	}
+
+	for (i = 0; i < model->node_count; ++i) {
+		free (model->parents[i]);
+		free (model->family[i]);
+		free (model->cpt[i]);
+	}
+	free (model->state_count);
+	free (model->parent_count);
+	free (model->parents);
+	free (model->family);
+	free (model->cpt_size);
+	free (model->cpt);
+	free (model);
+}
+
+/**
+ * Returns a hash (64-bit FNV-1a where unsigned long is 64 bits) of the
+ * model's structure: the node count, the state count of each node and the
+ * parents of each node.  CPT values are not part of the hash.
+ */
+unsigned long blbn_model_structure_hash (const blbn_model_t *model) {
+
+	unsigned long hash = (sizeof (unsigned long) >= 8 ? 14695981039346656037UL : 2166136261UL);
+	unsigned long prime = (sizeof (unsigned long) >= 8 ? 1099511628211UL : 16777619UL);
+	int i, p;
+
+#define BLBN_MODEL_HASH_INT(x) do { \
+		unsigned int _v = (unsigned int) (x); \
+		int _b; \
+		for (_b = 0; _b < 4; ++_b) { \
+			hash ^= (_v >> (8 * _b)) & 0xFF; \
+			hash *= prime; \
+		} \
+	} while (0)
+
+	BLBN_MODEL_HASH_INT (model->node_count);
+	for (i = 0; i < model->node_count; ++i) {
+		BLBN_MODEL_HASH_INT (model->state_count[i]);
+		BLBN_MODEL_HASH_INT (model->parent_count[i]);
+		for (p = 0; p < model->parent_count[i]; ++p) {
+			BLBN_MODEL_HASH_INT (model->parents[i][p]);
+		}
+	}
+
+#undef BLBN_MODEL_HASH_INT
+
+	return hash;
+}
+
+/**
+ * Sets scope to the variables of the factor with the specified id in the
+ * plan (see blbn_ve_step_t) and returns the number of variables.
+ */
+int blbn_model_factor_scope (const blbn_model_t *model, const blbn_ve_plan_t *plan, int factor_id, const int **scope) {
+
+	if (factor_id < model->node_count && plan->observed != NULL) {
+		*scope = plan->sliced_scope[factor_id];
+		return plan->sliced_count[factor_id];
+	}
+
+	if (factor_id < model->node_count) {
+		*scope = model->family[factor_id];
+		return model->parent_count[factor_id] + 1;
+	}
+
+	*scope = plan->steps[factor_id - model->node_count].scope;
+	return plan->steps[factor_id - model->node_count].scope_count;
+}
+
+/**
+ * Builds a variable elimination plan for the posterior of the target node.
+ * Every other node is summed out, choosing at each step the node whose
+ * elimination creates the smallest factor (greedy min-weight order).  The
+ * plan depends only on the structure, so it is valid for any CPT values and
+ * any evidence.
+ */
+blbn_ve_plan_t* blbn_ve_plan_new (const blbn_model_t *model, int target) {
+	return blbn_ve_plan_new_sliced (model, target, NULL);
+}
+
+/**
+ * Builds a variable elimination plan for the posterior of the target node
+ * over the CPTs sliced by the findings of the observed nodes (observed[i] is
+ * non-zero if node i has a finding; pass NULL for a plan over full CPTs).
+ * Observed nodes are not eliminated, and families that are entirely observed
+ * reduce to scalar weights that take no part in the plan.  The plan depends
+ * only on the structure and on which nodes are observed (not on their
+ * states), so it can be reused for every query with the same evidence
+ * pattern.
+ */
+blbn_ve_plan_t* blbn_ve_plan_new_sliced (const blbn_model_t *model, int target, const char *observed) {
+
+	blbn_ve_plan_t *plan = NULL;
+	int n = model->node_count;
+	int factor_count = 0;  // total number of factor ids (CPTs and step outputs)
+	char *active = NULL;   // active[f] is non-zero if factor f has not been consumed
+	char *eliminated = NULL;
+	char *in_scope = NULL;
+	const int *scope = NULL;
+	int scope_count;
+	int s, f, v, x, p, best_var, size, stride;
+	double weight, best_weight;
+
+	plan = (blbn_ve_plan_t *) malloc (sizeof (blbn_ve_plan_t));
+	plan->node_count = n;
+	plan->target = target;
+	plan->step_count = 0;
+	plan->steps = (blbn_ve_step_t *) malloc (n * sizeof (blbn_ve_step_t));
+	plan->final_count = 0;
+	plan->finals = NULL;
+	plan->max_size = 0;
+	plan->total_size = 0;
+	plan->observed = NULL;
+	plan->sliced_count = NULL;
+	plan->sliced_scope = NULL;
+	plan->sliced_stride = NULL;
+
+	active = (char *) calloc (2 * n, sizeof (char));
+	eliminated = (char *) calloc (n, sizeof (char));
+	in_scope = (char *) calloc (n, sizeof (char));
+
+	for (f = 0; f < n; ++f) {
+		active[f] = 1;
+	}
+	factor_count = n;
+
+	// Slice the CPTs: keep the unobserved nodes of each family and their CPT strides
+	if (observed != NULL) {
+		plan->observed = (char *) malloc (n * sizeof (char));
+		plan->sliced_count = (int *) malloc (n * sizeof (int));
+		plan->sliced_scope = (int **) malloc (n * sizeof (int *));
+		plan->sliced_stride = (int **) malloc (n * sizeof (int *));
+		for (x = 0; x < n; ++x) {
+			plan->observed[x] = (x != target && observed[x]);
+			eliminated[x] = plan->observed[x]; // observed nodes are never summed out
+		}
+		for (f = 0; f < n; ++f) {
+			plan->sliced_scope[f] = (int *) malloc ((model->parent_count[f] + 1) * sizeof (int));
+			plan->sliced_stride[f] = (int *) malloc ((model->parent_count[f] + 1) * sizeof (int));
+			plan->sliced_count[f] = 0;
+			stride = model->cpt_size[f];
+			for (p = 0; p <= model->parent_count[f]; ++p) {
+				stride /= model->state_count[model->family[f][p]];
+				if (!plan->observed[model->family[f][p]]) {
+					plan->sliced_scope[f][plan->sliced_count[f]] = model->family[f][p];
+					plan->sliced_stride[f][plan->sliced_count[f]] = stride;
+					++plan->sliced_count[f];
+				}
+			}
+			active[f] = (plan->sliced_count[f] > 0);
+		}
+	}
+
+	for (s = 0; s < n - 1; ++s) {
+
+		// Choose the variable whose elimination creates the smallest factor
+		best_var = -1;
+		best_weight = 0.0;
+		for (x = 0; x < n; ++x) {
+			if (x == target || eliminated[x]) {
+				continue;
+			}
+
+			memset (in_scope, 0, n * sizeof (char));
+			for (f = 0; f < factor_count; ++f) {
+				if (!active[f]) {
+					continue;
+				}
+				scope_count = blbn_model_factor_scope (model, plan, f, &scope);
+				for (v = 0; v < scope_count && scope[v] != x; ++v);
+				if (v < scope_count) {
+					for (v = 0; v < scope_count; ++v) {
+						in_scope[scope[v]] = 1;
+					}
+				}
+			}
+
+			weight = 1.0;
+			for (v = 0; v < n; ++v) {
+				if (in_scope[v] && v != x) {
+					weight *= model->state_count[v];
+				}
+			}
+
+			if (best_var < 0 || weight < best_weight) {
+				best_var = x;
+				best_weight = weight;
+			}
+		}
+		if (best_var < 0) {
+			break; // every unobserved non-target node has been eliminated
+		}
+
+		// Record the step: consume every active factor that mentions the variable
+		blbn_ve_step_t *step = &plan->steps[s];
+		step->var = best_var;
+		step->input_count = 0;
+		step->inputs = (int *) malloc (factor_count * sizeof (int));
+		memset (in_scope, 0, n * sizeof (char));
+		for (f = 0; f < factor_count; ++f) {
+			if (!active[f]) {
+				continue;
+			}
+			scope_count = blbn_model_factor_scope (model, plan, f, &scope);
+			for (v = 0; v < scope_count && scope[v] != best_var; ++v);
+			if (v < scope_count) {
+				step->inputs[step->input_count++] = f;
+				active[f] = 0;
+				for (v = 0; v < scope_count; ++v) {
+					in_scope[scope[v]] = 1;
+				}
+			}
+		}
+
+		step->scope_count = 0;
+		step->scope = (int *) malloc (n * sizeof (int));
+		size = 1;
+		for (v = 0; v < n; ++v) {
+			if (in_scope[v] && v != best_var) {
+				step->scope[step->scope_count++] = v;
+				size *= model->state_count[v];
+			}
+		}
+		step->size = size;
+
+		eliminated[best_var] = 1;
+		active[factor_count++] = 1;
+		plan->step_count = s + 1;
+
+		if (size > plan->max_size) {
+			plan->max_size = size;
+		}
+		plan->total_size += size;
+	}
+
+	// The remaining factors mention only the target (or no variable at all)
+	plan->finals = (int *) malloc (factor_count * sizeof (int));
+	for (f = 0; f < factor_count; ++f) {
+		if (active[f]) {
+			plan->finals[plan->final_count++] = f;
+		}
+	}
+
+	free (active);
+	free (eliminated);
+	free (in_scope);
+
+	return plan;
+}
+
+void blbn_ve_plan_free (blbn_ve_plan_t *plan) {
+
+	int s;
+
+	if (plan == NULL) {
+		return;
+	}
+
+	for (s = 0; s < plan->step_count; ++s) {
+		free (plan->steps[s].inputs);
+		free (plan->steps[s].scope);
+	}
+	free (plan->steps);
+	free (plan->finals);
+
+	if (plan->observed != NULL) {
+		for (s = 0; s < plan->node_count; ++s) {
+			free (plan->sliced_scope[s]);
+			free (plan->sliced_stride[s]);
+		}
+		free (plan->observed);
+		free (plan->sliced_count);
+		free (plan->sliced_scope);
+		free (plan->sliced_stride);
+	}
+	free (plan);
+}
+
+/**
+ * Executes the elimination steps of the plan on the base factors (factors[i]
+ * for i < node_count; NULL entries take no part), multiplies the remaining
+ * factors and the scalar weight into result and normalizes it.  Frees every
+ * factor.  Returns the probability of the evidence.
+ */
+static double blbn_model_run_plan (const blbn_model_t *model, const blbn_ve_plan_t *plan, blbn_factor_t **factors, double weight, double *result) {
+
+	blbn_factor_t *product = NULL;
+	blbn_factor_t *next = NULL;
+	int n = model->node_count;
+	int target = plan->target;
+	int s, f, t;
+	double sum;
+
+	// Eliminate every non-target node
+	for (s = 0; s < plan->step_count; ++s) {
+		const blbn_ve_step_t *step = &plan->steps[s];
+
+		product = blbn_factor_copy (factors[step->inputs[0]]);
+		for (f = 1; f < step->input_count; ++f) {
+			next = blbn_factor_product (product, factors[step->inputs[f]]);
+			blbn_factor_free (product);
+			product = next;
+		}
+		factors[n + s] = blbn_factor_marginalize (product, step->var);
+		blbn_factor_free (product);
+
+		for (f = 0; f < step->input_count; ++f) {
+			blbn_factor_free (factors[step->inputs[f]]);
+			factors[step->inputs[f]] = NULL;
+		}
+	}
+
+	// Multiply the remaining factors over the target
+	for (t = 0; t < model->state_count[target]; ++t) {
+		result[t] = weight;
+		for (f = 0; f < plan->final_count; ++f) {
+			const blbn_factor_t *factor = factors[plan->finals[f]];
+			result[t] *= (factor->var_count == 0 ? factor->values[0] : factor->values[t]);
+		}
+	}
+
+	for (f = 0; f < n + plan->step_count; ++f) {
+		blbn_factor_free (factors[f]);
+	}
+
+	sum = 0.0;
+	for (t = 0; t < model->state_count[target]; ++t) {
+		sum += result[t];
+	}
+	if (sum > 0.0) {
+		for (t = 0; t < model->state_count[target]; ++t) {
+			result[t] /= sum;
+		}
+	}
+
+	return sum;
+}
+
+/**
+ * Returns the state of the hard finding on the specified node (the only
+ * non-zero entry of its likelihood vector) or -1 if the node has no finding
+ * or only likelihood evidence.
+ */
+int blbn_model_hard_finding (const blbn_model_t *model, const double * const *lambda, int node_index) {
+
+	int k, finding = -1;
+
+	if (lambda == NULL || lambda[node_index] == NULL) {
+		return -1;
+	}
+
+	for (k = 0; k < model->state_count[node_index]; ++k) {
+		if (lambda[node_index][k] != 0.0) {
+			if (finding >= 0) {
+				return -1;
+			}
+			finding = k;
+		}
+	}
+
+	return finding;
+}
+
+/**
+ * Computes the posterior distribution of the plan's target node given the
+ * evidence by executing the elimination plan with the factor kernels.
+ *
+ * lambda[i] is the likelihood vector of node i (e.g., an indicator of the
+ * observed state) or NULL if node i has no finding.  The normalized
+ * posterior is written to result (one entry per target state) and the
+ * probability of the evidence is returned.  If the evidence has zero
+ * probability, result is left unnormalized (all zeros) and zero is returned.
+ */
+double blbn_model_target_posterior (const blbn_model_t *model, const blbn_ve_plan_t *plan, const double * const *lambda, double *result) {
+
+	blbn_factor_t **factors = NULL;
+	blbn_factor_t *evidence = NULL;
+	int n = model->node_count;
+	int i, v;
+	double sum;
+
+	factors = (blbn_factor_t **) calloc (n + plan->step_count, sizeof (blbn_factor_t *));
+
+	// CPT factors, each multiplied by the evidence on its own node
+	for (i = 0; i < n; ++i) {
+		int card[BLBN_FACTOR_MAX_VARS];
+		for (v = 0; v <= model->parent_count[i]; ++v) {
+			card[v] = model->state_count[model->family[i][v]];
+		}
+		factors[i] = blbn_factor_new (model->parent_count[i] + 1, model->family[i], card);
+		memcpy (factors[i]->values, model->cpt[i], model->cpt_size[i] * sizeof (double));
+
+		if (lambda != NULL && lambda[i] != NULL) {
+			evidence = blbn_factor_new (1, &i, &model->state_count[i]);
+			memcpy (evidence->values, lambda[i], model->state_count[i] * sizeof (double));
+			blbn_factor_multiply_in (factors[i], evidence);
+			blbn_factor_free (evidence);
+		}
+	}
+
+	sum = blbn_model_run_plan (model, plan, factors, 1.0, result);
+	free (factors);
+
+	return sum;
+}
+
+/**
+ * Computes the posterior distribution of the plan's target node like
+ * blbn_model_target_posterior (), but with a plan built by
+ * blbn_ve_plan_new_sliced () for the evidence pattern of lambda (the nodes
+ * with hard findings, see blbn_model_hard_finding ()).  Each CPT is sliced
+ * by the findings in its family before inference, so only factors over the
+ * unobserved nodes are multiplied and summed out, and each family that is
+ * entirely observed contributes a single CPT entry to a scalar weight.
+ *
+ * cpt holds the CPT of every node (in the layout of blbn_model_t); pass NULL
+ * to use the model's CPTs.
+ */
+double blbn_model_sliced_target_posterior (const blbn_model_t *model, const blbn_ve_plan_t *plan, const double * const *cpt, const double * const *lambda, double *result) {
+
+	blbn_factor_t **factors = NULL;
+	blbn_factor_t *evidence = NULL;
+	int n = model->node_count;
+	int i, p, v, e, base, offset, stride, finding;
+	int card[BLBN_FACTOR_MAX_VARS];
+	int states[BLBN_FACTOR_MAX_VARS];
+	double weight = 1.0;
+	double sum;
+
+	if (cpt == NULL) {
+		cpt = (const double * const *) model->cpt;
+	}
+
+	factors = (blbn_factor_t **) calloc (n + plan->step_count, sizeof (blbn_factor_t *));
+
+	for (i = 0; i < n; ++i) {
+
+		// Offset of the slice in the CPT (from the findings of the observed family members)
+		base = 0;
+		stride = model->cpt_size[i];
+		for (p = 0; p <= model->parent_count[i]; ++p) {
+			stride /= model->state_count[model->family[i][p]];
+			if (plan->observed[model->family[i][p]]) {
+				base += blbn_model_hard_finding (model, lambda, model->family[i][p]) * stride;
+			}
+		}
+
+		// Evidence weight of an observed node
+		if (plan->observed[i]) {
+			finding = blbn_model_hard_finding (model, lambda, i);
+			weight *= lambda[i][finding];
+		}
+
+		// A family that is entirely observed is a single CPT entry
+		if (plan->sliced_count[i] == 0) {
+			weight *= cpt[i][base];
+			continue;
+		}
+
+		// Gather the slice over the unobserved family members
+		for (v = 0; v < plan->sliced_count[i]; ++v) {
+			card[v] = model->state_count[plan->sliced_scope[i][v]];
+			states[v] = 0;
+		}
+		factors[i] = blbn_factor_new (plan->sliced_count[i], plan->sliced_scope[i], card);
+		offset = base;
+		for (e = 0; e < factors[i]->size; ++e) {
+			factors[i]->values[e] = cpt[i][offset];
+			for (v = plan->sliced_count[i] - 1; v >= 0; --v) {
+				offset += plan->sliced_stride[i][v];
+				if (++states[v] < card[v]) {
+					break;
+				}
+				offset -= states[v] * plan->sliced_stride[i][v];
+				states[v] = 0;
+			}
+		}
+
+		// Likelihood evidence on an unobserved node (including the target)
+		if (!plan->observed[i] && lambda != NULL && lambda[i] != NULL) {
+			evidence = blbn_factor_new (1, &i, &model->state_count[i]);
+			memcpy (evidence->values, lambda[i], model->state_count[i] * sizeof (double));
+			blbn_factor_multiply_in (factors[i], evidence);
+			blbn_factor_free (evidence);
+		}
+	}
+
+	sum = blbn_model_run_plan (model, plan, factors, weight, result);
+	free (factors);
+
+	return sum;
+}
@@ -0,0 +1,69 @@
+/*
+ * blbn_model.h
+ *
+ *  Native (Netica-independent) copy of a Bayesian network's structure and
+ *  conditional probability tables, and variable elimination plans for
+ *  computing the posterior of a target node given evidence.
+ *
+ *  Nodes are identified by their index in the BLBN static node ordering.
+ *  The CPT of node i is a factor over (parents[i][0], ..., parents[i][n-1], i)
+ *  stored row-major with the node's own state changing fastest, which is the
+ *  layout returned by GetNodeProbs_bn (node, NULL).
+ */
+
+#ifndef BLBN_MODEL_H_
+#define BLBN_MODEL_H_
+
+typedef struct blbn_model {
+	int node_count;     // number of nodes
+	int *state_count;   // number of states of each node
+	int *parent_count;  // number of parents of each node
+	int **parents;      // indices of the parents of each node (in CPT order)
+	int **family;       // parents followed by the node itself (the scope of its CPT)
+	int *cpt_size;      // number of entries in the CPT of each node
+	double **cpt;       // CPT of each node
+} blbn_model_t;
+
+typedef struct blbn_ve_step {
+	int var;          // node eliminated (summed out) in this step
+	int input_count;  // number of factors multiplied in this step
+	int *inputs;      // factor ids: i < node_count is the CPT of node i (times its evidence, or sliced by the findings), node_count + s is the output of step s
+	int scope_count;  // number of variables of the output factor
+	int *scope;       // variables of the output factor (ascending node index)
+	int size;         // number of entries of the output factor
+} blbn_ve_step_t;
+
+typedef struct blbn_ve_plan {
+	int node_count;         // number of nodes of the model
+	int target;             // node whose posterior is computed
+	int step_count;         // number of elimination steps
+	blbn_ve_step_t *steps;  // elimination steps (in order)
+	int final_count;        // number of factors left over the target (or over no variables)
+	int *finals;            // factor ids of the remaining factors
+	int max_size;           // size of the largest intermediate factor
+	int total_size;         // sum of the sizes of all intermediate factors
+
+	// Evidence slicing (NULL for plans over full CPTs): the CPT of node i is
+	// sliced by the findings of the observed nodes in its family, leaving a
+	// factor over the unobserved nodes of the family (a scalar weight if the
+	// whole family is observed)
+	char *observed;         // non-zero for each node with a finding (never the target)
+	int *sliced_count;      // number of unobserved nodes in the family of each node
+	int **sliced_scope;     // unobserved nodes in the family of each node (in family order)
+	int **sliced_stride;    // stride of each of those nodes in the node's CPT
+} blbn_ve_plan_t;
+
+blbn_model_t* blbn_model_new (int node_count, const int *state_count, const int *parent_count, int * const *parents);
+void blbn_model_free (blbn_model_t *model);
+unsigned long blbn_model_structure_hash (const blbn_model_t *model);
+int blbn_model_factor_scope (const blbn_model_t *model, const blbn_ve_plan_t *plan, int factor_id, const int **scope);
+
+blbn_ve_plan_t* blbn_ve_plan_new (const blbn_model_t *model, int target);
+blbn_ve_plan_t* blbn_ve_plan_new_sliced (const blbn_model_t *model, int target, const char *observed);
+void blbn_ve_plan_free (blbn_ve_plan_t *plan);
+
+int blbn_model_hard_finding (const blbn_model_t *model, const double * const *lambda, int node_index);
+double blbn_model_target_posterior (const blbn_model_t *model, const blbn_ve_plan_t *plan, const double * const *lambda, double *result);
+double blbn_model_sliced_target_posterior (const blbn_model_t *model, const blbn_ve_plan_t *plan, const double * const *cpt, const double * const *lambda, double *result);
+
+#endif /* BLBN_MODEL_H_ */
@@ -0,0 +1,257 @@
+/**
+ * blbn_factor_bench.c
+ *
+ * Micro-benchmark for the factor kernels in blbn/blbn_factor.c.  For each
+ * factor shape (number of variables and states per variable) the program
+ * checks the kernels against a straightforward reference implementation and
+ * reports the average time per operation for factor product (with a
+ * contiguous and a non-contiguous scope), marginalization and evidence
+ * reduction.
+ *
+ *   ./blbn_factor_bench [-n <iteration_count>]
+ *
+ * Build it once with and once without SIMD (e.g., -mavx2 versus
+ * -DBLBN_FACTOR_NO_SIMD) to compare the kernel paths.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "blbn/blbn_factor.h"
+
+/**
+ * Returns the value of the reference factor at the assignment (indexed by
+ * variable) given for the variables of the scope.
+ */
+double ref_value_at (const blbn_factor_t *factor, const int *assignment_by_var) {
+	int v = 0, offset = 0;
+
+	for (v = 0; v < factor->var_count; ++v) {
+		offset += assignment_by_var[factor->vars[v]] * factor->stride[v];
+	}
+
+	return factor->values[offset];
+}
+
+/**
+ * Decodes a flat index of the factor into an assignment indexed by variable.
+ */
+void ref_decode (const blbn_factor_t *factor, int index, int *assignment_by_var) {
+	int v = 0;
+
+	for (v = 0; v < factor->var_count; ++v) {
+		assignment_by_var[factor->vars[v]] = (index / factor->stride[v]) % factor->card[v];
+	}
+}
+
+/**
+ * Returns the maximum absolute difference between the product computed by
+ * the kernels and the reference product of a and b.
+ */
+double check_product (const blbn_factor_t *a, const blbn_factor_t *b, const blbn_factor_t *product) {
+	int assignment[BLBN_FACTOR_MAX_VARS * 4];
+	int i = 0;
+	double error = 0.0, diff;
+
+	for (i = 0; i < product->size; ++i) {
+		ref_decode (product, i, assignment);
+		diff = fabs (product->values[i] - ref_value_at (a, assignment) * ref_value_at (b, assignment));
+		if (diff > error) {
+			error = diff;
+		}
+	}
+
+	return error;
+}
+
+/**
+ * Returns the maximum absolute difference between the marginal computed by
+ * the kernels and the reference marginal of the factor over variable var.
+ */
+double check_marginal (const blbn_factor_t *factor, int var, const blbn_factor_t *marginal) {
+	int assignment[BLBN_FACTOR_MAX_VARS * 4];
+	int i = 0, k = 0;
+	int v = blbn_factor_index_of_var (factor, var);
+	double error = 0.0, diff, sum;
+
+	for (i = 0; i < marginal->size; ++i) {
+		ref_decode (marginal, i, assignment);
+		sum = 0.0;
+		for (k = 0; k < factor->card[v]; ++k) {
+			assignment[var] = k;
+			sum += ref_value_at (factor, assignment);
+		}
+		diff = fabs (marginal->values[i] - sum);
+		if (diff > error) {
+			error = diff;
+		}
+	}
+
+	return error;
+}
+
+/**
+ * Returns the maximum absolute difference between the reduction computed by
+ * the kernels and the reference reduction of the factor.
+ */
+double check_reduce (const blbn_factor_t *factor, int var, int state_index, const blbn_factor_t *reduced) {
+	int assignment[BLBN_FACTOR_MAX_VARS * 4];
+	int i = 0;
+	double error = 0.0, diff;
+
+	for (i = 0; i < reduced->size; ++i) {
+		ref_decode (reduced, i, assignment);
+		assignment[var] = state_index;
+		diff = fabs (reduced->values[i] - ref_value_at (factor, assignment));
+		if (diff > error) {
+			error = diff;
+		}
+	}
+
+	return error;
+}
+
+blbn_factor_t* random_factor (int var_count, const int *vars, const int *card) {
+	int i = 0;
+	blbn_factor_t *factor = blbn_factor_new (var_count, vars, card);
+
+	for (i = 0; i < factor->size; ++i) {
+		factor->values[i] = (double) rand () / RAND_MAX;
+	}
+
+	return factor;
+}
+
+double elapsed_ns (clock_t begin, clock_t end, int iteration_count) {
+	return 1.0e9 * (double) (end - begin) / CLOCKS_PER_SEC / iteration_count;
+}
+
+/**
+ * Main routine
+ */
+int main (int argc, char *argv[]) {
+
+	int i = 0, v = 0, n = 0;
+	int iteration_count = 100000;
+	int var_count = 0, state_count = 0;
+	int vars[BLBN_FACTOR_MAX_VARS];
+	int card[BLBN_FACTOR_MAX_VARS];
+	int b_vars[2];
+	int b_card[2];
+	double error = 0.0;
+	double product_ns, product_walk_ns, marginal_ns, reduce_ns;
+	volatile double sink = 0.0;
+	clock_t begin;
+
+	blbn_factor_t *a = NULL;
+	blbn_factor_t *b_suffix = NULL;
+	blbn_factor_t *b_walk = NULL;
+	blbn_factor_t *result = NULL;
+
+	for (i = 1; i < argc; ++i) {
+		if (strcmp (argv[i], "-n") == 0 && i + 1 < argc) {
+			iteration_count = atoi (argv[i + 1]);
+		}
+	}
+
+	if (iteration_count <= 0) {
+		printf ("Error: An invalid iteration count (-n) was specified. Exiting.\n");
+		exit (1);
+	}
+
+	srand (1);
+
+	printf ("Kernels: %s\n", blbn_factor_simd_name ());
+	printf ("Iterations: %d\n", iteration_count);
+	printf ("vars\tstates\tsize\tproduct_ns\tproduct_walk_ns\tmarginal_ns\treduce_ns\tmax_error\n");
+
+	// Shapes typical of CPTs and cliques in the data/dne networks
+	for (var_count = 2; var_count <= 5; ++var_count) {
+		for (state_count = 2; state_count <= 4; ++state_count) {
+
+			for (v = 0; v < var_count; ++v) {
+				vars[v] = v;
+				card[v] = state_count;
+			}
+
+			// a over all variables, b over the last two (contiguous) and over the first and last (strided)
+			a = random_factor (var_count, vars, card);
+			b_suffix = random_factor (2, &vars[var_count - 2], &card[var_count - 2]);
+			b_vars[0] = vars[var_count - 1]; b_card[0] = state_count;
+			b_vars[1] = vars[0];             b_card[1] = state_count;
+			b_walk = random_factor (2, b_vars, b_card);
+
+			error = 0.0;
+
+			// Correctness against the reference implementation
+			result = blbn_factor_product (a, b_suffix);
+			error = fmax (error, check_product (a, b_suffix, result));
+			blbn_factor_free (result);
+
+			result = blbn_factor_product (a, b_walk);
+			error = fmax (error, check_product (a, b_walk, result));
+			blbn_factor_free (result);
+
+			for (v = 0; v < var_count; ++v) {
+				result = blbn_factor_marginalize (a, v);
+				error = fmax (error, check_marginal (a, v, result));
+				blbn_factor_free (result);
+
+				result = blbn_factor_reduce (a, v, state_count - 1);
+				error = fmax (error, check_reduce (a, v, state_count - 1, result));
+				blbn_factor_free (result);
+			}
+
+			// Timing
+			result = blbn_factor_copy (a);
+
+			begin = clock ();
+			for (n = 0; n < iteration_count; ++n) {
+				memcpy (result->values, a->values, a->size * sizeof (double));
+				blbn_factor_multiply_in (result, b_suffix);
+				sink += result->values[0];
+			}
+			product_ns = elapsed_ns (begin, clock (), iteration_count);
+
+			begin = clock ();
+			for (n = 0; n < iteration_count; ++n) {
+				memcpy (result->values, a->values, a->size * sizeof (double));
+				blbn_factor_multiply_in (result, b_walk);
+				sink += result->values[0];
+			}
+			product_walk_ns = elapsed_ns (begin, clock (), iteration_count);
+
+			blbn_factor_free (result);
+
+			begin = clock ();
+			for (n = 0; n < iteration_count; ++n) {
+				for (v = 0; v < var_count; ++v) {
+					result = blbn_factor_marginalize (a, v);
+					sink += result->values[0];
+					blbn_factor_free (result);
+				}
+			}
+			marginal_ns = elapsed_ns (begin, clock (), iteration_count * var_count);
+
+			begin = clock ();
+			for (n = 0; n < iteration_count; ++n) {
+				for (v = 0; v < var_count; ++v) {
+					result = blbn_factor_reduce (a, v, n % state_count);
+					sink += result->values[0];
+					blbn_factor_free (result);
+				}
+			}
+			reduce_ns = elapsed_ns (begin, clock (), iteration_count * var_count);
+
+			printf ("%d\t%d\t%d\t%.1f\t%.1f\t%.1f\t%.1f\t%g\n", var_count, state_count, a->size, product_ns, product_walk_ns, marginal_ns, reduce_ns, error);
+
+			blbn_factor_free (a);
+			blbn_factor_free (b_suffix);
+			blbn_factor_free (b_walk);
+		}
+	}
+
+	return (sink == sink ? 0 : 1);
+}
@@ -39,6 +39,26 @@ int main (int argc, char *argv[]) {
 	int fold_count                = -1;    // k-folds (-k <fold_count>)
 	int fold_index                = -1;    // fold index (-f <fold_index>)
 	double equivalent_sample_size = 1.0;
+	int prune_d_separated         = 0;     // prune d-separated candidates (-dsep <0|1>)
+	char generated_folder[256]    = { 0 }; // cache folder for generated inference code (-gen <cache_folder>)
+	blbn_lw_options_t lw_options;          // likelihood weighting (-lw <sample_count>, -lwse <max_std_error>, -lwt <thread_count>)
+
+	blbn_bp_options_t bp_options;          // loopy belief propagation (-bp <max_iterations>, -bpd <damping>, -bpe <tolerance>, -bpc <cache_size>)
+	int sliced_inference          = 0;     // variable elimination over evidence-sliced CPTs (-ve <0|1>)
+	int eval_thread_count         = 1;     // threads evaluating validation cases with generated or sliced inference (-evt <thread_count>)
+	int score_thread_count        = 1;     // threads scoring SFL, EMPG and cheating candidates (-st <thread_count>)
+	int sfl_pair_samples          = 0;     // cases scored per (node, label) pair by SFL and RSFL (-sflp <sample_count>)
+	double score_cache_tolerance  = -1.0;  // incremental score matrix: largest CPT change that keeps a node's scores (-sct <tolerance>; negative to disable)
+	int score_cache_refresh       = 0;     // incremental score matrix: iterations between full rescorings (-scr <iterations>)
+	int sfl_lazy                  = 0;     // lazy-greedy selection of SFL candidates (-sfll <0|1>)
+	double score_budget           = 0.0;   // candidates scored per iteration: a count, or a fraction if below 1 (-sb <count|fraction>)
+	double sampled_validation_z   = 0.0;   // early stopping of lookahead evaluation on sampled validation cases (-sv <standard_errors>)
+	char eval_schedule[256]       = { 0 }; // iterations evaluated on the validation cases (-es <all|every:n|log:n|list:b,c,...>)
+
+	blbn_lw_default_options (&lw_options);
+	lw_options.sample_count = 0; // disabled unless -lw is given
+	blbn_bp_default_options (&bp_options);
+	bp_options.max_iterations = 0; // disabled unless -bp is given
 
 	//------------------------------------------------------------------------------
 	// Parse command-line arguments and extract valid parameters
@@ -127,6 +147,120 @@ int main (int argc, char *argv[]) {
 
 					printf ("Structure (-s): %s\n", &structure[0]);
 				}
+			} else if (strcmp (argv[i], "-dsep") == 0) {
+				if (i < argc) {
+					prune_d_separated = atoi (argv[i + 1]);
+
+					printf ("Prune d-separated candidates (-dsep): %d\n", prune_d_separated);
+				}
+			} else if (strcmp (argv[i], "-gen") == 0) {
+				if (i < argc) {
+					strcpy (&generated_folder[0], argv[i + 1]);
+
+					printf ("Generated inference cache folder (-gen): %s\n", &generated_folder[0]);
+				}
+			} else if (strcmp (argv[i], "-lw") == 0) {
+				if (i < argc) {
+					lw_options.sample_count = atol (argv[i + 1]);
+
+					printf ("Likelihood weighting samples per query (-lw): %ld\n", lw_options.sample_count);
+				}
+			} else if (strcmp (argv[i], "-lwse") == 0) {
+				if (i < argc) {
+					lw_options.max_std_error = atof (argv[i + 1]);
+
+					printf ("Likelihood weighting standard error threshold (-lwse): %f\n", lw_options.max_std_error);
+				}
+			} else if (strcmp (argv[i], "-lwt") == 0) {
+				if (i < argc) {
+					lw_options.thread_count = atoi (argv[i + 1]);
+
+					printf ("Likelihood weighting threads (-lwt): %d\n", lw_options.thread_count);
+				}
+			} else if (strcmp (argv[i], "-bp") == 0) {
+				if (i < argc) {
+					bp_options.max_iterations = atoi (argv[i + 1]);
+
+					printf ("Loopy belief propagation iteration cap (-bp): %d\n", bp_options.max_iterations);
+				}
+			} else if (strcmp (argv[i], "-bpd") == 0) {
+				if (i < argc) {
+					bp_options.damping = atof (argv[i + 1]);
+
+					printf ("Loopy belief propagation damping (-bpd): %f\n", bp_options.damping);
+				}
+			} else if (strcmp (argv[i], "-bpe") == 0) {
+				if (i < argc) {
+					bp_options.tolerance = atof (argv[i + 1]);
+
+					printf ("Loopy belief propagation convergence tolerance (-bpe): %g\n", bp_options.tolerance);
+				}
+			} else if (strcmp (argv[i], "-bpc") == 0) {
+				if (i < argc) {
+					bp_options.cache_size = atoi (argv[i + 1]);
+
+					printf ("Loopy belief propagation message cache size (-bpc): %d\n", bp_options.cache_size);
+				}
+			} else if (strcmp (argv[i], "-ve") == 0) {
+				if (i < argc) {
+					sliced_inference = atoi (argv[i + 1]);
+
+					printf ("Sliced variable elimination (-ve): %d\n", sliced_inference);
+				}
+			} else if (strcmp (argv[i], "-evt") == 0) {
+				if (i < argc) {
+					eval_thread_count = atoi (argv[i + 1]);
+
+					printf ("Evaluation threads (-evt): %d\n", eval_thread_count);
+				}
+			} else if (strcmp (argv[i], "-st") == 0) {
+				if (i < argc) {
+					score_thread_count = atoi (argv[i + 1]);
+
+					printf ("Scoring threads (-st): %d\n", score_thread_count);
+				}
+			} else if (strcmp (argv[i], "-sflp") == 0) {
+				if (i < argc) {
+					sfl_pair_samples = atoi (argv[i + 1]);
+
+					printf ("SFL cases per (node, label) pair (-sflp): %d\n", sfl_pair_samples);
+				}
+			} else if (strcmp (argv[i], "-sct") == 0) {
+				if (i < argc) {
+					score_cache_tolerance = atof (argv[i + 1]);
+
+					printf ("Incremental score matrix tolerance (-sct): %f\n", score_cache_tolerance);
+				}
+			} else if (strcmp (argv[i], "-scr") == 0) {
+				if (i < argc) {
+					score_cache_refresh = atoi (argv[i + 1]);
+
+					printf ("Incremental score matrix refresh (-scr): %d\n", score_cache_refresh);
+				}
+			} else if (strcmp (argv[i], "-sfll") == 0) {
+				if (i < argc) {
+					sfl_lazy = atoi (argv[i + 1]);
+
+					printf ("Lazy-greedy SFL selection (-sfll): %d\n", sfl_lazy);
+				}
+			} else if (strcmp (argv[i], "-sb") == 0) {
+				if (i < argc) {
+					score_budget = atof (argv[i + 1]);
+
+					printf ("Scoring budget (-sb): %f\n", score_budget);
+				}
+			} else if (strcmp (argv[i], "-sv") == 0) {
+				if (i < argc) {
+					sampled_validation_z = atof (argv[i + 1]);
+
+					printf ("Sampled validation confidence bound (-sv): %f\n", sampled_validation_z);
+				}
+			} else if (strcmp (argv[i], "-es") == 0) {
+				if (i < argc) {
+					strcpy (&eval_schedule[0], argv[i + 1]);
+
+					printf ("Evaluation schedule (-es): %s\n", eval_schedule);
+				}
 			}
 		}
 	}
@@ -184,6 +318,12 @@ int main (int argc, char *argv[]) {
 		exit (1);
 	}
 
+	// Validate scoring budget
+	if (score_budget > 0.0 && score_cache_tolerance >= 0.0) {
+		printf ("Error: A scoring budget (-sb) cannot be used with the incremental score matrix (-sct). Exiting.\n");
+		exit (1);
+	}
+
 	// Validate equivalent sample size
 	if (equivalent_sample_size < 1.0) {
 		printf ("Error: An invalid equivalent sample size (-z) was specified. Exiting.\n");
@@ -225,92 +365,53 @@ int main (int argc, char *argv[]) {
 	state = blbn_init_state (experiment_name, data_filepath, test_data_filepath, model_filepath, target_node_name, budget, output_folder, fold_count, fold_index); // Initialize meta-data used for learning
 
 
-	// <BEGINNING OF D-SEP TEST CASE SUITE>
-
-	int *d_seps = NULL;
-	int d_sep_count;
-
-	// Test Case 2
-	printf ("\nTest Case 1:\n");
+	if (state != NULL) {
 
-	// Enter/instantiate nodes with findings and get d-separations
-	printf ("Entering findings: { ");
-	blbn_retract_findings (state);
-	blbn_assert_node_finding (state, blbn_get_node_index (state, "TbOrCa"), 0); printf ("TbOrCa "); printf ("[%d] ", blbn_has_finding_set (state, blbn_get_node_index (state, "TbOrCa")));
-	//blbn_assert_node_finding (state, blbn_get_node_index (state, "VisitAsia"), 0); printf ("VisitAsia "); printf ("[%d] ", blbn_has_finding_set (state, blbn_get_node_index (state, "VisitAsia")));
-	blbn_assert_node_finding (state, blbn_get_node_index (state, "Tuberculosis"), 0); printf ("Tuberculosis "); printf ("[%d] ", blbn_has_finding_set (state, blbn_get_node_index (state, "Tuberculosis")));
-	//blbn_assert_node_finding (state, blbn_get_node_index (state, "Smoking"), 0); printf ("Smoking "); printf ("[%d] ", blbn_has_finding_set (state, blbn_get_node_index (state, "Smoking")));
-	blbn_assert_node_finding (state, blbn_get_node_index (state, "Cancer"), 0); printf ("Cancer "); printf ("[%d] ", blbn_has_finding_set (state, blbn_get_node_index (state, "Cancer")));
-	blbn_assert_node_finding (state, blbn_get_node_index (state, "Dyspnea"), 0); printf ("Dyspnea "); printf ("[%d] ", blbn_has_finding_set (state, blbn_get_node_index (state, "Dyspnea")));
+		state->prune_d_separated = (prune_d_separated != 0);
+		state->eval_thread_count = eval_thread_count;
+		state->score_thread_count = score_thread_count;
+		state->sfl_pair_samples = (sfl_pair_samples > 0 ? sfl_pair_samples : 0);
+		state->score_cache_tolerance = score_cache_tolerance;
+		state->score_cache_refresh = (score_cache_refresh > 0 ? score_cache_refresh : 0);
+		state->sfl_lazy = (sfl_lazy != 0);
+		state->score_budget = (score_budget > 0.0 ? score_budget : 0.0);
+
+		// Evaluate only some iterations on the validation cases (opt-in)
+		if (strlen (eval_schedule) > 0 && blbn_set_eval_schedule (state, eval_schedule) != 0) {
+			exit (1);
+		}
 
-	printf ("}\n");
-	d_sep_count = blbn_get_d_separated_nodes (state, blbn_get_node_index (state, "TbOrCa"), &d_seps); // Get nodes d-sep from target node
+		// Stream validation cases in a random order and stop lookahead evaluation early (opt-in)
+		if (sampled_validation_z > 0.0) {
+			blbn_enable_sampled_validation (state, sampled_validation_z);
+		}
 
-	printf ("D-separation count: %d\n", d_sep_count);
-	printf ("D-separations: { ");
-	for (i = 0; i < d_sep_count; ++i) {
-		printf ("%d ", d_seps[i]);
-		printf ("%s ", blbn_get_node_name (state, d_seps[i]));
-		printf ("[%d] ", blbn_has_finding_set (state, d_seps[i]));
-	}
-	printf ("}\n");
-
-	// Test Case 2
-	printf ("\nTest Case 2:\n");
-
-	// Enter/instantiate nodes with findings and get d-separations
-	printf ("Entering findings: { ");
-	blbn_retract_findings (state);
-	blbn_assert_node_finding (state, blbn_get_node_index (state, "TbOrCa"), 0); printf ("TbOrCa "); printf ("[%d] ", blbn_has_finding_set (state, blbn_get_node_index (state, "TbOrCa")));
-	//blbn_assert_node_finding (state, blbn_get_node_index (state, "VisitAsia"), 0); printf ("VisitAsia "); printf ("[%d] ", blbn_has_finding_set (state, blbn_get_node_index (state, "VisitAsia")));
-	blbn_assert_node_finding (state, blbn_get_node_index (state, "Tuberculosis"), 0); printf ("Tuberculosis "); printf ("[%d] ", blbn_has_finding_set (state, blbn_get_node_index (state, "Tuberculosis")));
-	//blbn_assert_node_finding (state, blbn_get_node_index (state, "Smoking"), 0); printf ("Smoking "); printf ("[%d] ", blbn_has_finding_set (state, blbn_get_node_index (state, "Smoking")));
-	blbn_assert_node_finding (state, blbn_get_node_index (state, "Cancer"), 0); printf ("Cancer "); printf ("[%d] ", blbn_has_finding_set (state, blbn_get_node_index (state, "Cancer")));
-	//blbn_assert_node_finding (state, blbn_get_node_index (state, "Dyspnea"), 0); printf ("Dyspnea "); printf ("[%d] ", blbn_has_finding_set (state, blbn_get_node_index (state, "Dyspnea")));
-
-	printf ("}\n");
-	d_sep_count = blbn_get_d_separated_nodes (state, blbn_get_node_index (state, "TbOrCa"), &d_seps); // Get nodes d-sep from target node
-
-	printf ("D-separation count: %d\n", d_sep_count);
-	printf ("D-separations: { ");
-	for (i = 0; i < d_sep_count; ++i) {
-		printf ("%d ", d_seps[i]);
-		printf ("%s ", blbn_get_node_name (state, d_seps[i]));
-		printf ("[%d] ", blbn_has_finding_set (state, d_seps[i]));
-	}
-	printf ("}\n");
-
-	// Test Case 3
-	printf ("\nTest Case 3:\n");
-
-	// Enter/instantiate nodes with findings and get d-separations
-	printf ("Entering findings: { ");
-	blbn_retract_findings (state);
-	//blbn_assert_node_finding (state, blbn_get_node_index (state, "TbOrCa"), 0); printf ("TbOrCa "); printf ("[%d] ", blbn_has_finding_set (state, blbn_get_node_index (state, "TbOrCa")));
-	//blbn_assert_node_finding (state, blbn_get_node_index (state, "VisitAsia"), 0); printf ("VisitAsia "); printf ("[%d] ", blbn_has_finding_set (state, blbn_get_node_index (state, "VisitAsia")));
-	//blbn_assert_node_finding (state, blbn_get_node_index (state, "Tuberculosis"), 0); printf ("Tuberculosis "); printf ("[%d] ", blbn_has_finding_set (state, blbn_get_node_index (state, "Tuberculosis")));
-	blbn_assert_node_finding (state, blbn_get_node_index (state, "Smoking"), 0); printf ("Smoking "); printf ("[%d] ", blbn_has_finding_set (state, blbn_get_node_index (state, "Smoking")));
-	//blbn_assert_node_finding (state, blbn_get_node_index (state, "Cancer"), 0); printf ("Cancer "); printf ("[%d] ", blbn_has_finding_set (state, blbn_get_node_index (state, "Cancer")));
-	//blbn_assert_node_finding (state, blbn_get_node_index (state, "Dyspnea"), 0); printf ("Dyspnea "); printf ("[%d] ", blbn_has_finding_set (state, blbn_get_node_index (state, "Dyspnea")));
-	blbn_assert_node_finding (state, blbn_get_node_index (state, "XRay"), 0); printf ("XRay "); printf ("[%d] ", blbn_has_finding_set (state, blbn_get_node_index (state, "XRay")));
-
-	printf ("}\n");
-	d_sep_count = blbn_get_d_separated_nodes (state, blbn_get_node_index (state, "TbOrCa"), &d_seps); // Get nodes d-sep from target node
-
-	printf ("D-separation count: %d\n", d_sep_count);
-	printf ("D-separations: { ");
-	for (i = 0; i < d_sep_count; ++i) {
-		printf ("%d ", d_seps[i]);
-		printf ("%s ", blbn_get_node_name (state, d_seps[i]));
-		printf ("[%d] ", blbn_has_finding_set (state, d_seps[i]));
-	}
-	printf ("}\n");
+		// Use generated and compiled code for target posterior queries (opt-in)
+		if (strlen (generated_folder) > 0) {
+			if (!file_exists (generated_folder)) {
+				printf ("Error: Generated inference cache folder (-gen) does not exist. Exiting.\n");
+				exit (1);
+			}
+			blbn_enable_generated_inference (state, generated_folder);
+		}
 
-	exit (1);
+		// Use variable elimination over evidence-sliced CPTs for target posterior queries and evaluation (opt-in; overrides -gen)
+		if (sliced_inference != 0) {
+			blbn_free_model (state);
+			blbn_enable_sliced_inference (state);
+		}
 
-	// <END OF D-SEP TEST CASE>
+		// Use likelihood weighting for all queries and evaluation (opt-in; overrides -gen and -ve)
+		if (lw_options.sample_count > 0) {
+			blbn_free_model (state);
+			blbn_enable_likelihood_weighting (state, &lw_options);
+		}
 
-	if (state != NULL) {
+		// Use loopy belief propagation for all queries and evaluation (opt-in; overrides -gen, -ve and -lw)
+		if (bp_options.max_iterations > 0) {
+			blbn_free_model (state);
+			blbn_enable_loopy_belief_propagation (state, &bp_options);
+		}
 
 		// Set network prior probability distributions over the nodes
 		if (strcmp (prior, "uniform") == 0) {